@@ -19,6 +19,7 @@ typedef struct IOTHUB_CLIENT_INSTANCE_TAG* IOTHUB_CLIENT_HANDLE;
 
 #include "iothub_client_ll.h"
 #include "iothubtransport.h"
+#include "iothub_client_threadpool.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -127,6 +128,34 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_GetSendStatus, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
 
+    /**
+    * @brief	Reports how many messages have been accepted by
+    *			IoTHubClient_SendEventAsync and not yet confirmed, and their
+    *			payload bytes. See OPTION_MAX_QUEUED_MESSAGES.
+    *
+    * @param	iotHubClientHandle	The handle created by a call to the create function.
+    * @param	messageCount		Receives the number of messages.
+    * @param	byteCount			Receives the payload bytes, only measured while
+    *								OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES is set.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_GetSendQueueDepth, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, size_t*, messageCount, size_t*, byteCount);
+
+    /**
+    * @brief	Reports how many of the messages counted by
+    *			IoTHubClient_GetSendQueueDepth have a given priority.
+    *			See IoTHubMessage_SetPriority.
+    *
+    * @param	iotHubClientHandle	The handle created by a call to the create function.
+    * @param	priority			The priority of the messages to count.
+    * @param	messageCount		Receives the number of messages.
+    * @param	byteCount			Receives the payload bytes of the messages.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_GetSendQueueDepthByPriority, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, size_t*, messageCount, size_t*, byteCount);
+
     /**
     * @brief	Sets up the message callback to be invoked when IoT Hub issues a
     * 			message to the device. This is a blocking call.
@@ -248,6 +277,21 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetOption, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value);
 
+    /**
+    * @brief	Schedules the work of this client on a shared thread pool instead of
+    *			on a dedicated thread. Must be called before any API that starts the
+    *			worker (for example IoTHubClient_SendEventAsync). For clients sharing a
+    *			transport the pool is used by the transport worker.
+    *
+    * @param	iotHubClientHandle	The handle created by a call to the create function.
+    * @param	threadPoolHandle	The handle created by IoTHubClient_ThreadPool_Create
+    *								or @c NULL to use a dedicated thread. The pool must
+    *								outlive the client.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetThreadPool, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle);
+
     /**
     * @brief	This API specifies a call back to be used when the device receives a state update.
     *
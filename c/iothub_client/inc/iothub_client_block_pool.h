@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_block_pool.h
+*	@brief A pool of fixed size memory blocks allocated up front.
+*
+*	@details The pool is used for the bookkeeping records that the client
+*			 and the transports allocate for every message, so that sending
+*			 does not go to the heap once the pool has been created. When
+*			 all the blocks are in use, allocations fall back to malloc.
+*			 The pool is not thread safe, callers serialize the calls.
+*/
+
+#ifndef IOTHUB_CLIENT_BLOCK_POOL_H
+#define IOTHUB_CLIENT_BLOCK_POOL_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct IOTHUB_CLIENT_BLOCK_POOL_INSTANCE_TAG* IOTHUB_CLIENT_BLOCK_POOL_HANDLE;
+
+    /** @brief	Counters kept by a block pool. */
+    typedef struct IOTHUB_CLIENT_BLOCK_POOL_STATISTICS_TAG
+    {
+        size_t capacity;        /*number of blocks allocated up front*/
+        size_t inUse;           /*blocks currently handed out by the pool, not counting the fallback ones*/
+        size_t highWatermark;   /*largest value inUse has ever had*/
+        size_t allocations;     /*number of blocks handed out by the pool*/
+        size_t fallbacks;       /*number of blocks that had to be allocated with malloc because the pool was exhausted*/
+    } IOTHUB_CLIENT_BLOCK_POOL_STATISTICS;
+
+    /**
+    * @brief	Creates a pool of @p capacity blocks of at least @p blockSize bytes each.
+    *
+    * @return	A non-NULL @c IOTHUB_CLIENT_BLOCK_POOL_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_BLOCK_POOL_HANDLE, IoTHubClient_BlockPool_Create, size_t, blockSize, size_t, capacity);
+
+    /**
+    * @brief	Destroys the pool. If some blocks are still in use, the memory
+    *			is released when the last of them is freed.
+    *
+    * @param	poolHandle	The handle created by a call to IoTHubClient_BlockPool_Create.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_BlockPool_Destroy, IOTHUB_CLIENT_BLOCK_POOL_HANDLE, poolHandle);
+
+    /**
+    * @brief	Allocates a block from the pool, or with malloc if the pool is exhausted.
+    *
+    * @param	poolHandle	The handle created by a call to IoTHubClient_BlockPool_Create.
+    *
+    * @return	A block of at least the size given to IoTHubClient_BlockPool_Create, or @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, void*, IoTHubClient_BlockPool_Alloc, IOTHUB_CLIENT_BLOCK_POOL_HANDLE, poolHandle);
+
+    /**
+    * @brief	Frees a block returned by IoTHubClient_BlockPool_Alloc.
+    *
+    * @param	poolHandle	The handle of the pool @p block was allocated from.
+    * @param	block		The block to free.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_BlockPool_Free, IOTHUB_CLIENT_BLOCK_POOL_HANDLE, poolHandle, void*, block);
+
+    /**
+    * @brief	Retrieves the counters of the pool.
+    *
+    * @param	poolHandle	The handle created by a call to IoTHubClient_BlockPool_Create.
+    * @param	statistics	Receives the counters.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_BlockPool_GetStatistics, IOTHUB_CLIENT_BLOCK_POOL_HANDLE, poolHandle, IOTHUB_CLIENT_BLOCK_POOL_STATISTICS*, statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_BLOCK_POOL_H */
@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_dispatcher.h
+*	@brief A thread that runs functions posted to it, one after the other,
+*		   in the order they were posted.
+*
+*	@details IoTHubClient uses it when OPTION_CALLBACK_DISPATCH_THREAD is set
+*			 so that the application callbacks do not run on the thread that
+*			 calls IoTHubClient_LL_DoWork, under the lock of the handle. A
+*			 slow callback then only delays the callbacks posted after it.
+*/
+
+#ifndef IOTHUB_CLIENT_DISPATCHER_H
+#define IOTHUB_CLIENT_DISPATCHER_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct IOTHUB_CLIENT_DISPATCHER_INSTANCE_TAG* IOTHUB_CLIENT_DISPATCHER_HANDLE;
+    typedef void(*IOTHUB_CLIENT_DISPATCHER_FUNCTION)(void* context);
+
+    /**
+    * @brief	Creates a dispatcher and starts its thread.
+    *
+    * @return	A non-NULL @c IOTHUB_CLIENT_DISPATCHER_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_DISPATCHER_HANDLE, IoTHubClient_Dispatcher_Create);
+
+    /**
+    * @brief	Runs the functions still posted, then stops and joins the thread
+    *			and frees the dispatcher. It shall not be called from a
+    *			function run by the dispatcher.
+    *
+    * @param	dispatcherHandle	The handle created by a call to IoTHubClient_Dispatcher_Create.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_Dispatcher_Destroy, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle);
+
+    /**
+    * @brief	Queues @p function to be called with @p context on the thread of
+    *			the dispatcher. Can be called from any thread.
+    *
+    * @param	dispatcherHandle	The handle created by a call to IoTHubClient_Dispatcher_Create.
+    * @param	function			The function to call.
+    * @param	context				The argument passed to @p function.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_Dispatcher_Post, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle, IOTHUB_CLIENT_DISPATCHER_FUNCTION, function, void*, context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_DISPATCHER_H */
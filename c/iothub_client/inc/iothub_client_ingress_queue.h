@@ -0,0 +1,68 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_ingress_queue.h
+*	@brief A multiple producer, single consumer FIFO of opaque items.
+*
+*	@details Any number of threads may call IoTHubClient_IngressQueue_Push
+*			 at the same time, without taking a lock when the compiler
+*			 provides atomic pointer exchange (MSVC and GCC/clang). Only one
+*			 thread at a time may call IoTHubClient_IngressQueue_Pop.
+*			 IoTHubClient uses it so that IoTHubClient_SendEventAsync does
+*			 not wait for the worker thread to finish IoTHubClient_LL_DoWork.
+*/
+
+#ifndef IOTHUB_CLIENT_INGRESS_QUEUE_H
+#define IOTHUB_CLIENT_INGRESS_QUEUE_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE_TAG* IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE;
+
+    /**
+    * @brief	Creates an empty queue.
+    *
+    * @return	A non-NULL @c IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, IoTHubClient_IngressQueue_Create);
+
+    /**
+    * @brief	Frees the queue. Items still in the queue are not freed, the
+    *			consumer is expected to pop them first.
+    *
+    * @param	queueHandle	The handle created by a call to IoTHubClient_IngressQueue_Create.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_IngressQueue_Destroy, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle);
+
+    /**
+    * @brief	Adds an item at the tail of the queue. Can be called concurrently
+    *			from any number of threads.
+    *
+    * @param	queueHandle	The handle created by a call to IoTHubClient_IngressQueue_Create.
+    * @param	item		The item to add. Must not be @c NULL.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_IngressQueue_Push, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle, void*, item);
+
+    /**
+    * @brief	Removes the item at the head of the queue. Shall only be called
+    *			by one thread at a time. An item whose push has not completed
+    *			yet is not returned; it is returned by a later call.
+    *
+    * @param	queueHandle	The handle created by a call to IoTHubClient_IngressQueue_Create.
+    *
+    * @return	The oldest item, or @c NULL if the queue is empty.
+    */
+    MOCKABLE_FUNCTION(, void*, IoTHubClient_IngressQueue_Pop, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_INGRESS_QUEUE_H */
@@ -25,13 +25,15 @@
 
 #include "azure_c_shared_utility/macro_utils.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_client_block_pool.h"
 
 #define IOTHUB_CLIENT_RESULT_VALUES       \
     IOTHUB_CLIENT_OK,                     \
     IOTHUB_CLIENT_INVALID_ARG,            \
     IOTHUB_CLIENT_ERROR,                  \
     IOTHUB_CLIENT_INVALID_SIZE,           \
-    IOTHUB_CLIENT_INDEFINITE_TIME
+    IOTHUB_CLIENT_INDEFINITE_TIME,        \
+    IOTHUB_CLIENT_QUEUE_FULL
 
 /** @brief Enumeration specifying the status of calls to various APIs in this module.
 */
@@ -52,6 +54,18 @@ typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG* IOTHUB_CLIENT_LL_HANDLE;
 */
 DEFINE_ENUM(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_STATUS_VALUES);
 
+#define IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES  \
+    IOTHUB_CLIENT_QUEUE_FULL_REJECT,            \
+    IOTHUB_CLIENT_QUEUE_FULL_BLOCK,             \
+    IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST,       \
+    IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST
+
+/** @brief Enumeration set with the @c QueueFullPolicy option to choose what
+*		   happens to an event sent while the limits set with the
+*		   @c MaxQueuedMessages and @c MaxQueuedBytes options are reached.
+*/
+DEFINE_ENUM(IOTHUB_CLIENT_QUEUE_FULL_POLICY, IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES);
+
 #define IOTHUB_IDENTITY_TYPE_VALUE  \
     IOTHUB_TYPE_TELEMETRY,          \
     IOTHUB_TYPE_DEVICE_TWIN,        \
@@ -90,7 +104,8 @@ extern "C"
     IOTHUB_CLIENT_CONFIRMATION_OK,                   \
     IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,      \
     IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,      \
-    IOTHUB_CLIENT_CONFIRMATION_ERROR                 \
+    IOTHUB_CLIENT_CONFIRMATION_ERROR,                \
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED       \
 
     /** @brief Enumeration passed in by the IoT Hub when the event confirmation
     *		   callback is invoked to indicate status of the event processing in
@@ -305,6 +320,30 @@ extern "C"
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Asynchronous call to send the message specified by @p eventMessageHandle,
+    *			taking ownership of the message instead of cloning it.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandle		   	The handle to an IoT Hub message. Upon success the
+    * 										message belongs to the IoT Hub client, which destroys
+    * 										it once it has been sent or has failed; the caller
+    * 										must not use or destroy it anymore. Upon failure the
+    * 										message still belongs to the caller.
+    * @param	eventConfirmationCallback  	The callback specified by the device for receiving
+    * 										confirmation of the delivery of the IoT Hub message.
+    * 										The user can specify a @c NULL value here to
+    * 										indicate that no callback is required.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: Together with ::IoTHubMessage_CreateFromByteArrayNoCopy this
+    *			lets a payload reach the transport without being copied by the client.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_Move, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief	This function returns the current sending status for IoTHubClient.
     *
@@ -319,6 +358,46 @@ extern "C"
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
 
+    /**
+    * @brief	This function returns the counters of the message pool created
+    *			by setting the @c MessagePoolSize option.
+    *
+    * @param	iotHubClientHandle		The handle created by a call to the create function.
+    * @param	statistics				Receives the counters. @c fallbacks counts the
+    *									events that had to be allocated with malloc
+    *									because the pool was exhausted.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetMessagePoolStatistics, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_BLOCK_POOL_STATISTICS*, statistics);
+
+    /**
+    * @brief	This function returns how many events have been accepted by
+    *			IoTHubClient_LL and not confirmed yet.
+    *
+    * @param	iotHubClientHandle		The handle created by a call to the create function.
+    * @param	messageCount			Receives the number of events.
+    * @param	byteCount				Receives the payload bytes of the events. Only the
+    *									events sent while the @c MaxQueuedMessages or
+    *									@c MaxQueuedBytes option is set are measured.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepth, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, size_t*, messageCount, size_t*, byteCount);
+
+    /**
+    * @brief	This function returns how many of the events counted by
+    *			IoTHubClient_LL_GetSendQueueDepth have a given priority.
+    *
+    * @param	iotHubClientHandle		The handle created by a call to the create function.
+    * @param	priority				The priority set with IoTHubMessage_SetPriority.
+    * @param	messageCount			Receives the number of events.
+    * @param	byteCount				Receives the measured payload bytes of the events.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepthByPriority, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, size_t*, messageCount, size_t*, byteCount);
+
     /**
     * @brief	Sets up the message callback to be invoked when IoT Hub issues a
     * 			message to the device. This is a blocking call.
@@ -450,6 +529,15 @@ extern "C"
     *                interval in seconds when pings are sent to the server.
     *              - @b logtrace - available for MQTT protocol.  Boolean value that turns on and
     *                off the diagnostic logging.
+    *              - @b MessagePoolSize - pointer to a @c size_t. Preallocates that many of the
+    *                records that keep the events waiting to be sent, so that sending an
+    *                event does not allocate them from the heap. Can only be set once.
+    *                Only these list records are pooled: the clone of the message, with
+    *                its buffer, properties map and id strings, is still allocated from
+    *                the heap by the message API.
+    *              - @b PublishPoolSize - available for MQTT protocol. Pointer to a @c size_t.
+    *                Preallocates that many of the records that keep the events waiting
+    *                for PUBACK. Can only be set once.
     *
     * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
     */
@@ -27,10 +27,32 @@ extern "C"
 
     static const char* OPTION_SAS_TOKEN_LIFETIME = "sas_token_lifetime";
     static const char* OPTION_SAS_TOKEN_REFRESH_TIME = "sas_token_refresh_time";
+    static const char* OPTION_SAS_TOKEN_REFRESH_JITTER = "SasTokenRefreshJitter";
+    static const char* OPTION_SAS_TOKEN_ROLLOVER = "SasTokenRollover";
     static const char* OPTION_CBS_REQUEST_TIMEOUT = "cbs_request_timeout";
 
     static const char* OPTION_MIN_POLLING_TIME = "MinimumPollingTime";
     static const char* OPTION_BATCHING = "Batching";
+    static const char* OPTION_COMPRESS_BATCHES = "CompressBatches";
+    static const char* OPTION_ADAPTIVE_POLLING_TIME = "AdaptivePollingTime";
+    static const char* OPTION_MAX_POLLS_PER_SECOND = "MaxPollsPerSecond";
+    static const char* OPTION_MAX_MESSAGES_PER_POLL = "MaxMessagesPerPoll";
+    static const char* OPTION_DOWORK_TIME_BUDGET = "DoWorkTimeBudget";
+
+    static const char* OPTION_WORKER_IDLE_WAIT_TIME = "WorkerIdleWaitTime";
+    static const char* OPTION_INGRESS_QUEUE = "IngressQueue";
+    static const char* OPTION_MESSAGE_POOL_SIZE = "MessagePoolSize";
+    static const char* OPTION_PUBLISH_POOL_SIZE = "PublishPoolSize";
+    static const char* OPTION_MAX_IN_FLIGHT = "MaxInFlight";
+    static const char* OPTION_MAX_PUBLISHES_PER_SECOND = "MaxPublishesPerSecond";
+    static const char* OPTION_TELEMETRY_AT_MOST_ONCE = "TelemetryAtMostOnce";
+    static const char* OPTION_IDLE_POLL_INTERVAL = "IdlePollInterval";
+    static const char* OPTION_MAX_QUEUED_MESSAGES = "MaxQueuedMessages";
+    static const char* OPTION_MAX_QUEUED_BYTES = "MaxQueuedBytes";
+    static const char* OPTION_QUEUE_FULL_POLICY = "QueueFullPolicy";
+    static const char* OPTION_OUTBOX_DIRECTORY = "OutboxDirectory";
+    static const char* OPTION_CALLBACK_DISPATCH_THREAD = "CallbackDispatchThread";
+    static const char* OPTION_HTTP_CONNECTION_POOL_SIZE = "HttpConnectionPoolSize";
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,123 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_outbox.h
+*	@brief An append-only log of the events waiting to be sent, kept in a
+*		   directory so that they survive a restart of the application.
+*
+*	@details The log is a sequence of segment files. Events are appended to
+*			 the last segment, and a segment is deleted once every event in it
+*			 has been completed and all the segments before it are gone.
+*			 Writes are buffered until IoTHubClient_Outbox_Flush is called.
+*			 The outbox is not thread safe, callers serialize the calls.
+*/
+
+#ifndef IOTHUB_CLIENT_OUTBOX_H
+#define IOTHUB_CLIENT_OUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct IOTHUB_CLIENT_OUTBOX_INSTANCE_TAG* IOTHUB_CLIENT_OUTBOX_HANDLE;
+
+#define IOTHUB_CLIENT_OUTBOX_READ_RESULT_VALUES \
+    IOTHUB_CLIENT_OUTBOX_READ_OK,               \
+    IOTHUB_CLIENT_OUTBOX_READ_ERROR,            \
+    IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD
+
+    /** @brief	Result of IoTHubClient_Outbox_Read. @c IOTHUB_CLIENT_OUTBOX_READ_ERROR
+    *			is a failure that may go away, such as an I/O error or a failed
+    *			allocation, the record can be read again later.
+    *			@c IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD means the record is
+    *			not in the outbox, is torn or does not hold a message, and will
+    *			never be read.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_OUTBOX_READ_RESULT, IOTHUB_CLIENT_OUTBOX_READ_RESULT_VALUES);
+
+    /** @brief	Called by IoTHubClient_Outbox_ForEachPending for every event that
+    *			was appended and not completed, oldest first.
+    */
+    typedef void(*IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK)(uint64_t recordId, void* context);
+
+    /**
+    * @brief	Opens the outbox kept in @p directory, which must exist. Events
+    *			left by a previous outbox in the same directory are kept, new
+    *			events go to a new segment.
+    *
+    * @param	directory	The directory holding the segment files.
+    * @param	segmentSize	The size in bytes after which a new segment is started.
+    *
+    * @return	A non-NULL @c IOTHUB_CLIENT_OUTBOX_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_OUTBOX_HANDLE, IoTHubClient_Outbox_Create, const char*, directory, size_t, segmentSize);
+
+    /**
+    * @brief	Flushes and closes the outbox. The events that were not completed
+    *			stay in the directory.
+    *
+    * @param	outboxHandle	The handle created by a call to IoTHubClient_Outbox_Create.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_Outbox_Destroy, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle);
+
+    /**
+    * @brief	Calls @p pendingCallback for each event that is in the outbox and
+    *			has not been completed, in the order they were appended.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_Outbox_ForEachPending, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle, IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK, pendingCallback, void*, context);
+
+    /**
+    * @brief	Appends the payload, message id, correlation id and properties of
+    *			@p messageHandle to the outbox.
+    *
+    * @param	outboxHandle	The handle created by a call to IoTHubClient_Outbox_Create.
+    * @param	messageHandle	The event to append, it is not modified.
+    * @param	recordId		Receives the value that identifies the event in the outbox.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_Outbox_Append, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle, IOTHUB_MESSAGE_HANDLE, messageHandle, uint64_t*, recordId);
+
+    /**
+    * @brief	Reads back an event appended to the outbox.
+    *
+    * @param	outboxHandle	The handle created by a call to IoTHubClient_Outbox_Create.
+    * @param	recordId		The value set by IoTHubClient_Outbox_Append.
+    * @param	messageHandle	Receives a new message that the caller destroys, or
+    *							@c NULL on failure.
+    *
+    * @return	@c IOTHUB_CLIENT_OUTBOX_READ_OK on success, otherwise a value that
+    *			tells whether reading the record again can succeed.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_OUTBOX_READ_RESULT, IoTHubClient_Outbox_Read, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle, uint64_t, recordId, IOTHUB_MESSAGE_HANDLE*, messageHandle);
+
+    /**
+    * @brief	Marks an event as completed, so that it is not pending anymore
+    *			and its segment can be deleted.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_Outbox_Complete, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle, uint64_t, recordId);
+
+    /**
+    * @brief	Writes the buffered appends and completions to the segment files
+    *			and syncs them to the storage.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, IoTHubClient_Outbox_Flush, IOTHUB_CLIENT_OUTBOX_HANDLE, outboxHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_OUTBOX_H */
@@ -14,6 +14,7 @@
 
 #include "iothub_message.h"
 #include "iothub_client_ll.h"
+#include "iothub_client_block_pool.h"
 #include "azure_c_shared_utility/macro_utils.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 
@@ -46,6 +47,11 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     void* context; 
     DLIST_ENTRY entry;
     uint64_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool; /*the pool the record was allocated from, NULL if it was allocated with malloc*/
+    IOTHUB_CLIENT_LL_HANDLE owner; /*the IoTHubClient_LL the record has to be given back to through IoTHubClient_LL_SendComplete*/
+    size_t queuedSize; /*payload bytes counted against OPTION_MAX_QUEUED_BYTES, 0 if the message was not measured*/
+    uint64_t outboxRecordId; /*where the message is kept in the outbox of the owner, if it has one*/
+    IOTHUB_MESSAGE_PRIORITY priority; /*the lane of the record, waitingToSend is ordered by it*/
 }IOTHUB_MESSAGE_LIST;
 
 typedef struct IOTHUB_DEVICE_TWIN_TAG
@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_threadpool.h
+*	@brief A fixed set of worker threads that can be shared by several
+*		   IoTHubClient and transport handles.
+*
+*	@details By default every IoTHubClient handle (or every shared transport)
+*			 runs its own worker thread. A thread pool lets an application
+*			 that owns many handles drive all of them from N threads instead.
+*			 Work functions registered with the pool are called repeatedly,
+*			 in a round robin fashion, and a given work function is never
+*			 called by two pool threads at the same time.
+*/
+
+#ifndef IOTHUB_CLIENT_THREADPOOL_H
+#define IOTHUB_CLIENT_THREADPOOL_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+    typedef struct IOTHUB_CLIENT_THREADPOOL_INSTANCE_TAG* IOTHUB_CLIENT_THREADPOOL_HANDLE;
+    typedef struct IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_TAG* IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE;
+    typedef void(*IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION)(void* context);
+
+    /**
+    * @brief	Creates a thread pool and starts its worker threads.
+    *
+    * @param	threadCount	The number of worker threads. Must be greater than 0.
+    *
+    * @return	A non-NULL @c IOTHUB_CLIENT_THREADPOOL_HANDLE value that is used when
+    * 			invoking other functions of the thread pool and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_THREADPOOL_HANDLE, IoTHubClient_ThreadPool_Create, size_t, threadCount);
+
+    /**
+    * @brief	Stops and joins the worker threads and frees the thread pool.
+    *			All the handles using the pool must have been destroyed before.
+    *
+    * @param	threadPoolHandle	The handle created by a call to IoTHubClient_ThreadPool_Create.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_ThreadPool_Destroy, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle);
+
+    /**
+    * @brief	Registers a work function that the pool threads shall call repeatedly
+    *			until it is removed by IoTHubClient_ThreadPool_RemoveWork.
+    *
+    * @param	threadPoolHandle	The handle created by a call to IoTHubClient_ThreadPool_Create.
+    * @param	workFunction		The function to be called.
+    * @param	context				The argument passed to @p workFunction.
+    *
+    * @return	A non-NULL work item handle on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, IoTHubClient_ThreadPool_AddWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION, workFunction, void*, context);
+
+    /**
+    * @brief	Unregisters a work item. When this function returns the work function
+    *			is not running and will not be called anymore. It shall not be called
+    *			from within a work function.
+    *
+    * @param	threadPoolHandle	The handle created by a call to IoTHubClient_ThreadPool_Create.
+    * @param	workItemHandle		The handle returned by IoTHubClient_ThreadPool_AddWork.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClient_ThreadPool_RemoveWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, workItemHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_THREADPOOL_H */
@@ -42,8 +42,26 @@ IOTHUBMESSAGE_UNKNOWN \
   */
 DEFINE_ENUM(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+#define IOTHUB_MESSAGE_PRIORITY_VALUES \
+IOTHUB_MESSAGE_PRIORITY_LOW, \
+IOTHUB_MESSAGE_PRIORITY_NORMAL, \
+IOTHUB_MESSAGE_PRIORITY_HIGH \
+
+/** @brief Enumeration specifying the order in which the events waiting
+  * to be sent are given to the transport: an event goes ahead of every
+  * waiting event of a lower priority. Messages are created with
+  * @c IOTHUB_MESSAGE_PRIORITY_NORMAL.
+  */
+DEFINE_ENUM(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
 
+/** @brief  Callback invoked when a message created with
+ *          ::IoTHubMessage_CreateFromByteArrayNoCopy is destroyed, handing the
+ *          byte array back to its owner.
+ */
+typedef void(*IOTHUB_MESSAGE_RELEASE_BUFFER_CALLBACK)(const unsigned char* byteArray, size_t size, void* context);
+
 /**
  * @brief   Creates a new IoT hub message from a byte array. The type of the
  *          message will be set to @c IOTHUBMESSAGE_BYTEARRAY.
@@ -56,6 +74,28 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
  */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size);
 
+/**
+ * @brief   Creates a new IoT hub message that wraps a byte array without
+ *          copying it. The type of the message will be set to
+ *          @c IOTHUBMESSAGE_BYTEARRAY.
+ *
+ *          The byte array must stay valid and unchanged until the message is
+ *          destroyed, at which point @p releaseCallback (if not @c NULL) is
+ *          called. Cloning the message copies the byte array.
+ *
+ * @param   byteArray       The byte array wrapped by the message.
+ * @param   size            The size of the byte array.
+ * @param   releaseCallback Called with @p byteArray, @p size and
+ *                          @p context when the message is destroyed. It is
+ *                          not called if the creation fails.
+ * @param   context         User specified context passed to
+ *                          @p releaseCallback.
+ *
+ * @return  A valid @c IOTHUB_MESSAGE_HANDLE if the message was successfully
+ *          created or @c NULL in case an error occurs.
+ */
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArrayNoCopy, const unsigned char*, byteArray, size_t, size, IOTHUB_MESSAGE_RELEASE_BUFFER_CALLBACK, releaseCallback, void*, context);
+
 /**
  * @brief   Creates a new IoT hub message from a null terminated string.  The
  *          type of the message will be set to @c IOTHUBMESSAGE_STRING.
@@ -167,6 +207,28 @@ MOCKABLE_FUNCTION(, const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId);
 
+/**
+* @brief   Gets the priority of the IOTHUB_MESSAGE_HANDLE.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  The priority of the message, @c IOTHUB_MESSAGE_PRIORITY_NORMAL
+*          if it was never set.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
+/**
+* @brief   Sets the priority of the IOTHUB_MESSAGE_HANDLE. It is used when
+*          the message is sent as an event, it is not sent to the hub.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   priority The priority of the message.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the priority was set successfully
+*          or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority);
+
 /**
  * @brief   Frees all resources associated with the given message handle.
  *
@@ -11,6 +11,7 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG* TRANSPORT_HANDLE;
 #include "iothub_client.h"
 #include "iothub_client_private.h"
 #include "iothub_transport_ll.h"
+#include "iothub_client_threadpool.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -24,6 +25,13 @@ extern TRANSPORT_LL_HANDLE	IoTHubTransport_GetLLTransport(TRANSPORT_HANDLE trans
 extern IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern bool					IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern void					IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
+extern IOTHUB_CLIENT_RESULT IoTHubTransport_SetWorkerIdleWaitTime(TRANSPORT_HANDLE transportHandle, unsigned int idleWaitTime);
+extern void					IoTHubTransport_SignalWorkerThread(TRANSPORT_HANDLE transportHandle);
+extern IOTHUB_CLIENT_RESULT IoTHubTransport_SetThreadPool(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle);
+
+/* implemented in iothub_client.c, must be called with the transport lock held */
+extern bool					IoTHubClient_IsSendBusy(IOTHUB_CLIENT_HANDLE iotHubClientHandle);
+extern void					IoTHubClient_SignalQueueSpace(IOTHUB_CLIENT_HANDLE iotHubClientHandle);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransport_mqtt_inflight.h
+*	@brief Finds the record of an in-flight MQTT packet from its packet id.
+*
+*	@details The MQTT transport keeps its unacknowledged publishes in lists
+*			 so they can be resent in order. This table indexes the same
+*			 records by their 16 bit packet id, so an acknowledgement finds
+*			 its record without walking the list. It is an open addressed
+*			 table with linear probing; it is rebuilt twice as large when it
+*			 is 3/4 full and never grows past one slot per packet id.
+*/
+
+#ifndef IOTHUBTRANSPORT_MQTT_INFLIGHT_H
+#define IOTHUBTRANSPORT_MQTT_INFLIGHT_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+    typedef struct IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE_TAG* IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE;
+
+    /**
+    * @brief	Creates an empty table.
+    *
+    * @param	initialCapacity	The number of records the table holds before it is first rebuilt, at least 1.
+    *
+    * @return	A non-NULL @c IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, iothubtransport_mqtt_inflight_create, size_t, initialCapacity);
+
+    /**
+    * @brief	Frees the table. The records it indexes are not touched.
+    *
+    * @param	inflightHandle	The handle created by a call to iothubtransport_mqtt_inflight_create.
+    */
+    MOCKABLE_FUNCTION(, void, iothubtransport_mqtt_inflight_destroy, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, inflightHandle);
+
+    /**
+    * @brief	Indexes @p record under @p packetId.
+    *
+    * @return	0 on success, a non-zero value if the arguments are invalid,
+    *			@p packetId is already in the table or the table could not grow.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransport_mqtt_inflight_insert, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, inflightHandle, uint16_t, packetId, void*, record);
+
+    /**
+    * @brief	Looks up the record indexed under @p packetId.
+    *
+    * @return	The record, or @c NULL if there is none.
+    */
+    MOCKABLE_FUNCTION(, void*, iothubtransport_mqtt_inflight_find, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, inflightHandle, uint16_t, packetId);
+
+    /**
+    * @brief	Takes the record indexed under @p packetId out of the table.
+    *
+    * @return	The record that was removed, or @c NULL if there was none.
+    */
+    MOCKABLE_FUNCTION(, void*, iothubtransport_mqtt_inflight_remove, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, inflightHandle, uint16_t, packetId);
+
+    /**
+    * @brief	Returns the number of records in the table, 0 if @p inflightHandle is @c NULL.
+    */
+    MOCKABLE_FUNCTION(, size_t, iothubtransport_mqtt_inflight_get_count, IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE, inflightHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORT_MQTT_INFLIGHT_H */
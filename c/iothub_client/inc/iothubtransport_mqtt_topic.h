@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransport_mqtt_topic.h
+*	@brief Parses the topics of the messages the MQTT transport receives.
+*
+*	@details The topic of an incoming message tells a cloud to device
+*			 message from a device twin response or patch and from a device
+*			 method invocation, and carries the request id, the status code,
+*			 the method name and the message properties. The parser reads
+*			 the topic once, in place, and does not allocate: what it finds
+*			 is returned as numbers or as pointers into the topic.
+*/
+
+#ifndef IOTHUBTRANSPORT_MQTT_TOPIC_H
+#define IOTHUBTRANSPORT_MQTT_TOPIC_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+    typedef enum IOTHUBTRANSPORT_MQTT_TOPIC_TYPE_TAG
+    {
+        IOTHUBTRANSPORT_MQTT_TOPIC_C2D,
+        IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN,
+        IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD
+    } IOTHUBTRANSPORT_MQTT_TOPIC_TYPE;
+
+    typedef struct IOTHUBTRANSPORT_MQTT_TOPIC_INFO_TAG
+    {
+        IOTHUBTRANSPORT_MQTT_TOPIC_TYPE type;
+
+        /*device twin: true for a desired properties patch, false for a response*/
+        bool isPatch;
+        /*device twin response: the status code of the request*/
+        int statusCode;
+        /*device twin response and device method: the $rid of the topic, 0 if it has none*/
+        size_t requestId;
+
+        /*device method: the method name, not NUL terminated*/
+        const char* methodName;
+        size_t methodNameLength;
+
+        /*cloud to device message: the URL encoded property bag, empty if there is none*/
+        const char* properties;
+    } IOTHUBTRANSPORT_MQTT_TOPIC_INFO;
+
+    /**
+    * @brief	Called for each property of a property bag, with its name and value URL decoded.
+    *			The strings are only valid during the call.
+    *
+    * @return	0 to go on with the next property, a non-zero value to stop.
+    */
+    typedef int(*IOTHUBTRANSPORT_MQTT_TOPIC_PROPERTY_CALLBACK)(void* context, const char* name, const char* value);
+
+    /**
+    * @brief	Classifies @p topic and fills @p topicInfo with what it carries.
+    *			The pointers in @p topicInfo point into @p topic.
+    *
+    * @return	0 on success, a non-zero value if the arguments are invalid
+    *			or a device twin or device method topic is malformed.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransport_mqtt_topic_parse, const char*, topic, IOTHUBTRANSPORT_MQTT_TOPIC_INFO*, topicInfo);
+
+    /**
+    * @brief	Calls @p propertyCallback for each name=value pair of the URL encoded @p properties.
+    *			Pairs without a value are skipped.
+    *
+    * @return	0 on success, a non-zero value if the arguments are invalid,
+    *			a property could not be decoded or @p propertyCallback stopped.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransport_mqtt_topic_for_each_property, const char*, properties, IOTHUBTRANSPORT_MQTT_TOPIC_PROPERTY_CALLBACK, propertyCallback, void*, context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORT_MQTT_TOPIC_H */
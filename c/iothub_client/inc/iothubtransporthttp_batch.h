@@ -0,0 +1,65 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransporthttp_batch.h
+*	@brief Serializes messages into the JSON items of an HTTP batch.
+*
+*	@details The size of an item is known before it is written, so the
+*			 HTTP transport can allocate the whole batch payload once and
+*			 have every item written straight into it.
+*/
+
+#ifndef IOTHUBTRANSPORTHTTP_BATCH_H
+#define IOTHUBTRANSPORTHTTP_BATCH_H
+
+#include "iothub_message.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+    typedef struct IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE_TAG
+    {
+        size_t itemSize;       /*exact number of bytes of the JSON item of the message*/
+        size_t contentSize;    /*number of bytes of the message content, before it is encoded*/
+        size_t propertyCount;
+        size_t propertiesSize; /*sum of the lengths of the names and values of the properties*/
+    } IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE;
+
+    /**
+    * @brief	Computes the size of the JSON item of a message without building it.
+    *
+    * @param	messageHandle	The message.
+    * @param	itemSize		Receives the sizes of the item.
+    *
+    * @return	0 on success and a non-zero value if the message cannot be serialized.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_batch_get_item_size, IOTHUB_MESSAGE_HANDLE, messageHandle, IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE*, itemSize);
+
+    /**
+    * @brief	Writes the JSON item of a message to @p destination.
+    *
+    * @param	messageHandle	The message.
+    * @param	destination		Where the item is written. It is not zero terminated.
+    * @param	available		The number of bytes that can be written to @p destination.
+    * @param	written			Receives the number of bytes written.
+    *
+    * @return	0 on success and a non-zero value if the message cannot be serialized
+    *			or its item does not fit in @p available bytes.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_batch_write_item, IOTHUB_MESSAGE_HANDLE, messageHandle, unsigned char*, destination, size_t, available, size_t*, written);
+
+    MOCKABLE_FUNCTION(, size_t, iothubtransporthttp_batch_base64_encoded_size, size_t, size);
+    MOCKABLE_FUNCTION(, size_t, iothubtransporthttp_batch_base64_encode, const unsigned char*, source, size_t, size, unsigned char*, destination);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORTHTTP_BATCH_H */
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransporthttp_compress.h
+*	@brief Deflates the payload of an HTTP batch while it is built.
+*
+*	@details The HTTP transport hands the JSON items of a batch to the
+*			 compressor one at a time and the compressed bytes are appended
+*			 to the payload as zlib produces them, so the uncompressed batch
+*			 never exists as a whole. The compressor also tells whether the
+*			 next item is guaranteed to keep the compressed payload within a
+*			 size limit, which lets the transport fill a batch by its
+*			 compressed size. The output is in the zlib format of RFC 1950,
+*			 which is the "deflate" HTTP content coding.
+*
+*			 The module is functional only when the SDK is built with
+*			 use_http_compression (USE_HTTP_COMPRESSION), otherwise
+*			 iothubtransporthttp_compress_is_supported returns false and
+*			 every other function fails.
+*/
+
+#ifndef IOTHUBTRANSPORTHTTP_COMPRESS_H
+#define IOTHUBTRANSPORTHTTP_COMPRESS_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "azure_c_shared_utility/buffer_.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+    typedef struct IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE_TAG* IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE;
+
+    /**
+    * @brief	Tells whether the SDK has been built with compression.
+    *
+    * @return	@c true when the compressor can be created.
+    */
+    MOCKABLE_FUNCTION(, bool, iothubtransporthttp_compress_is_supported);
+
+    /**
+    * @brief	Starts a compressed stream that is appended to @p destination.
+    *
+    * @param	destination	The buffer that receives the compressed bytes.
+    *
+    * @return	A non-NULL @c IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, iothubtransporthttp_compress_create, BUFFER_HANDLE, destination);
+
+    /**
+    * @brief	Frees the compressor. @p destination is not freed.
+    *
+    * @param	compressHandle	The handle created by a call to iothubtransporthttp_compress_create.
+    */
+    MOCKABLE_FUNCTION(, void, iothubtransporthttp_compress_destroy, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle);
+
+    /**
+    * @brief	Tells whether @p size more bytes are guaranteed to keep the
+    *			finished stream within @p limit bytes. The stream is flushed
+    *			when the estimate alone is not enough to tell.
+    *
+    * @param	compressHandle	The handle created by a call to iothubtransporthttp_compress_create.
+    * @param	size			The number of bytes that would be appended before the stream is finished.
+    * @param	limit			The maximum size of the finished stream.
+    * @param	fits			Receives @c true when the bytes fit.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_compress_fits, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, size_t, size, size_t, limit, bool*, fits);
+
+    /**
+    * @brief	Compresses @p size bytes of @p source into the stream.
+    *
+    * @param	compressHandle	The handle created by a call to iothubtransporthttp_compress_create.
+    * @param	source			The bytes to compress.
+    * @param	size			The number of bytes of @p source.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_compress_append, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size);
+
+    /**
+    * @brief	Compresses the last @p size bytes of @p source and ends the stream.
+    *
+    * @param	compressHandle	The handle created by a call to iothubtransporthttp_compress_create.
+    * @param	source			The bytes to compress.
+    * @param	size			The number of bytes of @p source.
+    *
+    * @return	0 on success and a non-zero value on failure.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_compress_finish, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORTHTTP_COMPRESS_H */
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransporthttp_poll.h
+*	@brief Decides when the HTTP transport polls a device for cloud to device messages.
+*
+*	@details A device is polled again soon after a poll that brought a
+*			 message, and less and less often while its polls come back
+*			 empty. The waits carry a per-device jitter so devices do not
+*			 poll in step, and the polls of all the devices of a transport
+*			 can be capped per second.
+*/
+
+#ifndef IOTHUBTRANSPORTHTTP_POLL_H
+#define IOTHUBTRANSPORTHTTP_POLL_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <ctime>
+#include <cstdint>
+
+extern "C"
+{
+#else
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+#endif
+
+    typedef struct IOTHUBTRANSPORTHTTP_POLL_INSTANCE_TAG* IOTHUBTRANSPORTHTTP_POLL_HANDLE;
+
+    /*the schedule of one device, owned by the transport and only touched by this module*/
+    typedef struct IOTHUBTRANSPORTHTTP_POLL_STATE_TAG
+    {
+        bool isScheduled;       /*false until the first poll is scheduled*/
+        time_t scheduledFrom;   /*the waitTime is counted from here*/
+        unsigned int waitTime;  /*seconds between scheduledFrom and the next poll*/
+        unsigned int idleTime;  /*the wait after the next empty poll, before jitter*/
+        uint32_t seed;          /*drives the jitter of the device*/
+    } IOTHUBTRANSPORTHTTP_POLL_STATE;
+
+    /**
+    * @brief	Creates a scheduler.
+    *
+    * @param	minimumTime	The wait in seconds after a poll that brought a message, at least 1.
+    * @param	maximumTime	The longest wait in seconds between 2 empty polls, before jitter.
+    *						It is raised to @p minimumTime if it is smaller.
+    *
+    * @return	A non-NULL @c IOTHUBTRANSPORTHTTP_POLL_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUBTRANSPORTHTTP_POLL_HANDLE, iothubtransporthttp_poll_create, unsigned int, minimumTime, unsigned int, maximumTime);
+
+    /**
+    * @brief	Frees the scheduler.
+    *
+    * @param	pollHandle	The handle created by a call to iothubtransporthttp_poll_create.
+    */
+    MOCKABLE_FUNCTION(, void, iothubtransporthttp_poll_destroy, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle);
+
+    /**
+    * @brief	Changes the waits of the scheduler. The new waits apply from the
+    *			next poll of every device.
+    *
+    * @return	0 on success and a non-zero value if the arguments are invalid.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_poll_set_times, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, minimumTime, unsigned int, maximumTime);
+
+    /**
+    * @brief	Caps the polls of all the devices to @p pollsPerSecond, 0 removes the cap.
+    *
+    * @return	0 on success and a non-zero value if @p pollHandle is @c NULL.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_poll_set_rate_limit, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, pollsPerSecond);
+
+    /**
+    * @brief	Tells whether a device shall be polled now. A device is scheduled
+    *			by its first call, somewhere within the minimum time, so devices
+    *			registered together do not poll together. A @c true answer counts
+    *			against the rate limit, so it shall be followed by a poll.
+    *			It can be called for different devices from different threads.
+    *
+    * @param	pollHandle	The handle created by a call to iothubtransporthttp_poll_create.
+    * @param	pollState	The schedule of the device.
+    * @param	now			The current time, (time_t)-1 when it is not available.
+    *
+    * @return	@c true if the device is due and the rate limit allows a poll.
+    */
+    MOCKABLE_FUNCTION(, bool, iothubtransporthttp_poll_is_due, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now);
+
+    /**
+    * @brief	Schedules the next poll of a device after a poll has been made.
+    *
+    * @param	pollHandle			The handle created by a call to iothubtransporthttp_poll_create.
+    * @param	pollState			The schedule of the device.
+    * @param	now					The time of the poll, (time_t)-1 when it is not available.
+    * @param	hasReceivedMessage	@c true if the poll brought a message.
+    */
+    MOCKABLE_FUNCTION(, void, iothubtransporthttp_poll_on_polled, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now, bool, hasReceivedMessage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORTHTTP_POLL_H */
@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothubtransporthttp_pool.h
+*	@brief Runs the lanes of the HTTP connection pool at the same time.
+*
+*	@details The HTTP transport gives every connection of its pool a lane.
+*			 Lane 0 runs on the thread that calls iothubtransporthttp_pool_run,
+*			 every other lane has a thread of its own that is kept between
+*			 runs, so a slow request on one connection does not hold back
+*			 the devices served by the others.
+*/
+
+#ifndef IOTHUBTRANSPORTHTTP_POOL_H
+#define IOTHUBTRANSPORTHTTP_POOL_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+    typedef struct IOTHUBTRANSPORTHTTP_POOL_INSTANCE_TAG* IOTHUBTRANSPORTHTTP_POOL_HANDLE;
+    typedef void(*IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION)(void* context, size_t lane);
+
+    /**
+    * @brief	Creates a pool of @p laneCount lanes and starts the threads of
+    *			the lanes 1 to @p laneCount - 1.
+    *
+    * @param	laneCount	The number of lanes, at least 2.
+    *
+    * @return	A non-NULL @c IOTHUBTRANSPORTHTTP_POOL_HANDLE value on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUBTRANSPORTHTTP_POOL_HANDLE, iothubtransporthttp_pool_create, size_t, laneCount);
+
+    /**
+    * @brief	Stops and joins the threads of the lanes and frees the pool.
+    *			It shall not be called while iothubtransporthttp_pool_run runs.
+    *
+    * @param	poolHandle	The handle created by a call to iothubtransporthttp_pool_create.
+    */
+    MOCKABLE_FUNCTION(, void, iothubtransporthttp_pool_destroy, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle);
+
+    /**
+    * @brief	Calls @p function once for every lane, every lane on its own
+    *			thread, and returns when all the calls have returned.
+    *
+    * @param	poolHandle	The handle created by a call to iothubtransporthttp_pool_create.
+    * @param	function	The function to call.
+    * @param	context		The first argument passed to @p function, the lane is the second.
+    *
+    * @return	0 when @p function has been called for every lane and a non-zero value
+    *			when it has not been called at all.
+    */
+    MOCKABLE_FUNCTION(, int, iothubtransporthttp_pool_run, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle, IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION, function, void*, context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUBTRANSPORTHTTP_POOL_H */
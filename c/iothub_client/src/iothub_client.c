@@ -10,14 +10,20 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client.h"
 #include "iothub_client_ll.h"
 #include "iothubtransport.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
+#include "iothub_client_options.h"
+#include "iothub_client_threadpool.h"
+#include "iothub_client_ingress_queue.h"
+#include "iothub_client_dispatcher.h"
 
 typedef struct IOTHUB_CLIENT_INSTANCE_TAG
 {
@@ -26,11 +32,51 @@ typedef struct IOTHUB_CLIENT_INSTANCE_TAG
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
     sig_atomic_t StopThread;
+    COND_HANDLE WorkCondition; /*created on demand when OPTION_WORKER_IDLE_WAIT_TIME is set*/
+    unsigned int WorkerIdleWaitTime; /*0 means the worker thread polls every 1 ms*/
+    IOTHUB_CLIENT_THREADPOOL_HANDLE ThreadPool; /*when set, the work is scheduled on the pool instead of on ThreadHandle*/
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE WorkItem;
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE IngressQueue; /*created when OPTION_INGRESS_QUEUE is set, holds INGRESS_EVENT* until the worker moves them to IoTHubClient_LL*/
+    bool HasSentEvent; /*set under the lock by the first IoTHubClient_SendEventAsync, IngressQueue cannot be created afterwards*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY QueueFullPolicy; /*copy of OPTION_QUEUE_FULL_POLICY, IoTHubClient_SendEventAsync waits for room when it is IOTHUB_CLIENT_QUEUE_FULL_BLOCK*/
+    COND_HANDLE QueueSpaceCondition; /*created when OPTION_QUEUE_FULL_POLICY is set to IOTHUB_CLIENT_QUEUE_FULL_BLOCK, posted after DoWork and by IoTHubClient_Destroy*/
+    size_t BlockedSendCount; /*number of IoTHubClient_SendEventAsync calls waiting on QueueSpaceCondition*/
+    bool IsDestroying; /*set by IoTHubClient_Destroy, the blocked IoTHubClient_SendEventAsync calls return IOTHUB_CLIENT_ERROR*/
+    IOTHUB_CLIENT_DISPATCHER_HANDLE Dispatcher; /*created when OPTION_CALLBACK_DISPATCH_THREAD is set, runs the application callbacks without the lock*/
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK DeviceTwinCallback; /*the application callback that IoTHubClient_LL reaches through the dispatcher*/
+    void* DeviceTwinUserContext;
 #ifndef DONT_USE_UPLOADTOBLOB
     SINGLYLINKEDLIST_HANDLE savedDataToBeCleaned; /*list containing UPLOADTOBLOB_SAVED_DATA*/
 #endif
 } IOTHUB_CLIENT_INSTANCE;
 
+typedef struct INGRESS_EVENT_TAG
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    void* userContextCallback;
+} INGRESS_EVENT;
+
+/*the confirmation of an event or of a reported state, on its way to the dispatcher*/
+typedef struct DISPATCHED_CONFIRMATION_TAG
+{
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback;
+    void* userContextCallback;
+    IOTHUB_CLIENT_CONFIRMATION_RESULT confirmationResult;
+    int statusCode;
+} DISPATCHED_CONFIRMATION;
+
+typedef struct DISPATCHED_TWIN_UPDATE_TAG
+{
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
+    void* userContextCallback;
+    DEVICE_TWIN_UPDATE_STATE updateState;
+    size_t size;
+    /*followed by the size bytes of the payload*/
+} DISPATCHED_TWIN_UPDATE;
+
 #ifndef DONT_USE_UPLOADTOBLOB
 typedef struct UPLOADTOBLOB_SAVED_DATA_TAG
 {
@@ -48,6 +94,7 @@ typedef struct UPLOADTOBLOB_SAVED_DATA_TAG
 
 /*used by unittests only*/
 const size_t IoTHubClient_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_INSTANCE, StopThread);
+const size_t IoTHubClient_IsDestroyingOffset = offsetof(IOTHUB_CLIENT_INSTANCE, IsDestroying);
 
 #ifndef DONT_USE_UPLOADTOBLOB
 /*this function is called from _Destroy and from ScheduleWork_Thread to join finished blobUpload threads and free that memory*/
@@ -98,12 +145,386 @@ static void garbageCollectorImpl(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
 }
 #endif
 
+static void WaitForWork(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_STATUS sendStatus;
+    int timeout;
+
+    /*Codes_SRS_IOTHUBCLIENT_07_003: [ If there are events being sent, the thread shall wait at most 1 ms so that confirmations are processed as fast as before. ]*/
+    if ((IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, &sendStatus) == IOTHUB_CLIENT_OK) &&
+        (sendStatus == IOTHUB_CLIENT_SEND_STATUS_IDLE))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_002: [ Otherwise the thread shall wait at most WorkerIdleWaitTime milliseconds. ]*/
+        timeout = (int)iotHubClientInstance->WorkerIdleWaitTime;
+    }
+    else
+    {
+        timeout = 1;
+    }
+
+    /*Codes_SRS_IOTHUBCLIENT_07_001: [ When OPTION_WORKER_IDLE_WAIT_TIME is non-zero, instead of sleeping the thread shall wait on the work condition by calling Condition_Wait while holding the lock, so that it can be woken up by the APIs queueing work. ]*/
+    if (Condition_Wait(iotHubClientInstance->WorkCondition, iotHubClientInstance->LockHandle, timeout) == COND_ERROR)
+    {
+        LogError("Condition_Wait failed");
+    }
+}
+
+static void SignalWorkerThread(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->TransportHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_005: [ If the transport connection is shared, the worker thread shall be woken up by calling IoTHubTransport_SignalWorkerThread whatever the OPTION_WORKER_IDLE_WAIT_TIME of this client, since the transport keeps the wait time set by any of its clients. ]*/
+        IoTHubTransport_SignalWorkerThread(iotHubClientInstance->TransportHandle);
+    }
+    /*Codes_SRS_IOTHUBCLIENT_07_004: [ APIs that queue work for the worker thread shall wake it up when OPTION_WORKER_IDLE_WAIT_TIME is non-zero. ]*/
+    else if ((iotHubClientInstance->WorkerIdleWaitTime != 0) && (iotHubClientInstance->WorkCondition != NULL))
+    {
+        if (Condition_Post(iotHubClientInstance->WorkCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed");
+        }
+    }
+}
+
+/*called by the worker thread of a shared transport with the transport lock, which is also this client's lock, already held*/
+bool IoTHubClient_IsSendBusy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
+{
+    bool result;
+    IOTHUB_CLIENT_STATUS sendStatus;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_054: [ If iotHubClientHandle is NULL, IoTHubClient_IsSendBusy shall return false. ]*/
+        result = false;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_055: [ IoTHubClient_IsSendBusy shall not take the lock and shall return false only when IoTHubClient_LL_GetSendStatus succeeds and reports IOTHUB_CLIENT_SEND_STATUS_IDLE. ]*/
+        result = !((IoTHubClient_LL_GetSendStatus(iotHubClientHandle->IoTHubClientLLHandle, &sendStatus) == IOTHUB_CLIENT_OK) &&
+            (sendStatus == IOTHUB_CLIENT_SEND_STATUS_IDLE));
+    }
+    return result;
+}
+
+/*wakes up every IoTHubClient_SendEventAsync waiting for room in the send queue, each one tries again. Must be called under the lock*/
+static void SignalQueueSpace(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    size_t i;
+    for (i = 0; i < iotHubClientInstance->BlockedSendCount; i++)
+    {
+        if (Condition_Post(iotHubClientInstance->QueueSpaceCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed");
+        }
+    }
+}
+
+/*called by the worker thread of a shared transport after the transport DoWork, with the transport lock, which is also this client's lock, already held*/
+void IoTHubClient_SignalQueueSpace(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_07_061: [ If iotHubClientHandle is NULL, IoTHubClient_SignalQueueSpace shall do nothing. ]*/
+    if (iotHubClientHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_062: [ IoTHubClient_SignalQueueSpace shall not take the lock and shall wake up the IoTHubClient_SendEventAsync calls waiting for room in the send queue by calling Condition_Post once for each of them. ]*/
+        SignalQueueSpace(iotHubClientHandle);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT SetWorkerIdleWaitTime(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, unsigned int idleWaitTime)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientInstance->TransportHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_008: [ If the transport connection is shared, IoTHubClient_SetOption shall call IoTHubTransport_SetWorkerIdleWaitTime and return its result. ]*/
+        result = IoTHubTransport_SetWorkerIdleWaitTime(iotHubClientInstance->TransportHandle, idleWaitTime);
+    }
+    else if ((idleWaitTime != 0) && (iotHubClientInstance->WorkCondition == NULL) &&
+        ((iotHubClientInstance->WorkCondition = Condition_Init()) == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_007: [ If Condition_Init fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("Condition_Init failed");
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    if (result == IOTHUB_CLIENT_OK)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_009: [ The worker thread shall be woken up so that the new wait time is used immediately. ]*/
+        /*IoTHubTransport_SetWorkerIdleWaitTime already wakes up the worker thread of a shared transport*/
+        if (iotHubClientInstance->TransportHandle == NULL)
+        {
+            SignalWorkerThread(iotHubClientInstance);
+        }
+        iotHubClientInstance->WorkerIdleWaitTime = idleWaitTime;
+    }
+    else
+    {
+        LogError("unable to set the worker idle wait time");
+    }
+    return result;
+}
+
+/*moves the events queued by IoTHubClient_SendEventAsync without the lock to IoTHubClient_LL. Must be called under the lock*/
+static void DrainIngressQueue(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->IngressQueue != NULL)
+    {
+        INGRESS_EVENT* ingressEvent;
+        while ((ingressEvent = (INGRESS_EVENT*)IoTHubClient_IngressQueue_Pop(iotHubClientInstance->IngressQueue)) != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_025: [ The queued events shall be passed to IoTHubClient_LL_SendEventAsync_Move, in the order they were queued, before IoTHubClient_LL_DoWork is called. ]*/
+            /*the message was already cloned when it was queued, so it is handed over to IoTHubClient_LL rather than cloned again*/
+            if (IoTHubClient_LL_SendEventAsync_Move(iotHubClientInstance->IoTHubClientLLHandle, ingressEvent->messageHandle, ingressEvent->eventConfirmationCallback, ingressEvent->userContextCallback) != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_026: [ If IoTHubClient_LL_SendEventAsync_Move fails for a queued event, its eventConfirmationCallback (if any) shall be called with IOTHUB_CLIENT_CONFIRMATION_ERROR and its message shall be destroyed. ]*/
+                LogError("IoTHubClient_LL_SendEventAsync_Move failed for a queued event");
+                if (ingressEvent->eventConfirmationCallback != NULL)
+                {
+                    ingressEvent->eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, ingressEvent->userContextCallback);
+                }
+                IoTHubMessage_Destroy(ingressEvent->messageHandle);
+            }
+            free(ingressEvent);
+        }
+    }
+}
+
+static void DispatchConfirmation(void* context)
+{
+    DISPATCHED_CONFIRMATION* confirmation = (DISPATCHED_CONFIRMATION*)context;
+
+    if (confirmation->eventConfirmationCallback != NULL)
+    {
+        confirmation->eventConfirmationCallback(confirmation->confirmationResult, confirmation->userContextCallback);
+    }
+    else
+    {
+        confirmation->reportedStateCallback(confirmation->statusCode, confirmation->userContextCallback);
+    }
+    free(confirmation);
+}
+
+static void PostConfirmation(DISPATCHED_CONFIRMATION* confirmation)
+{
+    if (IoTHubClient_Dispatcher_Post(confirmation->iotHubClientInstance->Dispatcher, DispatchConfirmation, confirmation) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_052: [ If a callback cannot be posted to the dispatcher, it shall be called on the thread that runs IoTHubClient_LL_DoWork, as without the dispatcher. ]*/
+        LogError("IoTHubClient_Dispatcher_Post failed, calling the callback directly");
+        DispatchConfirmation(confirmation);
+    }
+}
+
+static void EventConfirmationToDispatcher(IOTHUB_CLIENT_CONFIRMATION_RESULT confirmationResult, void* userContextCallback)
+{
+    DISPATCHED_CONFIRMATION* confirmation = (DISPATCHED_CONFIRMATION*)userContextCallback;
+    confirmation->confirmationResult = confirmationResult;
+    PostConfirmation(confirmation);
+}
+
+static void ReportedStateToDispatcher(int status_code, void* userContextCallback)
+{
+    DISPATCHED_CONFIRMATION* confirmation = (DISPATCHED_CONFIRMATION*)userContextCallback;
+    confirmation->statusCode = status_code;
+    PostConfirmation(confirmation);
+}
+
+/*allocates the context of the callback that IoTHubClient_LL calls in place of the confirmation callback of the application, only one of the two callbacks is set*/
+static DISPATCHED_CONFIRMATION* CreateDispatchedConfirmation(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback, void* userContextCallback)
+{
+    DISPATCHED_CONFIRMATION* result = (DISPATCHED_CONFIRMATION*)malloc(sizeof(DISPATCHED_CONFIRMATION));
+    if (result == NULL)
+    {
+        LogError("unable to malloc");
+    }
+    else
+    {
+        result->iotHubClientInstance = iotHubClientInstance;
+        result->eventConfirmationCallback = eventConfirmationCallback;
+        result->reportedStateCallback = reportedStateCallback;
+        result->userContextCallback = userContextCallback;
+        result->confirmationResult = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+        result->statusCode = 0;
+    }
+    return result;
+}
+
+static void DispatchTwinUpdate(void* context)
+{
+    DISPATCHED_TWIN_UPDATE* twinUpdate = (DISPATCHED_TWIN_UPDATE*)context;
+
+    twinUpdate->deviceTwinCallback(twinUpdate->updateState, (const unsigned char*)(twinUpdate + 1), twinUpdate->size, twinUpdate->userContextCallback);
+    free(twinUpdate);
+}
+
+static void DeviceTwinToDispatcher(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payLoad, size_t size, void* userContextCallback)
+{
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)userContextCallback;
+    /*the payload is only valid during the call, it is copied after the dispatched update*/
+    DISPATCHED_TWIN_UPDATE* twinUpdate = (DISPATCHED_TWIN_UPDATE*)malloc(sizeof(DISPATCHED_TWIN_UPDATE) + size);
+
+    if (twinUpdate == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_052: [ If a callback cannot be posted to the dispatcher, it shall be called on the thread that runs IoTHubClient_LL_DoWork, as without the dispatcher. ]*/
+        LogError("unable to malloc, calling the device twin callback directly");
+        iotHubClientInstance->DeviceTwinCallback(update_state, payLoad, size, iotHubClientInstance->DeviceTwinUserContext);
+    }
+    else
+    {
+        twinUpdate->deviceTwinCallback = iotHubClientInstance->DeviceTwinCallback;
+        twinUpdate->userContextCallback = iotHubClientInstance->DeviceTwinUserContext;
+        twinUpdate->updateState = update_state;
+        twinUpdate->size = size;
+        if (size != 0)
+        {
+            (void)memcpy(twinUpdate + 1, payLoad, size);
+        }
+
+        if (IoTHubClient_Dispatcher_Post(iotHubClientInstance->Dispatcher, DispatchTwinUpdate, twinUpdate) != 0)
+        {
+            LogError("IoTHubClient_Dispatcher_Post failed, calling the device twin callback directly");
+            free(twinUpdate);
+            iotHubClientInstance->DeviceTwinCallback(update_state, payLoad, size, iotHubClientInstance->DeviceTwinUserContext);
+        }
+    }
+}
+
+static IOTHUB_CLIENT_RESULT SetCallbackDispatcher(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, bool useDispatcher)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (!useDispatcher)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_046: [ Once the callback dispatcher has been created it cannot be removed; setting OPTION_CALLBACK_DISPATCH_THREAD to false shall then return IOTHUB_CLIENT_ERROR. ]*/
+        if (iotHubClientInstance->Dispatcher != NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("the callback dispatcher cannot be disabled once enabled");
+        }
+        else
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    else if (iotHubClientInstance->Dispatcher != NULL)
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if (iotHubClientInstance->IngressQueue != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_057: [ If the ingress queue has been created, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR for OPTION_CALLBACK_DISPATCH_THREAD set to true and shall not create the callback dispatcher. ]*/
+        /*IoTHubClient_SendEventAsync reads Dispatcher without the lock once the ingress queue exists*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the callback dispatcher has to be enabled before the ingress queue");
+    }
+    /*Codes_SRS_IOTHUBCLIENT_07_044: [ If optionName is OPTION_CALLBACK_DISPATCH_THREAD and value points to true, IoTHubClient_SetOption shall create the callback dispatcher by calling IoTHubClient_Dispatcher_Create. ]*/
+    else if ((iotHubClientInstance->Dispatcher = IoTHubClient_Dispatcher_Create()) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_045: [ If IoTHubClient_Dispatcher_Create fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("IoTHubClient_Dispatcher_Create failed");
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    return result;
+}
+
+/*queues without the lock: ingressQueue and Dispatcher are not changed by IoTHubClient_SetOption once the ingress queue exists*/
+static IOTHUB_CLIENT_RESULT SendEventToIngressQueue(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE ingressQueue, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    INGRESS_EVENT* ingressEvent;
+    bool useDispatcher = (iotHubClientInstance->Dispatcher != NULL) && (eventConfirmationCallback != NULL);
+
+    if ((eventMessageHandle == NULL) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL)))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_022: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid arg IOTHUB_MESSAGE_HANDLE eventMessageHandle=%p, void* userContextCallback=%p", eventMessageHandle, userContextCallback);
+    }
+    /*Codes_SRS_IOTHUBCLIENT_07_023: [ IoTHubClient_SendEventAsync shall clone eventMessageHandle by calling IoTHubMessage_Clone and add it, with eventConfirmationCallback and userContextCallback, to the ingress queue by calling IoTHubClient_IngressQueue_Push. ]*/
+    else if ((ingressEvent = (INGRESS_EVENT*)malloc(sizeof(INGRESS_EVENT))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_024: [ If any of these operations fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("unable to malloc");
+    }
+    else if ((ingressEvent->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("IoTHubMessage_Clone failed");
+        free(ingressEvent);
+    }
+    /*Codes_SRS_IOTHUBCLIENT_07_047: [ While the callback dispatcher exists, IoTHubClient_SendEventAsync shall pass to IoTHubClient_LL, instead of eventConfirmationCallback (if not NULL), a callback that posts eventConfirmationCallback to the dispatcher by calling IoTHubClient_Dispatcher_Post. ]*/
+    else if (useDispatcher &&
+        ((ingressEvent->userContextCallback = CreateDispatchedConfirmation(iotHubClientInstance, eventConfirmationCallback, NULL, userContextCallback)) == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_048: [ If allocating the context of that callback fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("CreateDispatchedConfirmation failed");
+        IoTHubMessage_Destroy(ingressEvent->messageHandle);
+        free(ingressEvent);
+    }
+    else
+    {
+        if (useDispatcher)
+        {
+            ingressEvent->eventConfirmationCallback = EventConfirmationToDispatcher;
+        }
+        else
+        {
+            ingressEvent->eventConfirmationCallback = eventConfirmationCallback;
+            ingressEvent->userContextCallback = userContextCallback;
+        }
+
+        if (IoTHubClient_IngressQueue_Push(ingressQueue, ingressEvent) != 0)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("IoTHubClient_IngressQueue_Push failed");
+            if (ingressEvent->eventConfirmationCallback == EventConfirmationToDispatcher)
+            {
+                free(ingressEvent->userContextCallback);
+            }
+            IoTHubMessage_Destroy(ingressEvent->messageHandle);
+            free(ingressEvent);
+        }
+        else
+        {
+            /*the worker holds the lock from DrainIngressQueue until Condition_Wait releases it, a post made outside the lock could be lost in between*/
+            if (iotHubClientInstance->WorkerIdleWaitTime != 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_065: [ When OPTION_WORKER_IDLE_WAIT_TIME is non-zero, IoTHubClient_SendEventAsync shall acquire the lock after queueing the event and wake up the worker thread while holding it, so that the wake-up cannot fall between the worker draining the ingress queue and waiting on the work condition. ]*/
+                if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_07_066: [ If acquiring that lock fails, IoTHubClient_SendEventAsync shall still wake up the worker thread and return IOTHUB_CLIENT_OK. ]*/
+                    LogError("unable to Lock, the worker thread is woken up without it");
+                    SignalWorkerThread(iotHubClientInstance);
+                }
+                else
+                {
+                    SignalWorkerThread(iotHubClientInstance);
+                    (void)Unlock(iotHubClientInstance->LockHandle);
+                }
+            }
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    return result;
+}
+
 static int ScheduleWork_Thread(void* threadArgument)
 {
     IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)threadArgument;
 
     while (1)
     {
+        bool hasWaited = false;
         if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
         {
             /*Codes_SRS_IOTHUBCLIENT_01_038: [ The thread shall exit when IoTHubClient_Destroy is called. ]*/
@@ -116,11 +537,19 @@ static int ScheduleWork_Thread(void* threadArgument)
             {
                 /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_DoWork every 1 ms.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+                DrainIngressQueue(iotHubClientInstance);
                 IoTHubClient_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
+                /*Codes_SRS_IOTHUBCLIENT_07_058: [ After each call to IoTHubClient_LL_DoWork, the IoTHubClient_SendEventAsync calls waiting for room in the send queue shall be woken up by calling Condition_Post once for each of them. ]*/
+                SignalQueueSpace(iotHubClientInstance);
 
 #ifndef DONT_USE_UPLOADTOBLOB
                 garbageCollectorImpl(iotHubClientInstance);
 #endif
+                if ((iotHubClientInstance->WorkerIdleWaitTime != 0) && (iotHubClientInstance->WorkCondition != NULL))
+                {
+                    WaitForWork(iotHubClientInstance);
+                    hasWaited = true;
+                }
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -129,23 +558,53 @@ static int ScheduleWork_Thread(void* threadArgument)
             /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.]*/
             /*no code, shall retry*/
         }
-        (void)ThreadAPI_Sleep(1);
+
+        if (!hasWaited)
+        {
+            (void)ThreadAPI_Sleep(1);
+        }
     }
 
     return 0;
 }
 
+static void ScheduleWork_ThreadPoolItem(void* context)
+{
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)context;
+
+    /*Codes_SRS_IOTHUBCLIENT_07_013: [ The work item registered with the thread pool shall call IoTHubClient_LL_DoWork under the lock created in IoTHubClient_Create, unless IoTHubClient_Destroy has been called. ]*/
+    if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+    {
+        if (!iotHubClientInstance->StopThread)
+        {
+            DrainIngressQueue(iotHubClientInstance);
+            IoTHubClient_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
+            SignalQueueSpace(iotHubClientInstance);
+
+#ifndef DONT_USE_UPLOADTOBLOB
+            garbageCollectorImpl(iotHubClientInstance);
+#endif
+        }
+        (void)Unlock(iotHubClientInstance->LockHandle);
+    }
+}
+
 static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
 {
     IOTHUB_CLIENT_RESULT result;
     if (iotHubClientInstance->TransportHandle == NULL)
     {
-        if (iotHubClientInstance->ThreadHandle == NULL)
+        if ((iotHubClientInstance->ThreadHandle != NULL) || (iotHubClientInstance->WorkItem != NULL))
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (iotHubClientInstance->ThreadPool != NULL)
         {
             iotHubClientInstance->StopThread = 0;
-            if (ThreadAPI_Create(&iotHubClientInstance->ThreadHandle, ScheduleWork_Thread, iotHubClientInstance) != THREADAPI_OK)
+            /*Codes_SRS_IOTHUBCLIENT_07_012: [ If a thread pool has been set, the work shall be scheduled by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]*/
+            if ((iotHubClientInstance->WorkItem = IoTHubClient_ThreadPool_AddWork(iotHubClientInstance->ThreadPool, ScheduleWork_ThreadPoolItem, iotHubClientInstance)) == NULL)
             {
-                iotHubClientInstance->ThreadHandle = NULL;
+                LogError("IoTHubClient_ThreadPool_AddWork failed");
                 result = IOTHUB_CLIENT_ERROR;
             }
             else
@@ -155,7 +614,16 @@ static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* io
         }
         else
         {
-            result = IOTHUB_CLIENT_OK;
+            iotHubClientInstance->StopThread = 0;
+            if (ThreadAPI_Create(&iotHubClientInstance->ThreadHandle, ScheduleWork_Thread, iotHubClientInstance) != THREADAPI_OK)
+            {
+                iotHubClientInstance->ThreadHandle = NULL;
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
         }
     }
     else
@@ -168,6 +636,64 @@ static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* io
     return result;
 }
 
+static IOTHUB_CLIENT_RESULT SetIngressQueue(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, bool useIngressQueue)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientInstance->TransportHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_028: [ If the transport connection is shared, IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG for OPTION_INGRESS_QUEUE. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("the ingress queue is not supported when the transport connection is shared");
+    }
+    else if (!useIngressQueue)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_029: [ Once the ingress queue has been created it cannot be removed; setting OPTION_INGRESS_QUEUE to false shall then return IOTHUB_CLIENT_ERROR. ]*/
+        if (iotHubClientInstance->IngressQueue != NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("the ingress queue cannot be disabled once enabled");
+        }
+        else
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    else if (iotHubClientInstance->IngressQueue != NULL)
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if (iotHubClientInstance->HasSentEvent)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_056: [ If IoTHubClient_SendEventAsync has already been called, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR for OPTION_INGRESS_QUEUE set to true and shall not create the ingress queue. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the ingress queue cannot be enabled once events have been sent");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_021: [ If optionName is OPTION_INGRESS_QUEUE and value points to true, IoTHubClient_SetOption shall create the ingress queue by calling IoTHubClient_IngressQueue_Create and start the worker thread if it was not previously started. ]*/
+        IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE ingressQueue = IoTHubClient_IngressQueue_Create();
+        if (ingressQueue == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_027: [ If creating the ingress queue or starting the worker thread fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("IoTHubClient_IngressQueue_Create failed");
+        }
+        else if (StartWorkerThreadIfNeeded(iotHubClientInstance) != IOTHUB_CLIENT_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+            IoTHubClient_IngressQueue_Destroy(ingressQueue);
+        }
+        else
+        {
+            iotHubClientInstance->IngressQueue = ingressQueue;
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
 {
     IOTHUB_CLIENT_INSTANCE* result = NULL;
@@ -234,6 +760,19 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connect
                     {
                         result->ThreadHandle = NULL;
                         result->TransportHandle = NULL;
+                        result->WorkCondition = NULL;
+                        result->WorkerIdleWaitTime = 0;
+                        result->ThreadPool = NULL;
+                        result->WorkItem = NULL;
+                        result->IngressQueue = NULL;
+                        result->HasSentEvent = false;
+                        result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                        result->QueueSpaceCondition = NULL;
+                        result->BlockedSendCount = 0;
+                        result->IsDestroying = false;
+                        result->Dispatcher = NULL;
+                        result->DeviceTwinCallback = NULL;
+                        result->DeviceTwinUserContext = NULL;
                     }
                 }
             }
@@ -292,6 +831,19 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_Create(const IOTHUB_CLIENT_CONFIG* config)
                 {
                     result->TransportHandle = NULL;
                     result->ThreadHandle = NULL;
+                    result->WorkCondition = NULL;
+                    result->WorkerIdleWaitTime = 0;
+                    result->ThreadPool = NULL;
+                    result->WorkItem = NULL;
+                    result->IngressQueue = NULL;
+                    result->HasSentEvent = false;
+                    result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                    result->QueueSpaceCondition = NULL;
+                    result->BlockedSendCount = 0;
+                    result->IsDestroying = false;
+                    result->Dispatcher = NULL;
+                    result->DeviceTwinCallback = NULL;
+                    result->DeviceTwinUserContext = NULL;
                 }
             }
         }
@@ -336,6 +888,19 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
             {
                 result->ThreadHandle = NULL;
                 result->TransportHandle = transportHandle;
+                result->WorkCondition = NULL;
+                result->WorkerIdleWaitTime = 0;
+                result->ThreadPool = NULL;
+                result->WorkItem = NULL;
+                result->IngressQueue = NULL;
+                result->HasSentEvent = false;
+                result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                result->QueueSpaceCondition = NULL;
+                result->BlockedSendCount = 0;
+                result->IsDestroying = false;
+                result->Dispatcher = NULL;
+                result->DeviceTwinCallback = NULL;
+                result->DeviceTwinUserContext = NULL;
                 /*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]*/
                 LOCK_HANDLE transportLock = IoTHubTransport_GetLock(transportHandle);
                 result->LockHandle = transportLock;
@@ -428,6 +993,20 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
         {
             LogError("unable to Lock - - will still proceed to try to end the thread without locking");
         }
+        else
+        {
+            iotHubClientInstance->IsDestroying = true;
+            /*Codes_SRS_IOTHUBCLIENT_07_060: [ IoTHubClient_Destroy shall wake up the IoTHubClient_SendEventAsync calls waiting for room in the send queue and wait, by calling Condition_Wait with the lock, until all of them have returned. ]*/
+            while (iotHubClientInstance->BlockedSendCount != 0)
+            {
+                SignalQueueSpace(iotHubClientInstance);
+                if (Condition_Wait(iotHubClientInstance->QueueSpaceCondition, iotHubClientInstance->LockHandle, 0) == COND_ERROR)
+                {
+                    LogError("Condition_Wait failed, the blocked IoTHubClient_SendEventAsync calls might still use the client");
+                    break;
+                }
+            }
+        }
 
 #ifndef DONT_USE_UPLOADTOBLOB
         /*Codes_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall free all data created by IoTHubClient_UploadToBlobAsync ]*/
@@ -437,9 +1016,10 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
             garbageCollectorImpl(iotHubClientInstance);
         }
 #endif
-        if (iotHubClientInstance->ThreadHandle != NULL)
+        if ((iotHubClientInstance->ThreadHandle != NULL) || (iotHubClientInstance->WorkItem != NULL))
         {
             iotHubClientInstance->StopThread = 1;
+            SignalWorkerThread(iotHubClientInstance);
             okToJoin = true;
         }
         else
@@ -453,6 +1033,9 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
             okToJoin = IoTHubTransport_SignalEndWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle);
         }
 
+        /*Codes_SRS_IOTHUBCLIENT_07_030: [ IoTHubClient_Destroy shall pass the events left in the ingress queue to IoTHubClient_LL before destroying it, so that their callbacks are called with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+        DrainIngressQueue(iotHubClientInstance);
+
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClient_LL instance by calling IoTHubClient_LL_Destroy.] */
         IoTHubClient_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
@@ -480,6 +1063,11 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
                     LogError("ThreadAPI_Join failed");
                 }
             }
+            if (iotHubClientInstance->WorkItem != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_014: [ If the work was scheduled on a thread pool, IoTHubClient_Destroy shall call IoTHubClient_ThreadPool_RemoveWork after unlocking the serializing lock. ]*/
+                IoTHubClient_ThreadPool_RemoveWork(iotHubClientInstance->ThreadPool, iotHubClientInstance->WorkItem);
+            }
             if (iotHubClientInstance->TransportHandle != NULL)
             {
                 /*Codes_SRS_IOTHUBCLIENT_01_007: [ The thread created as part of executing IoTHubClient_SendEventAsync or IoTHubClient_SetNotificationMessageCallback shall be joined. ]*/
@@ -487,12 +1075,33 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
             }
         }
 
+        if (iotHubClientInstance->Dispatcher != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_053: [ IoTHubClient_Destroy shall destroy the callback dispatcher by calling IoTHubClient_Dispatcher_Destroy once IoTHubClient_LL has been destroyed and the worker thread joined, so that the callbacks posted to it, including the ones completed by IoTHubClient_LL_Destroy, are called. ]*/
+            IoTHubClient_Dispatcher_Destroy(iotHubClientInstance->Dispatcher);
+        }
+
         if (iotHubClientInstance->TransportHandle == NULL)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
             Lock_Deinit(iotHubClientInstance->LockHandle);
         }
 
+        if (iotHubClientInstance->WorkCondition != NULL)
+        {
+            Condition_Deinit(iotHubClientInstance->WorkCondition);
+        }
+
+        if (iotHubClientInstance->QueueSpaceCondition != NULL)
+        {
+            Condition_Deinit(iotHubClientInstance->QueueSpaceCondition);
+        }
+
+        if (iotHubClientInstance->IngressQueue != NULL)
+        {
+            IoTHubClient_IngressQueue_Destroy(iotHubClientInstance->IngressQueue);
+        }
+
         free(iotHubClientInstance);
     }
 }
@@ -510,9 +1119,16 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
     else
     {
         IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+        /*read once: the ingress queue can only be created before the first event is sent and is never replaced*/
+        IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE ingressQueue = iotHubClientInstance->IngressQueue;
 
+        if (ingressQueue != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_031: [ If the ingress queue has been created, IoTHubClient_SendEventAsync shall queue the event without acquiring the lock created in IoTHubClient_Create, instead of calling IoTHubClient_LL_SendEventAsync. ]*/
+            result = SendEventToIngressQueue(iotHubClientInstance, ingressQueue, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+        }
         /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
             result = IOTHUB_CLIENT_ERROR;
@@ -520,6 +1136,10 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
         }
         else
         {
+            DISPATCHED_CONFIRMATION* confirmation = NULL;
+
+            iotHubClientInstance->HasSentEvent = true;
+
             /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
             if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
             {
@@ -527,11 +1147,70 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
                 result = IOTHUB_CLIENT_ERROR;
                 LogError("Could not start worker thread");
             }
+            /*Codes_SRS_IOTHUBCLIENT_07_047: [ While the callback dispatcher exists, IoTHubClient_SendEventAsync shall pass to IoTHubClient_LL, instead of eventConfirmationCallback (if not NULL), a callback that posts eventConfirmationCallback to the dispatcher by calling IoTHubClient_Dispatcher_Post. ]*/
+            else if ((iotHubClientInstance->Dispatcher != NULL) && (eventConfirmationCallback != NULL) &&
+                ((confirmation = CreateDispatchedConfirmation(iotHubClientInstance, eventConfirmationCallback, NULL, userContextCallback)) == NULL))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_048: [ If allocating the context of that callback fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("CreateDispatchedConfirmation failed");
+            }
             else
             {
+                if (confirmation != NULL)
+                {
+                    eventConfirmationCallback = EventConfirmationToDispatcher;
+                    userContextCallback = confirmation;
+                }
+
                 /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClient_LL_SendEventAsync, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClient_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClient_LL_SendEventAsync.] */
                 result = IoTHubClient_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+
+                /*Codes_SRS_IOTHUBCLIENT_07_033: [ If IoTHubClient_LL_SendEventAsync returns IOTHUB_CLIENT_QUEUE_FULL and OPTION_QUEUE_FULL_POLICY is IOTHUB_CLIENT_QUEUE_FULL_BLOCK, IoTHubClient_SendEventAsync shall wait for room by calling Condition_Wait on the queue space condition with the lock and no timeout, and then call IoTHubClient_LL_SendEventAsync again. ]*/
+                while ((result == IOTHUB_CLIENT_QUEUE_FULL) &&
+                    (iotHubClientInstance->QueueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_BLOCK))
+                {
+                    COND_RESULT waitResult;
+
+                    iotHubClientInstance->BlockedSendCount++;
+                    waitResult = Condition_Wait(iotHubClientInstance->QueueSpaceCondition, iotHubClientInstance->LockHandle, 0);
+                    iotHubClientInstance->BlockedSendCount--;
+
+                    if (waitResult == COND_ERROR)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_07_034: [ If Condition_Wait fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("Condition_Wait failed");
+                    }
+                    else if (iotHubClientInstance->IsDestroying)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_07_059: [ If IoTHubClient_Destroy has been called while IoTHubClient_SendEventAsync was waiting, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR without calling IoTHubClient_LL_SendEventAsync again. ]*/
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("IoTHubClient_Destroy was called while waiting for room in the send queue");
+                        if (iotHubClientInstance->BlockedSendCount == 0)
+                        {
+                            /*the last one out lets IoTHubClient_Destroy continue*/
+                            if (Condition_Post(iotHubClientInstance->QueueSpaceCondition) != COND_OK)
+                            {
+                                LogError("Condition_Post failed");
+                            }
+                        }
+                    }
+                    else
+                    {
+                        result = IoTHubClient_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+                    }
+                }
+
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    SignalWorkerThread(iotHubClientInstance);
+                }
+                else if (confirmation != NULL)
+                {
+                    free(confirmation);
+                }
             }
 
             /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -567,6 +1246,8 @@ IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClien
         {
             /* Codes_SRS_IOTHUBCLIENT_01_022: [IoTHubClient_GetSendStatus shall call IoTHubClient_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter iotHubClientStatus.] */
             /* Codes_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClient_LL_GetSendStatus.] */
+            /*Codes_SRS_IOTHUBCLIENT_07_032: [ IoTHubClient_GetSendStatus shall first pass the events in the ingress queue to IoTHubClient_LL, so that they are accounted for in the status. ]*/
+            DrainIngressQueue(iotHubClientInstance);
             result = IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientStatus);
 
             /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -577,6 +1258,74 @@ IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClien
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_GetSendQueueDepth(IOTHUB_CLIENT_HANDLE iotHubClientHandle, size_t* messageCount, size_t* byteCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_036: [ If iotHubClientHandle is NULL, IoTHubClient_GetSendQueueDepth shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_07_037: [ IoTHubClient_GetSendQueueDepth shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_038: [ If acquiring the lock fails, IoTHubClient_GetSendQueueDepth shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_039: [ IoTHubClient_GetSendQueueDepth shall pass the events in the ingress queue to IoTHubClient_LL, call IoTHubClient_LL_GetSendQueueDepth with messageCount and byteCount and return its result. ]*/
+            DrainIngressQueue(iotHubClientInstance);
+            result = IoTHubClient_LL_GetSendQueueDepth(iotHubClientInstance->IoTHubClientLLHandle, messageCount, byteCount);
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_GetSendQueueDepthByPriority(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, size_t* messageCount, size_t* byteCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_040: [ If iotHubClientHandle is NULL, IoTHubClient_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_07_041: [ IoTHubClient_GetSendQueueDepthByPriority shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_042: [ If acquiring the lock fails, IoTHubClient_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_043: [ IoTHubClient_GetSendQueueDepthByPriority shall pass the events in the ingress queue to IoTHubClient_LL, call IoTHubClient_LL_GetSendQueueDepthByPriority with priority, messageCount and byteCount and return its result. ]*/
+            DrainIngressQueue(iotHubClientInstance);
+            result = IoTHubClient_LL_GetSendQueueDepthByPriority(iotHubClientInstance->IoTHubClientLLHandle, priority, messageCount, byteCount);
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_SetMessageCallback(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -610,7 +1359,12 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetMessageCallback(IOTHUB_CLIENT_HANDLE iotHub
             else
             {
                 /* Codes_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
+                /*Codes_SRS_IOTHUBCLIENT_07_049: [ While the callback dispatcher exists, IoTHubClient_SetMessageCallback shall still pass messageCallback itself to IoTHubClient_LL, so that the disposition it returns is the one sent for the message. ]*/
                 result = IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, messageCallback, userContextCallback);
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    SignalWorkerThread(iotHubClientInstance);
+                }
             }
 
             /* Codes_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -716,11 +1470,46 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
-            result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            if (strcmp(OPTION_WORKER_IDLE_WAIT_TIME, optionName) == 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_006: [ If optionName is OPTION_WORKER_IDLE_WAIT_TIME then IoTHubClient_SetOption shall create the work condition (if needed) by calling Condition_Init and shall store the value, an unsigned int in milliseconds. ]*/
+                result = SetWorkerIdleWaitTime(iotHubClientInstance, *(const unsigned int*)value);
+            }
+            else if (strcmp(OPTION_INGRESS_QUEUE, optionName) == 0)
+            {
+                result = SetIngressQueue(iotHubClientInstance, *(const bool*)value);
+            }
+            else if (strcmp(OPTION_CALLBACK_DISPATCH_THREAD, optionName) == 0)
+            {
+                result = SetCallbackDispatcher(iotHubClientInstance, *(const bool*)value);
+            }
+            /*Codes_SRS_IOTHUBCLIENT_07_063: [ If optionName is OPTION_QUEUE_FULL_POLICY and value points to IOTHUB_CLIENT_QUEUE_FULL_BLOCK, IoTHubClient_SetOption shall create the queue space condition (if needed) by calling Condition_Init before calling IoTHubClient_LL_SetOption. ]*/
+            else if ((strcmp(OPTION_QUEUE_FULL_POLICY, optionName) == 0) &&
+                (*(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value == IOTHUB_CLIENT_QUEUE_FULL_BLOCK) &&
+                (iotHubClientInstance->QueueSpaceCondition == NULL) &&
+                ((iotHubClientInstance->QueueSpaceCondition = Condition_Init()) == NULL))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_064: [ If Condition_Init fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("Condition_Init failed");
+            }
+            else
             {
-                LogError("IoTHubClient_LL_SetOption failed");
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
+                result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClient_LL_SetOption failed");
+                }
+                else
+                {
+                    if (strcmp(OPTION_QUEUE_FULL_POLICY, optionName) == 0)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_07_035: [ If optionName is OPTION_QUEUE_FULL_POLICY and IoTHubClient_LL_SetOption succeeds, IoTHubClient_SetOption shall remember the policy for IoTHubClient_SendEventAsync. ]*/
+                        iotHubClientInstance->QueueFullPolicy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+                    }
+                    SignalWorkerThread(iotHubClientInstance);
+                }
             }
 
             Unlock(iotHubClientInstance->LockHandle);
@@ -729,6 +1518,54 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_SetThreadPool(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_07_015: [ If iotHubClientHandle is NULL, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid arg (NULL)");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_07_016: [ IoTHubClient_SetThreadPool shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_07_017: [ If acquiring the lock fails, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if (iotHubClientInstance->TransportHandle != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_018: [ If the transport connection is shared, IoTHubClient_SetThreadPool shall call IoTHubTransport_SetThreadPool and return its result. ]*/
+                result = IoTHubTransport_SetThreadPool(iotHubClientInstance->TransportHandle, threadPoolHandle);
+            }
+            else if ((iotHubClientInstance->ThreadHandle != NULL) || (iotHubClientInstance->WorkItem != NULL))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_019: [ If the work has already been scheduled, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("the worker thread has already been started");
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_07_020: [ Otherwise IoTHubClient_SetThreadPool shall store threadPoolHandle, which may be NULL to go back to a dedicated thread, and return IOTHUB_CLIENT_OK. ]*/
+                iotHubClientInstance->ThreadPool = threadPoolHandle;
+                result = IOTHUB_CLIENT_OK;
+            }
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_SetDeviceTwinCallback(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -762,11 +1599,25 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetDeviceTwinCallback(IOTHUB_CLIENT_HANDLE iot
             else
             {
                 /*Codes_SRS_IOTHUBCLIENT_10_005: [** `IoTHubClient_LL_SetDeviceTwinCallback` shall call `IoTHubClient_LL_SetDeviceTwinCallback`, while passing the `IoTHubClient_LL handle` created by `IoTHubClient_LL_Create` along with the parameters `reportedStateCallback` and `userContextCallback`. ]*/
-                result = IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientInstance->IoTHubClientLLHandle, deviceTwinCallback, userContextCallback);
+                if ((iotHubClientInstance->Dispatcher != NULL) && (deviceTwinCallback != NULL))
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_07_050: [ While the callback dispatcher exists, IoTHubClient_SetDeviceTwinCallback shall pass to IoTHubClient_LL, instead of deviceTwinCallback (if not NULL), a callback that copies the payload and posts deviceTwinCallback to the dispatcher. ]*/
+                    iotHubClientInstance->DeviceTwinCallback = deviceTwinCallback;
+                    iotHubClientInstance->DeviceTwinUserContext = userContextCallback;
+                    result = IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientInstance->IoTHubClientLLHandle, DeviceTwinToDispatcher, iotHubClientInstance);
+                }
+                else
+                {
+                    result = IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientInstance->IoTHubClientLLHandle, deviceTwinCallback, userContextCallback);
+                }
                 if (result != IOTHUB_CLIENT_OK)
                 {
                     LogError("IoTHubClient_LL_SetDeviceTwinCallback failed");
                 }
+                else
+                {
+                    SignalWorkerThread(iotHubClientInstance);
+                }
             }
 
             Unlock(iotHubClientInstance->LockHandle);
@@ -798,6 +1649,8 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendReportedState(IOTHUB_CLIENT_HANDLE iotHubC
         }
         else
         {
+            DISPATCHED_CONFIRMATION* confirmation = NULL;
+
             /*Codes_SRS_IOTHUBCLIENT_10_015: [** If the transport connection is shared, the thread shall be started by calling `IoTHubTransport_StartWorkerThread`. ]*/
             if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
             {
@@ -805,14 +1658,35 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendReportedState(IOTHUB_CLIENT_HANDLE iotHubC
                 result = IOTHUB_CLIENT_ERROR;
                 LogError("Could not start worker thread");
             }
+            /*Codes_SRS_IOTHUBCLIENT_07_051: [ While the callback dispatcher exists, IoTHubClient_SendReportedState shall pass to IoTHubClient_LL, instead of reportedStateCallback (if not NULL), a callback that posts reportedStateCallback to the dispatcher; if allocating its context fails, IoTHubClient_SendReportedState shall return IOTHUB_CLIENT_ERROR. ]*/
+            else if ((iotHubClientInstance->Dispatcher != NULL) && (reportedStateCallback != NULL) &&
+                ((confirmation = CreateDispatchedConfirmation(iotHubClientInstance, NULL, reportedStateCallback, userContextCallback)) == NULL))
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("CreateDispatchedConfirmation failed");
+            }
             else
             {
+                if (confirmation != NULL)
+                {
+                    reportedStateCallback = ReportedStateToDispatcher;
+                    userContextCallback = confirmation;
+                }
+
                 /*Codes_SRS_IOTHUBCLIENT_10_017: [** `IoTHubClient_SendReportedState` shall call `IoTHubClient_LL_SendReportedState`, while passing the `IoTHubClient_LL handle` created by `IoTHubClient_LL_Create` along with the parameters `reportedState`, `size`, `reportedStateCallback`, and `userContextCallback`. ]*/
                 /*Codes_SRS_IOTHUBCLIENT_10_018: [** When `IoTHubClient_LL_SendReportedState` is called, `IoTHubClient_SendReportedState` shall return the result of `IoTHubClient_LL_SendReportedState`. **]*/
                 result = IoTHubClient_LL_SendReportedState(iotHubClientInstance->IoTHubClientLLHandle, reportedState, size, reportedStateCallback, userContextCallback);
                 if (result != IOTHUB_CLIENT_OK)
                 {
                     LogError("IoTHubClient_LL_SendReportedState failed");
+                    if (confirmation != NULL)
+                    {
+                        free(confirmation);
+                    }
+                }
+                else
+                {
+                    SignalWorkerThread(iotHubClientInstance);
                 }
             }
 
@@ -861,6 +1735,10 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetDeviceMethodCallback(IOTHUB_CLIENT_HANDLE i
                 {
                     LogError("IoTHubClient_LL_SetDeviceMethodCallback failed");
                 }
+                else
+                {
+                    SignalWorkerThread(iotHubClientInstance);
+                }
             }
 
             Unlock(iotHubClientInstance->LockHandle);
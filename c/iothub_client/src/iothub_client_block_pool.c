@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iothub_client_block_pool.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*the blocks are rounded up to this so that every block in the slab is suitably aligned for the records stored in it*/
+typedef union BLOCK_POOL_ALIGNMENT_TAG
+{
+    void* pointer;
+    uint64_t integer;
+    double real;
+} BLOCK_POOL_ALIGNMENT;
+
+/*a free block holds the link to the next free block*/
+typedef struct BLOCK_POOL_FREE_BLOCK_TAG
+{
+    struct BLOCK_POOL_FREE_BLOCK_TAG* next;
+} BLOCK_POOL_FREE_BLOCK;
+
+typedef struct IOTHUB_CLIENT_BLOCK_POOL_INSTANCE_TAG
+{
+    unsigned char* slab;
+    size_t slabSize;
+    size_t blockSize;
+    BLOCK_POOL_FREE_BLOCK* freeBlocks;
+    size_t fallbacksInUse;
+    bool isDestroyed;
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+} IOTHUB_CLIENT_BLOCK_POOL_INSTANCE;
+
+static void release_pool(IOTHUB_CLIENT_BLOCK_POOL_INSTANCE* pool)
+{
+    free(pool->slab);
+    free(pool);
+}
+
+IOTHUB_CLIENT_BLOCK_POOL_HANDLE IoTHubClient_BlockPool_Create(size_t blockSize, size_t capacity)
+{
+    IOTHUB_CLIENT_BLOCK_POOL_INSTANCE* result;
+    size_t roundedBlockSize = ((blockSize + sizeof(BLOCK_POOL_ALIGNMENT) - 1) / sizeof(BLOCK_POOL_ALIGNMENT)) * sizeof(BLOCK_POOL_ALIGNMENT);
+
+    /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_001: [ If blockSize or capacity is 0, or the pool would not fit in memory, IoTHubClient_BlockPool_Create shall return NULL. ]*/
+    if ((blockSize == 0) || (capacity == 0) || (roundedBlockSize < blockSize) || (capacity > SIZE_MAX / roundedBlockSize))
+    {
+        LogError("invalid arg size_t blockSize=%zu, size_t capacity=%zu", blockSize, capacity);
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_002: [ IoTHubClient_BlockPool_Create shall allocate memory for the pool and, in one allocation, for capacity blocks of blockSize bytes rounded up to the alignment of pointers, 64 bit integers and doubles. ]*/
+    else if ((result = (IOTHUB_CLIENT_BLOCK_POOL_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_BLOCK_POOL_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_003: [ If any allocation fails, IoTHubClient_BlockPool_Create shall free everything it allocated and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->slab = (unsigned char*)malloc(capacity * roundedBlockSize)) == NULL)
+    {
+        LogError("unable to malloc %zu blocks of %zu bytes", capacity, roundedBlockSize);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t i;
+
+        result->slabSize = capacity * roundedBlockSize;
+        result->blockSize = roundedBlockSize;
+        result->fallbacksInUse = 0;
+        result->isDestroyed = false;
+        result->statistics.capacity = capacity;
+        result->statistics.inUse = 0;
+        result->statistics.highWatermark = 0;
+        result->statistics.allocations = 0;
+        result->statistics.fallbacks = 0;
+
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_004: [ All the blocks shall initially be free; they shall be handed out in address order. ]*/
+        result->freeBlocks = NULL;
+        for (i = capacity; i > 0; i--)
+        {
+            BLOCK_POOL_FREE_BLOCK* block = (BLOCK_POOL_FREE_BLOCK*)(result->slab + (i - 1) * roundedBlockSize);
+            block->next = result->freeBlocks;
+            result->freeBlocks = block;
+        }
+    }
+    return result;
+}
+
+void IoTHubClient_BlockPool_Destroy(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_005: [ If poolHandle is NULL, IoTHubClient_BlockPool_Destroy shall do nothing. ]*/
+    if (poolHandle != NULL)
+    {
+        if ((poolHandle->statistics.inUse == 0) && (poolHandle->fallbacksInUse == 0))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_006: [ If no block of the pool is in use, including the blocks allocated with malloc once the pool was exhausted, IoTHubClient_BlockPool_Destroy shall free all the memory of the pool. ]*/
+            release_pool(poolHandle);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_007: [ Otherwise IoTHubClient_BlockPool_Destroy shall only mark the pool as destroyed; the memory shall be freed when the last block in use is freed. ]*/
+            poolHandle->isDestroyed = true;
+        }
+    }
+}
+
+void* IoTHubClient_BlockPool_Alloc(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle)
+{
+    void* result;
+    if ((poolHandle == NULL) || poolHandle->isDestroyed)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_008: [ If poolHandle is NULL or the pool has been destroyed, IoTHubClient_BlockPool_Alloc shall return NULL. ]*/
+        LogError("invalid arg IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle=%p", poolHandle);
+        result = NULL;
+    }
+    else if (poolHandle->freeBlocks != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_009: [ If the pool has a free block, IoTHubClient_BlockPool_Alloc shall remove it from the free blocks, update the inUse, highWatermark and allocations counters and return it. ]*/
+        result = poolHandle->freeBlocks;
+        poolHandle->freeBlocks = poolHandle->freeBlocks->next;
+        poolHandle->statistics.allocations++;
+        poolHandle->statistics.inUse++;
+        if (poolHandle->statistics.inUse > poolHandle->statistics.highWatermark)
+        {
+            poolHandle->statistics.highWatermark = poolHandle->statistics.inUse;
+        }
+    }
+    /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_010: [ Otherwise IoTHubClient_BlockPool_Alloc shall allocate the block with malloc and increment the fallbacks counter. ]*/
+    else if ((result = malloc(poolHandle->blockSize)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_011: [ If malloc fails, IoTHubClient_BlockPool_Alloc shall return NULL. ]*/
+        LogError("pool exhausted and unable to malloc");
+    }
+    else
+    {
+        poolHandle->statistics.fallbacks++;
+        poolHandle->fallbacksInUse++;
+    }
+    return result;
+}
+
+void IoTHubClient_BlockPool_Free(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle, void* block)
+{
+    if ((poolHandle == NULL) || (block == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_012: [ If poolHandle or block is NULL, IoTHubClient_BlockPool_Free shall do nothing. ]*/
+        LogError("invalid arg IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle=%p, void* block=%p", poolHandle, block);
+    }
+    else if (((unsigned char*)block >= poolHandle->slab) && ((unsigned char*)block < poolHandle->slab + poolHandle->slabSize))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_013: [ If block belongs to the pool, IoTHubClient_BlockPool_Free shall add it to the free blocks and decrement the inUse counter. ]*/
+        BLOCK_POOL_FREE_BLOCK* freeBlock = (BLOCK_POOL_FREE_BLOCK*)block;
+        freeBlock->next = poolHandle->freeBlocks;
+        poolHandle->freeBlocks = freeBlock;
+        poolHandle->statistics.inUse--;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_015: [ Otherwise block was allocated with malloc and IoTHubClient_BlockPool_Free shall free it. ]*/
+        free(block);
+        poolHandle->fallbacksInUse--;
+    }
+
+    if ((poolHandle != NULL) && (block != NULL) && poolHandle->isDestroyed && (poolHandle->statistics.inUse == 0) && (poolHandle->fallbacksInUse == 0))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_014: [ If the pool has been destroyed and block was the last block in use, IoTHubClient_BlockPool_Free shall free all the memory of the pool. ]*/
+        release_pool(poolHandle);
+    }
+}
+
+int IoTHubClient_BlockPool_GetStatistics(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle, IOTHUB_CLIENT_BLOCK_POOL_STATISTICS* statistics)
+{
+    int result;
+    if ((poolHandle == NULL) || (statistics == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_016: [ If poolHandle or statistics is NULL, IoTHubClient_BlockPool_GetStatistics shall return a non-zero value. ]*/
+        LogError("invalid arg IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle=%p, IOTHUB_CLIENT_BLOCK_POOL_STATISTICS* statistics=%p", poolHandle, statistics);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_BLOCKPOOL_07_017: [ IoTHubClient_BlockPool_GetStatistics shall copy the counters of the pool to statistics and return 0. ]*/
+        *statistics = poolHandle->statistics;
+        result = 0;
+    }
+    return result;
+}
@@ -0,0 +1,228 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+#include "iothub_client_dispatcher.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*the thread is woken up by every post, the timeout only bounds the wait if a wake up is lost*/
+#define DISPATCHER_IDLE_WAIT_TIME 1000
+
+typedef struct DISPATCHER_ITEM_TAG
+{
+    struct DISPATCHER_ITEM_TAG* next;
+    IOTHUB_CLIENT_DISPATCHER_FUNCTION function;
+    void* context;
+} DISPATCHER_ITEM;
+
+typedef struct IOTHUB_CLIENT_DISPATCHER_INSTANCE_TAG
+{
+    LOCK_HANDLE lockHandle;
+    COND_HANDLE itemCondition; /*posted when an item is added or the thread has to stop*/
+    THREAD_HANDLE threadHandle;
+    DISPATCHER_ITEM* head; /*oldest item*/
+    DISPATCHER_ITEM* tail; /*newest item*/
+    sig_atomic_t stopThread;
+} IOTHUB_CLIENT_DISPATCHER_INSTANCE;
+
+/*used by unittests only*/
+const size_t IoTHubClient_Dispatcher_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_DISPATCHER_INSTANCE, stopThread);
+
+static int dispatcher_thread(void* threadArgument)
+{
+    IOTHUB_CLIENT_DISPATCHER_INSTANCE* dispatcher = (IOTHUB_CLIENT_DISPATCHER_INSTANCE*)threadArgument;
+    bool isStopped = false;
+
+    while (!isStopped)
+    {
+        DISPATCHER_ITEM* items = NULL;
+
+        if (Lock(dispatcher->lockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            (void)ThreadAPI_Sleep(1);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_012: [ While no item has been posted, the thread shall wait on the item condition by calling Condition_Wait. ]*/
+            if ((dispatcher->head == NULL) && !dispatcher->stopThread)
+            {
+                if (Condition_Wait(dispatcher->itemCondition, dispatcher->lockHandle, DISPATCHER_IDLE_WAIT_TIME) == COND_ERROR)
+                {
+                    LogError("Condition_Wait failed");
+                }
+            }
+
+            /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_013: [ The thread shall take all the posted items under the lock and call their functions, in the order they were posted, without holding the lock. ]*/
+            items = dispatcher->head;
+            dispatcher->head = NULL;
+            dispatcher->tail = NULL;
+
+            /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_014: [ The thread shall exit once IoTHubClient_Dispatcher_Destroy has been called and no item is left. ]*/
+            isStopped = ((items == NULL) && dispatcher->stopThread);
+            (void)Unlock(dispatcher->lockHandle);
+        }
+
+        while (items != NULL)
+        {
+            DISPATCHER_ITEM* next = items->next;
+            items->function(items->context);
+            free(items);
+            items = next;
+        }
+    }
+
+    return 0;
+}
+
+IOTHUB_CLIENT_DISPATCHER_HANDLE IoTHubClient_Dispatcher_Create(void)
+{
+    IOTHUB_CLIENT_DISPATCHER_INSTANCE* result;
+
+    /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_001: [ IoTHubClient_Dispatcher_Create shall allocate memory for the dispatcher, create its lock by calling Lock_Init and its item condition by calling Condition_Init. ]*/
+    if ((result = (IOTHUB_CLIENT_DISPATCHER_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_DISPATCHER_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_002: [ If any of the resources cannot be created, IoTHubClient_Dispatcher_Create shall free everything it created and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        LogError("Lock_Init failed");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->itemCondition = Condition_Init()) == NULL)
+    {
+        LogError("Condition_Init failed");
+        Lock_Deinit(result->lockHandle);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->head = NULL;
+        result->tail = NULL;
+        result->stopThread = 0;
+
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_003: [ IoTHubClient_Dispatcher_Create shall start the dispatcher thread by calling ThreadAPI_Create. ]*/
+        if (ThreadAPI_Create(&result->threadHandle, dispatcher_thread, result) != THREADAPI_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_004: [ If starting the thread fails, IoTHubClient_Dispatcher_Create shall free all resources and return NULL. ]*/
+            LogError("ThreadAPI_Create failed");
+            Condition_Deinit(result->itemCondition);
+            Lock_Deinit(result->lockHandle);
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void IoTHubClient_Dispatcher_Destroy(IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcherHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_005: [ If dispatcherHandle is NULL, IoTHubClient_Dispatcher_Destroy shall do nothing. ]*/
+    if (dispatcherHandle != NULL)
+    {
+        int res;
+
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_006: [ IoTHubClient_Dispatcher_Destroy shall signal the thread to end once it has run the posted items and join it. ]*/
+        if (Lock(dispatcherHandle->lockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock - will still attempt to end the thread without thread safety");
+            dispatcherHandle->stopThread = 1;
+        }
+        else
+        {
+            dispatcherHandle->stopThread = 1;
+            if (Condition_Post(dispatcherHandle->itemCondition) != COND_OK)
+            {
+                LogError("Condition_Post failed");
+            }
+            (void)Unlock(dispatcherHandle->lockHandle);
+        }
+
+        if (ThreadAPI_Join(dispatcherHandle->threadHandle, &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed");
+        }
+
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_007: [ IoTHubClient_Dispatcher_Destroy shall free the items that were not run and all other resources. ]*/
+        while (dispatcherHandle->head != NULL)
+        {
+            DISPATCHER_ITEM* next = dispatcherHandle->head->next;
+            LogError("destroying a dispatcher that still has items");
+            free(dispatcherHandle->head);
+            dispatcherHandle->head = next;
+        }
+        Condition_Deinit(dispatcherHandle->itemCondition);
+        Lock_Deinit(dispatcherHandle->lockHandle);
+        free(dispatcherHandle);
+    }
+}
+
+int IoTHubClient_Dispatcher_Post(IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcherHandle, IOTHUB_CLIENT_DISPATCHER_FUNCTION function, void* context)
+{
+    int result;
+    DISPATCHER_ITEM* item;
+
+    if ((dispatcherHandle == NULL) || (function == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_008: [ If dispatcherHandle or function is NULL, IoTHubClient_Dispatcher_Post shall fail and return a non-zero value. ]*/
+        LogError("invalid arg dispatcherHandle=%p, function=%p", dispatcherHandle, function);
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_009: [ IoTHubClient_Dispatcher_Post shall allocate an item holding function and context. ]*/
+    else if ((item = (DISPATCHER_ITEM*)malloc(sizeof(DISPATCHER_ITEM))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_010: [ If any operation fails, IoTHubClient_Dispatcher_Post shall fail and return a non-zero value. ]*/
+        LogError("unable to malloc");
+        result = __LINE__;
+    }
+    else
+    {
+        item->next = NULL;
+        item->function = function;
+        item->context = context;
+
+        if (Lock(dispatcherHandle->lockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            free(item);
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_DISPATCHER_07_011: [ IoTHubClient_Dispatcher_Post shall add the item after the items already posted and wake the thread up by calling Condition_Post, under the dispatcher lock, and return 0. ]*/
+            if (dispatcherHandle->tail == NULL)
+            {
+                dispatcherHandle->head = item;
+            }
+            else
+            {
+                dispatcherHandle->tail->next = item;
+            }
+            dispatcherHandle->tail = item;
+
+            if (Condition_Post(dispatcherHandle->itemCondition) != COND_OK)
+            {
+                LogError("Condition_Post failed");
+            }
+            (void)Unlock(dispatcherHandle->lockHandle);
+            result = 0;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,191 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stddef.h>
+#include "iothub_client_ingress_queue.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*the queue is the classic linked list with a stub node: producers atomically swap the head and then link the previous head to
+the new node, the (single) consumer follows the next pointers from the tail. When the compiler does not provide an atomic
+pointer exchange, the same operations are done under a lock that only guards the queue itself*/
+#if defined(_MSC_VER) && !defined(_WIN32_WCE)
+#include <windows.h>
+#define INGRESS_QUEUE_LOCK_FREE
+#define EXCHANGE_POINTER(target, value) InterlockedExchangePointer((PVOID volatile*)(target), (value))
+#define LOAD_POINTER(source) InterlockedCompareExchangePointer((PVOID volatile*)(source), NULL, NULL)
+#define STORE_POINTER(target, value) (void)InterlockedExchangePointer((PVOID volatile*)(target), (value))
+#elif defined(__GNUC__) && defined(__ATOMIC_ACQ_REL)
+#define INGRESS_QUEUE_LOCK_FREE
+#define EXCHANGE_POINTER(target, value) __atomic_exchange_n((target), (value), __ATOMIC_ACQ_REL)
+#define LOAD_POINTER(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define STORE_POINTER(target, value) __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#else
+static void* exchange_pointer(void** target, void* value)
+{
+    void* result = *target;
+    *target = value;
+    return result;
+}
+#define EXCHANGE_POINTER(target, value) exchange_pointer((void**)(target), (value))
+#define LOAD_POINTER(source) (*(source))
+#define STORE_POINTER(target, value) (*(target) = (value))
+#endif
+
+typedef struct INGRESS_QUEUE_NODE_TAG
+{
+    struct INGRESS_QUEUE_NODE_TAG* next;
+    void* item;
+} INGRESS_QUEUE_NODE;
+
+typedef struct IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE_TAG
+{
+    INGRESS_QUEUE_NODE* head; /*most recently pushed node, written by the producers*/
+    INGRESS_QUEUE_NODE* tail; /*stub node whose next is the oldest item, only touched by the consumer*/
+#ifndef INGRESS_QUEUE_LOCK_FREE
+    LOCK_HANDLE lockHandle;
+#endif
+} IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE;
+
+IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE IoTHubClient_IngressQueue_Create(void)
+{
+    /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_001: [ IoTHubClient_IngressQueue_Create shall allocate memory for the queue and for its stub node. ]*/
+    IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE* result = (IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_INGRESS_QUEUE_INSTANCE));
+    if (result == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_002: [ If any allocation fails, IoTHubClient_IngressQueue_Create shall free everything it allocated and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->tail = (INGRESS_QUEUE_NODE*)malloc(sizeof(INGRESS_QUEUE_NODE))) == NULL)
+    {
+        LogError("unable to malloc");
+        free(result);
+        result = NULL;
+    }
+#ifndef INGRESS_QUEUE_LOCK_FREE
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        LogError("Lock_Init failed");
+        free(result->tail);
+        free(result);
+        result = NULL;
+    }
+#endif
+    else
+    {
+        result->tail->next = NULL;
+        result->tail->item = NULL;
+        result->head = result->tail;
+    }
+    return result;
+}
+
+void IoTHubClient_IngressQueue_Destroy(IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queueHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_003: [ If queueHandle is NULL, IoTHubClient_IngressQueue_Destroy shall do nothing. ]*/
+    if (queueHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_004: [ IoTHubClient_IngressQueue_Destroy shall free all the nodes of the queue and the queue itself, but not the items. ]*/
+        INGRESS_QUEUE_NODE* node = queueHandle->tail;
+        while (node != NULL)
+        {
+            INGRESS_QUEUE_NODE* next = node->next;
+            free(node);
+            node = next;
+        }
+#ifndef INGRESS_QUEUE_LOCK_FREE
+        Lock_Deinit(queueHandle->lockHandle);
+#endif
+        free(queueHandle);
+    }
+}
+
+int IoTHubClient_IngressQueue_Push(IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queueHandle, void* item)
+{
+    int result;
+    INGRESS_QUEUE_NODE* node;
+
+    if ((queueHandle == NULL) || (item == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_005: [ If queueHandle or item is NULL, IoTHubClient_IngressQueue_Push shall fail and return a non-zero value. ]*/
+        LogError("invalid arg IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queueHandle=%p, void* item=%p", queueHandle, item);
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_006: [ IoTHubClient_IngressQueue_Push shall allocate a node holding item. ]*/
+    else if ((node = (INGRESS_QUEUE_NODE*)malloc(sizeof(INGRESS_QUEUE_NODE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_007: [ If any operation fails, IoTHubClient_IngressQueue_Push shall fail and return a non-zero value. ]*/
+        LogError("unable to malloc");
+        result = __LINE__;
+    }
+#ifndef INGRESS_QUEUE_LOCK_FREE
+    else if (Lock(queueHandle->lockHandle) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        free(node);
+        result = __LINE__;
+    }
+#endif
+    else
+    {
+        INGRESS_QUEUE_NODE* previous;
+        node->next = NULL;
+        node->item = item;
+
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_008: [ IoTHubClient_IngressQueue_Push shall make the node the new head of the queue by atomically exchanging the head pointer, then link the previous head to it, and return 0. ]*/
+        previous = (INGRESS_QUEUE_NODE*)EXCHANGE_POINTER(&queueHandle->head, node);
+        STORE_POINTER(&previous->next, node);
+#ifndef INGRESS_QUEUE_LOCK_FREE
+        (void)Unlock(queueHandle->lockHandle);
+#endif
+        result = 0;
+    }
+    return result;
+}
+
+void* IoTHubClient_IngressQueue_Pop(IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queueHandle)
+{
+    void* result;
+
+    if (queueHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_009: [ If queueHandle is NULL, IoTHubClient_IngressQueue_Pop shall return NULL. ]*/
+        LogError("invalid arg (NULL)");
+        result = NULL;
+    }
+#ifndef INGRESS_QUEUE_LOCK_FREE
+    else if (Lock(queueHandle->lockHandle) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        result = NULL;
+    }
+#endif
+    else
+    {
+        INGRESS_QUEUE_NODE* stub = queueHandle->tail;
+        INGRESS_QUEUE_NODE* next = (INGRESS_QUEUE_NODE*)LOAD_POINTER(&stub->next);
+        if (next == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_010: [ If there is no completely pushed item in the queue, IoTHubClient_IngressQueue_Pop shall return NULL. ]*/
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_011: [ Otherwise IoTHubClient_IngressQueue_Pop shall return the oldest item, make its node the new stub node and free the previous stub node. ]*/
+            result = next->item;
+            next->item = NULL;
+            queueHandle->tail = next;
+            free(stub);
+        }
+#ifndef INGRESS_QUEUE_LOCK_FREE
+        (void)Unlock(queueHandle->lockHandle);
+#endif
+    }
+    return result;
+}
@@ -15,6 +15,9 @@
 
 #include "iothub_client_ll.h"
 #include "iothub_client_private.h"
+#include "iothub_client_options.h"
+#include "iothub_client_block_pool.h"
+#include "iothub_client_outbox.h"
 #include "iothub_client_version.h"
 #include "iothub_transport_ll.h"
 #include <stdint.h>
@@ -25,6 +28,9 @@
 
 #define LOG_ERROR_RESULT LogError("result = %s", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
 #define INDEFINITE_TIME ((time_t)(-1))
+#define OUTBOX_SEGMENT_SIZE (4 * 1024 * 1024)
+#define OUTBOX_SEND_WINDOW 16 /*events of the outbox kept in memory in waitingToSend*/
+#define MESSAGE_PRIORITY_COUNT (IOTHUB_MESSAGE_PRIORITY_HIGH + 1)
 
 DEFINE_ENUM_STRINGS(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
 DEFINE_ENUM_STRINGS(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CONFIRMATION_RESULT_VALUES);
@@ -45,6 +51,8 @@ typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG
     time_t lastMessageReceiveTime;
     TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
     uint64_t currentMessageTimeout;
+    uint64_t latestMessageTimeout; /*greatest ms_timesOutAfter given to a record in waitingToSend so far, 0 if none was*/
+    bool messageTimeoutsInOrder; /*true while the records in waitingToSend have nondecreasing non-zero ms_timesOutAfter*/
     uint64_t current_device_twin_timeout;
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
     void* deviceTwinContextCallback;
@@ -57,6 +65,16 @@ typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG
 #endif
     uint32_t data_msg_id;
     bool complete_twin_update_encountered;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE messagePool; /*where the IOTHUB_MESSAGE_LIST records come from, NULL means malloc*/
+    size_t queuedMessages; /*events accepted by SendEventAsync whose confirmation callback has not been called yet*/
+    size_t queuedBytes; /*payload bytes of the queuedMessages that were measured*/
+    size_t queuedMessagesByPriority[MESSAGE_PRIORITY_COUNT]; /*queuedMessages split by IOTHUB_MESSAGE_PRIORITY*/
+    size_t queuedBytesByPriority[MESSAGE_PRIORITY_COUNT]; /*queuedBytes split by IOTHUB_MESSAGE_PRIORITY*/
+    size_t maxQueuedMessages; /*0 means no limit*/
+    size_t maxQueuedBytes; /*0 means no limit*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY queueFullPolicy;
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox; /*NULL unless OPTION_OUTBOX_DIRECTORY has been set*/
+    DLIST_ENTRY outboxBacklog; /*records of the events in the outbox that are not in waitingToSend yet, only initialized with the outbox*/
 }IOTHUB_CLIENT_LL_HANDLE_DATA;
 
 static const char HOSTNAME_TOKEN[] = "HostName";
@@ -120,6 +138,405 @@ static IOTHUB_DEVICE_TWIN* dev_twin_data_create(IOTHUB_CLIENT_LL_HANDLE_DATA* ha
     return result;
 }
 
+static IOTHUB_MESSAGE_LIST* create_message_list_entry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    IOTHUB_MESSAGE_LIST* result;
+    if (handleData->messagePool == NULL)
+    {
+        result = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_025: [ If the message pool has been created, IoTHubClient_LL_SendEventAsync shall allocate the waitingToSend record by calling IoTHubClient_BlockPool_Alloc. ]*/
+        result = (IOTHUB_MESSAGE_LIST*)IoTHubClient_BlockPool_Alloc(handleData->messagePool);
+    }
+
+    if (result != NULL)
+    {
+        result->pool = handleData->messagePool;
+        result->owner = handleData;
+        result->queuedSize = 0;
+        result->outboxRecordId = 0;
+        result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    return result;
+}
+
+static void destroy_message_list_entry(IOTHUB_MESSAGE_LIST* entry)
+{
+    if (entry->pool == NULL)
+    {
+        free(entry);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_026: [ A record allocated from the message pool shall be returned to it by calling IoTHubClient_BlockPool_Free. ]*/
+        IoTHubClient_BlockPool_Free(entry->pool, entry);
+    }
+}
+
+/*Codes_SRS_IOTHUBCLIENT_LL_07_046: [ A message shall stop counting against the limits once its confirmation callback has been called. ]*/
+static void release_queued_message(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* entry)
+{
+    if (handleData->queuedMessages > 0)
+    {
+        handleData->queuedMessages--;
+        handleData->queuedBytes -= entry->queuedSize;
+        handleData->queuedMessagesByPriority[entry->priority]--;
+        handleData->queuedBytesByPriority[entry->priority] -= entry->queuedSize;
+    }
+}
+
+/*calls the confirmation callback of a record that is done with and frees the record*/
+static void complete_message_list_entry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* entry, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    release_queued_message(handleData, entry);
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
+    if (entry->callback != NULL)
+    {
+        entry->callback(result, entry->context);
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_056: [ Once the confirmation callback of an event of the outbox has been called with any result but IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, the event shall be completed by calling IoTHubClient_Outbox_Complete. ]*/
+    if ((handleData->outbox != NULL) &&
+        (result != IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY) &&
+        (IoTHubClient_Outbox_Complete(handleData->outbox, entry->outboxRecordId) != 0))
+    {
+        LogError("unable to IoTHubClient_Outbox_Complete, the event will be sent again by the next outbox");
+    }
+    /*the records of the outbox backlog have no message in memory*/
+    if (entry->messageHandle != NULL)
+    {
+        IoTHubMessage_Destroy(entry->messageHandle);
+    }
+    destroy_message_list_entry(entry);
+}
+
+static void queue_message_list_entry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, PDLIST_ENTRY messages, IOTHUB_MESSAGE_LIST* entry, size_t messageSize, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    entry->callback = eventConfirmationCallback;
+    entry->context = userContextCallback;
+    entry->queuedSize = messageSize;
+    DList_InsertTailList(messages, &(entry->entry));
+    handleData->queuedMessages++;
+    handleData->queuedBytes += messageSize;
+    handleData->queuedMessagesByPriority[entry->priority]++;
+    handleData->queuedBytesByPriority[entry->priority] += messageSize;
+}
+
+static bool is_send_queue_limited(const IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    return (handleData->maxQueuedMessages != 0) || (handleData->maxQueuedBytes != 0);
+}
+
+static bool is_send_queue_full(const IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    bool result;
+    if ((handleData->maxQueuedMessages != 0) && (handleData->queuedMessages >= handleData->maxQueuedMessages))
+    {
+        result = true;
+    }
+    else if (handleData->maxQueuedBytes != 0)
+    {
+        /*the limit can be lowered below what is already queued*/
+        result = (handleData->queuedBytes > handleData->maxQueuedBytes) || (messageSize > handleData->maxQueuedBytes - handleData->queuedBytes);
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
+static size_t get_message_size(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    size_t result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        const unsigned char* buffer;
+        if (IoTHubMessage_GetByteArray(messageHandle, &buffer, &result) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to IoTHubMessage_GetByteArray, the message is counted as empty");
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        result = (text == NULL) ? 0 : strlen(text);
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*returns the record before which a record of that priority goes in waitingToSend: after every record of the same or a higher priority*/
+static PDLIST_ENTRY get_priority_insertion_point(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    /*walking from the tail only passes over the records of lower priority, none for the lowest priority used*/
+    PDLIST_ENTRY result = &(handleData->waitingToSend);
+    while ((result->Blink != &(handleData->waitingToSend)) &&
+        (containingRecord(result->Blink, IOTHUB_MESSAGE_LIST, entry)->priority < priority))
+    {
+        result = result->Blink;
+    }
+    return result;
+}
+
+/*for a record added at the tail of the outbox backlog, the last of the records waiting to be sent*/
+static void track_appended_timeout(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* entry)
+{
+    if (entry->ms_timesOutAfter != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_036: [ While every message has been given a timeout no earlier than the timeouts of the messages added before it, the messages in waitingToSend shall be considered sorted by timeout. ]*/
+        if (entry->ms_timesOutAfter < handleData->latestMessageTimeout)
+        {
+            handleData->messageTimeoutsInOrder = false;
+        }
+        else
+        {
+            handleData->latestMessageTimeout = entry->ms_timesOutAfter;
+        }
+    }
+}
+
+/*for a record inserted anywhere in waitingToSend, only the nearest records with a timeout on either side can break the order*/
+static void track_inserted_timeout(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* entry)
+{
+    if (entry->ms_timesOutAfter != 0)
+    {
+        if (entry->ms_timesOutAfter > handleData->latestMessageTimeout)
+        {
+            handleData->latestMessageTimeout = entry->ms_timesOutAfter;
+        }
+
+        if (handleData->messageTimeoutsInOrder)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_069: [ A record added to waitingToSend shall keep the messages sorted by timeout if its timeout is no earlier than the timeout of the nearest record before it and no later than the timeout of the nearest record after it, records without a timeout being skipped. ]*/
+            PDLIST_ENTRY neighbour = entry->entry.Blink;
+            while ((neighbour != &(handleData->waitingToSend)) && (containingRecord(neighbour, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter == 0))
+            {
+                neighbour = neighbour->Blink;
+            }
+            if ((neighbour != &(handleData->waitingToSend)) && (containingRecord(neighbour, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter > entry->ms_timesOutAfter))
+            {
+                handleData->messageTimeoutsInOrder = false;
+            }
+            else
+            {
+                neighbour = entry->entry.Flink;
+                while ((neighbour != &(handleData->waitingToSend)) && (containingRecord(neighbour, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter == 0))
+                {
+                    neighbour = neighbour->Flink;
+                }
+                if ((neighbour != &(handleData->waitingToSend)) && (containingRecord(neighbour, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter < entry->ms_timesOutAfter))
+                {
+                    handleData->messageTimeoutsInOrder = false;
+                }
+            }
+        }
+    }
+}
+
+static IOTHUB_MESSAGE_LIST* remove_oldest_unsent_message(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    IOTHUB_MESSAGE_LIST* result;
+    PDLIST_ENTRY oldest = handleData->waitingToSend.Flink;
+    if (oldest != &(handleData->waitingToSend))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_066: [ IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST shall drop the oldest events of the lowest priority in waitingToSend first. ]*/
+        IOTHUB_MESSAGE_PRIORITY lowest = containingRecord(handleData->waitingToSend.Blink, IOTHUB_MESSAGE_LIST, entry)->priority;
+        while (containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry)->priority != lowest)
+        {
+            oldest = oldest->Flink;
+        }
+        (void)DList_RemoveEntryList(oldest);
+        result = containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_055: [ Once waitingToSend is empty, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST shall drop the oldest events of the outbox backlog. ]*/
+    else if ((handleData->outbox != NULL) &&
+        ((oldest = DList_RemoveHeadList(&(handleData->outboxBacklog))) != &(handleData->outboxBacklog)))
+    {
+        result = containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+    }
+    else
+    {
+        result = NULL;
+    }
+    return result;
+}
+
+/*returns true if, once done, the message fits in the send queue*/
+static bool drop_oldest_messages(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    bool result;
+    if ((handleData->maxQueuedBytes != 0) && (messageSize > handleData->maxQueuedBytes))
+    {
+        /*dropping everything would not make room*/
+        result = false;
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* oldestEntry;
+        /*only the messages not given to the transport yet can be dropped, the transport owns the others until they are confirmed*/
+        while (is_send_queue_full(handleData, messageSize) &&
+            ((oldestEntry = remove_oldest_unsent_message(handleData)) != NULL))
+        {
+            complete_message_list_entry(handleData, oldestEntry, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED);
+        }
+        result = !is_send_queue_full(handleData, messageSize);
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT set_message_pool(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t capacity)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (capacity == 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_022: [ If the value of OPTION_MESSAGE_POOL_SIZE is 0, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("the message pool size cannot be 0");
+    }
+    else if (handleData->messagePool != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_023: [ If the message pool has already been created, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the message pool can only be set once");
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_021: [ If optionName is OPTION_MESSAGE_POOL_SIZE, IoTHubClient_LL_SetOption shall create a pool of that many waitingToSend records by calling IoTHubClient_BlockPool_Create. ]*/
+    else if ((handleData->messagePool = IoTHubClient_BlockPool_Create(sizeof(IOTHUB_MESSAGE_LIST), capacity)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_024: [ If IoTHubClient_BlockPool_Create fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("unable to IoTHubClient_BlockPool_Create");
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    return result;
+}
+
+static void add_outbox_backlog_entry(uint64_t recordId, void* context)
+{
+    IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)context;
+    IOTHUB_MESSAGE_LIST* newEntry = create_message_list_entry(handleData);
+    if (newEntry == NULL)
+    {
+        LogError("unable to create a record for a pending event of the outbox, it will be sent by the next outbox");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_051: [ Every event left pending in the outbox shall be added to the outbox backlog, in the order it was sent, with no confirmation callback and no timeout. ]*/
+        newEntry->messageHandle = NULL;
+        newEntry->ms_timesOutAfter = 0;
+        newEntry->outboxRecordId = recordId;
+        queue_message_list_entry(handleData, &(handleData->outboxBacklog), newEntry, 0, NULL, NULL);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT set_outbox(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const char* directory)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (handleData->outbox != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_050: [ If the outbox has already been created, or any event has been sent and not confirmed yet, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the outbox can only be set once");
+    }
+    else if (handleData->queuedMessages != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_050: [ If the outbox has already been created, or any event has been sent and not confirmed yet, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the outbox has to be set before any event is sent");
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_049: [ If optionName is OPTION_OUTBOX_DIRECTORY, IoTHubClient_LL_SetOption shall create an outbox in the directory value, a const char*, by calling IoTHubClient_Outbox_Create and get its pending events by calling IoTHubClient_Outbox_ForEachPending. ]*/
+    else if ((handleData->outbox = IoTHubClient_Outbox_Create(directory, OUTBOX_SEGMENT_SIZE)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_052: [ If IoTHubClient_Outbox_Create or IoTHubClient_Outbox_ForEachPending fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR and no outbox shall be used. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("unable to IoTHubClient_Outbox_Create");
+    }
+    else
+    {
+        DList_InitializeListHead(&(handleData->outboxBacklog));
+        if (IoTHubClient_Outbox_ForEachPending(handleData->outbox, add_outbox_backlog_entry, handleData) != 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_052: [ If IoTHubClient_Outbox_Create or IoTHubClient_Outbox_ForEachPending fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR and no outbox shall be used. ]*/
+            PDLIST_ENTRY replayed;
+            while ((replayed = DList_RemoveHeadList(&(handleData->outboxBacklog))) != &(handleData->outboxBacklog))
+            {
+                IOTHUB_MESSAGE_LIST* replayedEntry = containingRecord(replayed, IOTHUB_MESSAGE_LIST, entry);
+                release_queued_message(handleData, replayedEntry);
+                destroy_message_list_entry(replayedEntry);
+            }
+            IoTHubClient_Outbox_Destroy(handleData->outbox);
+            handleData->outbox = NULL;
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("unable to IoTHubClient_Outbox_ForEachPending");
+        }
+        else
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    return result;
+}
+
+/*moves the oldest events of the outbox backlog to waitingToSend, so that the transport has up to OUTBOX_SEND_WINDOW of them to send*/
+static void refill_from_outbox(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    size_t inMemory = 0;
+    PDLIST_ENTRY current = handleData->waitingToSend.Flink;
+    PDLIST_ENTRY oldest;
+    while ((current != &(handleData->waitingToSend)) && (inMemory < OUTBOX_SEND_WINDOW))
+    {
+        inMemory++;
+        current = current->Flink;
+    }
+
+    while ((inMemory < OUTBOX_SEND_WINDOW) &&
+        ((oldest = DList_RemoveHeadList(&(handleData->outboxBacklog))) != &(handleData->outboxBacklog)))
+    {
+        IOTHUB_MESSAGE_LIST* oldestEntry = containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+        IOTHUB_CLIENT_OUTBOX_READ_RESULT readResult = IoTHubClient_Outbox_Read(handleData->outbox, oldestEntry->outboxRecordId, &(oldestEntry->messageHandle));
+        if (readResult == IOTHUB_CLIENT_OUTBOX_READ_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_071: [ The record shall be added to waitingToSend like the records of IoTHubClient_LL_SendEventAsync, with the priority of the message read back obtained by calling IoTHubMessage_GetPriority. ]*/
+            IOTHUB_MESSAGE_PRIORITY priority = IoTHubMessage_GetPriority(oldestEntry->messageHandle);
+            if (priority != oldestEntry->priority)
+            {
+                /*the record was counted with the priority it was appended with*/
+                handleData->queuedMessagesByPriority[oldestEntry->priority]--;
+                handleData->queuedBytesByPriority[oldestEntry->priority] -= oldestEntry->queuedSize;
+                handleData->queuedMessagesByPriority[priority]++;
+                handleData->queuedBytesByPriority[priority] += oldestEntry->queuedSize;
+                oldestEntry->priority = priority;
+            }
+            DList_InsertTailList(get_priority_insertion_point(handleData, priority), &(oldestEntry->entry));
+            track_inserted_timeout(handleData, oldestEntry);
+            inMemory++;
+        }
+        else if (readResult == IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_062: [ If IoTHubClient_Outbox_Read returns IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD, the confirmation callback of the event shall be called with IOTHUB_CLIENT_CONFIRMATION_ERROR. ]*/
+            LogError("the record of the event in the outbox is not valid, the event is dropped");
+            complete_message_list_entry(handleData, oldestEntry, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_068: [ If IoTHubClient_Outbox_Read returns IOTHUB_CLIENT_OUTBOX_READ_ERROR, the record shall be put back at the head of the outbox backlog and read again by the next call to IoTHubClient_LL_DoWork. ]*/
+            LogError("unable to IoTHubClient_Outbox_Read, the event is read again later");
+            oldestEntry->messageHandle = NULL;
+            DList_InsertHeadList(&(handleData->outboxBacklog), &(oldestEntry->entry));
+            break;
+        }
+    }
+}
+
 IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateFromConnectionString(const char* connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
 {
     IOTHUB_CLIENT_LL_HANDLE result;
@@ -478,6 +895,17 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
                     handleData->conStatusCallback = NULL;
                     handleData->conStatusUserContextCallback = NULL;
                     handleData->lastMessageReceiveTime = INDEFINITE_TIME;
+                    handleData->messagePool = NULL;
+                    handleData->latestMessageTimeout = 0;
+                    handleData->messageTimeoutsInOrder = true;
+                    handleData->queuedMessages = 0;
+                    handleData->queuedBytes = 0;
+                    (void)memset(handleData->queuedMessagesByPriority, 0, sizeof(handleData->queuedMessagesByPriority));
+                    (void)memset(handleData->queuedBytesByPriority, 0, sizeof(handleData->queuedBytesByPriority));
+                    handleData->maxQueuedMessages = 0;
+                    handleData->maxQueuedBytes = 0;
+                    handleData->queueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                    handleData->outbox = NULL;
 
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_006: [IoTHubClient_LL_Create shall populate a structure of type IOTHUBTRANSPORT_CONFIG with the information from config parameter and the previous DLIST and shall pass that to the underlying layer _Create function.]*/
                     lowerLayerConfig.upperConfig = config;
@@ -638,6 +1066,17 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
                             handleData->lastMessageReceiveTime = INDEFINITE_TIME;
                             handleData->data_msg_id = 1;
                             handleData->complete_twin_update_encountered = false;
+                            handleData->messagePool = NULL;
+                            handleData->latestMessageTimeout = 0;
+                            handleData->messageTimeoutsInOrder = true;
+                            handleData->queuedMessages = 0;
+                            handleData->queuedBytes = 0;
+                            (void)memset(handleData->queuedMessagesByPriority, 0, sizeof(handleData->queuedMessagesByPriority));
+                            (void)memset(handleData->queuedBytesByPriority, 0, sizeof(handleData->queuedBytesByPriority));
+                            handleData->maxQueuedMessages = 0;
+                            handleData->maxQueuedBytes = 0;
+                            handleData->queueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                            handleData->outbox = NULL;
 
                             IOTHUB_DEVICE_CONFIG deviceConfig;
 
@@ -698,12 +1137,18 @@ void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
         {
             IOTHUB_MESSAGE_LIST* temp = containingRecord(unsend, IOTHUB_MESSAGE_LIST, entry);
             /*Codes_SRS_IOTHUBCLIENT_LL_02_033: [Otherwise, IoTHubClient_LL_Destroy shall complete all the event message callbacks that are in the waitingToSend list with the result IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY.] */
-            if (temp->callback != NULL)
+            complete_message_list_entry(handleData, temp, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+        }
+
+        if (handleData->outbox != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_059: [ IoTHubClient_LL_Destroy shall complete the callbacks of the outbox backlog with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY and destroy the outbox by calling IoTHubClient_Outbox_Destroy, leaving the events that were not confirmed in it. ]*/
+            while ((unsend = DList_RemoveHeadList(&(handleData->outboxBacklog))) != &(handleData->outboxBacklog))
             {
-                temp->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, temp->context);
+                IOTHUB_MESSAGE_LIST* temp = containingRecord(unsend, IOTHUB_MESSAGE_LIST, entry);
+                complete_message_list_entry(handleData, temp, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
             }
-            IoTHubMessage_Destroy(temp->messageHandle);
-            free(temp);
+            IoTHubClient_Outbox_Destroy(handleData->outbox);
         }
 
         /* Codes_SRS_IOTHUBCLIENT_LL_07_007: [ IoTHubClient_LL_Destroy shall iterate the device twin queues and destroy any remaining items. ] */
@@ -720,6 +1165,11 @@ void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 
         /*Codes_SRS_IOTHUBCLIENT_LL_17_011: [IoTHubClient_LL_Destroy  shall free the resources allocated by IoTHubClient (if any).] */
         tickcounter_destroy(handleData->tickCounter);
+        if (handleData->messagePool != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_029: [ IoTHubClient_LL_Destroy shall destroy the message pool, if any, by calling IoTHubClient_BlockPool_Destroy. ]*/
+            IoTHubClient_BlockPool_Destroy(handleData->messagePool);
+        }
 #ifndef DONT_USE_UPLOADTOBLOB
         IoTHubClient_LL_UploadToBlob_Destroy(handleData->uploadToBlobHandle);
 #endif
@@ -749,69 +1199,178 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOT
         else
         {
             newEntry->ms_timesOutAfter += handleData->currentMessageTimeout;
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_067: [ Once waitingToSend and the outbox backlog are empty, the timeouts of the messages that left them shall not be taken into account to decide whether the messages added afterwards are sorted by timeout. ]*/
+            if (DList_IsListEmpty(&(handleData->waitingToSend)) &&
+                ((handleData->outbox == NULL) || DList_IsListEmpty(&(handleData->outboxBacklog))))
+            {
+                handleData->latestMessageTimeout = 0;
+                handleData->messageTimeoutsInOrder = true;
+            }
             result = 0;
         }
     }
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+static IOTHUB_CLIENT_RESULT add_message_list_entry(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, bool takeOwnership, size_t messageSize, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
-    /*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
-    if (
-        (iotHubClientHandle == NULL) ||
-        (eventMessageHandle == NULL) ||
-        /*Codes_SRS_IOTHUBCLIENT_LL_02_012: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL.] */
-        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
-        )
+    IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+    IOTHUB_MESSAGE_LIST *newEntry = create_message_list_entry(handleData);
+    if (newEntry == NULL)
     {
-        result = IOTHUB_CLIENT_INVALID_ARG;
+        result = IOTHUB_CLIENT_ERROR;
         LOG_ERROR_RESULT;
     }
     else
     {
-        IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
-        if (newEntry == NULL)
+        if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
         {
             result = IOTHUB_CLIENT_ERROR;
             LOG_ERROR_RESULT;
+            destroy_message_list_entry(newEntry);
+        }
+        else if (handleData->outbox != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_053: [ While the outbox is used, IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall append eventMessageHandle to it by calling IoTHubClient_Outbox_Append and add the record to the outbox backlog without a message, instead of adding it to waitingToSend. ]*/
+            if (IoTHubClient_Outbox_Append(handleData->outbox, eventMessageHandle, &(newEntry->outboxRecordId)) != 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_07_054: [ If IoTHubClient_Outbox_Append fails, IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                destroy_message_list_entry(newEntry);
+                LOG_ERROR_RESULT;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_07_070: [ The priority of the record shall be obtained by calling IoTHubMessage_GetPriority. ]*/
+                newEntry->priority = IoTHubMessage_GetPriority(eventMessageHandle);
+                if (takeOwnership)
+                {
+                    /*the outbox has its own copy*/
+                    IoTHubMessage_Destroy(eventMessageHandle);
+                }
+                newEntry->messageHandle = NULL;
+                queue_message_list_entry(handleData, &(handleData->outboxBacklog), newEntry, messageSize, eventConfirmationCallback, userContextCallback);
+                track_appended_timeout(handleData, newEntry);
+                result = IOTHUB_CLIENT_OK;
+            }
         }
         else
         {
-            IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+            if (takeOwnership)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_07_034: [ IoTHubClient_LL_SendEventAsync_Move shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it, eventConfirmationCallback and userContextCallback. ]*/
+                newEntry->messageHandle = eventMessageHandle;
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+            else
+            {
+                newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+            }
 
-            if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
+            if (newEntry->messageHandle == NULL)
             {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
                 result = IOTHUB_CLIENT_ERROR;
+                destroy_message_list_entry(newEntry);
                 LOG_ERROR_RESULT;
-                free(newEntry);
             }
             else
             {
+                /*Codes_SRS_IOTHUBCLIENT_LL_07_063: [ The record shall be added to waitingToSend after every record of the same or a higher priority and before every record of a lower priority, the priority being obtained by calling IoTHubMessage_GetPriority. ]*/
+                newEntry->priority = IoTHubMessage_GetPriority(eventMessageHandle);
                 /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
-                    result = IOTHUB_CLIENT_ERROR;
-                    free(newEntry);
-                    LOG_ERROR_RESULT;
-                }
-                else
-                {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                    newEntry->callback = eventConfirmationCallback;
-                    newEntry->context = userContextCallback;
-                    DList_InsertTailList(&(iotHubClientHandle->waitingToSend), &(newEntry->entry));
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
-                    result = IOTHUB_CLIENT_OK;
-                }
+                queue_message_list_entry(handleData, get_priority_insertion_point(handleData, newEntry->priority), newEntry, messageSize, eventConfirmationCallback, userContextCallback);
+                track_inserted_timeout(handleData, newEntry);
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
+                result = IOTHUB_CLIENT_OK;
             }
         }
     }
     return result;
 }
 
+static IOTHUB_CLIENT_RESULT queue_event(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, bool takeOwnership, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_042: [ While OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES is set, the size of the payload of the message shall be obtained by calling IoTHubMessage_GetContentType and IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+    size_t messageSize = is_send_queue_limited(handleData) ? get_message_size(eventMessageHandle) : 0;
+
+    if (!is_send_queue_full(handleData, messageSize))
+    {
+        result = add_message_list_entry(iotHubClientHandle, eventMessageHandle, takeOwnership, messageSize, eventConfirmationCallback, userContextCallback);
+    }
+    else if (handleData->queueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_045: [ If the message does not fit and the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST, the message shall not be queued, eventConfirmationCallback shall be called with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED and IOTHUB_CLIENT_OK shall be returned. ]*/
+        if (eventConfirmationCallback != NULL)
+        {
+            eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, userContextCallback);
+        }
+        if (takeOwnership)
+        {
+            IoTHubMessage_Destroy(eventMessageHandle);
+        }
+        result = IOTHUB_CLIENT_OK;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_044: [ If the message does not fit and the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST, the oldest messages in waitingToSend shall be removed and have their callbacks called with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED until the message fits. ]*/
+    else if ((handleData->queueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST) && drop_oldest_messages(handleData, messageSize))
+    {
+        result = add_message_list_entry(iotHubClientHandle, eventMessageHandle, takeOwnership, messageSize, eventConfirmationCallback, userContextCallback);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_043: [ Otherwise, if the message does not fit, it shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+        result = IOTHUB_CLIENT_QUEUE_FULL;
+        LogError("the send queue is full (%zu messages, %zu bytes)", handleData->queuedMessages, handleData->queuedBytes);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (eventMessageHandle == NULL) ||
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_012: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL.] */
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+        )
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        result = queue_event(iotHubClientHandle, eventMessageHandle, false, eventConfirmationCallback, userContextCallback);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync_Move(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_032: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (eventMessageHandle == NULL) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+        )
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_033: [ Upon success eventMessageHandle shall belong to IoTHubClient_LL, which shall destroy it once its eventConfirmationCallback has been called. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_035: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR and eventMessageHandle shall still belong to the caller. ]*/
+        result = queue_event(iotHubClientHandle, eventMessageHandle, true, eventConfirmationCallback, userContextCallback);
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetMessageCallback(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -854,6 +1413,36 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetMessageCallback(IOTHUB_CLIENT_LL_HANDLE
     return result;
 }
 
+/*returns true if it stopped at a message that has not timed out, because the messages after it have not either*/
+static bool timeout_messages(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, PDLIST_ENTRY messages, uint64_t nowTick)
+{
+    bool result = false;
+    DLIST_ENTRY* currentItemInWaitingToSend = messages->Flink;
+    while (currentItemInWaitingToSend != messages) /*while we are not at the end of the list*/
+    {
+        IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+        if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
+        {
+            PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
+            DList_RemoveEntryList(currentItemInWaitingToSend);
+            complete_message_list_entry(handleData, fullEntry, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+            currentItemInWaitingToSend = theNext;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_038: [ When the messages in waitingToSend are sorted by timeout, IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has a timeout that has not expired. ]*/
+        else if ((fullEntry->ms_timesOutAfter != 0) && handleData->messageTimeoutsInOrder)
+        {
+            result = true;
+            break;
+        }
+        else
+        {
+            currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+        }
+    }
+    return result;
+}
+
 static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
 {
     uint64_t nowTick;
@@ -861,29 +1450,13 @@ static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
     {
         LogError("unable to get the current ms, timeouts will not be processed");
     }
-    else
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_037: [ If no message has ever been given a timeout, IoTHubClient_LL_DoWork shall not look at waitingToSend for timed out messages. ]*/
+    else if (handleData->latestMessageTimeout != 0)
     {
-        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
-        while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_057: [ The events of the outbox backlog shall time out like the ones in waitingToSend, which were sent before them. ]*/
+        if (!timeout_messages(handleData, &(handleData->waitingToSend), nowTick) && (handleData->outbox != NULL))
         {
-            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
-            /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-            if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
-            {
-                PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
-                DList_RemoveEntryList(currentItemInWaitingToSend);
-                if (fullEntry->callback != NULL)
-                {
-                    fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
-                }
-                IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
-                free(fullEntry);
-                currentItemInWaitingToSend = theNext;
-            }
-            else
-            {
-                currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
-            }
+            (void)timeout_messages(handleData, &(handleData->outboxBacklog), nowTick);
         }
     }
 }
@@ -896,6 +1469,12 @@ void IoTHubClient_LL_DoWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
         IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
         DoTimeouts(handleData);
 
+        if (handleData->outbox != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_058: [ IoTHubClient_LL_DoWork shall keep up to 16 events of the outbox in waitingToSend by moving the oldest records of the outbox backlog there, with the message read back by calling IoTHubClient_Outbox_Read. ]*/
+            refill_from_outbox(handleData);
+        }
+
         /*Codes_SRS_IOTHUBCLIENT_LL_07_008: [ IoTHubClient_LL_DoWork shall iterate the message queue and execute the underlying transports IoTHubTransport_ProcessItem function for each item. ] */
         DLIST_ENTRY* client_item = handleData->iot_msg_queue.Flink;
         while (client_item != &(handleData->iot_msg_queue)) /*while we are not at the end of the list*/
@@ -932,6 +1511,12 @@ void IoTHubClient_LL_DoWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 
         /*Codes_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClient_LL_DoWork shall invoke the underlaying layer's _DoWork function.]*/
         handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_060: [ IoTHubClient_LL_DoWork shall then write the events appended and completed since the previous call to the outbox by calling IoTHubClient_Outbox_Flush once. ]*/
+        if ((handleData->outbox != NULL) && (IoTHubClient_Outbox_Flush(handleData->outbox) != 0))
+        {
+            LogError("unable to IoTHubClient_Outbox_Flush");
+        }
     }
 }
 
@@ -951,7 +1536,90 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStatus(IOTHUB_CLIENT_LL_HANDLE iotHu
 
         /* Codes_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
         /* Codes_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
-        result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+        if ((handleData->outbox != NULL) && !DList_IsListEmpty(&(handleData->outboxBacklog)))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_061: [ While the outbox backlog is not empty, IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY. ]*/
+            *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else
+        {
+            result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetMessagePoolStatistics(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_BLOCK_POOL_STATISTICS* statistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL || statistics == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_027: [ If iotHubClientHandle or statistics is NULL, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else if (iotHubClientHandle->messagePool == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_028: [ If the message pool has not been created, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("OPTION_MESSAGE_POOL_SIZE has not been set");
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_030: [ IoTHubClient_LL_GetMessagePoolStatistics shall fill statistics by calling IoTHubClient_BlockPool_GetStatistics and return IOTHUB_CLIENT_OK. ]*/
+    else if (IoTHubClient_BlockPool_GetStatistics(iotHubClientHandle->messagePool, statistics) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_031: [ If IoTHubClient_BlockPool_GetStatistics fails, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendQueueDepth(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, size_t* messageCount, size_t* byteCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_047: [ If iotHubClientHandle, messageCount or byteCount is NULL, IoTHubClient_LL_GetSendQueueDepth shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if ((iotHubClientHandle == NULL) || (messageCount == NULL) || (byteCount == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_048: [ IoTHubClient_LL_GetSendQueueDepth shall set messageCount to the number of messages accepted and not yet confirmed, byteCount to their measured payload bytes and return IOTHUB_CLIENT_OK. ]*/
+        *messageCount = iotHubClientHandle->queuedMessages;
+        *byteCount = iotHubClientHandle->queuedBytes;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendQueueDepthByPriority(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, size_t* messageCount, size_t* byteCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_07_064: [ If iotHubClientHandle, messageCount or byteCount is NULL, or priority is not one of the IOTHUB_MESSAGE_PRIORITY values, IoTHubClient_LL_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if ((iotHubClientHandle == NULL) || (messageCount == NULL) || (byteCount == NULL) ||
+        ((priority != IOTHUB_MESSAGE_PRIORITY_LOW) && (priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) && (priority != IOTHUB_MESSAGE_PRIORITY_HIGH)))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_07_065: [ IoTHubClient_LL_GetSendQueueDepthByPriority shall set messageCount and byteCount to the part of the counts of IoTHubClient_LL_GetSendQueueDepth made of messages of that priority and return IOTHUB_CLIENT_OK. ]*/
+        *messageCount = iotHubClientHandle->queuedMessagesByPriority[priority];
+        *byteCount = iotHubClientHandle->queuedBytesByPriority[priority];
+        result = IOTHUB_CLIENT_OK;
     }
 
     return result;
@@ -976,13 +1644,7 @@ void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY c
         while ((oldest = DList_RemoveHeadList(completed)) != completed)
         {
             IOTHUB_MESSAGE_LIST* messageList = (IOTHUB_MESSAGE_LIST*)containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
-            /*Codes_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
-            if (messageList->callback != NULL)
-            {
-                messageList->callback(result, messageList->context);
-            }
-            IoTHubMessage_Destroy(messageList->messageHandle);
-            free(messageList);
+            complete_message_list_entry(handle, messageList, result);
         }
     }
 }
@@ -1241,6 +1903,49 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetOption(IOTHUB_CLIENT_LL_HANDLE iotHubCli
             handleData->currentMessageTimeout = *(const uint64_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        else if (strcmp(optionName, OPTION_MESSAGE_POOL_SIZE) == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            result = set_message_pool(handleData, *(const size_t*)value);
+        }
+        else if (strcmp(optionName, OPTION_MAX_QUEUED_MESSAGES) == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_039: [ If optionName is OPTION_MAX_QUEUED_MESSAGES, IoTHubClient_LL_SetOption shall limit the number of messages accepted and not yet confirmed to value, a pointer to a size_t; 0 means no limit. ]*/
+            handleData->maxQueuedMessages = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_MAX_QUEUED_BYTES) == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_07_040: [ If optionName is OPTION_MAX_QUEUED_BYTES, IoTHubClient_LL_SetOption shall limit the payload bytes of the messages accepted and not yet confirmed to value, a pointer to a size_t; 0 means no limit. ]*/
+            handleData->maxQueuedBytes = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_QUEUE_FULL_POLICY) == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+            if ((policy != IOTHUB_CLIENT_QUEUE_FULL_REJECT) &&
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_BLOCK) &&
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST) &&
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_07_041: [ If optionName is OPTION_QUEUE_FULL_POLICY, value is a pointer to an IOTHUB_CLIENT_QUEUE_FULL_POLICY; if it is not one of the policies IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("invalid queue full policy %d", (int)policy);
+            }
+            else
+            {
+                handleData->queueFullPolicy = policy;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_OUTBOX_DIRECTORY) == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            result = set_outbox(handleData, (const char*)value);
+        }
         else
         {
 
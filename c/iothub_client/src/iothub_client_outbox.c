@@ -0,0 +1,1071 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "iothub_client_outbox.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*fflush only hands the data to the system, the files are synced so that what has been flushed survives a power loss. The
+directory is synced as well where that is possible, so that created, renamed and deleted files survive it too*/
+#if defined(_WIN32)
+#include <io.h>
+#define OUTBOX_SYNC_FILE(file) _commit(_fileno(file))
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define OUTBOX_SYNC_FILE(file) fsync(fileno(file))
+#define OUTBOX_SYNC_DIRECTORY
+#else
+#define OUTBOX_SYNC_FILE(file) ((void)(file), 0)
+#endif
+
+#define OUTBOX_RECORD_MAGIC         0x424F4849 /*"IHOB"*/
+#define OUTBOX_RECORD_PENDING       1
+#define OUTBOX_RECORD_COMPLETED     2
+#define OUTBOX_NO_STRING            UINT32_MAX
+#define OUTBOX_MAX_SEGMENT_SIZE     0x7FFFFFFF /*offsets in a segment are the low 32 bits of a record id*/
+
+static const char OUTBOX_HEAD_FILE_FORMAT[] = "%s/iothub_outbox.head";
+static const char OUTBOX_NEW_HEAD_FILE_FORMAT[] = "%s/iothub_outbox.head.new";
+static const char OUTBOX_SEGMENT_FILE_FORMAT[] = "%s/iothub_outbox_%010lu.log";
+#define OUTBOX_FILE_NAME_EXTRA_SIZE (sizeof("/iothub_outbox_") + 10 + sizeof(".log"))
+
+typedef struct OUTBOX_RECORD_HEADER_TAG
+{
+    uint32_t magic;
+    uint32_t state; /*rewritten in place when the record is completed*/
+    uint32_t bodySize;
+    uint32_t checksum; /*of the body*/
+} OUTBOX_RECORD_HEADER;
+
+typedef struct OUTBOX_SEGMENT_TAG
+{
+    size_t pendingRecords;
+} OUTBOX_SEGMENT;
+
+typedef struct IOTHUB_CLIENT_OUTBOX_INSTANCE_TAG
+{
+    char* directory;
+    char* fileName; /*big enough for the name of any file of the outbox*/
+    char* newHeadFileName;
+    size_t segmentSize;
+    uint32_t firstSegmentIndex; /*index of segments[0]*/
+    OUTBOX_SEGMENT* segments; /*the last one is the segment appended to*/
+    size_t segmentCount;
+    FILE* appendFile;
+    uint32_t appendOffset;
+    bool appendFileDirty;
+    FILE* accessFile; /*used to read and complete the records of accessSegmentIndex*/
+    uint32_t accessSegmentIndex;
+    bool accessFileDirty;
+} IOTHUB_CLIENT_OUTBOX_INSTANCE;
+
+typedef void(*OUTBOX_RECORD_VISITOR)(uint32_t offset, const OUTBOX_RECORD_HEADER* header, void* context);
+
+typedef struct OUTBOX_BODY_READER_TAG
+{
+    const unsigned char* position;
+    size_t remaining;
+} OUTBOX_BODY_READER;
+
+typedef struct OUTBOX_PENDING_WALK_TAG
+{
+    uint32_t segmentIndex;
+    IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK pendingCallback;
+    void* context;
+} OUTBOX_PENDING_WALK;
+
+static uint64_t make_record_id(uint32_t segmentIndex, uint32_t offset)
+{
+    return (((uint64_t)segmentIndex) << 32) | offset;
+}
+
+static const char* get_segment_file_name(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint32_t segmentIndex)
+{
+    (void)sprintf(outbox->fileName, OUTBOX_SEGMENT_FILE_FORMAT, outbox->directory, (unsigned long)segmentIndex);
+    return outbox->fileName;
+}
+
+static const char* get_head_file_name(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    (void)sprintf(outbox->fileName, OUTBOX_HEAD_FILE_FORMAT, outbox->directory);
+    return outbox->fileName;
+}
+
+static int flush_and_sync(FILE* file)
+{
+    return ((fflush(file) != 0) || (OUTBOX_SYNC_FILE(file) != 0)) ? __LINE__ : 0;
+}
+
+static void sync_directory(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+#ifdef OUTBOX_SYNC_DIRECTORY
+    int directoryFd = open(outbox->directory, O_RDONLY);
+    if (directoryFd < 0)
+    {
+        LogError("unable to open %s to sync it", outbox->directory);
+    }
+    else
+    {
+        if (fsync(directoryFd) != 0)
+        {
+            LogError("unable to sync %s", outbox->directory);
+        }
+        (void)close(directoryFd);
+    }
+#else
+    (void)outbox;
+#endif
+}
+
+/*FNV-1a, only meant to detect records torn by a power loss*/
+static uint32_t compute_checksum(const unsigned char* data, size_t size)
+{
+    uint32_t result = 2166136261u;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        result ^= data[i];
+        result *= 16777619u;
+    }
+    return result;
+}
+
+static size_t get_string_field_size(const char* value)
+{
+    return sizeof(uint32_t) + ((value == NULL) ? 0 : strlen(value) + 1);
+}
+
+static unsigned char* write_uint32(unsigned char* destination, uint32_t value)
+{
+    (void)memcpy(destination, &value, sizeof(value));
+    return destination + sizeof(value);
+}
+
+static unsigned char* write_field(unsigned char* destination, const void* data, size_t size)
+{
+    destination = write_uint32(destination, (uint32_t)size);
+    (void)memcpy(destination, data, size);
+    return destination + size;
+}
+
+static unsigned char* write_string_field(unsigned char* destination, const char* value)
+{
+    return (value == NULL) ? write_uint32(destination, OUTBOX_NO_STRING) : write_field(destination, value, strlen(value) + 1);
+}
+
+/*the body is the content type, the priority, the payload, the message id, the correlation id and the properties*/
+static unsigned char* serialize_message(IOTHUB_MESSAGE_HANDLE messageHandle, size_t* bodySize)
+{
+    unsigned char* result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    const unsigned char* payload;
+    size_t payloadSize;
+    MAP_HANDLE properties;
+    const char*const* keys;
+    const char*const* values;
+    size_t propertyCount;
+
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        if (IoTHubMessage_GetByteArray(messageHandle, &payload, &payloadSize) != IOTHUB_MESSAGE_OK)
+        {
+            payload = NULL;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        /*the terminating '\0' is stored so that the string can be used in place when read back*/
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        payload = (const unsigned char*)text;
+        payloadSize = (text == NULL) ? 0 : strlen(text) + 1;
+    }
+    else
+    {
+        payload = NULL;
+    }
+
+    if (payload == NULL)
+    {
+        LogError("unable to get the payload of the message");
+        result = NULL;
+    }
+    else if (((properties = IoTHubMessage_Properties(messageHandle)) == NULL) ||
+        (Map_GetInternals(properties, &keys, &values, &propertyCount) != MAP_OK))
+    {
+        LogError("unable to get the properties of the message");
+        result = NULL;
+    }
+    else
+    {
+        const char* messageId = IoTHubMessage_GetMessageId(messageHandle);
+        const char* correlationId = IoTHubMessage_GetCorrelationId(messageHandle);
+        size_t size = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) + payloadSize + get_string_field_size(messageId) + get_string_field_size(correlationId) + sizeof(uint32_t);
+        size_t i;
+        for (i = 0; i < propertyCount; i++)
+        {
+            size += get_string_field_size(keys[i]) + get_string_field_size(values[i]);
+        }
+
+        if ((payloadSize > OUTBOX_MAX_SEGMENT_SIZE) || (size > OUTBOX_MAX_SEGMENT_SIZE))
+        {
+            LogError("the message is too big for the outbox (%zu bytes)", size);
+            result = NULL;
+        }
+        else if ((result = (unsigned char*)malloc(size)) == NULL)
+        {
+            LogError("unable to malloc");
+        }
+        else
+        {
+            unsigned char* position = write_uint32(result, (uint32_t)contentType);
+            position = write_uint32(position, (uint32_t)IoTHubMessage_GetPriority(messageHandle));
+            position = write_field(position, payload, payloadSize);
+            position = write_string_field(position, messageId);
+            position = write_string_field(position, correlationId);
+            position = write_uint32(position, (uint32_t)propertyCount);
+            for (i = 0; i < propertyCount; i++)
+            {
+                position = write_string_field(position, keys[i]);
+                position = write_string_field(position, values[i]);
+            }
+            *bodySize = size;
+        }
+    }
+    return result;
+}
+
+static int read_uint32(OUTBOX_BODY_READER* reader, uint32_t* value)
+{
+    int result;
+    if (reader->remaining < sizeof(*value))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        (void)memcpy(value, reader->position, sizeof(*value));
+        reader->position += sizeof(*value);
+        reader->remaining -= sizeof(*value);
+        result = 0;
+    }
+    return result;
+}
+
+static int read_field(OUTBOX_BODY_READER* reader, const unsigned char** data, uint32_t* size)
+{
+    int result;
+    if (read_uint32(reader, size) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (*size == OUTBOX_NO_STRING)
+    {
+        *data = NULL;
+        result = 0;
+    }
+    else if (*size > reader->remaining)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *data = reader->position;
+        reader->position += *size;
+        reader->remaining -= *size;
+        result = 0;
+    }
+    return result;
+}
+
+/*a string field is either absent or a '\0' terminated string*/
+static int read_string_field(OUTBOX_BODY_READER* reader, const char** value)
+{
+    int result;
+    const unsigned char* data;
+    uint32_t size;
+    if (read_field(reader, &data, &size) != 0)
+    {
+        result = __LINE__;
+    }
+    else if ((data != NULL) && ((size == 0) || (data[size - 1] != '\0')))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *value = (const char*)data;
+        result = 0;
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_OUTBOX_READ_RESULT read_properties(OUTBOX_BODY_READER* reader, IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result;
+    uint32_t propertyCount;
+    MAP_HANDLE properties;
+    if (read_uint32(reader, &propertyCount) != 0)
+    {
+        result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+    }
+    else if ((properties = IoTHubMessage_Properties(messageHandle)) == NULL)
+    {
+        result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+    }
+    else
+    {
+        uint32_t i;
+        result = IOTHUB_CLIENT_OUTBOX_READ_OK;
+        for (i = 0; (i < propertyCount) && (result == IOTHUB_CLIENT_OUTBOX_READ_OK); i++)
+        {
+            const char* key;
+            const char* value;
+            if ((read_string_field(reader, &key) != 0) ||
+                (read_string_field(reader, &value) != 0) ||
+                (key == NULL) ||
+                (value == NULL))
+            {
+                result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+            }
+            else if (Map_AddOrUpdate(properties, key, value) != MAP_OK)
+            {
+                result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+            }
+        }
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_OUTBOX_READ_RESULT deserialize_message(const unsigned char* body, size_t bodySize, IOTHUB_MESSAGE_HANDLE* messageHandle)
+{
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result;
+    OUTBOX_BODY_READER reader;
+    uint32_t contentType;
+    uint32_t priority;
+    const unsigned char* payload;
+    uint32_t payloadSize;
+    const char* messageId;
+    const char* correlationId;
+    reader.position = body;
+    reader.remaining = bodySize;
+
+    /*a record that does not hold a message is told apart from a failure to build the message, which may succeed later*/
+    if ((read_uint32(&reader, &contentType) != 0) ||
+        (read_uint32(&reader, &priority) != 0) ||
+        (read_field(&reader, &payload, &payloadSize) != 0) ||
+        (payload == NULL) ||
+        (read_string_field(&reader, &messageId) != 0) ||
+        (read_string_field(&reader, &correlationId) != 0))
+    {
+        LogError("the record is not a message");
+        result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+    }
+    else if ((contentType != IOTHUBMESSAGE_BYTEARRAY) &&
+        ((contentType != IOTHUBMESSAGE_STRING) || (payloadSize == 0) || (payload[payloadSize - 1] != '\0')))
+    {
+        LogError("the record has an invalid payload");
+        result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+    }
+    else if (priority > (uint32_t)IOTHUB_MESSAGE_PRIORITY_HIGH)
+    {
+        LogError("the record has an invalid priority (%lu)", (unsigned long)priority);
+        result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+    }
+    else if ((*messageHandle = (contentType == IOTHUBMESSAGE_BYTEARRAY) ?
+        IoTHubMessage_CreateFromByteArray(payload, payloadSize) :
+        IoTHubMessage_CreateFromString((const char*)payload)) == NULL)
+    {
+        LogError("unable to create the message");
+        result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+    }
+    else if (((messageId != NULL) && (IoTHubMessage_SetMessageId(*messageHandle, messageId) != IOTHUB_MESSAGE_OK)) ||
+        ((correlationId != NULL) && (IoTHubMessage_SetCorrelationId(*messageHandle, correlationId) != IOTHUB_MESSAGE_OK)) ||
+        (IoTHubMessage_SetPriority(*messageHandle, (IOTHUB_MESSAGE_PRIORITY)priority) != IOTHUB_MESSAGE_OK))
+    {
+        LogError("unable to set the ids or the priority of the message");
+        IoTHubMessage_Destroy(*messageHandle);
+        *messageHandle = NULL;
+        result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+    }
+    else if ((result = read_properties(&reader, *messageHandle)) != IOTHUB_CLIENT_OUTBOX_READ_OK)
+    {
+        LogError("unable to read the properties of the message back");
+        IoTHubMessage_Destroy(*messageHandle);
+        *messageHandle = NULL;
+    }
+    return result;
+}
+
+static bool segment_exists(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint32_t segmentIndex)
+{
+    FILE* segmentFile = fopen(get_segment_file_name(outbox, segmentIndex), "rb");
+    if (segmentFile != NULL)
+    {
+        (void)fclose(segmentFile);
+    }
+    return (segmentFile != NULL);
+}
+
+/*calls visitor for every complete record of the segment, stops at the first record that is torn: cut short, or with a body
+that does not match its checksum. Failing to read the segment is an error, so that its records are not taken for torn ones*/
+static int walk_segment(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint32_t segmentIndex, OUTBOX_RECORD_VISITOR visitor, void* context)
+{
+    int result;
+    FILE* segmentFile = fopen(get_segment_file_name(outbox, segmentIndex), "rb");
+    if (segmentFile == NULL)
+    {
+        LogError("unable to open segment %lu", (unsigned long)segmentIndex);
+        result = __LINE__;
+    }
+    else
+    {
+        long fileSize;
+        if ((fseek(segmentFile, 0, SEEK_END) != 0) ||
+            ((fileSize = ftell(segmentFile)) < 0) ||
+            (fseek(segmentFile, 0, SEEK_SET) != 0))
+        {
+            LogError("unable to get the size of segment %lu", (unsigned long)segmentIndex);
+            result = __LINE__;
+        }
+        else
+        {
+            OUTBOX_RECORD_HEADER header;
+            unsigned char* body = NULL;
+            uint32_t bodyCapacity = 0;
+            uint32_t offset = 0;
+            result = 0;
+            while (((long)offset + (long)sizeof(header) <= fileSize) &&
+                (fread(&header, sizeof(header), 1, segmentFile) == 1) &&
+                (header.magic == OUTBOX_RECORD_MAGIC) &&
+                ((long)offset + (long)sizeof(header) + (long)header.bodySize <= fileSize))
+            {
+                if (header.bodySize > bodyCapacity)
+                {
+                    unsigned char* newBody = (unsigned char*)realloc(body, header.bodySize);
+                    if (newBody == NULL)
+                    {
+                        LogError("unable to realloc");
+                        result = __LINE__;
+                        break;
+                    }
+                    body = newBody;
+                    bodyCapacity = header.bodySize;
+                }
+
+                if ((fread(body, 1, header.bodySize, segmentFile) != header.bodySize) ||
+                    (compute_checksum(body, header.bodySize) != header.checksum))
+                {
+                    break;
+                }
+                visitor(offset, &header, context);
+                offset += (uint32_t)sizeof(header) + header.bodySize;
+            }
+
+            if ((result == 0) && ferror(segmentFile))
+            {
+                LogError("unable to read segment %lu", (unsigned long)segmentIndex);
+                result = __LINE__;
+            }
+            free(body);
+        }
+        (void)fclose(segmentFile);
+    }
+    return result;
+}
+
+static void count_pending_record(uint32_t offset, const OUTBOX_RECORD_HEADER* header, void* context)
+{
+    (void)offset;
+    if (header->state == OUTBOX_RECORD_PENDING)
+    {
+        ((OUTBOX_SEGMENT*)context)->pendingRecords++;
+    }
+}
+
+static void report_pending_record(uint32_t offset, const OUTBOX_RECORD_HEADER* header, void* context)
+{
+    OUTBOX_PENDING_WALK* walk = (OUTBOX_PENDING_WALK*)context;
+    if (header->state == OUTBOX_RECORD_PENDING)
+    {
+        walk->pendingCallback(make_record_id(walk->segmentIndex, offset), walk->context);
+    }
+}
+
+static int add_segment(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, size_t pendingRecords)
+{
+    int result;
+    OUTBOX_SEGMENT* newSegments = (OUTBOX_SEGMENT*)realloc(outbox->segments, (outbox->segmentCount + 1) * sizeof(OUTBOX_SEGMENT));
+    if (newSegments == NULL)
+    {
+        LogError("unable to realloc");
+        result = __LINE__;
+    }
+    else
+    {
+        outbox->segments = newSegments;
+        outbox->segments[outbox->segmentCount].pendingRecords = pendingRecords;
+        outbox->segmentCount++;
+        result = 0;
+    }
+    return result;
+}
+
+/*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_006: [ Appends shall go to a new segment once the segment appended to has reached segmentSize bytes. ]*/
+static int start_new_segment(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    int result;
+    uint32_t segmentIndex = outbox->firstSegmentIndex + (uint32_t)outbox->segmentCount;
+    FILE* newFile = fopen(get_segment_file_name(outbox, segmentIndex), "wb");
+    if (newFile == NULL)
+    {
+        LogError("unable to create segment %lu", (unsigned long)segmentIndex);
+        result = __LINE__;
+    }
+    else if (add_segment(outbox, 0) != 0)
+    {
+        (void)fclose(newFile);
+        (void)remove(outbox->fileName);
+        result = __LINE__;
+    }
+    else
+    {
+        if (outbox->appendFile != NULL)
+        {
+            if (outbox->appendFileDirty && (flush_and_sync(outbox->appendFile) != 0))
+            {
+                LogError("unable to sync the previous segment appended to");
+            }
+            (void)fclose(outbox->appendFile);
+        }
+        outbox->appendFile = newFile;
+        outbox->appendOffset = 0;
+        outbox->appendFileDirty = false;
+        /*a segment lost by a power loss would end the log before the segments that follow it*/
+        sync_directory(outbox);
+        result = 0;
+    }
+    return result;
+}
+
+static void close_access_file(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    if (outbox->accessFile != NULL)
+    {
+        if (outbox->accessFileDirty && (flush_and_sync(outbox->accessFile) != 0))
+        {
+            LogError("unable to sync the completions");
+        }
+        (void)fclose(outbox->accessFile);
+        outbox->accessFile = NULL;
+        outbox->accessFileDirty = false;
+    }
+}
+
+/*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_019: [ The head file shall be replaced by renaming a new head file, written and synced beforehand, over it. ]*/
+static int write_head_file(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint32_t firstSegmentIndex)
+{
+    int result;
+    FILE* newHeadFile;
+    (void)sprintf(outbox->newHeadFileName, OUTBOX_NEW_HEAD_FILE_FORMAT, outbox->directory);
+    if ((newHeadFile = fopen(outbox->newHeadFileName, "wb")) == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        bool written = (fprintf(newHeadFile, "%lu\n", (unsigned long)firstSegmentIndex) >= 0) && (flush_and_sync(newHeadFile) == 0);
+        if ((fclose(newHeadFile) != 0) || !written)
+        {
+            (void)remove(outbox->newHeadFileName);
+            result = __LINE__;
+        }
+        /*rename does not replace an existing file on every platform, the head file is then removed first and
+        read_first_segment_index finds the new head file until it has been renamed*/
+        else if ((rename(outbox->newHeadFileName, get_head_file_name(outbox)) != 0) &&
+            ((remove(outbox->fileName) != 0) || (rename(outbox->newHeadFileName, outbox->fileName) != 0)))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            sync_directory(outbox);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_013: [ Once the first segment has no pending record and is not the segment appended to, its file shall be deleted, after the index of the new first segment has been written to the head file. ]*/
+static void delete_completed_segments(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    size_t completedSegments = 0;
+    while ((completedSegments + 1 < outbox->segmentCount) && (outbox->segments[completedSegments].pendingRecords == 0))
+    {
+        completedSegments++;
+    }
+
+    if (completedSegments > 0)
+    {
+        /*the head file is written first, so that a crash in between only leaves files that are not looked at anymore*/
+        if (write_head_file(outbox, outbox->firstSegmentIndex + (uint32_t)completedSegments) != 0)
+        {
+            LogError("unable to write the head of the outbox, the completed segments are kept for now");
+        }
+        else
+        {
+            size_t i;
+            for (i = 0; i < completedSegments; i++)
+            {
+                if ((outbox->accessFile != NULL) && (outbox->accessSegmentIndex == outbox->firstSegmentIndex))
+                {
+                    close_access_file(outbox);
+                }
+                if (remove(get_segment_file_name(outbox, outbox->firstSegmentIndex)) != 0)
+                {
+                    LogError("unable to delete segment %lu", (unsigned long)outbox->firstSegmentIndex);
+                }
+                outbox->firstSegmentIndex++;
+            }
+            outbox->segmentCount -= completedSegments;
+            (void)memmove(outbox->segments, outbox->segments + completedSegments, outbox->segmentCount * sizeof(OUTBOX_SEGMENT));
+        }
+    }
+}
+
+static uint32_t read_first_segment_index(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    uint32_t result;
+    FILE* headFile = fopen(get_head_file_name(outbox), "rb");
+    if (headFile == NULL)
+    {
+        /*the head file was removed and the new one was not renamed yet, it is complete since it was synced before*/
+        (void)sprintf(outbox->newHeadFileName, OUTBOX_NEW_HEAD_FILE_FORMAT, outbox->directory);
+        headFile = fopen(outbox->newHeadFileName, "rb");
+    }
+
+    if (headFile == NULL)
+    {
+        /*a new outbox*/
+        result = 0;
+    }
+    else
+    {
+        unsigned long firstSegmentIndex;
+        if (fscanf(headFile, "%lu", &firstSegmentIndex) != 1)
+        {
+            LogError("the head file of the outbox is not valid, it is ignored");
+            result = 0;
+        }
+        else
+        {
+            result = (uint32_t)firstSegmentIndex;
+        }
+        (void)fclose(headFile);
+    }
+    return result;
+}
+
+static void destroy_outbox(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox)
+{
+    if (outbox->appendFile != NULL)
+    {
+        if (outbox->appendFileDirty && (flush_and_sync(outbox->appendFile) != 0))
+        {
+            LogError("unable to sync the appends");
+        }
+        (void)fclose(outbox->appendFile);
+    }
+    close_access_file(outbox);
+    free(outbox->segments);
+    free(outbox->newHeadFileName);
+    free(outbox->fileName);
+    free(outbox->directory);
+    free(outbox);
+}
+
+/*flushes the appends when a record of the segment appended to is about to be accessed through another FILE, they stay dirty
+until IoTHubClient_Outbox_Flush has synced them*/
+static int flush_appends_for(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint32_t segmentIndex)
+{
+    int result;
+    if ((segmentIndex == outbox->firstSegmentIndex + (uint32_t)outbox->segmentCount - 1) && outbox->appendFileDirty)
+    {
+        if (fflush(outbox->appendFile) != 0)
+        {
+            LogError("unable to flush the segment appended to");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*positions the access file on the header of a record of the outbox*/
+static IOTHUB_CLIENT_OUTBOX_READ_RESULT seek_record(IOTHUB_CLIENT_OUTBOX_INSTANCE* outbox, uint64_t recordId, OUTBOX_SEGMENT** segment, OUTBOX_RECORD_HEADER* header)
+{
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result;
+    uint32_t segmentIndex = (uint32_t)(recordId >> 32);
+    uint32_t offset = (uint32_t)recordId;
+
+    if ((segmentIndex - outbox->firstSegmentIndex) >= outbox->segmentCount)
+    {
+        LogError("record %llu is not in the outbox", (unsigned long long)recordId);
+        result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+    }
+    else if (flush_appends_for(outbox, segmentIndex) != 0)
+    {
+        result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+    }
+    else
+    {
+        if ((outbox->accessFile != NULL) && (outbox->accessSegmentIndex != segmentIndex))
+        {
+            close_access_file(outbox);
+        }
+
+        if ((outbox->accessFile == NULL) &&
+            ((outbox->accessFile = fopen(get_segment_file_name(outbox, segmentIndex), "r+b")) == NULL))
+        {
+            LogError("unable to open segment %lu", (unsigned long)segmentIndex);
+            result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+        }
+        else
+        {
+            outbox->accessSegmentIndex = segmentIndex;
+            if ((fseek(outbox->accessFile, (long)offset, SEEK_SET) != 0) ||
+                (fread(header, sizeof(*header), 1, outbox->accessFile) != 1))
+            {
+                LogError("record %llu cannot be read", (unsigned long long)recordId);
+                result = feof(outbox->accessFile) ? IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD : IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+                clearerr(outbox->accessFile);
+            }
+            else if (header->magic != OUTBOX_RECORD_MAGIC)
+            {
+                LogError("record %llu is not a record", (unsigned long long)recordId);
+                result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+            }
+            else
+            {
+                *segment = &(outbox->segments[segmentIndex - outbox->firstSegmentIndex]);
+                result = IOTHUB_CLIENT_OUTBOX_READ_OK;
+            }
+        }
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_OUTBOX_HANDLE IoTHubClient_Outbox_Create(const char* directory, size_t segmentSize)
+{
+    IOTHUB_CLIENT_OUTBOX_INSTANCE* result;
+
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_001: [ If directory is NULL, or segmentSize is 0 or greater than 0x7FFFFFFF, IoTHubClient_Outbox_Create shall return NULL. ]*/
+    if ((directory == NULL) || (segmentSize == 0) || (segmentSize > OUTBOX_MAX_SEGMENT_SIZE))
+    {
+        LogError("invalid arg const char* directory=%p, size_t segmentSize=%zu", directory, segmentSize);
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_CLIENT_OUTBOX_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_OUTBOX_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_002: [ If any resource cannot be allocated or the segment to append to cannot be created, IoTHubClient_Outbox_Create shall return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        size_t directoryLength = strlen(directory);
+        (void)memset(result, 0, sizeof(IOTHUB_CLIENT_OUTBOX_INSTANCE));
+        result->segmentSize = segmentSize;
+
+        if (((result->directory = (char*)malloc(directoryLength + 1)) == NULL) ||
+            ((result->fileName = (char*)malloc(directoryLength + OUTBOX_FILE_NAME_EXTRA_SIZE)) == NULL) ||
+            ((result->newHeadFileName = (char*)malloc(directoryLength + sizeof(OUTBOX_NEW_HEAD_FILE_FORMAT))) == NULL))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_002: [ If any resource cannot be allocated or the segment to append to cannot be created, IoTHubClient_Outbox_Create shall return NULL. ]*/
+            LogError("unable to malloc");
+            destroy_outbox(result);
+            result = NULL;
+        }
+        else
+        {
+            OUTBOX_SEGMENT scannedSegment;
+            bool failed = false;
+            (void)memcpy(result->directory, directory, directoryLength + 1);
+
+            /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_003: [ IoTHubClient_Outbox_Create shall read the index of the first segment from the head file of directory, or use 0 if there is none, and count the pending records of that segment and of every segment that follows it. ]*/
+            result->firstSegmentIndex = read_first_segment_index(result);
+            while (!failed && segment_exists(result, result->firstSegmentIndex + (uint32_t)result->segmentCount))
+            {
+                scannedSegment.pendingRecords = 0;
+                if ((walk_segment(result, result->firstSegmentIndex + (uint32_t)result->segmentCount, count_pending_record, &scannedSegment) != 0) ||
+                    (add_segment(result, scannedSegment.pendingRecords) != 0))
+                {
+                    failed = true;
+                }
+            }
+
+            /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_004: [ IoTHubClient_Outbox_Create shall create a new segment to append to after the existing ones. ]*/
+            if (failed || (start_new_segment(result) != 0))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_002: [ If any resource cannot be allocated or the segment to append to cannot be created, IoTHubClient_Outbox_Create shall return NULL. ]*/
+                LogError("unable to open the outbox in %s", directory);
+                destroy_outbox(result);
+                result = NULL;
+            }
+            else
+            {
+                delete_completed_segments(result);
+            }
+        }
+    }
+    return result;
+}
+
+void IoTHubClient_Outbox_Destroy(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_005: [ If outboxHandle is NULL, IoTHubClient_Outbox_Destroy shall do nothing, otherwise it shall flush and close the segment files and free the outbox; the pending records stay in the directory. ]*/
+    if (outboxHandle != NULL)
+    {
+        destroy_outbox(outboxHandle);
+    }
+}
+
+int IoTHubClient_Outbox_ForEachPending(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK pendingCallback, void* context)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_007: [ If outboxHandle or pendingCallback is NULL, IoTHubClient_Outbox_ForEachPending shall fail and return a non-zero value. ]*/
+    if ((outboxHandle == NULL) || (pendingCallback == NULL))
+    {
+        LogError("invalid arg IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle=%p, IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK pendingCallback=%p", outboxHandle, pendingCallback);
+        result = __LINE__;
+    }
+    else
+    {
+        OUTBOX_PENDING_WALK walk;
+        size_t i;
+        walk.pendingCallback = pendingCallback;
+        walk.context = context;
+        result = 0;
+
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_008: [ IoTHubClient_Outbox_ForEachPending shall call pendingCallback with the record id of every pending record, segment after segment, in the order the records were appended. ]*/
+        for (i = 0; i < outboxHandle->segmentCount; i++)
+        {
+            walk.segmentIndex = outboxHandle->firstSegmentIndex + (uint32_t)i;
+            if (outboxHandle->segments[i].pendingRecords > 0)
+            {
+                if ((flush_appends_for(outboxHandle, walk.segmentIndex) != 0) ||
+                    (walk_segment(outboxHandle, walk.segmentIndex, report_pending_record, &walk) != 0))
+                {
+                    LogError("unable to read segment %lu", (unsigned long)walk.segmentIndex);
+                    result = __LINE__;
+                    break;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_Outbox_Append(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t* recordId)
+{
+    int result;
+    unsigned char* body;
+    size_t bodySize;
+
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_009: [ If outboxHandle, messageHandle or recordId is NULL, IoTHubClient_Outbox_Append shall fail and return a non-zero value. ]*/
+    if ((outboxHandle == NULL) || (messageHandle == NULL) || (recordId == NULL))
+    {
+        LogError("invalid arg IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle=%p, IOTHUB_MESSAGE_HANDLE messageHandle=%p, uint64_t* recordId=%p", outboxHandle, messageHandle, recordId);
+        result = __LINE__;
+    }
+    else if ((outboxHandle->appendOffset >= outboxHandle->segmentSize) && (start_new_segment(outboxHandle) != 0))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_011: [ If the message cannot be serialized or written, IoTHubClient_Outbox_Append shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_010: [ IoTHubClient_Outbox_Append shall write a pending record holding the content type, priority, payload, message id, correlation id and properties of messageHandle at the end of the segment appended to, and set recordId to the segment index in the upper 32 bits and the offset of the record in the lower 32 bits. ]*/
+    else if ((body = serialize_message(messageHandle, &bodySize)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_011: [ If the message cannot be serialized or written, IoTHubClient_Outbox_Append shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    else
+    {
+        OUTBOX_RECORD_HEADER header;
+        header.magic = OUTBOX_RECORD_MAGIC;
+        header.state = OUTBOX_RECORD_PENDING;
+        header.bodySize = (uint32_t)bodySize;
+        header.checksum = compute_checksum(body, bodySize);
+
+        outboxHandle->appendFileDirty = true;
+        if ((fwrite(&header, sizeof(header), 1, outboxHandle->appendFile) != 1) ||
+            (fwrite(body, bodySize, 1, outboxHandle->appendFile) != 1))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_011: [ If the message cannot be serialized or written, IoTHubClient_Outbox_Append shall fail and return a non-zero value. ]*/
+            /*the tail of the segment is torn now, the next append goes to a new segment*/
+            LogError("unable to write to the outbox");
+            outboxHandle->appendOffset = (uint32_t)outboxHandle->segmentSize;
+            result = __LINE__;
+        }
+        else
+        {
+            *recordId = make_record_id(outboxHandle->firstSegmentIndex + (uint32_t)outboxHandle->segmentCount - 1, outboxHandle->appendOffset);
+            outboxHandle->appendOffset += (uint32_t)(sizeof(header) + bodySize);
+            outboxHandle->segments[outboxHandle->segmentCount - 1].pendingRecords++;
+            result = 0;
+        }
+        free(body);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_OUTBOX_READ_RESULT IoTHubClient_Outbox_Read(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, uint64_t recordId, IOTHUB_MESSAGE_HANDLE* messageHandle)
+{
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result;
+    OUTBOX_SEGMENT* segment;
+    OUTBOX_RECORD_HEADER header;
+    unsigned char* body;
+
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_020: [ If outboxHandle or messageHandle is NULL, IoTHubClient_Outbox_Read shall return IOTHUB_CLIENT_OUTBOX_READ_ERROR. ]*/
+    if ((outboxHandle == NULL) || (messageHandle == NULL))
+    {
+        LogError("invalid arg IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle=%p, IOTHUB_MESSAGE_HANDLE* messageHandle=%p", outboxHandle, messageHandle);
+        result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_012: [ If recordId is not the id of a record of the outbox, or the record is cut short, its checksum does not match or it does not hold a message, IoTHubClient_Outbox_Read shall set messageHandle to NULL and return IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_021: [ If the record cannot be read because of an I/O error or any other failure, IoTHubClient_Outbox_Read shall set messageHandle to NULL and return IOTHUB_CLIENT_OUTBOX_READ_ERROR. ]*/
+    else
+    {
+        *messageHandle = NULL;
+        if ((result = seek_record(outboxHandle, recordId, &segment, &header)) != IOTHUB_CLIENT_OUTBOX_READ_OK)
+        {
+            LogError("unable to read record %llu", (unsigned long long)recordId);
+        }
+        else if ((body = (unsigned char*)malloc((header.bodySize == 0) ? 1 : header.bodySize)) == NULL)
+        {
+            LogError("unable to malloc");
+            result = IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+        }
+        else
+        {
+            if (fread(body, 1, header.bodySize, outboxHandle->accessFile) != header.bodySize)
+            {
+                LogError("record %llu cannot be read", (unsigned long long)recordId);
+                result = feof(outboxHandle->accessFile) ? IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD : IOTHUB_CLIENT_OUTBOX_READ_ERROR;
+                clearerr(outboxHandle->accessFile);
+            }
+            else if (compute_checksum(body, header.bodySize) != header.checksum)
+            {
+                LogError("record %llu is corrupted", (unsigned long long)recordId);
+                result = IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_014: [ IoTHubClient_Outbox_Read shall set messageHandle to a new message with the content type, priority, payload, message id, correlation id and properties stored in the record and return IOTHUB_CLIENT_OUTBOX_READ_OK. ]*/
+                result = deserialize_message(body, header.bodySize, messageHandle);
+            }
+            free(body);
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_Outbox_Complete(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, uint64_t recordId)
+{
+    int result;
+    OUTBOX_SEGMENT* segment;
+    OUTBOX_RECORD_HEADER header;
+
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_015: [ If outboxHandle is NULL, or recordId is not the id of a pending record of the outbox, IoTHubClient_Outbox_Complete shall fail and return a non-zero value. ]*/
+    if (outboxHandle == NULL)
+    {
+        LogError("invalid arg IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle=NULL");
+        result = __LINE__;
+    }
+    else if (seek_record(outboxHandle, recordId, &segment, &header) != IOTHUB_CLIENT_OUTBOX_READ_OK)
+    {
+        result = __LINE__;
+    }
+    else if ((header.state != OUTBOX_RECORD_PENDING) || (segment->pendingRecords == 0))
+    {
+        LogError("record %llu is not pending", (unsigned long long)recordId);
+        result = __LINE__;
+    }
+    else
+    {
+        uint32_t completed = OUTBOX_RECORD_COMPLETED;
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_016: [ IoTHubClient_Outbox_Complete shall overwrite the state of the record in place with completed. ]*/
+        outboxHandle->accessFileDirty = true;
+        if ((fseek(outboxHandle->accessFile, (long)((uint32_t)recordId + offsetof(OUTBOX_RECORD_HEADER, state)), SEEK_SET) != 0) ||
+            (fwrite(&completed, sizeof(completed), 1, outboxHandle->accessFile) != 1))
+        {
+            LogError("unable to complete record %llu", (unsigned long long)recordId);
+            result = __LINE__;
+        }
+        else
+        {
+            segment->pendingRecords--;
+            delete_completed_segments(outboxHandle);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_Outbox_Flush(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_017: [ If outboxHandle is NULL, IoTHubClient_Outbox_Flush shall fail and return a non-zero value. ]*/
+    if (outboxHandle == NULL)
+    {
+        LogError("invalid arg IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle=NULL");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+        /*Codes_SRS_IOTHUBCLIENT_OUTBOX_07_018: [ IoTHubClient_Outbox_Flush shall call fflush on the segment files that have buffered appends or completions, sync them to the storage, and return a non-zero value if any fflush or sync fails. ]*/
+        if (outboxHandle->appendFileDirty)
+        {
+            if (flush_and_sync(outboxHandle->appendFile) != 0)
+            {
+                LogError("unable to flush the appends");
+                result = __LINE__;
+            }
+            else
+            {
+                outboxHandle->appendFileDirty = false;
+            }
+        }
+        if (outboxHandle->accessFileDirty)
+        {
+            if (flush_and_sync(outboxHandle->accessFile) != 0)
+            {
+                LogError("unable to flush the completions");
+                result = __LINE__;
+            }
+            else
+            {
+                outboxHandle->accessFileDirty = false;
+            }
+        }
+    }
+    return result;
+}
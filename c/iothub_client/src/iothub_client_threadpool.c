@@ -0,0 +1,438 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+#include "iothub_client_threadpool.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+typedef struct IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_TAG
+{
+    IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION workFunction;
+    void* context;
+    bool isRunning;
+    bool isRemoving; /*set by IoTHubClient_ThreadPool_RemoveWork, the pool threads no longer pick the item*/
+    COND_HANDLE releaseCondition; /*posted when the work function returns while isRemoving is set*/
+} IOTHUB_CLIENT_THREADPOOL_WORK_ITEM;
+
+typedef struct IOTHUB_CLIENT_THREADPOOL_INSTANCE_TAG
+{
+    LOCK_HANDLE lockHandle;
+    COND_HANDLE workCondition; /*the pool threads wait on it when there is no work item they can pick*/
+    VECTOR_HANDLE workItems; /*of IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* */
+    THREAD_HANDLE* threadHandles;
+    size_t threadCount;
+    size_t nextWorkItem;
+    bool isRoundEnded; /*set when the round robin wraps around, cleared once a pool thread has waited 1 ms since*/
+    size_t roundCount; /*number of rounds ended, tells whether a wait started after the current round ended*/
+    sig_atomic_t stopThreads;
+} IOTHUB_CLIENT_THREADPOOL_INSTANCE;
+
+/*used by unittests only*/
+const size_t IoTHubClient_ThreadPool_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_THREADPOOL_INSTANCE, stopThreads);
+
+static bool find_by_handle(const void* element, const void* value)
+{
+    return (*(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* const*)element == (const IOTHUB_CLIENT_THREADPOOL_WORK_ITEM*)value);
+}
+
+/*picks the next work item that is not being run by another pool thread nor being removed. Must be called under the pool lock*/
+static IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* get_next_work_item(IOTHUB_CLIENT_THREADPOOL_INSTANCE* threadPool)
+{
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* result = NULL;
+
+    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_024: [ Once a round has ended, the pool threads shall not pick any work item until the next round starts. ]*/
+    if (!threadPool->isRoundEnded)
+    {
+        size_t itemCount = VECTOR_size(threadPool->workItems);
+        size_t i;
+
+        for (i = 0; (i < itemCount) && (result == NULL); i++)
+        {
+            IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* candidate;
+            if (threadPool->nextWorkItem >= itemCount)
+            {
+                threadPool->nextWorkItem = 0;
+            }
+            candidate = *(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM**)VECTOR_element(threadPool->workItems, threadPool->nextWorkItem);
+            threadPool->nextWorkItem++;
+            if (!candidate->isRunning && !candidate->isRemoving)
+            {
+                candidate->isRunning = true;
+                result = candidate;
+            }
+        }
+
+        if ((itemCount != 0) && (threadPool->nextWorkItem >= itemCount))
+        {
+            threadPool->isRoundEnded = true;
+            threadPool->roundCount++;
+        }
+    }
+
+    return result;
+}
+
+/*marks the work item as no longer running and wakes up IoTHubClient_ThreadPool_RemoveWork if it waits for it*/
+static void release_work_item(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* workItem)
+{
+    workItem->isRunning = false;
+    if (workItem->isRemoving)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_023: [ When the work function returns and IoTHubClient_ThreadPool_RemoveWork waits for the work item, the pool thread shall wake it up by calling Condition_Post on the work item condition. ]*/
+        if (Condition_Post(workItem->releaseCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed");
+        }
+    }
+}
+
+static void wake_up_threads(IOTHUB_CLIENT_THREADPOOL_INSTANCE* threadPool, size_t threadCount)
+{
+    size_t i;
+
+    for (i = 0; i < threadCount; i++)
+    {
+        if (Condition_Post(threadPool->workCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed");
+        }
+    }
+}
+
+static int threadpool_worker_thread(void* threadArgument)
+{
+    IOTHUB_CLIENT_THREADPOOL_INSTANCE* threadPool = (IOTHUB_CLIENT_THREADPOOL_INSTANCE*)threadArgument;
+
+    while (1)
+    {
+        IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* workItem = NULL;
+        bool shouldSleep = true;
+
+        if (Lock(threadPool->lockHandle) == LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_012: [ The pool threads shall exit when IoTHubClient_ThreadPool_Destroy is called. ]*/
+            if (threadPool->stopThreads)
+            {
+                (void)Unlock(threadPool->lockHandle);
+                break;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_010: [ Each pool thread shall pick the registered work items in a round robin fashion, skipping the work items that are being run by another pool thread. ]*/
+                workItem = get_next_work_item(threadPool);
+                if (workItem != NULL)
+                {
+                    shouldSleep = false;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_021: [ If there is no work item the pool thread can pick, it shall call Condition_Wait on the pool condition with the pool lock, for at most 1 ms if work items are registered and until it is signaled otherwise. ]*/
+                    int timeout = (VECTOR_size(threadPool->workItems) == 0) ? 0 : 1;
+                    bool isWaitingForNextRound = threadPool->isRoundEnded;
+                    size_t roundCount = threadPool->roundCount;
+                    COND_RESULT waitResult = Condition_Wait(threadPool->workCondition, threadPool->lockHandle, timeout);
+                    if (waitResult == COND_ERROR)
+                    {
+                        LogError("Condition_Wait failed");
+                    }
+                    else
+                    {
+                        shouldSleep = false;
+                        if ((waitResult == COND_TIMEOUT) && isWaitingForNextRound && (roundCount == threadPool->roundCount))
+                        {
+                            /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_013: [ Every time the round robin wraps around the list of work items, the next round shall start only after a pool thread has waited 1 ms, so that each work item is called every 1 ms as with a dedicated thread. ]*/
+                            threadPool->isRoundEnded = false;
+                        }
+                    }
+                }
+                (void)Unlock(threadPool->lockHandle);
+            }
+        }
+
+        if (workItem != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_011: [ The pool thread shall call the work function of the work item it picked, passing the context given to IoTHubClient_ThreadPool_AddWork. ]*/
+            workItem->workFunction(workItem->context);
+
+            if (Lock(threadPool->lockHandle) != LOCK_OK)
+            {
+                LogError("unable to Lock - still releasing the work item");
+                release_work_item(workItem);
+            }
+            else
+            {
+                release_work_item(workItem);
+                (void)Unlock(threadPool->lockHandle);
+            }
+        }
+
+        if (shouldSleep)
+        {
+            /*the pool lock or the pool condition failed, do not spin*/
+            (void)ThreadAPI_Sleep(1);
+        }
+    }
+
+    return 0;
+}
+
+static void stop_and_join_threads(IOTHUB_CLIENT_THREADPOOL_INSTANCE* threadPool, size_t threadCount)
+{
+    size_t i;
+
+    if (Lock(threadPool->lockHandle) != LOCK_OK)
+    {
+        LogError("unable to Lock - will still attempt to end the threads without thread safety");
+        threadPool->stopThreads = 1;
+        wake_up_threads(threadPool, threadCount);
+    }
+    else
+    {
+        threadPool->stopThreads = 1;
+        wake_up_threads(threadPool, threadCount);
+        (void)Unlock(threadPool->lockHandle);
+    }
+
+    for (i = 0; i < threadCount; i++)
+    {
+        int res;
+        if (ThreadAPI_Join(threadPool->threadHandles[i], &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed");
+        }
+    }
+}
+
+IOTHUB_CLIENT_THREADPOOL_HANDLE IoTHubClient_ThreadPool_Create(size_t threadCount)
+{
+    IOTHUB_CLIENT_THREADPOOL_INSTANCE* result;
+
+    if (threadCount == 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_001: [ If threadCount is 0, IoTHubClient_ThreadPool_Create shall return NULL. ]*/
+        LogError("invalid threadCount 0");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_002: [ IoTHubClient_ThreadPool_Create shall allocate memory for the pool, create the pool lock by calling Lock_Init, the pool condition by calling Condition_Init and the list of work items by calling VECTOR_create. ]*/
+    else if ((result = (IOTHUB_CLIENT_THREADPOOL_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_THREADPOOL_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_003: [ If any of the resources cannot be created, IoTHubClient_ThreadPool_Create shall free everything it created and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->threadHandles = (THREAD_HANDLE*)malloc(threadCount * sizeof(THREAD_HANDLE))) == NULL)
+    {
+        LogError("unable to malloc");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        LogError("Lock_Init failed");
+        free(result->threadHandles);
+        free(result);
+        result = NULL;
+    }
+    else if ((result->workCondition = Condition_Init()) == NULL)
+    {
+        LogError("Condition_Init failed");
+        Lock_Deinit(result->lockHandle);
+        free(result->threadHandles);
+        free(result);
+        result = NULL;
+    }
+    else if ((result->workItems = VECTOR_create(sizeof(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM*))) == NULL)
+    {
+        LogError("VECTOR_create failed");
+        Condition_Deinit(result->workCondition);
+        Lock_Deinit(result->lockHandle);
+        free(result->threadHandles);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t i;
+
+        result->threadCount = threadCount;
+        result->nextWorkItem = 0;
+        result->isRoundEnded = false;
+        result->roundCount = 0;
+        result->stopThreads = 0;
+
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_004: [ IoTHubClient_ThreadPool_Create shall start threadCount threads by calling ThreadAPI_Create. ]*/
+        for (i = 0; i < threadCount; i++)
+        {
+            if (ThreadAPI_Create(&result->threadHandles[i], threadpool_worker_thread, result) != THREADAPI_OK)
+            {
+                break;
+            }
+        }
+
+        if (i < threadCount)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_005: [ If starting any of the threads fails, IoTHubClient_ThreadPool_Create shall stop and join the threads already started, free all resources and return NULL. ]*/
+            LogError("ThreadAPI_Create failed");
+            stop_and_join_threads(result, i);
+            VECTOR_destroy(result->workItems);
+            Condition_Deinit(result->workCondition);
+            Lock_Deinit(result->lockHandle);
+            free(result->threadHandles);
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void IoTHubClient_ThreadPool_Destroy(IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_006: [ If threadPoolHandle is NULL, IoTHubClient_ThreadPool_Destroy shall do nothing. ]*/
+    if (threadPoolHandle != NULL)
+    {
+        size_t i;
+        size_t itemCount;
+
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_007: [ IoTHubClient_ThreadPool_Destroy shall signal the pool threads to end, wake them up by calling Condition_Post once per thread and join them. ]*/
+        stop_and_join_threads(threadPoolHandle, threadPoolHandle->threadCount);
+
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_008: [ IoTHubClient_ThreadPool_Destroy shall free all the work items that were not removed and all other resources. ]*/
+        itemCount = VECTOR_size(threadPoolHandle->workItems);
+        if (itemCount != 0)
+        {
+            LogError("destroying a thread pool that still has %zu work items", itemCount);
+        }
+        for (i = 0; i < itemCount; i++)
+        {
+            IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* workItem = *(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM**)VECTOR_element(threadPoolHandle->workItems, i);
+            Condition_Deinit(workItem->releaseCondition);
+            free(workItem);
+        }
+        VECTOR_destroy(threadPoolHandle->workItems);
+        Condition_Deinit(threadPoolHandle->workCondition);
+        Lock_Deinit(threadPoolHandle->lockHandle);
+        free(threadPoolHandle->threadHandles);
+        free(threadPoolHandle);
+    }
+}
+
+IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE IoTHubClient_ThreadPool_AddWork(IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION workFunction, void* context)
+{
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM* result;
+
+    if ((threadPoolHandle == NULL) || (workFunction == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_014: [ If threadPoolHandle or workFunction is NULL, IoTHubClient_ThreadPool_AddWork shall return NULL. ]*/
+        LogError("invalid arg threadPoolHandle=%p, workFunction=%p", threadPoolHandle, workFunction);
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_015: [ IoTHubClient_ThreadPool_AddWork shall allocate a work item holding workFunction and context, and create the work item condition by calling Condition_Init. ]*/
+    else if ((result = (IOTHUB_CLIENT_THREADPOOL_WORK_ITEM*)malloc(sizeof(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_016: [ If any operation fails, IoTHubClient_ThreadPool_AddWork shall return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->releaseCondition = Condition_Init()) == NULL)
+    {
+        LogError("Condition_Init failed");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->workFunction = workFunction;
+        result->context = context;
+        result->isRunning = false;
+        result->isRemoving = false;
+
+        if (Lock(threadPoolHandle->lockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock");
+            Condition_Deinit(result->releaseCondition);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_017: [ IoTHubClient_ThreadPool_AddWork shall add the work item to the pool's list under the pool lock and return it. ]*/
+            if (VECTOR_push_back(threadPoolHandle->workItems, &result, 1) != 0)
+            {
+                LogError("VECTOR_push_back failed");
+                Condition_Deinit(result->releaseCondition);
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_022: [ IoTHubClient_ThreadPool_AddWork shall wake up a pool thread by calling Condition_Post on the pool condition. ]*/
+                wake_up_threads(threadPoolHandle, 1);
+            }
+            (void)Unlock(threadPoolHandle->lockHandle);
+        }
+    }
+
+    return result;
+}
+
+void IoTHubClient_ThreadPool_RemoveWork(IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItemHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_018: [ If threadPoolHandle or workItemHandle is NULL, IoTHubClient_ThreadPool_RemoveWork shall do nothing. ]*/
+    if ((threadPoolHandle != NULL) && (workItemHandle != NULL))
+    {
+        bool isRemoved = false;
+
+        while (!isRemoved)
+        {
+            if (Lock(threadPoolHandle->lockHandle) != LOCK_OK)
+            {
+                LogError("unable to Lock");
+                (void)ThreadAPI_Sleep(1);
+            }
+            else
+            {
+                COND_RESULT waitResult = COND_OK;
+
+                workItemHandle->isRemoving = true;
+
+                /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_019: [ If the work function is being run by a pool thread, IoTHubClient_ThreadPool_RemoveWork shall wait for it to return by calling Condition_Wait on the work item condition with the pool lock. ]*/
+                while (workItemHandle->isRunning && (waitResult != COND_ERROR))
+                {
+                    waitResult = Condition_Wait(workItemHandle->releaseCondition, threadPoolHandle->lockHandle, 0);
+                }
+
+                if (!workItemHandle->isRunning)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_THREADPOOL_07_020: [ IoTHubClient_ThreadPool_RemoveWork shall remove the work item from the pool's list and free it. ]*/
+                    void* element = VECTOR_find_if(threadPoolHandle->workItems, find_by_handle, workItemHandle);
+                    if (element != NULL)
+                    {
+                        VECTOR_erase(threadPoolHandle->workItems, element, 1);
+                    }
+                    isRemoved = true;
+                }
+                (void)Unlock(threadPoolHandle->lockHandle);
+
+                if (!isRemoved)
+                {
+                    LogError("Condition_Wait failed");
+                    (void)ThreadAPI_Sleep(1);
+                }
+            }
+        }
+
+        Condition_Deinit(workItemHandle->releaseCondition);
+        free(workItemHandle);
+    }
+}
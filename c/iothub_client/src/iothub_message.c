@@ -25,9 +25,15 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
         BUFFER_HANDLE byteArray;
         STRING_HANDLE string;
     } value;
+    /*set for the messages created by IoTHubMessage_CreateFromByteArrayNoCopy, in which case value.byteArray is NULL*/
+    const unsigned char* externalByteArray;
+    size_t externalSize;
+    IOTHUB_MESSAGE_RELEASE_BUFFER_CALLBACK releaseCallback;
+    void* releaseContext;
     MAP_HANDLE properties;
     char* messageId;
     char* correlationId;
+    IOTHUB_MESSAGE_PRIORITY priority;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
 static bool ContainsOnlyUsAscii(const char* asciiValue)
@@ -120,8 +126,13 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
                 /*Codes_SRS_IOTHUBMESSAGE_02_025: [Otherwise, IoTHubMessage_CreateFromByteArray shall return a non-NULL handle.] */
                 /*Codes_SRS_IOTHUBMESSAGE_02_026: [The type of the new message shall be IOTHUBMESSAGE_BYTEARRAY.] */
                 result->contentType = IOTHUBMESSAGE_BYTEARRAY;
+                result->externalByteArray = NULL;
+                result->externalSize = 0;
+                result->releaseCallback = NULL;
+                result->releaseContext = NULL;
                 result->messageId = NULL;
                 result->correlationId = NULL;
+                result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
                 /*all is fine, return result*/
             }
         }
@@ -162,13 +173,57 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
             /*Codes_SRS_IOTHUBMESSAGE_02_031: [Otherwise, IoTHubMessage_CreateFromString shall return a non-NULL handle.] */
             /*Codes_SRS_IOTHUBMESSAGE_02_032: [The type of the new message shall be IOTHUBMESSAGE_STRING.] */
             result->contentType = IOTHUBMESSAGE_STRING;
+            result->externalByteArray = NULL;
+            result->externalSize = 0;
+            result->releaseCallback = NULL;
+            result->releaseContext = NULL;
             result->messageId = NULL;
             result->correlationId = NULL;
+            result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
         }
     }
     return result;
 }
 
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArrayNoCopy(const unsigned char* byteArray, size_t size, IOTHUB_MESSAGE_RELEASE_BUFFER_CALLBACK releaseCallback, void* context)
+{
+    IOTHUB_MESSAGE_HANDLE_DATA* result;
+    if ((byteArray == NULL) && (size != 0))
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_022: [ If size is not zero and byteArray is NULL, IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL. ]*/
+        LogError("invalid arg const unsigned char* byteArray=%p, size_t size=%zu", byteArray, size);
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_025: [ If there are any errors then IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL and shall not call releaseCallback. ]*/
+        LogError("unable to malloc");
+    }
+    /*Codes_SRS_IOTHUBMESSAGE_07_024: [ IoTHubMessage_CreateFromByteArrayNoCopy shall call Map_Create to create the message properties. ]*/
+    else if ((result->properties = Map_Create(ValidateAsciiCharactersFilter)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_025: [ If there are any errors then IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL and shall not call releaseCallback. ]*/
+        LogError("Map_Create failed");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_023: [ IoTHubMessage_CreateFromByteArrayNoCopy shall keep byteArray, size, releaseCallback and context without copying the content of byteArray. ]*/
+        /*Codes_SRS_IOTHUBMESSAGE_07_026: [ Otherwise, IoTHubMessage_CreateFromByteArrayNoCopy shall return a non-NULL handle of type IOTHUBMESSAGE_BYTEARRAY. ]*/
+        result->contentType = IOTHUBMESSAGE_BYTEARRAY;
+        result->value.byteArray = NULL;
+        result->externalByteArray = byteArray;
+        result->externalSize = size;
+        result->releaseCallback = releaseCallback;
+        result->releaseContext = context;
+        result->messageId = NULL;
+        result->correlationId = NULL;
+        result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    return result;
+}
+
 /*Codes_SRS_IOTHUBMESSAGE_03_001: [IoTHubMessage_Clone shall create a new IoT hub message with data content identical to that of the iotHubMessageHandle parameter.]*/
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
@@ -192,8 +247,14 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
         }
         else
         {
+            result->externalByteArray = NULL;
+            result->externalSize = 0;
+            result->releaseCallback = NULL;
+            result->releaseContext = NULL;
             result->messageId = NULL;
             result->correlationId = NULL;
+            /*Codes_SRS_IOTHUBMESSAGE_07_034: [ IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle. ]*/
+            result->priority = source->priority;
             if (source->messageId != NULL && mallocAndStrcpy_s(&result->messageId, source->messageId) != 0)
             {
                 LogError("unable to Copy messageId");
@@ -214,7 +275,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
             else if (source->contentType == IOTHUBMESSAGE_BYTEARRAY)
             {
                 /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone to content by a call to BUFFER_clone] */
-                if ((result->value.byteArray = BUFFER_clone(source->value.byteArray)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_07_027: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_Clone shall copy its byte array by calling BUFFER_create. ]*/
+                if ((result->value.byteArray = (source->value.byteArray != NULL) ? BUFFER_clone(source->value.byteArray) : BUFFER_create(source->externalByteArray, source->externalSize)) == NULL)
                 {
                     /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
                     LogError("unable to BUFFER_clone");
@@ -329,6 +391,13 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMes
             result = IOTHUB_MESSAGE_INVALID_ARG;
             LogError("invalid type of message %s", ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, handleData->contentType));
         }
+        else if (handleData->value.byteArray == NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_07_028: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_GetByteArray shall return the byteArray and size it was created with. ]*/
+            *buffer = handleData->externalByteArray;
+            *size = handleData->externalSize;
+            result = IOTHUB_MESSAGE_OK;
+        }
         else
         {
             /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
@@ -451,6 +520,44 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_SetCorrelationId(IOTHUB_MESSAGE_HANDLE iotHu
     return result;
 }
 
+IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+    /*Codes_SRS_IOTHUBMESSAGE_07_030: [ If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL. ]*/
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("invalid arg (NULL) passed to IoTHubMessage_GetPriority");
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_031: [ Otherwise IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL if IoTHubMessage_SetPriority was never called. ]*/
+        IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
+        result = handleData->priority;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    /*Codes_SRS_IOTHUBMESSAGE_07_032: [ If iotHubMessageHandle is NULL or priority is not one of the IOTHUB_MESSAGE_PRIORITY values, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG. ]*/
+    if (iotHubMessageHandle == NULL ||
+        ((priority != IOTHUB_MESSAGE_PRIORITY_LOW) && (priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) && (priority != IOTHUB_MESSAGE_PRIORITY_HIGH)))
+    {
+        LogError("invalid arg passed to IoTHubMessage_SetPriority");
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_07_033: [ Otherwise IoTHubMessage_SetPriority shall store priority in the message and return IOTHUB_MESSAGE_OK. ]*/
+        IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
+        handleData->priority = priority;
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
 IOTHUB_MESSAGE_RESULT IoTHubMessage_SetMessageId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* messageId)
 {
     IOTHUB_MESSAGE_RESULT result;
@@ -509,7 +616,15 @@ void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
         if (handleData->contentType == IOTHUBMESSAGE_BYTEARRAY)
         {
-            BUFFER_delete(handleData->value.byteArray);
+            if (handleData->value.byteArray != NULL)
+            {
+                BUFFER_delete(handleData->value.byteArray);
+            }
+            else if (handleData->releaseCallback != NULL)
+            {
+                /*Codes_SRS_IOTHUBMESSAGE_07_029: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_Destroy shall call releaseCallback (if not NULL) with the byteArray, size and context the message was created with. ]*/
+                handleData->releaseCallback(handleData->externalByteArray, handleData->externalSize, handleData->releaseContext);
+            }
         }
         else
         {
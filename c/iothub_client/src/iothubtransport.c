@@ -17,8 +17,10 @@
 #include "iothub_client_private.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
+#include "iothub_client_threadpool.h"
 
 typedef struct TRANSPORT_HANDLE_DATA_TAG
 {
@@ -26,6 +28,10 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG
     THREAD_HANDLE workerThreadHandle;
     LOCK_HANDLE lockHandle;
     sig_atomic_t stopThread;
+	COND_HANDLE workCondition;
+	unsigned int idleWaitTime;
+	IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool; /* when set, DoWork is scheduled on the pool instead of on workerThreadHandle */
+	IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItem;
 	TRANSPORT_PROVIDER_FIELDS;
 	VECTOR_HANDLE clients;
 } TRANSPORT_HANDLE_DATA;
@@ -109,6 +115,10 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 						/*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
 						result->stopThread = 1;
 						result->workerThreadHandle = NULL; /* create thread when work needs to be done */
+						result->workCondition = NULL; /* created when an idle wait time is set */
+						result->idleWaitTime = 0;
+						result->threadPool = NULL;
+						result->workItem = NULL;
                         result->IoTHubTransport_GetHostname = transportProtocol->IoTHubTransport_GetHostname;
 						result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
 						result->IoTHubTransport_Create = transportProtocol->IoTHubTransport_Create;
@@ -128,12 +138,48 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 	return result;
 }
 
+static int get_worker_wait_time(TRANSPORT_HANDLE_DATA* transportData)
+{
+	int result = (int)transportData->idleWaitTime;
+	size_t clientCount = VECTOR_size(transportData->clients);
+	size_t index;
+
+	for (index = 0; index < clientCount; index++)
+	{
+		IOTHUB_CLIENT_HANDLE* clientHandle = (IOTHUB_CLIENT_HANDLE*)VECTOR_element(transportData->clients, index);
+		/*Codes_SRS_IOTHUBTRANSPORT_07_014: [ If any client using the transport reports that it is busy sending, the thread shall wait at most 1 ms so that confirmations are processed as fast as before. ]*/
+		if ((clientHandle != NULL) && IoTHubClient_IsSendBusy(*clientHandle))
+		{
+			result = 1;
+			break;
+		}
+	}
+	return result;
+}
+
+static void signal_queue_space(TRANSPORT_HANDLE_DATA* transportData)
+{
+	size_t clientCount = VECTOR_size(transportData->clients);
+	size_t index;
+
+	for (index = 0; index < clientCount; index++)
+	{
+		IOTHUB_CLIENT_HANDLE* clientHandle = (IOTHUB_CLIENT_HANDLE*)VECTOR_element(transportData->clients, index);
+		if (clientHandle != NULL)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_015: [ After each call to lower layer transport DoWork, IoTHubClient_SignalQueueSpace shall be called for each client using the transport, so that the events waiting for room in the send queue are retried. ]*/
+			IoTHubClient_SignalQueueSpace(*clientHandle);
+		}
+	}
+}
+
 static int transport_worker_thread(void* threadArgument)
 {
 	TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
 
 	while (1)
 	{
+		bool hasWaited = false;
 		/*Codes_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. ]*/
 		if (Lock(transportData->lockHandle) == LOCK_OK)
 		{
@@ -147,16 +193,45 @@ static int transport_worker_thread(void* threadArgument)
 			else
 			{
 				(transportData->IoTHubTransport_DoWork)(transportData->transportLLHandle, NULL);
+				signal_queue_space(transportData);
+				if ((transportData->idleWaitTime != 0) && (transportData->workCondition != NULL))
+				{
+					/*Codes_SRS_IOTHUBTRANSPORT_07_001: [ If an idle wait time has been set, the thread shall call Condition_Wait with the transport lock and the idle wait time instead of sleeping. ]*/
+					if (Condition_Wait(transportData->workCondition, transportData->lockHandle, get_worker_wait_time(transportData)) == COND_ERROR)
+					{
+						LogError("Condition_Wait failed");
+					}
+					hasWaited = true;
+				}
 				(void)Unlock(transportData->lockHandle);
 			}
 		}
-		/*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
-		ThreadAPI_Sleep(1);
+		if (!hasWaited)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
+			ThreadAPI_Sleep(1);
+		}
 	}
 
 	return 0;
 }
 
+static void transport_worker_item(void* context)
+{
+	TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)context;
+
+	/*Codes_SRS_IOTHUBTRANSPORT_07_009: [ The work item registered with the thread pool shall call lower layer transport DoWork under the transport lock, unless the worker has been signaled to end. ]*/
+	if (Lock(transportData->lockHandle) == LOCK_OK)
+	{
+		if (!transportData->stopThread)
+		{
+			(transportData->IoTHubTransport_DoWork)(transportData->transportLLHandle, NULL);
+			signal_queue_space(transportData);
+		}
+		(void)Unlock(transportData->lockHandle);
+	}
+}
+
 static bool find_by_handle(const void* element, const void* value)
 {
 	/* data stored at element is device handle */
@@ -168,16 +243,21 @@ static bool find_by_handle(const void* element, const void* value)
 static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_HANDLE clientHandle)
 {
 	IOTHUB_CLIENT_RESULT result;
-	if (transportData->workerThreadHandle == NULL)
+	if ((transportData->workerThreadHandle == NULL) && (transportData->workItem == NULL))
 	{
-		/*Codes_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]*/
 		transportData->stopThread = 0;
-		if (ThreadAPI_Create(&transportData->workerThreadHandle, transport_worker_thread, transportData) != THREADAPI_OK)
+		if (transportData->threadPool != NULL)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_008: [ If a thread pool has been set, IoTHubTransport_StartWorkerThread shall schedule the work by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]*/
+			transportData->workItem = IoTHubClient_ThreadPool_AddWork(transportData->threadPool, transport_worker_item, transportData);
+		}
+		/*Codes_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]*/
+		else if (ThreadAPI_Create(&transportData->workerThreadHandle, transport_worker_thread, transportData) != THREADAPI_OK)
 		{
 			transportData->workerThreadHandle = NULL;
 		}
 	}
-	if (transportData->workerThreadHandle != NULL)
+	if ((transportData->workerThreadHandle != NULL) || (transportData->workItem != NULL))
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the list of IoTHubClient handles. ]*/
 		bool addToList = ((VECTOR_size(transportData->clients) == 0) || (VECTOR_find_if(transportData->clients, find_by_handle, clientHandle) == NULL));
@@ -210,6 +290,10 @@ static void stop_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
 {
 	/*Codes_SRS_IOTHUBTRANSPORT_17_043: [** IoTHubTransport_SignalEndWorkerThread shall signal the worker thread to end.*/
 	transportData->stopThread = 1;
+	if (transportData->workCondition != NULL)
+	{
+		(void)Condition_Post(transportData->workCondition);
+	}
 }
 
 static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
@@ -227,6 +311,12 @@ static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
 			transportData->workerThreadHandle = NULL;
 		}
 	}
+	if (transportData->workItem != NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_07_010: [ If the work was scheduled on a thread pool, it shall be removed by calling IoTHubClient_ThreadPool_RemoveWork instead of joining a thread. ]*/
+		IoTHubClient_ThreadPool_RemoveWork(transportData->threadPool, transportData->workItem);
+		transportData->workItem = NULL;
+	}
 }
 
 static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_HANDLE clientHandle)
@@ -239,7 +329,7 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
 		VECTOR_erase(transportData->clients, element, 1);
 	}
 	/*Codes_SRS_IOTHUBTRANSPORT_17_025: [ If the worker thread does not exist, then IoTHubTransport_EndWorkerThread shall return. ]*/
-	if (transportData->workerThreadHandle != NULL)
+	if ((transportData->workerThreadHandle != NULL) || (transportData->workItem != NULL))
 	{
 		if (VECTOR_size(transportData->clients) == 0)
 		{
@@ -278,6 +368,10 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
 		wait_worker_thread(transportData);
 		/*Codes_SRS_IOTHUBTRANSPORT_17_010: [ IoTHubTransport_Destroy shall free all resources. ]*/
 		Lock_Deinit(transportData->lockHandle);
+		if (transportData->workCondition != NULL)
+		{
+			Condition_Deinit(transportData->workCondition);
+		}
 		(transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
 		VECTOR_destroy(transportData->clients);
 		free(transportHandle);
@@ -373,3 +467,79 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
 		wait_worker_thread(transportData);
 	}
 }
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_SetWorkerIdleWaitTime(TRANSPORT_HANDLE transportHandle, unsigned int idleWaitTime)
+{
+	IOTHUB_CLIENT_RESULT result;
+	if (transportHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_07_002: [ If transportHandle is NULL, IoTHubTransport_SetWorkerIdleWaitTime shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+		LogError("Invalid NULL transportHandle");
+		result = IOTHUB_CLIENT_INVALID_ARG;
+	}
+	else
+	{
+		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		/*Codes_SRS_IOTHUBTRANSPORT_07_003: [ IoTHubTransport_SetWorkerIdleWaitTime shall create the work condition by calling Condition_Init if it does not exist yet and idleWaitTime is not 0. ]*/
+		if ((idleWaitTime != 0) && (transportData->workCondition == NULL) &&
+			((transportData->workCondition = Condition_Init()) == NULL))
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_004: [ If Condition_Init fails, IoTHubTransport_SetWorkerIdleWaitTime shall return IOTHUB_CLIENT_ERROR. ]*/
+			LogError("Condition_Init failed");
+			result = IOTHUB_CLIENT_ERROR;
+		}
+		else
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_005: [ IoTHubTransport_SetWorkerIdleWaitTime shall store idleWaitTime, wake up the worker thread and return IOTHUB_CLIENT_OK. ]*/
+			IoTHubTransport_SignalWorkerThread(transportHandle);
+			transportData->idleWaitTime = idleWaitTime;
+			result = IOTHUB_CLIENT_OK;
+		}
+	}
+	return result;
+}
+
+void IoTHubTransport_SignalWorkerThread(TRANSPORT_HANDLE transportHandle)
+{
+	/*Codes_SRS_IOTHUBTRANSPORT_07_006: [ If transportHandle is NULL, IoTHubTransport_SignalWorkerThread shall do nothing. ]*/
+	if (transportHandle != NULL)
+	{
+		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		/*Codes_SRS_IOTHUBTRANSPORT_07_007: [ If an idle wait time has been set, IoTHubTransport_SignalWorkerThread shall wake up the worker thread by calling Condition_Post. ]*/
+		if ((transportData->idleWaitTime != 0) && (transportData->workCondition != NULL))
+		{
+			if (Condition_Post(transportData->workCondition) != COND_OK)
+			{
+				LogError("Condition_Post failed");
+			}
+		}
+	}
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_SetThreadPool(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE threadPoolHandle)
+{
+	IOTHUB_CLIENT_RESULT result;
+	if (transportHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_07_011: [ If transportHandle is NULL, IoTHubTransport_SetThreadPool shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+		LogError("Invalid NULL transportHandle");
+		result = IOTHUB_CLIENT_INVALID_ARG;
+	}
+	else
+	{
+		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		if ((transportData->workerThreadHandle != NULL) || (transportData->workItem != NULL))
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_012: [ If the worker has already been started, IoTHubTransport_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]*/
+			LogError("the worker thread has already been started");
+			result = IOTHUB_CLIENT_ERROR;
+		}
+		else
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_07_013: [ Otherwise IoTHubTransport_SetThreadPool shall store threadPoolHandle and return IOTHUB_CLIENT_OK. ]*/
+			transportData->threadPool = threadPoolHandle;
+			result = IOTHUB_CLIENT_OK;
+		}
+	}
+	return result;
+}
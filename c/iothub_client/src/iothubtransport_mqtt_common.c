@@ -5,7 +5,6 @@
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
-#include <ctype.h>
 #include "azure_c_shared_utility/gballoc.h"
 
 #include "azure_c_shared_utility/xlogging.h"
@@ -16,14 +15,17 @@
 #include "iothub_client_ll.h"
 #include "iothub_client_options.h"
 #include "iothub_client_private.h"
+#include "iothub_client_block_pool.h"
+#include "iothubtransport_mqtt_inflight.h"
+#include "iothubtransport_mqtt_topic.h"
 #include "azure_umqtt_c/mqtt_client.h"
 #include "azure_c_shared_utility/sastoken.h"
 #include "azure_c_shared_utility/tickcounter.h"
 
 #include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/optionhandler.h"
 #include "azure_c_shared_utility/platform.h"
 
-#include "azure_c_shared_utility/string_tokenizer.h"
 #include "iothub_client_version.h"
 
 #include "iothubtransport_mqtt_common.h"
@@ -46,9 +48,11 @@
 #define FAILED_CONN_BACKOFF_VALUE   5
 #define STATUS_CODE_FAILURE_VALUE   500
 #define STATUS_CODE_TIMEOUT_VALUE   408
-
-static const char TOPIC_DEVICE_TWIN_PREFIX[] = "$iothub/twin";
-static const char TOPIC_DEVICE_METHOD_PREFIX[] = "$iothub/methods";
+#define INFLIGHT_INITIAL_CAPACITY   16
+#define PUBLISH_TOKEN               1000 // a publish token in thousandths, the bucket is refilled by the ms
+#define METHOD_NAME_BUFFER_SIZE     128
+#define SAS_ROLLOVER_TIMEOUT_VALUE  30 // seconds the new connection of a rollover has to be accepted
+#define DRAIN_TIMEOUT_VALUE         10 // seconds the replaced connection has to acknowledge its publishes
 
 static const char* TOPIC_GET_DESIRED_STATE = "$iothub/twin/res/#";
 static const char* TOPIC_NOTIFICATION_STATE = "$iothub/twin/PATCH/properties/desired/#";
@@ -66,8 +70,6 @@ static const char* REPORTED_PROPERTIES_TOPIC = "$iothub/twin/PATCH/properties/re
 static const char* GET_PROPERTIES_TOPIC = "$iothub/twin/GET/?$rid=%"PRIu16;
 static const char* DEVICE_METHOD_RESPONSE_TOPIC = "$iothub/methods/res/%d/?$rid=%"PRIu16;
 
-static const char* REQUEST_ID_PROPERTY = "?$rid=";
-
 #define UNSUBSCRIBE_FROM_TOPIC                  0x0000
 #define SUBSCRIBE_GET_REPORTED_STATE_TOPIC      0x0001
 #define SUBSCRIBE_NOTIFICATION_STATE_TOPIC      0x0002
@@ -76,21 +78,15 @@ static const char* REQUEST_ID_PROPERTY = "?$rid=";
 #define SUBSCRIBE_DEVICE_METHOD_TOPIC           0x0010
 #define SUBSCRIBE_TOPIC_COUNT                   4
 
-typedef struct SYSTEM_PROPERTY_INFO_TAG
-{
-    const char* propName;
-    size_t propLength;
-} SYSTEM_PROPERTY_INFO;
-
-static SYSTEM_PROPERTY_INFO sysPropList[] = {
-    { "%24.exp", 7 },
-    { "%24.mid", 7 },
-    { "%24.uid", 7 },
-    { "%24.to", 6 },
-    { "%24.cid", 7 },
-    { "devices/", 8 },
-    { "iothub-operation", 16 },
-    { "iothub-ack", 10 }
+/*the names of the system properties, URL decoded, that are not handed to the application*/
+static const char* sysPropList[] = {
+    "$.exp",
+    "$.mid",
+    "$.uid",
+    "$.to",
+    "$.cid",
+    "iothub-operation",
+    "iothub-ack"
 };
 
 static TICK_COUNTER_HANDLE g_msgTickCounter;
@@ -101,6 +97,14 @@ typedef enum DEVICE_TWIN_MSG_TYPE_TAG
     RETRIEVE_PROPERTIES
 } DEVICE_TWIN_MSG_TYPE;
 
+typedef enum SAS_ROLLOVER_STATE_TAG
+{
+    SAS_ROLLOVER_IDLE,
+    SAS_ROLLOVER_CONNECTING,
+    SAS_ROLLOVER_ACCEPTED,
+    SAS_ROLLOVER_FAILED
+} SAS_ROLLOVER_STATE;
+
 typedef enum MQTT_TRANSPORT_CREDENTIAL_TYPE_TAG
 {
     CREDENTIAL_NOT_BUILD,
@@ -185,6 +189,46 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 
     // Telemetry specific
     DLIST_ENTRY telemetry_waitingForAck;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE publishPool;
+    // Telemetry published with DELIVER_AT_MOST_ONCE is neither tracked nor resent
+    bool telemetryAtMostOnce;
+
+    // The records of telemetry_waitingForAck and ack_waiting_queue by packet id, created on first use
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE telemetry_inflight;
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE device_twin_inflight;
+
+    // Flow control, 0 when there is no limit
+    size_t maxInFlight;
+    size_t maxPublishesPerSecond;
+    uint64_t publishTokens;
+    uint64_t publishTokensTime;
+    bool publishTokensTimeSet;
+
+    // An idle connection only does its work every idlePollInterval milliseconds, 0 to do it on every DoWork
+    size_t idlePollInterval;
+    uint64_t lastPollTime;
+    bool lastPollTimeSet;
+
+    // SAS token refresh, in seconds
+    size_t sasTokenLifetime;
+    size_t sasTokenRefreshTime;
+    size_t sasTokenRefreshJitter;
+    size_t sasTokenRefreshSeed;
+    bool sasTokenRollover;
+
+    // Make-before-break refresh: the connection opened with a new SAS token until it is accepted,
+    // then the connection it replaced until the publishes sent on it are acknowledged
+    MQTT_CLIENT_HANDLE rolloverMqttClient;
+    XIO_HANDLE rolloverXioTransport;
+    SAS_ROLLOVER_STATE rolloverState;
+    bool rolloverSessionPresent;
+    uint64_t rolloverConnectTime;
+    // IoT Hub allows one connection per device, it closes the current connection once the new one is made
+    bool isRolloverReplacedConnectionLost;
+    MQTT_CLIENT_HANDLE drainingMqttClient;
+    XIO_HANDLE drainingXioTransport;
+    bool isDrainingConnectionLost;
+    uint64_t drainStartTime;
 } MQTTTRANSPORT_HANDLE_DATA, *PMQTTTRANSPORT_HANDLE_DATA;
 
 typedef struct MQTT_DEVICE_TWIN_ITEM_TAG
@@ -206,20 +250,115 @@ typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
     IOTHUB_MESSAGE_LIST* iotHubMessageEntry;
     void* context;
     uint16_t packet_id;
+    // The PUBLISH built on the first send, resent as is until the message is acknowledged
+    MQTT_MESSAGE_HANDLE mqttMessage;
+    // Last sent on a connection replaced by a SAS token rollover
+    bool isOnDrainingConnection;
     DLIST_ENTRY entry;
 } MQTT_MESSAGE_DETAILS_LIST, *PMQTT_MESSAGE_DETAILS_LIST;
 
+static bool is_packet_id_in_flight(PMQTTTRANSPORT_HANDLE_DATA transport_data, uint16_t packet_id)
+{
+    return ((transport_data->telemetry_inflight != NULL) && (iothubtransport_mqtt_inflight_find(transport_data->telemetry_inflight, packet_id) != NULL)) ||
+        ((transport_data->device_twin_inflight != NULL) && (iothubtransport_mqtt_inflight_find(transport_data->device_twin_inflight, packet_id) != NULL));
+}
+
 static uint16_t get_next_packet_id(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
-    if (transport_data->packetId+1 >= USHRT_MAX)
+    size_t skipped = 0;
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_144: [When the packet id wraps around, the packet ids of the publishes still waiting for an acknowledgement or a response shall be skipped.] */
+    do
     {
-        transport_data->packetId = 1;
+        if (transport_data->packetId+1 >= USHRT_MAX)
+        {
+            transport_data->packetId = 1;
+        }
+        else
+        {
+            transport_data->packetId++;
+        }
+    } while (is_packet_id_in_flight(transport_data, transport_data->packetId) && (++skipped < USHRT_MAX));
+    return transport_data->packetId;
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_142: [A publish waiting for an acknowledgement or a response shall be indexed by its packet id, so that the acknowledgement or the response finds it without walking the waiting list.] */
+static int track_inflight_packet(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE* inflight, uint16_t packet_id, void* record)
+{
+    int result;
+    if ((*inflight == NULL) &&
+        ((*inflight = iothubtransport_mqtt_inflight_create(INFLIGHT_INITIAL_CAPACITY)) == NULL))
+    {
+        LogError("Failure creating the in flight packet table.");
+        result = __LINE__;
+    }
+    else if (iothubtransport_mqtt_inflight_insert(*inflight, packet_id, record) != 0)
+    {
+        LogError("Failure tracking packet id %" PRIu16 ".", packet_id);
+        result = __LINE__;
     }
     else
     {
-        transport_data->packetId++;
+        result = 0;
     }
-    return transport_data->packetId;
+    return result;
+}
+
+static void* untrack_inflight_packet(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflight, uint16_t packet_id)
+{
+    return (inflight == NULL) ? NULL : iothubtransport_mqtt_inflight_remove(inflight, packet_id);
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_151: [The publish tokens shall be refilled at "MaxPublishesPerSecond" tokens per second, up to one second worth of tokens.] */
+static void refill_publish_tokens(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    uint64_t current_ms;
+    if (transport_data->maxPublishesPerSecond == 0)
+    {
+        // Not rate limited
+    }
+    else if (tickcounter_get_current_ms(g_msgTickCounter, &current_ms) != 0)
+    {
+        LogError("Failed retrieving tickcounter info, publish tokens are not refilled");
+    }
+    else
+    {
+        uint64_t bucketSize = (uint64_t)transport_data->maxPublishesPerSecond * PUBLISH_TOKEN;
+        if (!transport_data->publishTokensTimeSet)
+        {
+            transport_data->publishTokens = bucketSize;
+        }
+        else
+        {
+            uint64_t elapsed_ms = current_ms - transport_data->publishTokensTime;
+            // past a second the bucket is full whatever the rate, this also keeps the product from overflowing
+            transport_data->publishTokens = (elapsed_ms >= 1000) ? bucketSize : transport_data->publishTokens + (elapsed_ms * transport_data->maxPublishesPerSecond);
+            if (transport_data->publishTokens > bucketSize)
+            {
+                transport_data->publishTokens = bucketSize;
+            }
+        }
+        transport_data->publishTokensTime = current_ms;
+        transport_data->publishTokensTimeSet = true;
+    }
+}
+
+static bool has_publish_token(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    return (transport_data->maxPublishesPerSecond == 0) || (transport_data->publishTokens >= PUBLISH_TOKEN);
+}
+
+static void take_publish_token(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    if (transport_data->maxPublishesPerSecond != 0)
+    {
+        transport_data->publishTokens -= PUBLISH_TOKEN;
+    }
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_148: [IoTHubTransport_MQTT_Common_DoWork shall not publish a new message while "MaxInFlight" messages are waiting for their PUBACK; a PUBACK frees a place in the window for the next call.] */
+static bool has_inflight_window(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    return (transport_data->maxInFlight == 0) || (iothubtransport_mqtt_inflight_get_count(transport_data->telemetry_inflight) < transport_data->maxInFlight);
 }
 
 static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
@@ -244,197 +383,37 @@ static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
     }
 }
 
-static int retrieve_device_method_rid_info(const char* resp_topic, STRING_HANDLE method_name, uint16_t* request_id)
+static MQTT_MESSAGE_DETAILS_LIST* create_message_details_entry(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
-    int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
+    MQTT_MESSAGE_DETAILS_LIST* result;
+    if (transport_data->publishPool == NULL)
     {
-        LogError("Failed creating token from device twin topic.");
-        result = __LINE__;
-        *request_id = 0;
+        result = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
     }
     else
     {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = __LINE__;
-            *request_id = 0;
-        }
-        else
-        {
-            size_t token_index = 0;
-            size_t request_id_length = strlen(REQUEST_ID_PROPERTY);
-            result = __LINE__;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_index == 3)
-                {
-                    if (STRING_concat_with_STRING(method_name, token_value) != 0)
-                    {
-                        result = __LINE__;
-                        *request_id = 0;
-                        break;
-                    }
-                }
-                else if (token_index == 4)
-                {
-                    if (STRING_length(token_value) >= request_id_length)
-                    {
-                        const char* request_id_value = STRING_c_str(token_value);
-                        if (memcmp(request_id_value, REQUEST_ID_PROPERTY, request_id_length) == 0)
-                        {
-                            *request_id = (uint16_t)atol(request_id_value+request_id_length);
-                            result = 0;
-                            break;
-                        }
-                    }
-                }
-                token_index++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_133: [If a publish pool has been set, IoTHubTransport_MQTT_Common_DoWork shall take the publish record from the pool instead of allocating it with malloc.] */
+        result = (MQTT_MESSAGE_DETAILS_LIST*)IoTHubClient_BlockPool_Alloc(transport_data->publishPool);
     }
     return result;
 }
 
-static int parse_device_twin_topic_info(const char* resp_topic, bool* patch_msg, size_t* request_id, int* status_code)
+static void destroy_message_details_entry(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
 {
-    int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
+    if (mqttMsgEntry->mqttMessage != NULL)
     {
-        LogError("Failed creating token from device twin topic.");
-        result = __LINE__;
-        *status_code = 0;
-        *request_id = 0;
-        *patch_msg = false;
+        mqttmessage_destroy(mqttMsgEntry->mqttMessage);
     }
-    else
-    {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = __LINE__;
-            *status_code = 0;
-            *request_id = 0;
-            *patch_msg = false;
-        }
-        else
-        {
-            result = __LINE__;
-            size_t token_count = 0;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_count == 2)
-                {
-                    if (strcmp(STRING_c_str(token_value), "PATCH") == 0)
-                    {
-                        *patch_msg = true;
-                        *status_code = 0;
-                        *request_id = 0;
-                        result = 0;
-                        break;
-                    }
-                    else
-                    {
-                        *patch_msg = false;
-                    }
-                }
-                else if (token_count == 3)
-                {
-                    *status_code = atol(STRING_c_str(token_value));
-                    if (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/?$rid=") == 0)
-                    {
-                        *request_id = (size_t)atol(STRING_c_str(token_value));
-                    }
-                    *patch_msg = false;
-                    result = 0;
-                    break;
-                }
-                token_count++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
-    }
-    return result;
-}
-
-static IOTHUB_IDENTITY_TYPE retrieve_topic_type(const char* topic_resp)
-{
-    IOTHUB_IDENTITY_TYPE type;
-    size_t dev_twin_topic_len = sizeof(TOPIC_DEVICE_TWIN_PREFIX)-1;
-    size_t dev_method_topic_len = sizeof(TOPIC_DEVICE_METHOD_PREFIX)-1;
-    size_t topic_len = strlen(topic_resp);
-    size_t len_to_use = (dev_twin_topic_len > dev_method_topic_len) ? dev_twin_topic_len : dev_method_topic_len;
 
-    bool search_device_twin = true;
-    bool search_device_method = true;
-    if (topic_len < len_to_use)
+    if (transport_data->publishPool == NULL)
     {
-        search_device_twin = false;
-        search_device_method = false;
+        free(mqttMsgEntry);
     }
     else
     {
-        for (size_t index = 0; index < len_to_use && (search_device_twin || search_device_method); index++)
-        {
-            if (search_device_twin)
-            {
-                if (index > dev_twin_topic_len)
-                {
-                    search_device_twin = false;
-                }
-                else
-                {
-                    if (index == dev_twin_topic_len)
-                    {
-                        break;
-                    }
-                    else if (toupper(TOPIC_DEVICE_TWIN_PREFIX[index]) != toupper(topic_resp[index]))
-                    {
-                        search_device_twin = false;
-                    }
-                }
-            }
-            if (search_device_method)
-            {
-                if (index > dev_method_topic_len)
-                {
-                    search_device_method = false;
-                }
-                else
-                {
-                    if (index == dev_method_topic_len)
-                    {
-                        break;
-                    }
-                    else if (toupper(TOPIC_DEVICE_METHOD_PREFIX[index]) != toupper(topic_resp[index]))
-                    {
-                        search_device_method = false;
-                    }
-                }
-            }
-        }
-    }
-    if (search_device_twin)
-    {
-        type = IOTHUB_TYPE_DEVICE_TWIN;
-    }
-    else if (search_device_method)
-    {
-        type = IOTHUB_TYPE_DEVICE_METHODS;
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_134: [Publish records taken from the publish pool shall be given back to the pool by calling IoTHubClient_BlockPool_Free.] */
+        IoTHubClient_BlockPool_Free(transport_data->publishPool, mqttMsgEntry);
     }
-    else
-    {
-        type = IOTHUB_TYPE_TELEMETRY;
-    }
-    return type;
 }
 
 static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_CLIENT_CONFIRMATION_RESULT confirmResult)
@@ -480,6 +459,27 @@ static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
     return result;
 }
 
+static int send_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    int result;
+    if (tickcounter_get_current_ms(g_msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
+    {
+        LogError("Failed retrieving tickcounter info");
+        result = __LINE__;
+    }
+    else if (mqtt_client_publish(transport_data->mqttClient, mqttMsgEntry->mqttMessage) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        mqttMsgEntry->retryCount++;
+        mqttMsgEntry->isOnDrainingConnection = false;
+        result = 0;
+    }
+    return result;
+}
+
 static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
 {
     int result;
@@ -490,37 +490,76 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
     }
     else
     {
-        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->packet_id, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
-        if (mqttMsg == NULL)
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_152: [The MQTT_MESSAGE_HANDLE of a message shall be created once, when the message is first published, and kept with the message until it is acknowledged or failed.] */
+        mqttMsgEntry->mqttMessage = mqttmessage_create(mqttMsgEntry->packet_id, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
+        STRING_delete(msgTopic);
+        if (mqttMsgEntry->mqttMessage == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = send_mqtt_telemetry_msg(transport_data, mqttMsgEntry);
+        }
+    }
+    return result;
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_168: [If "TelemetryAtMostOnce" is set, IoTHubTransport_MQTT_Common_DoWork shall publish the telemetry messages with DELIVER_AT_MOST_ONCE, without a publish record, a packet id or a place in the Waiting Acknowledge messages.] */
+static int publish_mqtt_telemetry_msg_at_most_once(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE messageHandle, const unsigned char* payload, size_t len)
+{
+    int result;
+    STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(messageHandle, STRING_c_str(transport_data->topic_MqttEvent));
+    if (msgTopic == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        // A QoS 0 PUBLISH carries no packet id
+        MQTT_MESSAGE_HANDLE mqttMessage = mqttmessage_create(0, STRING_c_str(msgTopic), DELIVER_AT_MOST_ONCE, payload, len);
+        if (mqttMessage == NULL)
         {
             result = __LINE__;
         }
         else
         {
-            if (tickcounter_get_current_ms(g_msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
+            if (mqtt_client_publish(transport_data->mqttClient, mqttMessage) != 0)
             {
-                LogError("Failed retrieving tickcounter info");
                 result = __LINE__;
             }
             else
             {
-                if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
-                {
-                    result = __LINE__;
-                }
-                else
-                {
-                    mqttMsgEntry->retryCount++;
-                    result = 0;
-                }
+                result = 0;
             }
-            mqttmessage_destroy(mqttMsg);
+            mqttmessage_destroy(mqttMessage);
         }
         STRING_delete(msgTopic);
     }
     return result;
 }
 
+static int resend_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    int result;
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_153: [A message shall be resent by setting the DUP flag of its MQTT_MESSAGE_HANDLE and publishing it again, without reading the message payload or properties again.] */
+    if (mqttMsgEntry->mqttMessage == NULL)
+    {
+        LogError("Failure: the message to resend has never been published.");
+        result = __LINE__;
+    }
+    else if (mqttmessage_setIsDuplicateMsg(mqttMsgEntry->mqttMessage, true) != 0)
+    {
+        LogError("Failure setting the duplicate flag of the message to resend.");
+        result = __LINE__;
+    }
+    else
+    {
+        result = send_mqtt_telemetry_msg(transport_data, mqttMsgEntry);
+    }
+    return result;
+}
+
 static int publish_device_method_message(MQTTTRANSPORT_HANDLE_DATA* transport_data, int status_code, uint16_t request_id, BUFFER_HANDLE response)
 {
     int result;
@@ -576,10 +615,16 @@ static int publish_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_
         mqtt_info->msgPublishTime = 0;
         mqtt_info->iothub_type = IOTHUB_TYPE_DEVICE_TWIN;
         mqtt_info->device_twin_data = NULL;
-        STRING_HANDLE msg_topic = STRING_construct_sprintf(GET_PROPERTIES_TOPIC, mqtt_info->packet_id);
-        if (msg_topic == NULL)
+        STRING_HANDLE msg_topic;
+        if (track_inflight_packet(&transport_data->device_twin_inflight, mqtt_info->packet_id, mqtt_info) != 0)
+        {
+            free(mqtt_info);
+            result = __LINE__;
+        }
+        else if ((msg_topic = STRING_construct_sprintf(GET_PROPERTIES_TOPIC, mqtt_info->packet_id)) == NULL)
         {
             LogError("Failed constructing get Prop topic.");
+            (void)untrack_inflight_packet(transport_data->device_twin_inflight, mqtt_info->packet_id);
             free(mqtt_info);
             result = __LINE__;
         }
@@ -589,6 +634,7 @@ static int publish_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_
             if (mqtt_get_msg == NULL)
             {
                 LogError("Failed constructing mqtt message.");
+                (void)untrack_inflight_packet(transport_data->device_twin_inflight, mqtt_info->packet_id);
                 free(mqtt_info);
                 result = __LINE__;
             }
@@ -597,6 +643,7 @@ static int publish_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_
                 if (mqtt_client_publish(transport_data->mqttClient, mqtt_get_msg) != 0)
                 {
                     LogError("Failed publishing to mqtt client.");
+                    (void)untrack_inflight_packet(transport_data->device_twin_inflight, mqtt_info->packet_id);
                     free(mqtt_info);
                     result = __LINE__;
                 }
@@ -618,10 +665,15 @@ static int publish_device_twin_message(MQTTTRANSPORT_HANDLE_DATA* transport_data
     int result;
     mqtt_info->packet_id = get_next_packet_id(transport_data);
     mqtt_info->device_twin_msg_type = REPORTED_STATE;
-    STRING_HANDLE msgTopic = STRING_construct_sprintf(REPORTED_PROPERTIES_TOPIC, mqtt_info->packet_id);
-    if (msgTopic == NULL)
+    STRING_HANDLE msgTopic;
+    if (track_inflight_packet(&transport_data->device_twin_inflight, mqtt_info->packet_id, mqtt_info) != 0)
+    {
+        result = __LINE__;
+    }
+    else if ((msgTopic = STRING_construct_sprintf(REPORTED_PROPERTIES_TOPIC, mqtt_info->packet_id)) == NULL)
     {
         LogError("Failed constructing reported prop topic.");
+        (void)untrack_inflight_packet(transport_data->device_twin_inflight, mqtt_info->packet_id);
         result = __LINE__;
     }
     else
@@ -656,17 +708,21 @@ static int publish_device_twin_message(MQTTTRANSPORT_HANDLE_DATA* transport_data
             mqttmessage_destroy(mqtt_rpt_msg);
         }
         STRING_delete(msgTopic);
+        if (result != 0)
+        {
+            (void)untrack_inflight_packet(transport_data->device_twin_inflight, mqtt_info->packet_id);
+        }
     }
     return result;
 }
 
-static bool isSystemProperty(const char* tokenData)
+static bool isSystemProperty(const char* propName)
 {
     bool result = false;
     size_t propCount = sizeof(sysPropList)/sizeof(sysPropList[0]);
     for (size_t index = 0; index < propCount; index++)
     {
-        if (memcmp(tokenData, sysPropList[index].propName, sysPropList[index].propLength) == 0)
+        if (strcmp(propName, sysPropList[index]) == 0)
         {
             result = true;
             break;
@@ -675,101 +731,93 @@ static bool isSystemProperty(const char* tokenData)
     return result;
 }
 
-static int extractMqttProperties(IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* topic_name)
+static int addMqttProperty(void* context, const char* propName, const char* propValue)
+{
+    int result;
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_155: [The system properties of a cloud to device message ($.exp, $.mid, $.uid, $.to, $.cid, iothub-operation and iothub-ack) shall not be added to the properties of the message.] */
+    if (isSystemProperty(propName))
+    {
+        result = 0;
+    }
+    else if (Map_AddOrUpdate((MAP_HANDLE)context, propName, propValue) != MAP_OK)
+    {
+        LogError("Map_AddOrUpdate failed.");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static int extractMqttProperties(IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* properties)
 {
     int result;
-    STRING_HANDLE mqttTopic = STRING_construct(topic_name);
-    if (mqttTopic == NULL)
+    MAP_HANDLE propertyMap = IoTHubMessage_Properties(IoTHubMessage);
+    if (propertyMap == NULL)
     {
-        LogError("Failure constructing string topic name.");
+        LogError("Failure to retrieve IoTHubMessage_properties.");
+        result = __LINE__;
+    }
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_154: [The topic of a received message shall be parsed with iothubtransport_mqtt_topic_parse, and the properties of a cloud to device message shall be URL decoded from its topic and added to the message without allocating memory for them.] */
+    else if (iothubtransport_mqtt_topic_for_each_property(properties, addMqttProperty, propertyMap) != 0)
+    {
+        LogError("Failure adding the mqtt properties.");
         result = __LINE__;
     }
     else
     {
-        STRING_TOKENIZER_HANDLE token = STRING_TOKENIZER_create(mqttTopic);
-        if (token != NULL)
+        result = 0;
+    }
+    return result;
+}
+
+static void invoke_device_method(PMQTTTRANSPORT_HANDLE_DATA transportData, const IOTHUBTRANSPORT_MQTT_TOPIC_INFO* topicInfo, MQTT_MESSAGE_HANDLE msgHandle)
+{
+    char stackMethodName[METHOD_NAME_BUFFER_SIZE];
+    char* method_name;
+
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_156: [The method name of a device method invocation shall be copied to a buffer on the stack, or to an allocated one if it does not fit.] */
+    if (topicInfo->methodNameLength < sizeof(stackMethodName))
+    {
+        method_name = stackMethodName;
+    }
+    else if ((method_name = (char*)malloc(topicInfo->methodNameLength + 1)) == NULL)
+    {
+        LogError("Failure: allocating method_name string value");
+    }
+
+    if (method_name != NULL)
+    {
+        BUFFER_HANDLE result_buffer;
+        (void)memcpy(method_name, topicInfo->methodName, topicInfo->methodNameLength);
+        method_name[topicInfo->methodNameLength] = '\0';
+
+        if (topicInfo->requestId > UINT16_MAX)
+        {
+            LogError("Failure: device method request id out of range");
+        }
+        else if ((result_buffer = BUFFER_new()) == NULL)
         {
-            MAP_HANDLE propertyMap = IoTHubMessage_Properties(IoTHubMessage);
-            if (propertyMap == NULL)
+            LogError("Failure: allocating device method response buffer");
+        }
+        else
+        {
+            const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+            int status_code = IoTHubClient_LL_DeviceMethodComplete(transportData->llClientHandle, method_name, payload->message, payload->length, result_buffer);
+            if (publish_device_method_message(transportData, status_code, (uint16_t)topicInfo->requestId, result_buffer) != 0)
             {
-                LogError("Failure to retrieve IoTHubMessage_properties.");
-                result = __LINE__;
+                LogError("Failure: publishing device method response");
             }
-            else
-            {
-                STRING_HANDLE output = STRING_new();
-                if (output == NULL)
-                {
-                    LogError("Failure to allocate STRING_new.");
-                    result = __LINE__;
-                }
-                else
-                {
-                    result = 0;
-                    while (STRING_TOKENIZER_get_next_token(token, output, PROPERTY_SEPARATOR) == 0 && result == 0)
-                    {
-                        const char* tokenData = STRING_c_str(output);
-                        size_t tokenLen = strlen(tokenData);
-                        if (tokenData == NULL || tokenLen == 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            if (!isSystemProperty(tokenData) )
-                            {
-                                const char* iterator = tokenData;
-                                while (iterator != NULL && *iterator != '\0' && result == 0)
-                                {
-                                    if (*iterator == '=')
-                                    {
-                                        size_t nameLen = iterator - tokenData;
-                                        char* propName = malloc(nameLen + 1);
-
-                                        size_t valLen = tokenLen - (nameLen + 1) + 1;
-                                        char* propValue = malloc(valLen + 1);
-
-                                        if (propName == NULL || propValue == NULL)
-                                        {
-                                            result = __LINE__;
-                                        }
-                                        else
-                                        {
-                                            strncpy(propName, tokenData, nameLen);
-                                            propName[nameLen] = '\0';
-
-                                            strncpy(propValue, iterator + 1, valLen);
-                                            propValue[valLen] = '\0';
-
-                                            if (Map_AddOrUpdate(propertyMap, propName, propValue) != MAP_OK)
-                                            {
-                                                LogError("Map_AddOrUpdate failed.");
-                                                result = __LINE__;
-                                            }
-                                        }
-                                        free(propName);
-                                        free(propValue);
-
-                                        break;
-                                    }
-                                    iterator++;
-                                }
-                            }
-                        }
-                    }
-                    STRING_delete(output);
-                }
-            }
-            STRING_TOKENIZER_destroy(token);
+            BUFFER_delete(result_buffer);
         }
-        else
+
+        if (method_name != stackMethodName)
         {
-            LogError("Unable to create Tokenizer object.");
-            result = __LINE__;
+            free(method_name);
         }
-        STRING_delete(mqttTopic);
     }
-    return result;
 }
 
 static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* callbackCtx)
@@ -784,83 +832,42 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
         else
         {
             PMQTTTRANSPORT_HANDLE_DATA transportData = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
+            IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
 
-            IOTHUB_IDENTITY_TYPE type = retrieve_topic_type(topic_resp);
-            if (type == IOTHUB_TYPE_DEVICE_TWIN)
+            if (iothubtransport_mqtt_topic_parse(topic_resp, &topicInfo) != 0)
             {
-                size_t request_id;
-                int status_code;
-                bool notification_msg;
-                if (parse_device_twin_topic_info(topic_resp, &notification_msg, &request_id, &status_code) != 0)
-                {
-                    LogError("Failure: parsing device topic info");
-                }
-                else
-                {
-                    const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                    if (notification_msg)
-                    {
-                        IoTHubClient_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length);
-                    }
-                    else
-                    {
-                        PDLIST_ENTRY dev_twin_item = transportData->ack_waiting_queue.Flink;
-                        while (dev_twin_item != &transportData->ack_waiting_queue)
-                        {
-                            DLIST_ENTRY saveListEntry;
-                            saveListEntry.Flink = dev_twin_item->Flink;
-                            MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(dev_twin_item, MQTT_DEVICE_TWIN_ITEM, entry);
-                            if (request_id == msg_entry->packet_id)
-                            {
-                                (void)DList_RemoveEntryList(dev_twin_item);
-                                if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
-                                {
-                                    IoTHubClient_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
-                                }
-                                else
-                                {
-                                    IoTHubClient_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, status_code);
-                                }
-                                free(msg_entry);
-                                break;
-                            }
-                            dev_twin_item = saveListEntry.Flink;
-                        }
-                    }
-                }
+                LogError("Failure: parsing topic %s", topic_resp);
             }
-            else if (type == IOTHUB_TYPE_DEVICE_METHODS)
+            else if (topicInfo.type == IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN)
             {
-                uint16_t request_id;
-                STRING_HANDLE method_name = STRING_new();
-                if (method_name == NULL)
+                const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+                if (topicInfo.isPatch)
                 {
-                    LogError("Failure: allocating method_name string value");
+                    IoTHubClient_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length);
                 }
                 else
                 {
-                    BUFFER_HANDLE result_buffer;
-                    if (retrieve_device_method_rid_info(topic_resp, method_name, &request_id) != 0)
-                    {
-                        LogError("Failure: retrieve device topic info");
-                    }
-                    else if ((result_buffer = BUFFER_new()) == NULL)
-                    {
-                        LogError("Failure: retrieve device topic info");
-                    }
-                    else
+                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_146: [On a device twin response the request shall be found by the packet id carried in the $rid of the topic; a response for no request in flight shall be ignored.] */
+                    MQTT_DEVICE_TWIN_ITEM* msg_entry = (topicInfo.requestId > UINT16_MAX) ? NULL : (MQTT_DEVICE_TWIN_ITEM*)untrack_inflight_packet(transportData->device_twin_inflight, (uint16_t)topicInfo.requestId);
+                    if (msg_entry != NULL)
                     {
-                        const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                        int status_code = IoTHubClient_LL_DeviceMethodComplete(transportData->llClientHandle, STRING_c_str(method_name), payload->message, payload->length, result_buffer);
-                        if (publish_device_method_message(transportData, status_code, request_id, result_buffer) != 0)
+                        (void)DList_RemoveEntryList(&msg_entry->entry);
+                        if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
                         {
-                            LogError("Failure: publishing device method response");
+                            IoTHubClient_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
                         }
-                        BUFFER_delete(result_buffer);
+                        else
+                        {
+                            IoTHubClient_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, topicInfo.statusCode);
+                        }
+                        free(msg_entry);
                     }
-                    STRING_delete(method_name);
                 }
             }
+            else if (topicInfo.type == IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD)
+            {
+                invoke_device_method(transportData, &topicInfo, msgHandle);
+            }
             else
             {
                 const APP_PAYLOAD* appPayload = mqttmessage_getApplicationMsg(msgHandle);
@@ -872,7 +879,7 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                 else
                 {
                     // Will need to update this when the service has messages that can be rejected
-                    if (extractMqttProperties(IoTHubMessage, topic_resp) != 0)
+                    if (extractMqttProperties(IoTHubMessage, topicInfo.properties) != 0)
                     {
                         LogError("failure extracting mqtt properties.");
                     }
@@ -890,10 +897,83 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
     }
 }
 
+static void resubscribe_topics(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    if (transport_data->topic_MqttMessage != NULL)
+    {
+        transport_data->topics_ToSubscribe |= SUBSCRIBE_TELEMETRY_TOPIC;
+    }
+    if (transport_data->topic_GetState != NULL)
+    {
+        transport_data->topics_ToSubscribe |= SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
+    }
+    if (transport_data->topic_NotifyState != NULL)
+    {
+        transport_data->topics_ToSubscribe |= SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
+    }
+    if (transport_data->topic_DeviceMethods != NULL)
+    {
+        transport_data->topics_ToSubscribe |= SUBSCRIBE_DEVICE_METHOD_TOPIC;
+    }
+}
+
+// From the CONNECT of the new connection until it takes over, the current connection is on its way out
+static bool is_sas_rollover_pending(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    return (transport_data->rolloverState == SAS_ROLLOVER_CONNECTING) || (transport_data->rolloverState == SAS_ROLLOVER_ACCEPTED);
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_161: [The events of the connection opened by a SAS token rollover, and the events other than PUBACKs of the connection it replaced, shall be recorded for IoTHubTransport_MQTT_Common_DoWork and shall not change the state of the current connection.] */
+static bool is_replacement_connection_event(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo)
+{
+    bool result;
+    if ((transport_data->rolloverMqttClient != NULL) && (handle == transport_data->rolloverMqttClient))
+    {
+        if (actionResult == MQTT_CLIENT_ON_CONNACK)
+        {
+            const CONNECT_ACK* connack = (const CONNECT_ACK*)msgInfo;
+            if ((connack != NULL) && (connack->returnCode == CONNECTION_ACCEPTED))
+            {
+                transport_data->rolloverSessionPresent = connack->isSessionPresent;
+                transport_data->rolloverState = SAS_ROLLOVER_ACCEPTED;
+            }
+            else
+            {
+                LogError("The connection with the new SAS token was not accepted: %s", (connack == NULL) ? "no CONNACK" : retrieve_mqtt_return_codes(connack->returnCode));
+                transport_data->rolloverState = SAS_ROLLOVER_FAILED;
+            }
+        }
+        else if (actionResult == MQTT_CLIENT_ON_DISCONNECT)
+        {
+            transport_data->rolloverState = SAS_ROLLOVER_FAILED;
+        }
+        result = true;
+    }
+    else if ((transport_data->drainingMqttClient != NULL) && (handle == transport_data->drainingMqttClient))
+    {
+        if (actionResult == MQTT_CLIENT_ON_DISCONNECT)
+        {
+            transport_data->isDrainingConnectionLost = true;
+        }
+        result = (actionResult != MQTT_CLIENT_ON_PUBLISH_ACK) && (actionResult != MQTT_CLIENT_ON_PUBLISH_COMP);
+    }
+    else if ((actionResult == MQTT_CLIENT_ON_DISCONNECT) && (handle == transport_data->mqttClient) && is_sas_rollover_pending(transport_data))
+    {
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_174: [Until then, an error or a disconnection of the current connection shall only be recorded: it shall not be reported with IotHubClient_LL_ConnectionStatusCallBack and shall not change the state of the connection.] */
+        LogInfo("The connection being replaced by a SAS token rollover was closed.");
+        transport_data->isRolloverReplacedConnectionLost = true;
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+    return result;
+}
+
 static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* callbackCtx)
 {
-    (void)handle;
-    if (callbackCtx != NULL)
+    if ((callbackCtx != NULL) && !is_replacement_connection_event((PMQTTTRANSPORT_HANDLE_DATA)callbackCtx, handle, actionResult, msgInfo))
     {
         PMQTTTRANSPORT_HANDLE_DATA transport_data = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
 
@@ -905,20 +985,13 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                 const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
                 if (puback != NULL)
                 {
-                    PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                    while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_145: [On a PUBACK the publish shall be found by its packet id, removed from the Waiting Acknowledge messages and completed with IOTHUB_CLIENT_CONFIRMATION_OK; a PUBACK for no publish in flight shall be ignored.] */
+                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)untrack_inflight_packet(transport_data->telemetry_inflight, puback->packetId);
+                    if (mqttMsgEntry != NULL)
                     {
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                        DLIST_ENTRY saveListEntry;
-                        saveListEntry.Flink = currentListEntry->Flink;
-
-                        if (puback->packetId == mqttMsgEntry->packet_id)
-                        {
-                            (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
-                            free(mqttMsgEntry);
-                        }
-                        currentListEntry = saveListEntry.Flink;
+                        (void)DList_RemoveEntryList(&mqttMsgEntry->entry); //First remove the item from Waiting for Ack List.
+                        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        destroy_message_details_entry(transport_data, mqttMsgEntry);
                     }
                 }
                 else
@@ -1000,43 +1073,46 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
 
 static void mqtt_error_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_ERROR error, void* callbackCtx)
 {
-    (void)handle;
     if (callbackCtx != NULL)
     {
         PMQTTTRANSPORT_HANDLE_DATA transport_data = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
-        switch (error)
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_161: [The events of the connection opened by a SAS token rollover, and the events other than PUBACKs of the connection it replaced, shall be recorded for IoTHubTransport_MQTT_Common_DoWork and shall not change the state of the current connection.] */
+        if ((transport_data->rolloverMqttClient != NULL) && (handle == transport_data->rolloverMqttClient))
         {
-            case MQTT_CLIENT_CONNECTION_ERROR:
-            {
-                IotHubClient_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
-                break;
-            }
-            case MQTT_CLIENT_NO_PING_RESPONSE:
-            {
-                LogError("Mqtt Ping Response was not encountered.  Reconnecting device...");
-                break;
-            }
+            LogError("The connection with the new SAS token failed: %d", (int)error);
+            transport_data->rolloverState = SAS_ROLLOVER_FAILED;
         }
-        transport_data->isConnected = false;
-        transport_data->currPacketState = PACKET_TYPE_ERROR;
-                transport_data->device_twin_get_sent = false;
-        if (transport_data->topic_MqttMessage != NULL)
+        else if ((transport_data->drainingMqttClient != NULL) && (handle == transport_data->drainingMqttClient))
         {
-                transport_data->topics_ToSubscribe |= SUBSCRIBE_TELEMETRY_TOPIC;
-                }
-                if (transport_data->topic_GetState != NULL)
+            transport_data->isDrainingConnectionLost = true;
+        }
+        else if ((handle == transport_data->mqttClient) && is_sas_rollover_pending(transport_data))
+        {
+            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_174: [Until then, an error or a disconnection of the current connection shall only be recorded: it shall not be reported with IotHubClient_LL_ConnectionStatusCallBack and shall not change the state of the connection.] */
+            LogInfo("The connection being replaced by a SAS token rollover failed: %d", (int)error);
+            transport_data->isRolloverReplacedConnectionLost = true;
+        }
+        else
+        {
+            switch (error)
+            {
+                case MQTT_CLIENT_CONNECTION_ERROR:
                 {
-                    transport_data->topics_ToSubscribe |= SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
+                    IotHubClient_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+                    break;
                 }
-                if (transport_data->topic_NotifyState != NULL)
+                case MQTT_CLIENT_NO_PING_RESPONSE:
                 {
-                    transport_data->topics_ToSubscribe |= SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
+                    LogError("Mqtt Ping Response was not encountered.  Reconnecting device...");
+                    break;
                 }
-                if (transport_data->topic_DeviceMethods != NULL)
-                {
-                    transport_data->topics_ToSubscribe |= SUBSCRIBE_DEVICE_METHOD_TOPIC;
+            }
+            transport_data->isConnected = false;
+            transport_data->currPacketState = PACKET_TYPE_ERROR;
+            transport_data->device_twin_get_sent = false;
+            resubscribe_topics(transport_data);
         }
-     }
+    }
     else
     {
         LogError("Failure: mqtt called back with null context.");
@@ -1143,20 +1219,59 @@ static const unsigned char* RetrieveMessagePayload(IOTHUB_MESSAGE_HANDLE message
     return result;
 }
 
-static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_159: [The xio of the connection opened by a SAS token rollover shall be given the options of the current xio, retrieved with xio_retrieveoptions and applied with OptionHandler_FeedOptions.] */
+static int copy_xio_options(XIO_HANDLE source, XIO_HANDLE destination)
+{
+    int result;
+    if (source == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        OPTIONHANDLER_HANDLE options = xio_retrieveoptions(source);
+        if (options == NULL)
+        {
+            LogError("unable to retrieve the options of the current TLS layer.");
+            result = __LINE__;
+        }
+        else
+        {
+            if (OptionHandler_FeedOptions(options, destination) != OPTIONHANDLER_OK)
+            {
+                LogError("unable to apply the options of the current TLS layer to the new one.");
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+            OptionHandler_Destroy(options);
+        }
+    }
+    return result;
+}
+
+static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transport_data, XIO_HANDLE* xioTransport)
 {
     int result;
 
-    if (transport_data->xioTransport == NULL)
+    if (*xioTransport == NULL)
     {
         // construct address
         const char* hostAddress = STRING_c_str(transport_data->hostAddress);
-        transport_data->xioTransport = transport_data->get_io_transport(hostAddress);
-        if (transport_data->xioTransport == NULL)
+        *xioTransport = transport_data->get_io_transport(hostAddress);
+        if (*xioTransport == NULL)
         {
             LogError("Unable to create the lower level TLS layer.");
             result = __LINE__;
         }
+        else if ((xioTransport != &transport_data->xioTransport) && (copy_xio_options(transport_data->xioTransport, *xioTransport) != 0))
+        {
+            xio_destroy(*xioTransport);
+            *xioTransport = NULL;
+            result = __LINE__;
+        }
         else
         {
             result = 0;
@@ -1169,7 +1284,7 @@ static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transport_
     return result;
 }
 
-static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_CLIENT_HANDLE mqttClient, XIO_HANDLE* xioTransport, uint64_t* connectTime)
 {
     int result;
 
@@ -1199,7 +1314,7 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transport_data)
         {
             // Construct SAS token
             size_t secSinceEpoch = (size_t)(difftime(get_time(NULL), EPOCH_TIME_T_VALUE) + 0);
-            size_t expiryTime = secSinceEpoch + SAS_TOKEN_DEFAULT_LIFETIME;
+            size_t expiryTime = secSinceEpoch + transport_data->sasTokenLifetime;
 
             sasToken = SASToken_Create(transport_data->transport_creds.CREDENTIAL_VALUE.deviceKey, transport_data->devicesPath, emptyKeyName, expiryTime);
             break;
@@ -1226,16 +1341,16 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transport_data)
             options.useCleanSession = false;
             options.qualityOfServiceValue = DELIVER_AT_LEAST_ONCE;
 
-            if (GetTransportProviderIfNecessary(transport_data) == 0)
+            if (GetTransportProviderIfNecessary(transport_data, xioTransport) == 0)
             {
-                if (mqtt_client_connect(transport_data->mqttClient, transport_data->xioTransport, &options) != 0)
+                if (mqtt_client_connect(mqttClient, *xioTransport, &options) != 0)
                 {
                     LogError("failure connecting to address %s:%d.", STRING_c_str(transport_data->hostAddress), transport_data->portNum);
                     result = __LINE__;
                 }
                 else
                 {
-                    (void)tickcounter_get_current_ms(g_msgTickCounter, &transport_data->mqtt_connect_time);
+                    (void)tickcounter_get_current_ms(g_msgTickCounter, connectTime);
                     result = 0;
                 }
             }
@@ -1251,6 +1366,217 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     return result;
 }
 
+static void close_connection(MQTT_CLIENT_HANDLE* mqttClient, XIO_HANDLE* xioTransport)
+{
+    if (*mqttClient != NULL)
+    {
+        (void)mqtt_client_disconnect(*mqttClient);
+        mqtt_client_deinit(*mqttClient);
+        *mqttClient = NULL;
+    }
+    if (*xioTransport != NULL)
+    {
+        xio_destroy(*xioTransport);
+        *xioTransport = NULL;
+    }
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_157: [The connection shall be refreshed "sas_token_refresh_time" seconds after it was opened, or after 80% of "sas_token_lifetime" if the refresh time is 0 or not shorter than the lifetime, less an offset of at most "SasTokenRefreshJitter" seconds derived from the device id.] */
+static size_t get_sas_refresh_time(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    size_t result = ((transport_data->sasTokenRefreshTime == 0) || (transport_data->sasTokenRefreshTime >= transport_data->sasTokenLifetime)) ?
+        (size_t)(transport_data->sasTokenLifetime * SAS_REFRESH_MULTIPLIER) :
+        transport_data->sasTokenRefreshTime;
+    if (transport_data->sasTokenRefreshJitter != 0)
+    {
+        // The offset is at most half the refresh time, a connection is never refreshed as soon as it is open
+        size_t jitter = (transport_data->sasTokenRefreshJitter < result / 2) ? transport_data->sasTokenRefreshJitter : result / 2;
+        result -= transport_data->sasTokenRefreshSeed % (jitter + 1);
+    }
+    return result;
+}
+
+static size_t get_sas_refresh_seed(const char* deviceId)
+{
+    // FNV-1a, so that the devices of a fleet started together spread their refreshes over the jitter
+    uint32_t result = 2166136261u;
+    for (; *deviceId != '\0'; deviceId++)
+    {
+        result = (result ^ (unsigned char)*deviceId) * 16777619u;
+    }
+    return result;
+}
+
+static void disconnect_for_sas_refresh(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    (void)mqtt_client_disconnect(transport_data->mqttClient);
+    IotHubClient_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN);
+    transport_data->isConnected = false;
+    transport_data->currPacketState = UNKNOWN_TYPE;
+    transport_data->device_twin_get_sent = false;
+    resubscribe_topics(transport_data);
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_158: [If "SasTokenRollover" is set, IoTHubTransport_MQTT_Common_DoWork shall refresh the connection by opening a second connection, with a new SAS token and a new xio, before closing the current one.] */
+static int start_sas_rollover(PMQTTTRANSPORT_HANDLE_DATA transport_data, uint64_t current_time)
+{
+    int result;
+    transport_data->rolloverMqttClient = mqtt_client_init(mqtt_notification_callback, mqtt_operation_complete_callback, transport_data, mqtt_error_callback, transport_data);
+    if (transport_data->rolloverMqttClient == NULL)
+    {
+        LogError("failure initializing the mqtt client of the new connection.");
+        result = __LINE__;
+    }
+    else
+    {
+        mqtt_client_set_trace(transport_data->rolloverMqttClient, transport_data->log_trace, transport_data->raw_trace);
+        transport_data->rolloverState = SAS_ROLLOVER_CONNECTING;
+        transport_data->rolloverConnectTime = current_time;
+        transport_data->isRolloverReplacedConnectionLost = false;
+        if (SendMqttConnectMsg(transport_data, transport_data->rolloverMqttClient, &transport_data->rolloverXioTransport, &transport_data->rolloverConnectTime) != 0)
+        {
+            LogError("failure opening the connection with the new SAS token.");
+            close_connection(&transport_data->rolloverMqttClient, &transport_data->rolloverXioTransport);
+            transport_data->rolloverState = SAS_ROLLOVER_IDLE;
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_160: [Once the new connection is accepted, IoTHubTransport_MQTT_Common_DoWork shall publish on it, and shall keep the connection it replaced only to receive the PUBACKs of the messages published on it; the topics shall be subscribed again unless the new connection resumed the session of a connection that had subscribed them.] */
+static void complete_sas_rollover(PMQTTTRANSPORT_HANDLE_DATA transport_data, uint64_t current_time)
+{
+    PDLIST_ENTRY currentListEntry;
+
+    close_connection(&transport_data->drainingMqttClient, &transport_data->drainingXioTransport);
+    transport_data->drainingMqttClient = transport_data->mqttClient;
+    transport_data->drainingXioTransport = transport_data->xioTransport;
+    transport_data->isDrainingConnectionLost = !transport_data->isConnected || transport_data->isRolloverReplacedConnectionLost;
+    transport_data->drainStartTime = current_time;
+    for (currentListEntry = transport_data->telemetry_waitingForAck.Flink; currentListEntry != &transport_data->telemetry_waitingForAck; currentListEntry = currentListEntry->Flink)
+    {
+        containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry)->isOnDrainingConnection = true;
+    }
+
+    transport_data->mqttClient = transport_data->rolloverMqttClient;
+    transport_data->xioTransport = transport_data->rolloverXioTransport;
+    transport_data->mqtt_connect_time = transport_data->rolloverConnectTime;
+    transport_data->rolloverMqttClient = NULL;
+    transport_data->rolloverXioTransport = NULL;
+    transport_data->rolloverState = SAS_ROLLOVER_IDLE;
+
+    if (!transport_data->rolloverSessionPresent || (transport_data->currPacketState != PUBLISH_TYPE))
+    {
+        transport_data->currPacketState = CONNACK_TYPE;
+        transport_data->device_twin_get_sent = false;
+        resubscribe_topics(transport_data);
+    }
+    transport_data->isConnected = true;
+    transport_data->connectFailCount = 0;
+}
+
+static void process_sas_rollover(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    uint64_t current_time;
+    if (tickcounter_get_current_ms(g_msgTickCounter, &current_time) != 0)
+    {
+        LogError("Failed retrieving tickcounter info, the SAS token rollover is not checked");
+    }
+    else
+    {
+        if ((transport_data->rolloverState == SAS_ROLLOVER_CONNECTING) &&
+            ((current_time - transport_data->rolloverConnectTime) / 1000 > SAS_ROLLOVER_TIMEOUT_VALUE))
+        {
+            LogError("The connection with the new SAS token was not accepted in time.");
+            transport_data->rolloverState = SAS_ROLLOVER_FAILED;
+        }
+
+        if (transport_data->rolloverState == SAS_ROLLOVER_ACCEPTED)
+        {
+            complete_sas_rollover(transport_data, current_time);
+        }
+        else if (transport_data->rolloverState == SAS_ROLLOVER_FAILED)
+        {
+            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_162: [If the new connection fails or is not accepted within 30 seconds, IoTHubTransport_MQTT_Common_DoWork shall close it and refresh the current connection by reconnecting it.] */
+            close_connection(&transport_data->rolloverMqttClient, &transport_data->rolloverXioTransport);
+            transport_data->rolloverState = SAS_ROLLOVER_IDLE;
+            if (transport_data->isConnected)
+            {
+                disconnect_for_sas_refresh(transport_data);
+            }
+        }
+        else
+        {
+            mqtt_client_dowork(transport_data->rolloverMqttClient);
+        }
+    }
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_163: [The replaced connection shall be closed once every message published on it has been acknowledged, once it is lost, or 10 seconds after the new connection took over; the messages it left unacknowledged shall then be resent on the new connection without waiting for the resend timeout.] */
+static void drain_replaced_connection(PMQTTTRANSPORT_HANDLE_DATA transport_data, uint64_t current_time)
+{
+    bool isDrained = true;
+    PDLIST_ENTRY currentListEntry;
+    for (currentListEntry = transport_data->telemetry_waitingForAck.Flink; isDrained && (currentListEntry != &transport_data->telemetry_waitingForAck); currentListEntry = currentListEntry->Flink)
+    {
+        isDrained = !containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry)->isOnDrainingConnection;
+    }
+
+    if (isDrained || transport_data->isDrainingConnectionLost || ((current_time - transport_data->drainStartTime) / 1000 > DRAIN_TIMEOUT_VALUE))
+    {
+        close_connection(&transport_data->drainingMqttClient, &transport_data->drainingXioTransport);
+    }
+    else
+    {
+        mqtt_client_dowork(transport_data->drainingMqttClient);
+    }
+}
+
+/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_171: [If "IdlePollInterval" is set, IoTHubTransport_MQTT_Common_DoWork shall do nothing while the connection is idle and less than "IdlePollInterval" milliseconds have passed since it last did its work; the connection is idle when it is connected and subscribed, is not being refreshed, and has no message to send and none waiting for an acknowledgement.] */
+static bool is_idle_poll_pending(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    bool result;
+    uint64_t current_ms;
+    if ((transport_data->idlePollInterval == 0) ||
+        !transport_data->isConnected ||
+        (transport_data->currPacketState != PUBLISH_TYPE) ||
+        (transport_data->rolloverState != SAS_ROLLOVER_IDLE) ||
+        (transport_data->drainingMqttClient != NULL) ||
+        !DList_IsListEmpty(transport_data->waitingToSend) ||
+        !DList_IsListEmpty(&transport_data->telemetry_waitingForAck) ||
+        !DList_IsListEmpty(&transport_data->ack_waiting_queue))
+    {
+        result = false;
+    }
+    else if (tickcounter_get_current_ms(g_msgTickCounter, &current_ms) != 0)
+    {
+        LogError("Failed retrieving tickcounter info, the idle connection is polled now");
+        result = false;
+    }
+    else if (transport_data->lastPollTimeSet && ((current_ms - transport_data->lastPollTime) < transport_data->idlePollInterval))
+    {
+        result = true;
+    }
+    else
+    {
+        transport_data->lastPollTime = current_ms;
+        transport_data->lastPollTimeSet = true;
+        result = false;
+    }
+    return result;
+}
+
+// A keepalive of 0 disables the PINGREQs, otherwise an idle connection must be polled before the hub times it out
+static bool is_idle_poll_interval_allowed(size_t idlePollInterval, int keepAlive)
+{
+    return (idlePollInterval == 0) || (keepAlive == 0) || (idlePollInterval < (size_t)keepAlive * 1000);
+}
+
 static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
     int result = 0;
@@ -1258,9 +1584,20 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     // Make sure we're not destroying the object
     if (!transport_data->isDestroyCalled)
     {
+        // A rollover settles first: once accepted its connection takes over, even from a connection the hub has already closed
+        if (transport_data->rolloverState != SAS_ROLLOVER_IDLE)
+        {
+            process_sas_rollover(transport_data);
+        }
+
         // If we are not isConnected then check to see if we need 
         // to back off the connecting to the server
-        if (!transport_data->isConnected)
+        if (!transport_data->isConnected && (transport_data->rolloverState != SAS_ROLLOVER_IDLE))
+        {
+            // The connection with the new SAS token is on its way
+            result = __LINE__;
+        }
+        else if (!transport_data->isConnected)
         {
             // Default makeConnection as true if something goes wrong we'll make the connection
             bool makeConnection = true;
@@ -1288,7 +1625,7 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
                 }
                 else
                 {
-                    if (SendMqttConnectMsg(transport_data) != 0)
+                    if (SendMqttConnectMsg(transport_data, transport_data->mqttClient, &transport_data->xioTransport, &transport_data->mqtt_connect_time) != 0)
                     {
                         transport_data->connectFailCount++;
                         result = __LINE__;
@@ -1314,28 +1651,22 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
             }
             else
             {
-                if ((current_time - transport_data->mqtt_connect_time) / 1000 > (SAS_TOKEN_DEFAULT_LIFETIME*SAS_REFRESH_MULTIPLIER))
+                if (transport_data->drainingMqttClient != NULL)
                 {
-                    (void)mqtt_client_disconnect(transport_data->mqttClient);
-                    IotHubClient_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN);
-                    transport_data->isConnected = false;
-                    transport_data->currPacketState = UNKNOWN_TYPE;
-                    transport_data->device_twin_get_sent = false;
-                    if (transport_data->topic_MqttMessage != NULL)
-                    {
-                        transport_data->topics_ToSubscribe |= SUBSCRIBE_TELEMETRY_TOPIC;
-                    }
-                    if (transport_data->topic_GetState != NULL)
-                    {
-                        transport_data->topics_ToSubscribe |= SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
-                    }
-                    if (transport_data->topic_NotifyState != NULL)
+                    drain_replaced_connection(transport_data, current_time);
+                }
+
+                if ((current_time - transport_data->mqtt_connect_time) / 1000 > get_sas_refresh_time(transport_data))
+                {
+                    if (!transport_data->sasTokenRollover)
                     {
-                        transport_data->topics_ToSubscribe |= SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
+                        disconnect_for_sas_refresh(transport_data);
                     }
-                    if (transport_data->topic_DeviceMethods != NULL)
+                    else if ((transport_data->rolloverState == SAS_ROLLOVER_IDLE) && (transport_data->drainingMqttClient == NULL) &&
+                        (start_sas_rollover(transport_data, current_time) != 0))
                     {
-                        transport_data->topics_ToSubscribe |= SUBSCRIBE_DEVICE_METHOD_TOPIC;
+                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_162: [If the new connection fails or is not accepted within 30 seconds, IoTHubTransport_MQTT_Common_DoWork shall close it and refresh the current connection by reconnecting it.] */
+                        disconnect_for_sas_refresh(transport_data);
                     }
                 }
             }
@@ -1525,7 +1856,33 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                     state->topics_ToSubscribe = UNSUBSCRIBE_FROM_TOPIC;
                     state->topic_DeviceMethods = NULL;
                     state->log_trace = state->raw_trace = false;
-
+                    state->publishPool = NULL;
+                    state->telemetryAtMostOnce = false;
+                    state->telemetry_inflight = NULL;
+                    state->maxInFlight = 0;
+                    state->maxPublishesPerSecond = 0;
+                    state->publishTokens = 0;
+                    state->publishTokensTime = 0;
+                    state->publishTokensTimeSet = false;
+                    state->idlePollInterval = 0;
+                    state->lastPollTime = 0;
+                    state->lastPollTimeSet = false;
+                    state->device_twin_inflight = NULL;
+                    state->sasTokenLifetime = SAS_TOKEN_DEFAULT_LIFETIME;
+                    state->sasTokenRefreshTime = 0;
+                    state->sasTokenRefreshJitter = 0;
+                    state->sasTokenRefreshSeed = get_sas_refresh_seed(upperConfig->deviceId);
+                    state->sasTokenRollover = false;
+                    state->rolloverMqttClient = NULL;
+                    state->rolloverXioTransport = NULL;
+                    state->rolloverState = SAS_ROLLOVER_IDLE;
+                    state->rolloverSessionPresent = false;
+                    state->rolloverConnectTime = 0;
+                    state->isRolloverReplacedConnectionLost = false;
+                    state->drainingMqttClient = NULL;
+                    state->drainingXioTransport = NULL;
+                    state->isDrainingConnectionLost = false;
+                    state->drainStartTime = 0;
                 }
             }
         }
@@ -1612,6 +1969,10 @@ TRANSPORT_LL_HANDLE IoTHubTransport_MQTT_Common_Create(const IOTHUBTRANSPORT_CON
 
 static void DisconnectFromClient(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
+    close_connection(&transport_data->rolloverMqttClient, &transport_data->rolloverXioTransport);
+    close_connection(&transport_data->drainingMqttClient, &transport_data->drainingXioTransport);
+    transport_data->rolloverState = SAS_ROLLOVER_IDLE;
+
     (void)mqtt_client_disconnect(transport_data->mqttClient);
     xio_destroy(transport_data->xioTransport);
     transport_data->xioTransport = NULL;
@@ -1636,7 +1997,7 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->telemetry_waitingForAck);
             MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
-            free(mqttMsgEntry);
+            destroy_message_details_entry(transport_data, mqttMsgEntry);
         }
         while (!DList_IsListEmpty(&transport_data->ack_waiting_queue))
         {
@@ -1646,6 +2007,15 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
             free(mqtt_device_twin);
         }
 
+        iothubtransport_mqtt_inflight_destroy(transport_data->telemetry_inflight);
+        iothubtransport_mqtt_inflight_destroy(transport_data->device_twin_inflight);
+
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_135: [If a publish pool has been set, IoTHubTransport_MQTT_Common_Destroy shall destroy it after the pending publish records have been released.] */
+        if (transport_data->publishPool != NULL)
+        {
+            IoTHubClient_BlockPool_Destroy(transport_data->publishPool);
+        }
+
         switch (transport_data->transport_creds.credential_type)
         {
             case SAS_TOKEN_FROM_USER:
@@ -1921,7 +2291,8 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_MQTT_Common_ProcessItem(TRANSPORT_LL_
     {
         PMQTTTRANSPORT_HANDLE_DATA transport_data = (PMQTTTRANSPORT_HANDLE_DATA)handle;
 
-        if (transport_data->currPacketState == PUBLISH_TYPE)
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_173: [Once the CONNECT of the new connection of a SAS token rollover has been sent, and until that connection takes over or fails, IoTHubTransport_MQTT_Common_DoWork shall not publish nor subscribe on the current connection, and IoTHubTransport_MQTT_Common_ProcessItem shall return IOTHUB_PROCESS_NOT_CONNECTED.] */
+        if ((transport_data->currPacketState == PUBLISH_TYPE) && !is_sas_rollover_pending(transport_data))
         {
             if (item_type == IOTHUB_TYPE_DEVICE_TWIN)
             {
@@ -1979,13 +2350,22 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
     {
         transport_data->llClientHandle = iotHubClientHandle;
 
-        if (InitializeConnection(transport_data) != 0)
+        if (is_idle_poll_pending(transport_data))
+        {
+            // Nothing to send nor to wait for, incoming messages are read at the next poll
+        }
+        else if (InitializeConnection(transport_data) != 0)
         {
             // Don't want to flood the logs with failures here
         }
         else
         {
-            if (transport_data->currPacketState == CONNACK_TYPE || transport_data->currPacketState == SUBSCRIBE_TYPE)
+            if (is_sas_rollover_pending(transport_data))
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_173: [Once the CONNECT of the new connection of a SAS token rollover has been sent, and until that connection takes over or fails, IoTHubTransport_MQTT_Common_DoWork shall not publish nor subscribe on the current connection, and IoTHubTransport_MQTT_Common_ProcessItem shall return IOTHUB_PROCESS_NOT_CONNECTED.] */
+                // The messages wait in waitingToSend for the new connection, the current one only receives
+            }
+            else if (transport_data->currPacketState == CONNACK_TYPE || transport_data->currPacketState == SUBSCRIBE_TYPE)
             {
                 SubscribeToMqttProtocol(transport_data);
             }
@@ -2010,49 +2390,70 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
             else if (transport_data->currPacketState == PUBLISH_TYPE)
             {
                 PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
+                /*resent messages are moved behind lastListEntry, they are not looked at again in this pass*/
+                PDLIST_ENTRY lastListEntry = transport_data->telemetry_waitingForAck.Blink;
+                uint64_t current_ms = 0;
+                refill_publish_tokens(transport_data);
+                if ((currentListEntry != &transport_data->telemetry_waitingForAck) &&
+                    (tickcounter_get_current_ms(g_msgTickCounter, &current_ms) != 0))
+                {
+                    LogError("Failed retrieving tickcounter info, no message is resent");
+                    currentListEntry = &transport_data->telemetry_waitingForAck;
+                }
                 while (currentListEntry != &transport_data->telemetry_waitingForAck)
                 {
                     MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
+                    bool isLastListEntry = (currentListEntry == lastListEntry);
                     DLIST_ENTRY nextListEntry;
-                    nextListEntry.Flink = currentListEntry->Flink;
+                    nextListEntry.Flink = isLastListEntry ? &transport_data->telemetry_waitingForAck : currentListEntry->Flink;
 
-                    uint64_t current_ms;
-                    (void)tickcounter_get_current_ms(g_msgTickCounter, &current_ms);
                     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransport_MQTT_Common_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
-                    if (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN)
+                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_163: [The replaced connection shall be closed once every message published on it has been acknowledged, once it is lost, or 10 seconds after the new connection took over; the messages it left unacknowledged shall then be resent on the new connection without waiting for the resend timeout.] */
+                    if ((mqttMsgEntry->isOnDrainingConnection && (transport_data->drainingMqttClient == NULL)) ||
+                        (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN))
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransport_MQTT_Common_DoWork has resent the message two times then it shall fail the message] */
                         if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
                         {
+                            (void)untrack_inflight_packet(transport_data->telemetry_inflight, mqttMsgEntry->packet_id);
                             (void)DList_RemoveEntryList(currentListEntry);
                             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
-                            free(mqttMsgEntry);
+                            destroy_message_details_entry(transport_data, mqttMsgEntry);
+                        }
+                        else if (!has_publish_token(transport_data))
+                        {
+                            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_150: [If "MaxPublishesPerSecond" is set, IoTHubTransport_MQTT_Common_DoWork shall take a publish token for every message it publishes or resends, and shall stop publishing and resending when there is none left.] */
+                            break;
                         }
                         else
                         {
-                            size_t messageLength;
-                            const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
-                            if (messageLength == 0 || messagePayload == NULL)
+                            take_publish_token(transport_data);
+                            if (resend_mqtt_telemetry_msg(transport_data, mqttMsgEntry) != 0)
                             {
-                                LogError("Failure from creating Message IoTHubMessage_GetData");
+                                (void)untrack_inflight_packet(transport_data->telemetry_inflight, mqttMsgEntry->packet_id);
+                                (void)DList_RemoveEntryList(currentListEntry);
+                                sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                                destroy_message_details_entry(transport_data, mqttMsgEntry);
                             }
-                            else
+                            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_140: [A message that has been resent shall be moved to the end of the Waiting Acknowledge messages, so that they stay in the order they were last published.] */
+                            else if (!isLastListEntry)
                             {
-                                if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
-                                {
-                                    (void)DList_RemoveEntryList(currentListEntry);
-                                    sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                    free(mqttMsgEntry);
-                                }
+                                (void)DList_RemoveEntryList(currentListEntry);
+                                DList_InsertTailList(&(transport_data->telemetry_waitingForAck), currentListEntry);
                             }
                         }
                     }
+                    else
+                    {
+                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_141: [IoTHubTransport_MQTT_Common_DoWork shall stop looking for messages to resend at the first message that has not been waiting longer than 2 min.] */
+                        break;
+                    }
                     currentListEntry = nextListEntry.Flink;
                 }
 
                 currentListEntry = transport_data->waitingToSend->Flink;
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                while (currentListEntry != transport_data->waitingToSend)
+                while ((currentListEntry != transport_data->waitingToSend) && has_inflight_window(transport_data) && has_publish_token(transport_data))
                 {
                     IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
                     DLIST_ENTRY savedFromCurrentListEntry;
@@ -2065,10 +2466,24 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                     {
                         LogError("Failure result from IoTHubMessage_GetData");
                     }
+                    else if (transport_data->telemetryAtMostOnce)
+                    {
+                        take_publish_token(transport_data);
+                        (void)(DList_RemoveEntryList(currentListEntry));
+                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_169: [A message published with DELIVER_AT_MOST_ONCE shall be completed with IOTHUB_CLIENT_CONFIRMATION_OK as soon as mqtt_client_publish has handed it to the xio, or with IOTHUB_CLIENT_CONFIRMATION_ERROR if it could not be published.] */
+                        if (publish_mqtt_telemetry_msg_at_most_once(transport_data, iothubMsgList->messageHandle, messagePayload, messageLength) != 0)
+                        {
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                        }
+                        else
+                        {
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        }
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransport_MQTT_Common_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = create_message_details_entry(transport_data);
                         if (mqttMsgEntry == NULL)
                         {
                             LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
@@ -2077,12 +2492,22 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                         {
                             mqttMsgEntry->retryCount = 0;
                             mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
+                            mqttMsgEntry->mqttMessage = NULL;
                             mqttMsgEntry->packet_id = get_next_packet_id(transport_data);
-                            if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            take_publish_token(transport_data);
+                            if (track_inflight_packet(&transport_data->telemetry_inflight, mqttMsgEntry->packet_id, mqttMsgEntry) != 0)
+                            {
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_143: [If the publish cannot be indexed by its packet id, it shall not be sent and shall be completed with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+                                (void)(DList_RemoveEntryList(currentListEntry));
+                                sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                                destroy_message_details_entry(transport_data, mqttMsgEntry);
+                            }
+                            else if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
                             {
+                                (void)untrack_inflight_packet(transport_data->telemetry_inflight, mqttMsgEntry->packet_id);
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                free(mqttMsgEntry);
+                                destroy_message_details_entry(transport_data, mqttMsgEntry);
                             }
                             else
                             {
@@ -2161,17 +2586,26 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_036: [If the option parameter is set to "keepalive" then the value shall be a int_ptr and the value will determine the mqtt keepalive time that is set for pings.] */
             int* keepAliveOption = (int*)value;
-            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_037 : [If the option parameter is set to supplied int_ptr keepalive is the same value as the existing keepalive then IoTHubTransport_MQTT_Common_SetOption shall do nothing.] */
-            if (*keepAliveOption != transport_data->keepAliveValue)
+            if (!is_idle_poll_interval_allowed(transport_data->idlePollInterval, *keepAliveOption))
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_176: [A "keepalive" that is not above a non-zero "IdlePollInterval" shall be rejected with IOTHUB_CLIENT_INVALID_ARG.] */
+                LogError("keepalive of %d seconds is not above IdlePollInterval of %lu milliseconds", *keepAliveOption, (unsigned long)transport_data->idlePollInterval);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
             {
-                transport_data->keepAliveValue = (uint16_t)(*keepAliveOption);
-                if (transport_data->isConnected)
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_037 : [If the option parameter is set to supplied int_ptr keepalive is the same value as the existing keepalive then IoTHubTransport_MQTT_Common_SetOption shall do nothing.] */
+                if (*keepAliveOption != transport_data->keepAliveValue)
                 {
-                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [If the client is isConnected when the keepalive is set then IoTHubTransport_MQTT_Common_SetOption shall disconnect and reconnect with the specified keepalive value.] */
-                    DisconnectFromClient(transport_data);
+                    transport_data->keepAliveValue = (uint16_t)(*keepAliveOption);
+                    if (transport_data->isConnected)
+                    {
+                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [If the client is isConnected when the keepalive is set then IoTHubTransport_MQTT_Common_SetOption shall disconnect and reconnect with the specified keepalive value.] */
+                        DisconnectFromClient(transport_data);
+                    }
                 }
+                result = IOTHUB_CLIENT_OK;
             }
-            result = IOTHUB_CLIENT_OK;
         }
         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_039: [If the option parameter is set to "x509certificate" then the value shall be a const char of the certificate to be used for x509.] */
         else if ((strcmp(OPTION_X509_CERT, option) == 0) && (transport_data->transport_creds.credential_type != X509))
@@ -2185,10 +2619,106 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
             LogError("x509privatekey specified, but authentication method is not x509");
             result = IOTHUB_CLIENT_INVALID_ARG;
         }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_136: [If the option parameter is set to "PublishPoolSize" then the value shall be a size_t_ptr holding the number of publish records that IoTHubTransport_MQTT_Common_SetOption shall preallocate by calling IoTHubClient_BlockPool_Create.] */
+        else if (strcmp(OPTION_PUBLISH_POOL_SIZE, option) == 0)
+        {
+            size_t poolSize = *((const size_t*)value);
+            if (poolSize == 0)
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_137: [If the "PublishPoolSize" value is 0, IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+                LogError("PublishPoolSize cannot be 0");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else if (transport_data->publishPool != NULL)
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_138: [If a publish pool has already been set, IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_ERROR.] */
+                LogError("PublishPoolSize can only be set once");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else if ((transport_data->publishPool = IoTHubClient_BlockPool_Create(sizeof(MQTT_MESSAGE_DETAILS_LIST), poolSize)) == NULL)
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_139: [If IoTHubClient_BlockPool_Create fails, IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_ERROR.] */
+                LogError("failure creating the publish pool");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_147: [If the option parameter is set to "MaxInFlight" then the value shall be a size_t_ptr holding the most messages that may wait for their PUBACK at once, 0 for no limit.] */
+        else if (strcmp(OPTION_MAX_IN_FLIGHT, option) == 0)
+        {
+            transport_data->maxInFlight = *((const size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_149: [If the option parameter is set to "MaxPublishesPerSecond" then the value shall be a size_t_ptr holding the most messages published or resent per second, 0 for no limit; setting it shall fill the publish tokens.] */
+        else if (strcmp(OPTION_MAX_PUBLISHES_PER_SECOND, option) == 0)
+        {
+            transport_data->maxPublishesPerSecond = *((const size_t*)value);
+            transport_data->publishTokensTimeSet = false;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_170: [If the option parameter is set to "TelemetryAtMostOnce" then the value shall be a bool_ptr telling whether telemetry is published with DELIVER_AT_MOST_ONCE; messages already waiting for their PUBACK are not affected.] */
+        else if (strcmp(OPTION_TELEMETRY_AT_MOST_ONCE, option) == 0)
+        {
+            transport_data->telemetryAtMostOnce = *((const bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_172: [If the option parameter is set to "IdlePollInterval" then the value shall be a size_t_ptr holding the milliseconds between two polls of an idle connection, 0 to poll it on every call to IoTHubTransport_MQTT_Common_DoWork.] */
+        else if (strcmp(OPTION_IDLE_POLL_INTERVAL, option) == 0)
+        {
+            size_t idlePollInterval = *((const size_t*)value);
+            if (!is_idle_poll_interval_allowed(idlePollInterval, transport_data->keepAliveValue))
+            {
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_175: [An "IdlePollInterval" that is not below the keepalive of the connection shall be rejected with IOTHUB_CLIENT_INVALID_ARG, since no PINGREQ is sent while an idle connection is skipped.] */
+                LogError("IdlePollInterval of %lu milliseconds is not below the keepalive of %d seconds", (unsigned long)idlePollInterval, (int)transport_data->keepAliveValue);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                transport_data->idlePollInterval = idlePollInterval;
+                transport_data->lastPollTimeSet = false;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_164: [If the option parameter is set to "sas_token_lifetime" then the value shall be a size_t_ptr holding the lifetime in seconds of the SAS tokens created from the device key; 0 shall be rejected with IOTHUB_CLIENT_INVALID_ARG.] */
+        else if (strcmp(OPTION_SAS_TOKEN_LIFETIME, option) == 0)
+        {
+            size_t lifetime = *((const size_t*)value);
+            if (lifetime == 0)
+            {
+                LogError("sas_token_lifetime cannot be 0");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                transport_data->sasTokenLifetime = lifetime;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_165: [If the option parameter is set to "sas_token_refresh_time" then the value shall be a size_t_ptr holding the seconds after which a connection is refreshed, 0 for 80% of the SAS token lifetime.] */
+        else if (strcmp(OPTION_SAS_TOKEN_REFRESH_TIME, option) == 0)
+        {
+            transport_data->sasTokenRefreshTime = *((const size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_166: [If the option parameter is set to "SasTokenRefreshJitter" then the value shall be a size_t_ptr holding the most seconds by which a connection is refreshed early, 0 for none.] */
+        else if (strcmp(OPTION_SAS_TOKEN_REFRESH_JITTER, option) == 0)
+        {
+            transport_data->sasTokenRefreshJitter = *((const size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_167: [If the option parameter is set to "SasTokenRollover" then the value shall be a bool_ptr telling whether the connection is refreshed by opening the new connection before closing the current one.] */
+        else if (strcmp(OPTION_SAS_TOKEN_ROLLOVER, option) == 0)
+        {
+            transport_data->sasTokenRollover = *((const bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
         else
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransport_MQTT_Common_SetOption shall pass down the option to xio_setoption if the option parameter is not a known option string for the MQTT transport.] */
-            if (GetTransportProviderIfNecessary(transport_data) == 0)
+            if (GetTransportProviderIfNecessary(transport_data, &transport_data->xioTransport) == 0)
             {
                 if (xio_setoption(transport_data->xioTransport, option, value) == 0)
                 {
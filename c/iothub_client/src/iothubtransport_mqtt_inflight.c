@@ -0,0 +1,288 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "iothubtransport_mqtt_inflight.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#define MINIMUM_SLOT_COUNT 4
+/*one slot per packet id, at this size every packet id has a slot of its own*/
+#define MAXIMUM_SLOT_COUNT 65536
+
+typedef struct INFLIGHT_SLOT_TAG
+{
+    void* record; /*NULL when the slot is free*/
+    uint16_t packetId;
+} INFLIGHT_SLOT;
+
+typedef struct IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE_TAG
+{
+    INFLIGHT_SLOT* slots;
+    size_t slotCount; /*a power of 2*/
+    size_t count;
+} IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE;
+
+/*packet ids are handed out in sequence, so the id itself spreads them over the slots*/
+static size_t get_home_slot(IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE* inflight, uint16_t packetId)
+{
+    return (size_t)packetId & (inflight->slotCount - 1);
+}
+
+static size_t get_grow_threshold(size_t slotCount)
+{
+    return (slotCount == MAXIMUM_SLOT_COUNT) ? slotCount : slotCount - slotCount / 4;
+}
+
+static INFLIGHT_SLOT* create_slots(size_t slotCount)
+{
+    INFLIGHT_SLOT* result = (INFLIGHT_SLOT*)malloc(slotCount * sizeof(INFLIGHT_SLOT));
+    if (result == NULL)
+    {
+        LogError("unable to malloc %u slots", (unsigned int)slotCount);
+    }
+    else
+    {
+        (void)memset(result, 0, slotCount * sizeof(INFLIGHT_SLOT));
+    }
+    return result;
+}
+
+/*returns the slot holding packetId, or slotCount if there is none*/
+static size_t find_slot(IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE* inflight, uint16_t packetId)
+{
+    size_t mask = inflight->slotCount - 1;
+    size_t slot = get_home_slot(inflight, packetId);
+    size_t probed;
+
+    for (probed = 0; probed < inflight->slotCount; probed++)
+    {
+        if (inflight->slots[slot].record == NULL)
+        {
+            break;
+        }
+        else if (inflight->slots[slot].packetId == packetId)
+        {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return inflight->slotCount;
+}
+
+static void place_record(IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE* inflight, uint16_t packetId, void* record)
+{
+    size_t mask = inflight->slotCount - 1;
+    size_t slot = get_home_slot(inflight, packetId);
+
+    while (inflight->slots[slot].record != NULL)
+    {
+        slot = (slot + 1) & mask;
+    }
+    inflight->slots[slot].record = record;
+    inflight->slots[slot].packetId = packetId;
+}
+
+static int rebuild(IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE* inflight, size_t slotCount)
+{
+    int result;
+    INFLIGHT_SLOT* slots = create_slots(slotCount);
+    if (slots == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        INFLIGHT_SLOT* oldSlots = inflight->slots;
+        size_t oldSlotCount = inflight->slotCount;
+        size_t i;
+
+        inflight->slots = slots;
+        inflight->slotCount = slotCount;
+        for (i = 0; i < oldSlotCount; i++)
+        {
+            if (oldSlots[i].record != NULL)
+            {
+                place_record(inflight, oldSlots[i].packetId, oldSlots[i].record);
+            }
+        }
+        free(oldSlots);
+        result = 0;
+    }
+    return result;
+}
+
+IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE iothubtransport_mqtt_inflight_create(size_t initialCapacity)
+{
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE* result;
+
+    if (initialCapacity == 0)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_001: [ If initialCapacity is 0, iothubtransport_mqtt_inflight_create shall fail and return NULL. ]*/
+        LogError("invalid argument initialCapacity=0");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_002: [ iothubtransport_mqtt_inflight_create shall allocate memory for the table and for its slots, all of them free. ]*/
+    else if ((result = (IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE*)malloc(sizeof(IOTHUBTRANSPORT_MQTT_INFLIGHT_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_003: [ If any allocation fails, iothubtransport_mqtt_inflight_create shall free everything it allocated and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_004: [ The number of slots shall be the smallest power of 2, at least 4 and at most 65536, whose 3/4 is not smaller than initialCapacity. ]*/
+        size_t slotCount = MINIMUM_SLOT_COUNT;
+        while ((slotCount < MAXIMUM_SLOT_COUNT) && (get_grow_threshold(slotCount) < initialCapacity))
+        {
+            slotCount *= 2;
+        }
+
+        if ((result->slots = create_slots(slotCount)) == NULL)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_003: [ If any allocation fails, iothubtransport_mqtt_inflight_create shall free everything it allocated and return NULL. ]*/
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->slotCount = slotCount;
+            result->count = 0;
+        }
+    }
+
+    return result;
+}
+
+void iothubtransport_mqtt_inflight_destroy(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_005: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_destroy shall do nothing. ]*/
+    if (inflightHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_006: [ iothubtransport_mqtt_inflight_destroy shall free the slots and the table, and shall not touch the records. ]*/
+        free(inflightHandle->slots);
+        free(inflightHandle);
+    }
+}
+
+int iothubtransport_mqtt_inflight_insert(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle, uint16_t packetId, void* record)
+{
+    int result;
+
+    if ((inflightHandle == NULL) || (record == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_007: [ If inflightHandle or record is NULL, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+        LogError("invalid argument inflightHandle=%p, record=%p", inflightHandle, record);
+        result = __LINE__;
+    }
+    else if (find_slot(inflightHandle, packetId) != inflightHandle->slotCount)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_008: [ If packetId is already in the table, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+        LogError("packet id %u is already in flight", (unsigned int)packetId);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_009: [ When the table is 3/4 full, iothubtransport_mqtt_inflight_insert shall rebuild it with twice as many slots, up to 65536. ]*/
+        if ((inflightHandle->count >= get_grow_threshold(inflightHandle->slotCount)) &&
+            (inflightHandle->slotCount < MAXIMUM_SLOT_COUNT) &&
+            (rebuild(inflightHandle, inflightHandle->slotCount * 2) != 0))
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_010: [ If the table cannot be rebuilt, iothubtransport_mqtt_inflight_insert shall keep using its current slots. ]*/
+            LogError("unable to grow the table, %u packets in flight", (unsigned int)inflightHandle->count);
+        }
+
+        if (inflightHandle->count == inflightHandle->slotCount)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_011: [ If every slot is taken, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+            LogError("the table is full");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_012: [ Otherwise iothubtransport_mqtt_inflight_insert shall store record in the first free slot from the slot of packetId on and return 0. ]*/
+            place_record(inflightHandle, packetId, record);
+            inflightHandle->count++;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+void* iothubtransport_mqtt_inflight_find(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle, uint16_t packetId)
+{
+    void* result;
+
+    if (inflightHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_013: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_find shall return NULL. ]*/
+        LogError("invalid argument inflightHandle=NULL");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_014: [ iothubtransport_mqtt_inflight_find shall return the record stored under packetId, or NULL if there is none. ]*/
+        size_t slot = find_slot(inflightHandle, packetId);
+        result = (slot == inflightHandle->slotCount) ? NULL : inflightHandle->slots[slot].record;
+    }
+
+    return result;
+}
+
+void* iothubtransport_mqtt_inflight_remove(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle, uint16_t packetId)
+{
+    void* result;
+
+    if (inflightHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_015: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_remove shall return NULL. ]*/
+        LogError("invalid argument inflightHandle=NULL");
+        result = NULL;
+    }
+    else
+    {
+        size_t slot = find_slot(inflightHandle, packetId);
+        if (slot == inflightHandle->slotCount)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_016: [ If packetId is not in the table, iothubtransport_mqtt_inflight_remove shall return NULL. ]*/
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_017: [ Otherwise iothubtransport_mqtt_inflight_remove shall free the slot, move back the records that probed past it so no tombstone is left, and return the record. ]*/
+            size_t mask = inflightHandle->slotCount - 1;
+            size_t next = (slot + 1) & mask;
+
+            result = inflightHandle->slots[slot].record;
+            inflightHandle->slots[slot].record = NULL;
+            while (inflightHandle->slots[next].record != NULL)
+            {
+                size_t home = get_home_slot(inflightHandle, inflightHandle->slots[next].packetId);
+                /*the record at next can fill the free slot unless its home lies after the free slot*/
+                if (((next - home) & mask) >= ((next - slot) & mask))
+                {
+                    inflightHandle->slots[slot] = inflightHandle->slots[next];
+                    inflightHandle->slots[next].record = NULL;
+                    slot = next;
+                }
+                next = (next + 1) & mask;
+            }
+            inflightHandle->count--;
+        }
+    }
+
+    return result;
+}
+
+size_t iothubtransport_mqtt_inflight_get_count(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_018: [ iothubtransport_mqtt_inflight_get_count shall return the number of records in the table, or 0 if inflightHandle is NULL. ]*/
+    return (inflightHandle == NULL) ? 0 : inflightHandle->count;
+}
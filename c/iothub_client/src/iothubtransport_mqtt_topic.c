@@ -0,0 +1,366 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "iothubtransport_mqtt_topic.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*properties whose name and value fit here are decoded on the stack*/
+#define PROPERTY_BUFFER_SIZE 256
+/*devices/{device id}/messages/devicebound/{properties}*/
+#define C2D_PROPERTIES_SEGMENT 4
+
+static const char DEVICE_TWIN_PREFIX[] = "$iothub/twin/";
+static const char DEVICE_METHOD_PREFIX[] = "$iothub/methods/";
+static const char PATCH_SEGMENT[] = "PATCH";
+static const char REQUEST_ID_KEY[] = "$rid=";
+
+static char to_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+/*returns the length of prefix if topic starts with it, ignoring case, 0 otherwise*/
+static size_t match_prefix(const char* topic, const char* prefix, size_t prefixLength)
+{
+    size_t index;
+    for (index = 0; index < prefixLength; index++)
+    {
+        if (to_lower(topic[index]) != to_lower(prefix[index]))
+        {
+            return 0;
+        }
+    }
+    return prefixLength;
+}
+
+/*returns the '/' or the '\0' that ends the segment starting at position*/
+static const char* find_segment_end(const char* position)
+{
+    while (*position != '\0' && *position != '/')
+    {
+        position++;
+    }
+    return position;
+}
+
+/*reads the decimal number at position, which must be followed by one of the terminators or by '\0'*/
+static int parse_decimal(const char* position, const char* terminators, const char** end, size_t* value)
+{
+    int result;
+    size_t number = 0;
+    const char* digit = position;
+
+    while (*digit >= '0' && *digit <= '9' && number <= ((size_t)-1 - 9) / 10)
+    {
+        number = number * 10 + (size_t)(*digit - '0');
+        digit++;
+    }
+
+    if (digit == position || (*digit != '\0' && strchr(terminators, *digit) == NULL))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *end = digit;
+        *value = number;
+        result = 0;
+    }
+    return result;
+}
+
+/*looks the $rid up in the query string at position, "?name=value&name=value..."*/
+static int parse_request_id(const char* position, size_t* requestId)
+{
+    int result = __LINE__;
+    if (*position == '?')
+    {
+        const char* parameter = position + 1;
+        while (*parameter != '\0')
+        {
+            if (strncmp(parameter, REQUEST_ID_KEY, sizeof(REQUEST_ID_KEY) - 1) == 0)
+            {
+                const char* end;
+                result = parse_decimal(parameter + sizeof(REQUEST_ID_KEY) - 1, "&", &end, requestId);
+                break;
+            }
+            while (*parameter != '\0' && *parameter != '&')
+            {
+                parameter++;
+            }
+            if (*parameter == '&')
+            {
+                parameter++;
+            }
+        }
+    }
+    return result;
+}
+
+/*$iothub/twin/PATCH/properties/desired/?$version={version}
+  $iothub/twin/res/{status}/?$rid={request id}*/
+static int parse_device_twin_topic(const char* position, IOTHUBTRANSPORT_MQTT_TOPIC_INFO* topicInfo)
+{
+    int result;
+    const char* operationEnd = find_segment_end(position);
+
+    if ((size_t)(operationEnd - position) == sizeof(PATCH_SEGMENT) - 1 && memcmp(position, PATCH_SEGMENT, sizeof(PATCH_SEGMENT) - 1) == 0)
+    {
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_004: [ If the segment after $iothub/twin is PATCH, iothubtransport_mqtt_topic_parse shall set isPatch to true. ] */
+        topicInfo->isPatch = true;
+        result = 0;
+    }
+    else if (*operationEnd != '/')
+    {
+        LogError("device twin topic has no status code");
+        result = __LINE__;
+    }
+    else
+    {
+        const char* statusEnd;
+        size_t statusCode;
+
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_005: [ Otherwise iothubtransport_mqtt_topic_parse shall read the status code from the next segment, and shall fail if it is not a number. ] */
+        if (parse_decimal(operationEnd + 1, "/", &statusEnd, &statusCode) != 0 || statusCode > INT_MAX)
+        {
+            LogError("device twin topic has an invalid status code");
+            result = __LINE__;
+        }
+        else
+        {
+            topicInfo->statusCode = (int)statusCode;
+            /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_006: [ iothubtransport_mqtt_topic_parse shall read the request id from the $rid of the query string after the status code, and leave it 0 if there is none. ] */
+            if (*statusEnd == '/' && parse_request_id(statusEnd + 1, &topicInfo->requestId) != 0)
+            {
+                topicInfo->requestId = 0;
+            }
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*$iothub/methods/POST/{method name}/?$rid={request id}*/
+static int parse_device_method_topic(const char* position, IOTHUBTRANSPORT_MQTT_TOPIC_INFO* topicInfo)
+{
+    int result;
+    const char* verbEnd = find_segment_end(position);
+
+    if (*verbEnd != '/')
+    {
+        LogError("device method topic has no method name");
+        result = __LINE__;
+    }
+    else
+    {
+        const char* methodName = verbEnd + 1;
+        const char* methodNameEnd = find_segment_end(methodName);
+
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_008: [ If the method name is empty or is not followed by a query string with a $rid, iothubtransport_mqtt_topic_parse shall fail and return a non-zero value. ] */
+        if (methodNameEnd == methodName || *methodNameEnd != '/')
+        {
+            LogError("device method topic has no method name");
+            result = __LINE__;
+        }
+        else if (parse_request_id(methodNameEnd + 1, &topicInfo->requestId) != 0)
+        {
+            LogError("device method topic has no request id");
+            result = __LINE__;
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_007: [ iothubtransport_mqtt_topic_parse shall point methodName at the segment after the verb of a device method topic and read the request id from the $rid of the query string that follows it. ] */
+            topicInfo->methodName = methodName;
+            topicInfo->methodNameLength = (size_t)(methodNameEnd - methodName);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*returns the value of the hexadecimal digit c, or -1 if c is not one*/
+static int hex_value(char c)
+{
+    int result;
+    if (c >= '0' && c <= '9')
+    {
+        result = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+        result = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+        result = c - 'A' + 10;
+    }
+    else
+    {
+        result = -1;
+    }
+    return result;
+}
+
+/*decodes the URL encoded characters from begin to end into destination, returns the number of characters written*/
+static size_t url_decode(const char* begin, const char* end, char* destination)
+{
+    size_t written = 0;
+
+    while (begin < end)
+    {
+        int high;
+        int low;
+        if (*begin == '%' && end - begin >= 3 &&
+            (high = hex_value(begin[1])) >= 0 &&
+            (low = hex_value(begin[2])) >= 0)
+        {
+            destination[written++] = (char)((high << 4) | low);
+            begin += 3;
+        }
+        else
+        {
+            destination[written++] = *begin;
+            begin++;
+        }
+    }
+    return written;
+}
+
+static int call_property_callback(const char* name, const char* separator, const char* end, IOTHUBTRANSPORT_MQTT_TOPIC_PROPERTY_CALLBACK propertyCallback, void* context)
+{
+    int result;
+    char stackBuffer[PROPERTY_BUFFER_SIZE];
+    /*decoding never makes a property longer: the name, the value and their terminators fit in the length of the pair plus 1*/
+    size_t bufferSize = (size_t)(end - name) + 1;
+    char* buffer;
+
+    /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_012: [ iothubtransport_mqtt_topic_for_each_property shall decode the property in a buffer on the stack, or allocate one if it does not fit. ] */
+    if (bufferSize <= sizeof(stackBuffer))
+    {
+        buffer = stackBuffer;
+    }
+    else if ((buffer = (char*)malloc(bufferSize)) == NULL)
+    {
+        LogError("unable to malloc %u bytes to decode a property", (unsigned int)bufferSize);
+    }
+
+    if (buffer == NULL)
+    {
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_013: [ If the buffer cannot be allocated, iothubtransport_mqtt_topic_for_each_property shall fail and return a non-zero value. ] */
+        result = __LINE__;
+    }
+    else
+    {
+        size_t nameLength = url_decode(name, separator, buffer);
+        size_t valueLength;
+        buffer[nameLength] = '\0';
+        valueLength = url_decode(separator + 1, end, buffer + nameLength + 1);
+        buffer[nameLength + 1 + valueLength] = '\0';
+
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_014: [ If propertyCallback returns a non-zero value, iothubtransport_mqtt_topic_for_each_property shall stop and return a non-zero value. ] */
+        result = (propertyCallback(context, buffer, buffer + nameLength + 1) == 0) ? 0 : __LINE__;
+
+        if (buffer != stackBuffer)
+        {
+            free(buffer);
+        }
+    }
+    return result;
+}
+
+int iothubtransport_mqtt_topic_parse(const char* topic, IOTHUBTRANSPORT_MQTT_TOPIC_INFO* topicInfo)
+{
+    int result;
+
+    if (topic == NULL || topicInfo == NULL)
+    {
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_001: [ If topic or topicInfo is NULL, iothubtransport_mqtt_topic_parse shall fail and return a non-zero value. ] */
+        LogError("invalid argument (topic=%p, topicInfo=%p)", topic, topicInfo);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t prefixLength;
+
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_002: [ iothubtransport_mqtt_topic_parse shall read the topic once, without allocating memory, and shall reset every field of topicInfo before filling it. ] */
+        (void)memset(topicInfo, 0, sizeof(IOTHUBTRANSPORT_MQTT_TOPIC_INFO));
+
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_003: [ A topic starting with $iothub/twin/ shall be a device twin topic, a topic starting with $iothub/methods/ a device method topic, regardless of case, and any other topic a cloud to device message. ] */
+        if ((prefixLength = match_prefix(topic, DEVICE_TWIN_PREFIX, sizeof(DEVICE_TWIN_PREFIX) - 1)) != 0)
+        {
+            topicInfo->type = IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN;
+            result = parse_device_twin_topic(topic + prefixLength, topicInfo);
+        }
+        else if ((prefixLength = match_prefix(topic, DEVICE_METHOD_PREFIX, sizeof(DEVICE_METHOD_PREFIX) - 1)) != 0)
+        {
+            topicInfo->type = IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD;
+            result = parse_device_method_topic(topic + prefixLength, topicInfo);
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_009: [ iothubtransport_mqtt_topic_parse shall point properties at what follows devices/{device id}/messages/devicebound/ in a cloud to device message topic, or at the end of the topic if there is nothing there. ] */
+            const char* position = topic;
+            size_t segment;
+            for (segment = 0; segment < C2D_PROPERTIES_SEGMENT && *position != '\0'; segment++)
+            {
+                position = find_segment_end(position);
+                if (*position == '/')
+                {
+                    position++;
+                }
+            }
+            topicInfo->type = IOTHUBTRANSPORT_MQTT_TOPIC_C2D;
+            topicInfo->properties = position;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int iothubtransport_mqtt_topic_for_each_property(const char* properties, IOTHUBTRANSPORT_MQTT_TOPIC_PROPERTY_CALLBACK propertyCallback, void* context)
+{
+    int result;
+
+    if (properties == NULL || propertyCallback == NULL)
+    {
+        /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_010: [ If properties or propertyCallback is NULL, iothubtransport_mqtt_topic_for_each_property shall fail and return a non-zero value. ] */
+        LogError("invalid argument (properties=%p, propertyCallback=%p)", properties, propertyCallback);
+        result = __LINE__;
+    }
+    else
+    {
+        const char* pair = properties;
+        result = 0;
+        while (result == 0 && *pair != '\0')
+        {
+            const char* separator = NULL;
+            const char* end = pair;
+            while (*end != '\0' && *end != '&')
+            {
+                if (*end == '=' && separator == NULL)
+                {
+                    separator = end;
+                }
+                end++;
+            }
+
+            /* Codes_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_011: [ iothubtransport_mqtt_topic_for_each_property shall call propertyCallback with the URL decoded name and value of each &-separated name=value pair, skipping the pairs with no = or with an empty name. ] */
+            if (separator != NULL && separator != pair)
+            {
+                result = call_property_callback(pair, separator, end, propertyCallback, context);
+            }
+            pair = (*end == '&') ? end + 1 : end;
+        }
+    }
+    return result;
+}
@@ -285,7 +285,8 @@ static void removeEventFromInProgressList(IOTHUB_MESSAGE_LIST* message)
 static void rollEventBackToWaitList(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     removeEventFromInProgressList(message);
-    DList_InsertTailList(device_state->waitingToSend, &message->entry);
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_07_002: [Events rolled back from inProgress shall be put back at the head of waitingToSend, in the order they were sent, so that waitingToSend stays in send order.]
+    DList_InsertHeadList(device_state->waitingToSend, &message->entry);
 }
 
 static void rollEventsBackToWaitList(AMQP_TRANSPORT_DEVICE_STATE* device_state)
@@ -304,7 +305,8 @@ static void on_message_send_complete(void* context, MESSAGE_SEND_RESULT send_res
 {
     IOTHUB_MESSAGE_LIST* message = (IOTHUB_MESSAGE_LIST*)context;
 
-    IOTHUB_CLIENT_RESULT iot_hub_send_result;
+    IOTHUB_CLIENT_CONFIRMATION_RESULT iot_hub_send_result;
+    DLIST_ENTRY messageCompleted;
 
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_142: [The callback 'on_message_send_complete' shall pass to the upper layer callback an IOTHUB_CLIENT_CONFIRMATION_OK if the result received is MESSAGE_SEND_OK] 
     if (send_result == MESSAGE_SEND_OK)
@@ -317,23 +319,16 @@ static void on_message_send_complete(void* context, MESSAGE_SEND_RESULT send_res
         iot_hub_send_result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
     }
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_102: [The callback 'on_message_send_complete' shall invoke the upper layer callback for message received if provided] 
-    if (message->callback != NULL)
-    {
-        message->callback(iot_hub_send_result, message->context);
-    }
-
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_100: [The callback 'on_message_send_complete' shall remove the target message from the in-progress list after the upper layer callback] 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_100: [The callback 'on_message_send_complete' shall remove the target message from the in-progress list]
     if (isEventInInProgressList(message))
     {
         removeEventFromInProgressList(message);
     }
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_151: [The callback 'on_message_send_complete' shall destroy the message handle (IOTHUB_MESSAGE_HANDLE) using IoTHubMessage_Destroy()]
-    IoTHubMessage_Destroy(message->messageHandle);
-
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_152: [The callback 'on_message_send_complete' shall destroy the IOTHUB_MESSAGE_LIST instance]
-    free(message); 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_07_003: [The callback 'on_message_send_complete' shall hand the message back to the IoTHubClient_LL that queued it by calling IoTHubClient_LL_SendComplete with a list holding only the message, which invokes the upper layer callback and destroys the message and the IOTHUB_MESSAGE_LIST instance]
+    DList_InitializeListHead(&messageCompleted);
+    DList_InsertTailList(&messageCompleted, &message->entry);
+    IoTHubClient_LL_SendComplete(message->owner, &messageCompleted, iot_hub_send_result);
 }
 
 static AMQP_VALUE on_message_received(const void* context, MESSAGE_HANDLE message)
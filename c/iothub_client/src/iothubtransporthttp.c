@@ -8,23 +8,29 @@
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <time.h>
+#include <stdint.h>
 #include "iothub_client_options.h"
 #include "iothub_client_version.h"
 #include "iothub_client_private.h"
 #include "iothub_transport_ll.h"
 #include "iothubtransporthttp.h"
+#include "iothubtransporthttp_batch.h"
+#include "iothubtransporthttp_pool.h"
+#include "iothubtransporthttp_poll.h"
+#include "iothubtransporthttp_compress.h"
 
 #include "azure_c_shared_utility/httpapiexsas.h"
+#include "azure_c_shared_utility/sastoken.h"
 #include "azure_c_shared_utility/urlencode.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -33,6 +39,8 @@ const char* IOTHUB_CORRELATION_ID = "iothub-correlationid";
 #define CONTENT_TYPE "Content-Type"
 #define APPLICATION_OCTET_STREAM "application/octet-stream"
 #define APPLICATION_VND_MICROSOFT_IOTHUB_JSON "application/vnd.microsoft.iothub.json"
+#define CONTENT_ENCODING "Content-Encoding"
+#define DEFLATE "deflate"
 
 /*DEFAULT_GETMINIMUMPOLLINGTIME is the minimum time in seconds allowed between 2 consecutive GET issues to the service (GET=fetch messages)*/
 /*the default is 25 minutes*/
@@ -42,18 +50,38 @@ const char* IOTHUB_CORRELATION_ID = "iothub-correlationid";
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
-
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
     STRING_HANDLE hostName;
-    HTTPAPIEX_HANDLE httpApiExHandle;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*the connection of lane 0 of the pool*/
     bool doBatchedTransfers;
+    bool doCompressedBatches;
     unsigned int getMinimumPollingTime;
     VECTOR_HANDLE perDeviceList;
+    size_t connectionPoolSize;
+    HTTPAPIEX_HANDLE* poolHttpApiExHandles; /*the connections of the lanes 1 to connectionPoolSize - 1, NULL when connectionPoolSize is 1*/
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool; /*NULL when connectionPoolSize is 1*/
+    bool wereOptionsPassedDown; /*the connections of a bigger pool would miss the options already passed to HTTPAPIEX*/
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollScheduler; /*NULL unless "AdaptivePollingTime" is set, then it replaces getMinimumPollingTime as the poll schedule*/
+    unsigned int adaptivePollingTime;
+    unsigned int maxPollsPerSecond;
+    uint32_t registeredDeviceCount; /*seeds the poll schedule of the next device*/
+    unsigned int maxMessagesPerPoll; /*GET requests per device and poll cycle while the service has messages*/
+    size_t doWorkRound; /*rotates the device every lane serves first*/
+    unsigned int doWorkTimeBudget; /*milliseconds, 0 when a DoWork serves every device*/
+    TICK_COUNTER_HANDLE doWorkTickCounter; /*NULL unless "DoWorkTimeBudget" is set*/
+    bool hasDoWorkStartTime; /*false when the start of the DoWork could not be read, then the budget does not apply*/
+    uint64_t doWorkStartTime;
+    size_t sasTokenLifetime; /*seconds, 0 when HTTPAPIEX_SAS signs every request*/
+    size_t sasTokenRefreshTime; /*seconds, 0 for half of sasTokenLifetime*/
 }HTTPTRANSPORT_HANDLE_DATA;
 
+#define DEVICE_DEFERRAL_VALUES \
+    DEVICE_NOT_DEFERRED, \
+    DEVICE_DEFERRED, /*the budget of a DoWork ran out before the device was served*/ \
+    DEVICE_CAUGHT_UP /*the device was deferred and has been served first by the current DoWork*/
+DEFINE_ENUM(DEVICE_DEFERRAL, DEVICE_DEFERRAL_VALUES);
+
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 {
     HTTPTRANSPORT_HANDLE_DATA* transportHandle;
@@ -70,6 +98,14 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
     bool DoWork_PullMessage;
     time_t lastPollTime;
     bool isFirstPoll;
+    IOTHUBTRANSPORTHTTP_POLL_STATE pollState;
+    DEVICE_DEFERRAL deferral;
+    STRING_HANDLE sasTokenScope; /*NULL until the device signs its first cached token*/
+    STRING_HANDLE cachedSasToken; /*NULL unless "sas_token_lifetime" is set*/
+    time_t cachedSasTokenTime; /*when cachedSasToken was signed*/
+    size_t cachedSasTokenLifetime;
+    bool isEventHeaderAuthorized; /*eventHTTPrequestHeaders carry the current token*/
+    bool isMessageHeaderAuthorized; /*messageHTTPrequestHeaders carry the current token*/
 
     IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle;
     PDLIST_ENTRY waitingToSend;
@@ -373,6 +409,20 @@ static bool create_deviceSASObject(HTTPTRANSPORT_PERDEVICE_DATA* handleData, STR
     return result;
 }
 
+static void destroy_cachedSasToken(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    if (handleData->sasTokenScope != NULL)
+    {
+        STRING_delete(handleData->sasTokenScope);
+        handleData->sasTokenScope = NULL;
+    }
+    if (handleData->cachedSasToken != NULL)
+    {
+        STRING_delete(handleData->cachedSasToken);
+        handleData->cachedSasToken = NULL;
+    }
+}
+
 static void destroy_deviceId(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
 {
     STRING_delete(handleData->deviceId);
@@ -573,6 +623,13 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
                 result->DoWork_PullMessage = false;
                 result->isFirstPoll = true;
+                (void)memset(&result->pollState, 0, sizeof(result->pollState));
+                result->pollState.seed = handleData->registeredDeviceCount++;
+                result->deferral = DEVICE_NOT_DEFERRED;
+                result->sasTokenScope = NULL;
+                result->cachedSasToken = NULL;
+                result->isEventHeaderAuthorized = false;
+                result->isMessageHeaderAuthorized = false;
                 result->iotHubClientHandle = iotHubClientHandle;
                 result->waitingToSend = waitingToSend;
                 DList_InitializeListHead(&(result->eventConfirmations));
@@ -612,6 +669,7 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
     destroy_messageHTTPrequestHeaders(perDeviceItem);
     destroy_abandonHTTPrelativePathBegin(perDeviceItem);
     destroy_SASObject(perDeviceItem);
+    destroy_cachedSasToken(perDeviceItem);
 }
 
 static IOTHUB_DEVICE_HANDLE* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHandle)
@@ -737,6 +795,51 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
     return result;
 }
 
+static void destroy_poolHttpApiExHandles(HTTPAPIEX_HANDLE* poolHttpApiExHandles, size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        HTTPAPIEX_Destroy(poolHttpApiExHandles[i]);
+    }
+    free(poolHttpApiExHandles);
+}
+
+static void destroy_connectionPool(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    /*a pool of 1 connection has no pool and no extra connections*/
+    if (handleData->pool != NULL)
+    {
+        iothubtransporthttp_pool_destroy(handleData->pool);
+        handleData->pool = NULL;
+        destroy_poolHttpApiExHandles(handleData->poolHttpApiExHandles, handleData->connectionPoolSize - 1);
+        handleData->poolHttpApiExHandles = NULL;
+        handleData->connectionPoolSize = 1;
+    }
+}
+
+static void destroy_pollScheduler(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    /*without "AdaptivePollingTime" there is no scheduler*/
+    if (handleData->pollScheduler != NULL)
+    {
+        iothubtransporthttp_poll_destroy(handleData->pollScheduler);
+        handleData->pollScheduler = NULL;
+        handleData->adaptivePollingTime = 0;
+    }
+}
+
+static void destroy_doWorkTickCounter(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    /*without "DoWorkTimeBudget" there is no tick counter*/
+    if (handleData->doWorkTickCounter != NULL)
+    {
+        tickcounter_destroy(handleData->doWorkTickCounter);
+        handleData->doWorkTickCounter = NULL;
+        handleData->doWorkTimeBudget = 0;
+    }
+}
+
 static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
     VECTOR_destroy(handleData->perDeviceList);
@@ -814,7 +917,23 @@ static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONF
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
                 result->doBatchedTransfers = false;
+                result->doCompressedBatches = false;
                 result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+                result->connectionPoolSize = 1;
+                result->poolHttpApiExHandles = NULL;
+                result->pool = NULL;
+                result->wereOptionsPassedDown = false;
+                result->pollScheduler = NULL;
+                result->adaptivePollingTime = 0;
+                result->maxPollsPerSecond = 0;
+                result->registeredDeviceCount = 0;
+                result->maxMessagesPerPoll = 1;
+                result->doWorkRound = 0;
+                result->doWorkTimeBudget = 0;
+                result->doWorkTickCounter = NULL;
+                result->hasDoWorkStartTime = false;
+                result->sasTokenLifetime = 0;
+                result->sasTokenRefreshTime = 0;
             }
             else
             {
@@ -849,6 +968,9 @@ static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
         }
 
         destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *) handle);
+        destroy_connectionPool((HTTPTRANSPORT_HANDLE_DATA *) handle);
+        destroy_pollScheduler((HTTPTRANSPORT_HANDLE_DATA *) handle);
+        destroy_doWorkTickCounter((HTTPTRANSPORT_HANDLE_DATA *) handle);
         destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *) handle);
         destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
         free(handle);
@@ -943,380 +1065,477 @@ static void IoTHubTransportHttp_Unsubscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE ha
     LogError("not implemented (yet)");
 }
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
+#define MAKE_PAYLOAD_RESULT_VALUES \
+    MAKE_PAYLOAD_OK, /*returned when there is a payload to be later send by HTTP*/ \
+    MAKE_PAYLOAD_NO_ITEMS, /*returned when there are no items to be send*/ \
+    MAKE_PAYLOAD_ERROR, /*returned when there were errors*/ \
+    MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT /*returned when the first item doesn't fit*/
+
+DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
+
+static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
 {
-    int result;
-    const char*const* keys;
-    const char*const* values;
-    size_t count;
-    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
-    {
-        result = __LINE__;
-        LogError("error while Map_GetInternals");
-    }
-    else
-    {
+    /*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
+    DList_AppendTailList(destination->Flink, source);
+    DList_RemoveEntryList(source);
+    DList_InitializeListHead(source);
+}
 
-        if (count == 0)
+/*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
+/*the items are measured first, so that the payload is allocated once and every item is written straight into it*/
+/*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload)
+{
+    MAKE_PAYLOAD_RESULT result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
+    size_t payloadSize = 1; /*the opening '['*/
+    size_t itemCount = 0;
+    PDLIST_ENTRY actual = deviceData->waitingToSend->Flink;
+    bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
+                           /*either all the items enter the list or only some*/
+    *payload = NULL;
+
+    while (keepGoing && (actual != deviceData->waitingToSend))
+    {
+        IOTHUB_MESSAGE_LIST* message = containingRecord(actual, IOTHUB_MESSAGE_LIST, entry);
+        IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+        if (iothubtransporthttp_batch_get_item_size(message->messageHandle, &itemSize) != 0)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-            /*no properties - do nothing with existing*/
-            result = 0;
-            *propertiesMessageSizeContribution = 0;
+            LogError("unable to iothubtransporthttp_batch_get_item_size");
+            if (itemCount == 0)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                result = MAKE_PAYLOAD_ERROR;
+            }
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+            keepGoing = false;
         }
         else
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-            if (STRING_concat(existing, ",\"properties\":") != 0)
-            {
-                /*go ahead and return it*/
-                result = __LINE__;
-                LogError("failed STRING_concat");
-            }
-            else if (appendMapToJSON(existing, keys, values, count) != 0)
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_001: [ When batching, the message size shall be the exact number of bytes of the payload, that is the JSON items of all the messages in the batch, their separators and the enclosing [ and ]. ]*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+            if (payloadSize + itemSize.itemSize + 1 > MAXIMUM_MESSAGE_SIZE) /*the item and the ',' or ']' that follows it*/
             {
-                result = __LINE__;
-                LogError("unable to append the properties");
+                if (itemCount == 0)
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+                    PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                    DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                    result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+                }
+                /*else this item doesn't make it to the payload, but the payload is valid so far*/
+                keepGoing = false;
             }
             else
             {
-                /*all is fine*/
-                size_t i;
-                *propertiesMessageSizeContribution = 0;
-                for (i = 0;i < count;i++)
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-                    *propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
-                }
-                result = 0;
+                payloadSize += itemSize.itemSize + 1; /*the item and the ',' or ']' that follows it*/
+                itemCount++;
+                actual = actual->Flink;
             }
         }
     }
-    return result;
-}
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
-{
-    int result;
-    if (STRING_concat(existing, "{") != 0)
+    if (result != MAKE_PAYLOAD_OK)
     {
-        /*go on and return it*/
-        result = __LINE__;
-        LogError("STRING_construct failed");
+        /*nothing to build*/
+    }
+    else if (itemCount == 0)
+    {
+        result = MAKE_PAYLOAD_NO_ITEMS;
+    }
+    else if ((*payload = BUFFER_new()) == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+        LogError("unable to BUFFER_new");
+        result = MAKE_PAYLOAD_ERROR;
+    }
+    else if (BUFFER_pre_build(*payload, payloadSize) != 0)
+    {
+        LogError("unable to BUFFER_pre_build");
+        BUFFER_delete(*payload);
+        *payload = NULL;
+        result = MAKE_PAYLOAD_ERROR;
     }
     else
     {
-        size_t i;
-        for (i = 0; i < count; i++)
+        unsigned char* destination = BUFFER_u_char(*payload);
+        size_t position = 0;
+
+        destination[position++] = '[';
+        while (itemCount > 0)
         {
-            if (!(
-                (STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-                (STRING_concat(existing, keys[i]) == 0) &&
-                (STRING_concat(existing, "\":\"") == 0) &&
-                (STRING_concat(existing, values[i]) == 0) &&
-                (STRING_concat(existing, "\"") == 0)
-                ))
+            PDLIST_ENTRY head = deviceData->waitingToSend->Flink;
+            IOTHUB_MESSAGE_LIST* message = containingRecord(head, IOTHUB_MESSAGE_LIST, entry);
+            size_t written;
+            if (iothubtransporthttp_batch_write_item(message->messageHandle, destination + position, payloadSize - position - 1, &written) != 0)
             {
-                LogError("unable to STRING_concat");
+                LogError("unable to iothubtransporthttp_batch_write_item");
                 break;
             }
+            else
+            {
+                position += written;
+                itemCount--;
+                destination[position++] = (itemCount == 0) ? ']' : ','; /*the last comma is replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
+                (void)DList_RemoveHeadList(deviceData->waitingToSend);
+                DList_InsertTailList(&(deviceData->eventConfirmations), head);
+            }
         }
 
-        if (i < count)
-        {
-            result = __LINE__;
-            /*error, let it go through*/
-        }
-        else if (STRING_concat(existing, "}") != 0)
-        {
-            result = __LINE__;
-            LogError("unable to STRING_concat");
-        }
-        else
+        if ((itemCount > 0) || (position != payloadSize))
         {
-            /*all is fine*/
-            result = 0;
+            /*the items that were measured could not all be written, they go back to waitingToSend*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+            BUFFER_delete(*payload);
+            *payload = NULL;
+            result = MAKE_PAYLOAD_ERROR;
         }
     }
     return result;
 }
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
+/*the same batch as makePayload, but every item is deflated into the payload as soon as it is written*/
+/*the batch is filled by its compressed size and the uncompressed batch never exists as a whole*/
+static MAKE_PAYLOAD_RESULT makeCompressedPayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload)
 {
-    STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-    IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
-    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+    MAKE_PAYLOAD_RESULT result;
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle;
 
-    switch (contentType)
+    if ((*payload = BUFFER_new()) == NULL)
     {
-    case IOTHUBMESSAGE_BYTEARRAY:
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+        LogError("unable to BUFFER_new");
+        result = MAKE_PAYLOAD_ERROR;
+    }
+    /*Codes_SRS_TRANSPORTMULTITHTTP_07_014: [ When "CompressBatches" is true, IoTHubTransportHttp_DoWork shall deflate the batch into the payload by calling iothubtransporthttp_compress_create. ]*/
+    else if ((compressHandle = iothubtransporthttp_compress_create(*payload)) == NULL)
     {
-        result = STRING_construct("{\"body\":\"");
-        if (result == NULL)
-        {
-            LogError("unable to STRING_construct");
-        }
-        else
+        LogError("unable to iothubtransporthttp_compress_create");
+        BUFFER_delete(*payload);
+        *payload = NULL;
+        result = MAKE_PAYLOAD_ERROR;
+    }
+    else
+    {
+        unsigned char* item = NULL; /*the '[' or ',' and the JSON item that is compressed next*/
+        size_t itemCapacity = 0;
+        size_t itemCount = 0;
+        bool keepGoing = true;
+
+        result = MAKE_PAYLOAD_OK;
+        while (keepGoing && (deviceData->waitingToSend->Flink != deviceData->waitingToSend))
         {
-            const unsigned char* source;
-            size_t size;
+            PDLIST_ENTRY head = deviceData->waitingToSend->Flink;
+            IOTHUB_MESSAGE_LIST* message = containingRecord(head, IOTHUB_MESSAGE_LIST, entry);
+            IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+            bool fits;
+            size_t written;
 
-            if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
+            if (iothubtransporthttp_batch_get_item_size(message->messageHandle, &itemSize) != 0)
             {
-                LogError("unable to get the data for the message.");
-                STRING_delete(result);
-                result = NULL;
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+                LogError("unable to iothubtransporthttp_batch_get_item_size");
+                result = (itemCount == 0) ? MAKE_PAYLOAD_ERROR : MAKE_PAYLOAD_OK;
+                keepGoing = false;
             }
-            else
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_015: [ When "CompressBatches" is true, the message size shall be the size of the compressed payload and an item shall be added only if iothubtransporthttp_compress_fits guarantees it within the message size limit. ]*/
+            else if (iothubtransporthttp_compress_fits(compressHandle, itemSize.itemSize + 2, MAXIMUM_MESSAGE_SIZE, &fits) != 0) /*the item, the '[' or ',' before it and the ']' that might follow it*/
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_016: [ If compressing fails, IoTHubTransportHttp_DoWork shall put the items back in waitingToSend and advance to the next activity. ]*/
+                LogError("unable to iothubtransporthttp_compress_fits");
+                result = MAKE_PAYLOAD_ERROR;
+                keepGoing = false;
+            }
+            else if (!fits)
             {
-                STRING_HANDLE encoded = Base64_Encode_Bytes(source, size);
-                if (encoded == NULL)
+                if (itemCount == 0)
                 {
-                    LogError("unable to Base64_Encode_Bytes.");
-                    STRING_delete(result);
-                    result = NULL;
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+                    (void)DList_RemoveHeadList(deviceData->waitingToSend);
+                    DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                    result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
                 }
-                else
+                /*else this item doesn't make it to the payload, but the payload is valid so far*/
+                keepGoing = false;
+            }
+            else
+            {
+                if (itemCapacity < itemSize.itemSize + 1)
                 {
-                    size_t propertiesSize;
-                    if (!(
-                        (STRING_concat_with_STRING(result, encoded) == 0) &&
-                        (STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
+                    unsigned char* newItem = (unsigned char*)realloc(item, itemSize.itemSize + 1);
+                    if (newItem == NULL)
                     {
-                        STRING_delete(result);
-                        result = NULL;
-                        LogError("unable to STRING_concat_with_STRING.");
+                        LogError("unable to realloc");
+                        keepGoing = false;
                     }
                     else
                     {
-                        /*all is fine... */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
+                        item = newItem;
+                        itemCapacity = itemSize.itemSize + 1;
                     }
-                    STRING_delete(encoded);
                 }
-            }
-        }
-        break;
-    }
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
-    case IOTHUBMESSAGE_STRING:
-    {
-        result = STRING_construct("{\"body\":");
-        if (result == NULL)
-        {
-            LogError("unable to STRING_construct");
-        }
-        else
-        {
-            const char* source = IoTHubMessage_GetString(message->messageHandle);
-            if (source == NULL)
-            {
-                LogError("unable to IoTHubMessage_GetString");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                STRING_HANDLE asJson = STRING_new_JSON(source);
-                if (asJson == NULL)
+
+                if (!keepGoing)
+                {
+                    result = (itemCount == 0) ? MAKE_PAYLOAD_ERROR : MAKE_PAYLOAD_OK;
+                }
+                else if (iothubtransporthttp_batch_write_item(message->messageHandle, item + 1, itemCapacity - 1, &written) != 0)
                 {
-                    LogError("unable to STRING_new_JSON");
-                    STRING_delete(result);
-                    result = NULL;
+                    LogError("unable to iothubtransporthttp_batch_write_item");
+                    result = (itemCount == 0) ? MAKE_PAYLOAD_ERROR : MAKE_PAYLOAD_OK;
+                    keepGoing = false;
                 }
                 else
                 {
-                    size_t propertiesSize;
-                    if (!(
-                        (STRING_concat_with_STRING(result, asJson) == 0) &&
-                        (STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
+                    item[0] = (itemCount == 0) ? '[' : ',';
+                    if (iothubtransporthttp_compress_append(compressHandle, item, written + 1) != 0)
                     {
-                        LogError("unable to STRING_concat_with_STRING");
-                        STRING_delete(result);
-                        result = NULL;
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_07_016: [ If compressing fails, IoTHubTransportHttp_DoWork shall put the items back in waitingToSend and advance to the next activity. ]*/
+                        LogError("unable to iothubtransporthttp_compress_append");
+                        result = MAKE_PAYLOAD_ERROR;
+                        keepGoing = false;
                     }
                     else
                     {
-                        /*result has the intended content*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
+                        itemCount++;
+                        (void)DList_RemoveHeadList(deviceData->waitingToSend);
+                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
                     }
-                    STRING_delete(asJson);
                 }
             }
         }
-        break;
+
+        if (result != MAKE_PAYLOAD_OK)
+        {
+            /*nothing to send*/
+        }
+        else if (itemCount == 0)
+        {
+            result = MAKE_PAYLOAD_NO_ITEMS;
+        }
+        else if (iothubtransporthttp_compress_finish(compressHandle, (const unsigned char*)"]", 1) != 0)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_016: [ If compressing fails, IoTHubTransportHttp_DoWork shall put the items back in waitingToSend and advance to the next activity. ]*/
+            LogError("unable to iothubtransporthttp_compress_finish");
+            result = MAKE_PAYLOAD_ERROR;
+        }
+
+        if ((result == MAKE_PAYLOAD_ERROR) && (itemCount > 0))
+        {
+            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+        }
+
+        if (result != MAKE_PAYLOAD_OK)
+        {
+            BUFFER_delete(*payload);
+            *payload = NULL;
+        }
+
+        free(item);
+        iothubtransporthttp_compress_destroy(compressHandle);
     }
-    default:
+
+    return result;
+}
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_07_017: [ When "CompressBatches" is true, the batch shall be sent with a clone of the event HTTP request headers that has the header "Content-Encoding" set to "deflate". ]*/
+static HTTP_HEADERS_HANDLE createCompressedBatchHeaders(HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    HTTP_HEADERS_HANDLE result = HTTPHeaders_Clone(deviceData->eventHTTPrequestHeaders);
+    if (result == NULL)
     {
-        LogError("an unknown message type was encountered (%d)", contentType);
-        result = NULL; /*unknown message type*/
-        break;
+        LogError("unable to HTTPHeaders_Clone");
     }
+    else if (HTTPHeaders_ReplaceHeaderNameValuePair(result, CONTENT_ENCODING, DEFLATE) != HTTP_HEADERS_OK)
+    {
+        LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
+        HTTPHeaders_Free(result);
+        result = NULL;
     }
     return result;
 }
 
-#define MAKE_PAYLOAD_RESULT_VALUES \
-    MAKE_PAYLOAD_OK, /*returned when there is a payload to be later send by HTTP*/ \
-    MAKE_PAYLOAD_NO_ITEMS, /*returned when there are no items to be send*/ \
-    MAKE_PAYLOAD_ERROR, /*returned when there were errors*/ \
-    MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT /*returned when the first item doesn't fit*/
-
-DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
-
-/*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
-/*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+/*sets the "Authorization" header, skipping the headers of the device that already carry the token*/
+static bool authorizeRequestHeaders(HTTP_HEADERS_HANDLE requestHttpHeadersHandle, const char* sasToken, bool* isAuthorized)
 {
-    MAKE_PAYLOAD_RESULT result;
-    size_t allMessagesSize = 0;
-    *payload = STRING_construct("[");
-    if (*payload == NULL)
+    bool result;
+    if ((isAuthorized != NULL) && *isAuthorized)
     {
-        LogError("unable to STRING_construct");
-        result = MAKE_PAYLOAD_ERROR;
+        result = true;
+    }
+    else if (HTTPHeaders_ReplaceHeaderNameValuePair(requestHttpHeadersHandle, "Authorization", sasToken) != HTTP_HEADERS_OK)
+    {
+        LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
+        result = false;
     }
     else
     {
-        bool isFirst = true;
-        PDLIST_ENTRY actual;
-        bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
-                               /*either all the items enter the list or only some*/
-        result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
-        while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+        if (isAuthorized != NULL)
         {
-            size_t messageSize;
-            STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
-            if (isFirst)
-            {
-                isFirst = false;
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                if (temp == NULL) /*first item failed to create, nothing to send*/
-                {
-                    result = MAKE_PAYLOAD_ERROR;
-                    STRING_delete(*payload);
-                    *payload = NULL;
-                    keepGoing = false;
-                }
-                else
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-                    if (messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-                        STRING_delete(*payload);
-                        *payload = NULL;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        if (STRING_concat_with_STRING(*payload, temp) != 0)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            result = MAKE_PAYLOAD_ERROR;
-                            STRING_delete(*payload);
-                            *payload = NULL;
-                            keepGoing = false;
-                        }
-                        else
-                        {
-                            /*first item was put nicely in the payload*/
-                            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                            DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                            allMessagesSize += messageSize;
-                        }
-                    }
-                    STRING_delete(temp);
-                }
-            }
-            else
-            {
-                /*there is at least 1 item already in the payload*/
-                if (temp == NULL)
-                {
-                    /*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                    result = MAKE_PAYLOAD_OK;
-                    keepGoing = false;
-                }
-                else
-                {
-                    if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        /*this item doesn't make it to the payload, but the payload is valid so far*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else if (STRING_concat_with_STRING(*payload, temp) != 0)
-                    {
-                        /*should still send what there is so far...*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        /*cool, the payload made it there, let's continue... */
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        allMessagesSize += messageSize;
-                    }
-                    STRING_delete(temp);
-                }
-            }
+            *isAuthorized = true;
         }
+        result = true;
+    }
+    return result;
+}
 
-        /*closing the payload*/
-        if (result == MAKE_PAYLOAD_OK)
+/*Codes_SRS_TRANSPORTMULTITHTTP_07_045: [ The first token of a device shall be scoped to hostName + "/devices/" + URL_ENCODED(deviceId). ]*/
+static bool create_sasTokenScope(HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    bool result;
+    STRING_HANDLE urlEncodedDeviceId = URL_EncodeString(STRING_c_str(deviceData->deviceId));
+    if (urlEncodedDeviceId == NULL)
+    {
+        LogError("unable to URL_EncodeString");
+        result = false;
+    }
+    else
+    {
+        if ((deviceData->sasTokenScope = STRING_clone(deviceData->transportHandle->hostName)) == NULL)
         {
-            ((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
+            LogError("unable to STRING_clone");
+            result = false;
+        }
+        else if ((STRING_concat(deviceData->sasTokenScope, "/devices/") != 0) ||
+            (STRING_concat_with_STRING(deviceData->sasTokenScope, urlEncodedDeviceId) != 0))
+        {
+            LogError("unable to build the SAS token scope");
+            STRING_delete(deviceData->sasTokenScope);
+            deviceData->sasTokenScope = NULL;
+            result = false;
         }
         else
         {
-            /*no need to close anything*/
+            result = true;
         }
+        STRING_delete(urlEncodedDeviceId);
     }
     return result;
 }
 
-static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
-{
-    /*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
-    DList_AppendTailList(destination->Flink, source);
-    DList_RemoveEntryList(source);
-    DList_InitializeListHead(source);
-}
-
-static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static STRING_HANDLE create_sasToken(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, time_t now)
 {
-
-    if (DList_IsListEmpty(deviceData->waitingToSend))
+    STRING_HANDLE result;
+    STRING_HANDLE emptyKeyName;
+    if (now == (time_t)(-1))
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_060: [If the list is empty then IoTHubTransportHttp_DoWork shall proceed to the following action.] */
+        LogError("unable to get_time");
+        result = NULL;
+    }
+    else if ((deviceData->sasTokenScope == NULL) && !create_sasTokenScope(deviceData))
+    {
+        result = NULL;
+    }
+    else if ((emptyKeyName = STRING_new()) == NULL)
+    {
+        LogError("unable to STRING_new");
+        result = NULL;
     }
     else
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_053: [If option SetBatching is true then _Dowork shall send batched event message as specced below.] */
-        if (handleData->doBatchedTransfers)
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_046: [ A device shall sign a new token by calling SASToken_Create with its device key, the scope, an empty key name and an expiry "sas_token_lifetime" seconds from now when it has no token, when the refresh time has passed since it signed it, when "sas_token_lifetime" changed or when the clock went back. ]*/
+        size_t expiry = (size_t)get_difftime(now, (time_t)0) + deviceData->transportHandle->sasTokenLifetime;
+        if ((result = SASToken_Create(deviceData->deviceKey, deviceData->sasTokenScope, emptyKeyName, expiry)) == NULL)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_054: [Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair.] */
+            LogError("unable to SASToken_Create");
+        }
+        STRING_delete(emptyKeyName);
+    }
+    return result;
+}
+
+/*returns the token of a device, signing a new one only when the cached one is due for renewal*/
+static const char* get_cachedSasToken(HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    const char* result;
+    HTTPTRANSPORT_HANDLE_DATA* handleData = deviceData->transportHandle;
+    size_t refreshTime = ((handleData->sasTokenRefreshTime == 0) || (handleData->sasTokenRefreshTime >= handleData->sasTokenLifetime)) ?
+        handleData->sasTokenLifetime / 2 :
+        handleData->sasTokenRefreshTime;
+    time_t now = get_time(NULL);
+    double age = ((deviceData->cachedSasToken == NULL) || (now == (time_t)(-1))) ? -1 : get_difftime(now, deviceData->cachedSasTokenTime);
+
+    if ((age >= 0) && (age < refreshTime) && (deviceData->cachedSasTokenLifetime == handleData->sasTokenLifetime))
+    {
+        result = STRING_c_str(deviceData->cachedSasToken);
+    }
+    else
+    {
+        STRING_HANDLE sasToken = create_sasToken(deviceData, now);
+        if (sasToken != NULL)
+        {
+            if (deviceData->cachedSasToken != NULL)
+            {
+                STRING_delete(deviceData->cachedSasToken);
+            }
+            deviceData->cachedSasToken = sasToken;
+            deviceData->cachedSasTokenTime = now;
+            deviceData->cachedSasTokenLifetime = handleData->sasTokenLifetime;
+            deviceData->isEventHeaderAuthorized = false;
+            deviceData->isMessageHeaderAuthorized = false;
+            result = STRING_c_str(sasToken);
+        }
+        else if ((age >= 0) && (age < deviceData->cachedSasTokenLifetime))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_047: [ If signing a new token fails, the device shall keep using its previous token until it expires. ]*/
+            LogError("unable to renew the SAS token, the previous one is used until it expires");
+            result = STRING_c_str(deviceData->cachedSasToken);
+        }
+        else
+        {
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+/*executes a request of a device with a device key, it takes the arguments of HTTPAPIEX_SAS_ExecuteRequest but the SAS object*/
+static HTTPAPIEX_RESULT executeKeyDeviceRequest(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPIEX_HANDLE httpApiExHandle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath,
+    HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    HTTPAPIEX_RESULT result;
+    if ((deviceData->transportHandle->sasTokenLifetime == 0) || (deviceData->deviceKey == NULL))
+    {
+        /*HTTPAPIEX_SAS replaces the token in the headers of the device*/
+        deviceData->isEventHeaderAuthorized = false;
+        deviceData->isMessageHeaderAuthorized = false;
+        result = HTTPAPIEX_SAS_ExecuteRequest(deviceData->sasObject, httpApiExHandle, requestType, relativePath, requestHttpHeadersHandle, requestContent, statusCode, responseHttpHeadersHandle, responseContent);
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_048: [ The event and message HTTP request headers of the device shall get the "Authorization" header by calling HTTPHeaders_ReplaceHeaderNameValuePair only when they do not carry the current token, any other request headers shall get it for every request. ]*/
+        bool* isAuthorized =
+            (requestHttpHeadersHandle == deviceData->eventHTTPrequestHeaders) ? &(deviceData->isEventHeaderAuthorized) :
+            (requestHttpHeadersHandle == deviceData->messageHTTPrequestHeaders) ? &(deviceData->isMessageHeaderAuthorized) :
+            NULL;
+        const char* sasToken = get_cachedSasToken(deviceData);
+        if ((sasToken == NULL) || !authorizeRequestHeaders(requestHttpHeadersHandle, sasToken, isAuthorized))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_049: [ If the token or the "Authorization" header cannot be produced, the request shall fail as if HTTPAPIEX_SAS_ExecuteRequest had failed. ]*/
+            result = HTTPAPIEX_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_044: [ When "sas_token_lifetime" is set, the requests of a device with a device key shall be made by HTTPAPIEX_ExecuteRequest with the token cached by the device instead of HTTPAPIEX_SAS_ExecuteRequest. ]*/
+            result = HTTPAPIEX_ExecuteRequest(httpApiExHandle, requestType, relativePath, requestHttpHeadersHandle, requestContent, statusCode, responseHttpHeadersHandle, responseContent);
+        }
+    }
+    return result;
+}
+
+static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+
+    if (DList_IsListEmpty(deviceData->waitingToSend))
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_060: [If the list is empty then IoTHubTransportHttp_DoWork shall proceed to the following action.] */
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_053: [If option SetBatching is true then _Dowork shall send batched event message as specced below.] */
+        if (handleData->doBatchedTransfers)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_054: [Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair.] */
             if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->eventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_VND_MICROSOFT_IOTHUB_JSON) != HTTP_HEADERS_OK)
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_055: [If updating Content-Type fails for any reason, then _DoWork shall advance to the next action.] */
@@ -1325,67 +1544,56 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
             else
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                STRING_HANDLE payload;
-                switch (makePayload(deviceData, &payload))
+                BUFFER_HANDLE payload;
+                switch (handleData->doCompressedBatches ? makeCompressedPayload(deviceData, &payload) : makePayload(deviceData, &payload))
                 {
                 case MAKE_PAYLOAD_OK:
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-                    BUFFER_HANDLE temp = BUFFER_new();
-                    if (temp == NULL)
+                    unsigned int statusCode;
+                    HTTP_HEADERS_HANDLE requestHeaders = handleData->doCompressedBatches ? createCompressedBatchHeaders(deviceData) : deviceData->eventHTTPrequestHeaders;
+                    if (requestHeaders == NULL)
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_07_016: [ If compressing fails, IoTHubTransportHttp_DoWork shall put the items back in waitingToSend and advance to the next activity. ]*/
+                        reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                    }
+                    else if (executeKeyDeviceRequest(
+                        deviceData,
+                        httpApiExHandle,
+                        HTTPAPI_REQUEST_POST,
+                        STRING_c_str(deviceData->eventHTTPrelativePath),
+                        requestHeaders,
+                        payload,
+                        &statusCode,
+                        NULL,
+                        NULL
+                        ) != HTTPAPIEX_OK)
                     {
-                        LogError("unable to BUFFER_new");
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                        LogError("unable to HTTPAPIEX_ExecuteRequest");
+                        //items go back to waitingToSend
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                         reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                     }
                     else
                     {
-                        if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+                        if (statusCode < 300)
                         {
-                            LogError("unable to BUFFER_build");
-                            //items go back to waitingToSend
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
+                            IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
                         }
                         else
                         {
-                            unsigned int statusCode;
-                            if (HTTPAPIEX_SAS_ExecuteRequest(
-                                deviceData->sasObject,
-                                handleData->httpApiExHandle,
-                                HTTPAPI_REQUEST_POST,
-                                STRING_c_str(deviceData->eventHTTPrelativePath),
-                                deviceData->eventHTTPrequestHeaders,
-                                temp,
-                                &statusCode,
-                                NULL,
-                                NULL
-                                ) != HTTPAPIEX_OK)
-                            {
-                                LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                //items go back to waitingToSend
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                            }
-                            else
-                            {
-                                if (statusCode < 300)
-                                {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
-                                    IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
-                                }
-                                else
-                                {
-                                    //items go back to waitingToSend
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                    LogError("unexpected HTTP status code (%u)", statusCode);
-                                    reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                                }
-                            }
+                            //items go back to waitingToSend
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+                            LogError("unexpected HTTP status code (%u)", statusCode);
+                            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                         }
-                        BUFFER_delete(temp);
                     }
-                    STRING_delete(payload);
+                    if ((requestHeaders != NULL) && (requestHeaders != deviceData->eventHTTPrequestHeaders))
+                    {
+                        HTTPHeaders_Free(requestHeaders);
+                    }
+                    BUFFER_delete(payload);
                     break;
                 }
                 case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
@@ -1580,7 +1788,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
                                                 else if ((r = HTTPAPIEX_ExecuteRequest(
-                                                    handleData->httpApiExHandle,
+                                                    httpApiExHandle,
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1596,9 +1804,9 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                             else
                                             {
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
-                                                if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                                                    deviceData->sasObject,
-                                                    handleData->httpApiExHandle,
+                                                if ((r = executeKeyDeviceRequest(
+                                                    deviceData,
+                                                    httpApiExHandle,
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1646,7 +1854,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
     ACCEPT
 DEFINE_ENUM(ACTION, ACTION_VALUES);
 
-static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
+static void abandonOrAcceptMessage(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_097: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
     -requestType: POST
@@ -1746,7 +1954,7 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                                 LogError("Unable to replace the old SAS Token.");
                             }
                             else if ((r = HTTPAPIEX_ExecuteRequest(
-                                handleData->httpApiExHandle,
+                                httpApiExHandle,
                                 (action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                                 STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
                                 abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1762,9 +1970,9 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                                 LogError("Unable to HTTPAPIEX_ExecuteRequest.");
                             }
                         }
-                        else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                            deviceData->sasObject,
-                            handleData->httpApiExHandle,
+                        else if ((r = executeKeyDeviceRequest(
+                            deviceData,
+                            httpApiExHandle,
                             (action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                             STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
                             abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1806,242 +2014,371 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
     }
 }
 
-static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static bool isDoWorkBudgetSpent(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
-    if (deviceData->DoWork_PullMessage)
+    bool result;
+    uint64_t now;
+    if ((handleData->doWorkTickCounter == NULL) || !handleData->hasDoWorkStartTime)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
-        time_t timeNow = get_time(NULL);
-        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
-        if (isPollingAllowed)
+        result = false;
+    }
+    else if (tickcounter_get_current_ms(handleData->doWorkTickCounter, &now) != 0)
+    {
+        /*the device is better served late than never*/
+        LogError("unable to tickcounter_get_current_ms");
+        result = false;
+    }
+    else
+    {
+        result = (now - handleData->doWorkStartTime >= handleData->doWorkTimeBudget);
+    }
+    return result;
+}
+
+/*a message whose accept, reject or abandon is deferred to the end of the poll cycle*/
+typedef struct PENDING_COMPLETION_TAG
+{
+    STRING_HANDLE ETag;
+    ACTION action;
+}PENDING_COMPLETION;
+
+static void completeMessage(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action, VECTOR_HANDLE pendingCompletions)
+{
+    if (pendingCompletions == NULL)
+    {
+        abandonOrAcceptMessage(httpApiExHandle, deviceData, ETag, action);
+    }
+    else
+    {
+        PENDING_COMPLETION pendingCompletion;
+        if ((pendingCompletion.ETag = STRING_construct(ETag)) == NULL)
         {
-            HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
-            if (responseHTTPHeaders == NULL)
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_033: [ If a completion cannot be deferred, the message shall be accepted, rejected or abandoned right away. ]*/
+            LogError("unable to STRING_construct, completing the message now");
+            abandonOrAcceptMessage(httpApiExHandle, deviceData, ETag, action);
+        }
+        else
+        {
+            pendingCompletion.action = action;
+            if (VECTOR_push_back(pendingCompletions, &pendingCompletion, 1) != 0)
             {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                LogError("unable to HTTPHeaders_Alloc");
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_033: [ If a completion cannot be deferred, the message shall be accepted, rejected or abandoned right away. ]*/
+                LogError("unable to VECTOR_push_back, completing the message now");
+                STRING_delete(pendingCompletion.ETag);
+                abandonOrAcceptMessage(httpApiExHandle, deviceData, ETag, action);
             }
-            else
+        }
+    }
+}
+
+static void completePendingMessages(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, VECTOR_HANDLE pendingCompletions)
+{
+    size_t pendingCount = VECTOR_size(pendingCompletions);
+    for (size_t i = 0; i < pendingCount; i++)
+    {
+        PENDING_COMPLETION* pendingCompletion = (PENDING_COMPLETION*)VECTOR_element(pendingCompletions, i);
+        abandonOrAcceptMessage(httpApiExHandle, deviceData, STRING_c_str(pendingCompletion->ETag), pendingCompletion->action);
+        STRING_delete(pendingCompletion->ETag);
+    }
+}
+
+#define POLL_MESSAGE_RESULT_VALUES \
+    POLL_MESSAGE_NOT_SENT, /*returned when the prerequisites of the GET request could not be built*/ \
+    POLL_MESSAGE_FAILED, /*returned when the GET request failed*/ \
+    POLL_MESSAGE_EMPTY, /*returned when the service answered with a status code other than 200*/ \
+    POLL_MESSAGE_RECEIVED /*returned when the service answered with a message (status code 200)*/
+
+DEFINE_ENUM(POLL_MESSAGE_RESULT, POLL_MESSAGE_RESULT_VALUES);
+
+static POLL_MESSAGE_RESULT pollMessage(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, time_t timeNow, VECTOR_HANDLE pendingCompletions)
+{
+    POLL_MESSAGE_RESULT result = POLL_MESSAGE_NOT_SENT;
+    HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
+    if (responseHTTPHeaders == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+        LogError("unable to HTTPHeaders_Alloc");
+    }
+    else
+    {
+        BUFFER_HANDLE responseContent = BUFFER_new();
+        if (responseContent == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+            LogError("unable to BUFFER_new");
+        }
+        else
+        {
+            unsigned int statusCode = 0;
+            HTTPAPIEX_RESULT r;
+            if (deviceData->deviceSasToken != NULL)
             {
-                BUFFER_HANDLE responseContent = BUFFER_new();
-                if (responseContent == NULL)
+                /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_050: [ The deviceSasToken cannot change, so the message HTTP request headers shall get it only for the first GET request of the device. ]*/
+                if (!authorizeRequestHeaders(deviceData->messageHTTPrequestHeaders, STRING_c_str(deviceData->deviceSasToken), &(deviceData->isMessageHeaderAuthorized)))
+                {
+                    r = HTTPAPIEX_ERROR;
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+                    LogError("Unable to replace the old SAS Token.");
+                }
+                else if ((r = HTTPAPIEX_ExecuteRequest(
+                    httpApiExHandle,
+                    HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
+                    STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
+                    deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
+                    NULL,                                                           /*requestContent: NULL*/
+                    &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
+                    responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
+                    responseContent                                                 /*responseContent: a new instance of buffer*/
+                    )) != HTTPAPIEX_OK)
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                    LogError("unable to BUFFER_new");
+                    LogError("Unable to HTTPAPIEX_ExecuteRequest.");
+                }
+            }
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
+            requestType: GET
+            relativePath: the message HTTP relative path
+            requestHttpHeadersHandle: message HTTP request headers created by _Create
+            requestContent: NULL
+            statusCode: a pointer to unsigned int which shall be later examined
+            responseHeadearsHandle: a new instance of HTTP headers
+            responseContent: a new instance of buffer]
+            */
+            else if ((r = executeKeyDeviceRequest(
+                deviceData,
+                httpApiExHandle,
+                HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
+                STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
+                deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
+                NULL,                                                           /*requestContent: NULL*/
+                &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
+                responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
+                responseContent                                                 /*responseContent: a new instance of buffer*/
+                )) != HTTPAPIEX_OK)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+                LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+            }
+
+            result = (r != HTTPAPIEX_OK) ? POLL_MESSAGE_FAILED : ((statusCode == 200) ? POLL_MESSAGE_RECEIVED : POLL_MESSAGE_EMPTY);
+
+            if (r == HTTPAPIEX_OK)
+            {
+                /*HTTP dialogue was succesfull*/
+                if (timeNow == (time_t)(-1))
+                {
+                    deviceData->isFirstPoll = true;
                 }
                 else
                 {
-                    unsigned int statusCode = 0;
-                    HTTPAPIEX_RESULT r;
-                    if (deviceData->deviceSasToken != NULL)
-                    {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                        if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                        {
-                            r = HTTPAPIEX_ERROR;
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                            LogError("Unable to replace the old SAS Token.");
-                        }
-                        else if ((r = HTTPAPIEX_ExecuteRequest(
-                            handleData->httpApiExHandle,
-                            HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-                            STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-                            deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-                            NULL,                                                           /*requestContent: NULL*/
-                            &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-                            responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-                            responseContent                                                 /*responseContent: a new instance of buffer*/
-                            )) != HTTPAPIEX_OK)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                            LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                        }
-                    }
+                    deviceData->isFirstPoll = false;
+                    deviceData->lastPollTime = timeNow;
+                }
+                if (statusCode == 204)
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+                    /*this is an expected status code, means "no commands", but logging that creates panic*/
 
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
-                    requestType: GET
-                    relativePath: the message HTTP relative path
-                    requestHttpHeadersHandle: message HTTP request headers created by _Create
-                    requestContent: NULL
-                    statusCode: a pointer to unsigned int which shall be later examined
-                    responseHeadearsHandle: a new instance of HTTP headers
-                    responseContent: a new instance of buffer]
-                    */
-                    else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                        deviceData->sasObject,
-                        handleData->httpApiExHandle,
-                        HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-                        STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-                        deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-                        NULL,                                                           /*requestContent: NULL*/
-                        &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-                        responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-                        responseContent                                                 /*responseContent: a new instance of buffer*/
-                        )) != HTTPAPIEX_OK)
+                    /*do nothing, advance to next action*/
+                }
+                else if (statusCode != 200)
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+                    LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+                }
+                else
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
+                    const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
+                    if (etagValue == NULL)
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                        LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+                        LogError("unable to find a received header called \"E-Tag\"");
                     }
-                    if (r == HTTPAPIEX_OK)
+                    else
                     {
-                        /*HTTP dialogue was succesfull*/
-                        if (timeNow == (time_t)(-1))
-                        {
-                            deviceData->isFirstPoll = true;
-                        }
-                        else
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
+                        size_t etagsize = strlen(etagValue);
+                        if (
+                            (etagsize < 2) ||
+                            (etagValue[0] != '"') ||
+                            (etagValue[etagsize - 1] != '"')
+                            )
                         {
-                            deviceData->isFirstPoll = false;
-                            deviceData->lastPollTime = timeNow;
-                        }
-                        if (statusCode == 204)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-                            /*this is an expected status code, means "no commands", but logging that creates panic*/
-
-                            /*do nothing, advance to next action*/
-                        }
-                        else if (statusCode != 200)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-                            LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+                            LogError("ETag is not a valid quoted string");
                         }
                         else
                         {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
-                            const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
-                            if (etagValue == NULL)
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
+                            IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(BUFFER_u_char(responseContent), BUFFER_length(responseContent));
+                            if (receivedMessage == NULL)
                             {
-                                LogError("unable to find a received header called \"E-Tag\"");
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
+                                LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
+                                completeMessage(httpApiExHandle, deviceData, etagValue, ABANDON, pendingCompletions);
                             }
                             else
                             {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
-                                size_t etagsize = strlen(etagValue);
-                                if (
-                                    (etagsize < 2) ||
-                                    (etagValue[0] != '"') ||
-                                    (etagValue[etagsize - 1] != '"')
-                                    )
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
+                                size_t nHeaders;
+                                if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
                                 {
-                                    LogError("ETag is not a valid quoted string");
+                                    LogError("unable to get the count of HTTP headers");
+                                    completeMessage(httpApiExHandle, deviceData, etagValue, ABANDON, pendingCompletions);
                                 }
                                 else
                                 {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
-                                    IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(BUFFER_u_char(responseContent), BUFFER_length(responseContent));
-                                    if (receivedMessage == NULL)
-                                    {
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
-                                        LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
-                                        abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
-                                    }
-                                    else
+                                    size_t i;
+                                    MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
+                                    for (i = 0; i < nHeaders; i++)
                                     {
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
-                                        size_t nHeaders;
-                                        if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
+                                        char* completeHeader;
+                                        if (HTTPHeaders_GetHeader(responseHTTPHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
                                         {
-                                            LogError("unable to get the count of HTTP headers");
-                                            abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+                                            break;
                                         }
                                         else
                                         {
-                                            size_t i;
-                                            MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
-                                            for (i = 0; i < nHeaders; i++)
+                                            if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
                                             {
-                                                char* completeHeader;
-                                                if (HTTPHeaders_GetHeader(responseHTTPHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
-                                                {
-                                                    break;
-                                                }
-                                                else
+                                                /*looks like a property headers*/
+                                                /*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
+                                                char* whereIsColon = strchr(completeHeader, ':');
+                                                if (whereIsColon != NULL)
                                                 {
-                                                    if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
-                                                    {
-                                                        /*looks like a property headers*/
-                                                        /*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
-                                                    {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
+                                                    *whereIsColon = '\0'; /*cut it down*/
+                                                    if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
                                                     {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
+                                                        free(completeHeader);
+                                                        break;
                                                     }
-                                                    free(completeHeader);
                                                 }
                                             }
-
-                                            if (i < nHeaders)
-                                            {
-                                                abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
-                                            }
-                                            else
+                                            else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
                                             {
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_093: [Otherwise, _DoWork shall call IoTHubClient_LL_MessageCallback with parameters handle = iotHubClientHandle and message = newly created message.]*/
-                                                IOTHUBMESSAGE_DISPOSITION_RESULT messageResult = IoTHubClient_LL_MessageCallback(iotHubClientHandle, receivedMessage);
-                                                if (messageResult == IOTHUBMESSAGE_ACCEPTED)
-                                                {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_094: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ACCEPTED then _DoWork shall "accept" the message.]*/
-                                                    abandonOrAcceptMessage(handleData, deviceData, etagValue, ACCEPT);
-                                                }
-                                                else if (messageResult == IOTHUBMESSAGE_REJECTED)
+                                                char* whereIsColon = strchr(completeHeader, ':');
+                                                if (whereIsColon != NULL)
                                                 {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_095: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message.]*/
-                                                    abandonOrAcceptMessage(handleData, deviceData, etagValue, REJECT);
+                                                    *whereIsColon = '\0'; /*cut it down*/
+                                                    if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
+                                                    {
+                                                        free(completeHeader);
+                                                        break;
+                                                    }
                                                 }
-                                                else
+                                            }
+                                            else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
+                                            {
+                                                char* whereIsColon = strchr(completeHeader, ':');
+                                                if (whereIsColon != NULL)
                                                 {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message.] */
-                                                    abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+                                                    *whereIsColon = '\0'; /*cut it down*/
+                                                    if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
+                                                    {
+                                                        free(completeHeader);
+                                                        break;
+                                                    }
                                                 }
                                             }
+                                            free(completeHeader);
                                         }
-                                        IoTHubMessage_Destroy(receivedMessage);
                                     }
-                                }
 
+                                    if (i < nHeaders)
+                                    {
+                                        completeMessage(httpApiExHandle, deviceData, etagValue, ABANDON, pendingCompletions);
+                                    }
+                                    else
+                                    {
+                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_093: [Otherwise, _DoWork shall call IoTHubClient_LL_MessageCallback with parameters handle = iotHubClientHandle and message = newly created message.]*/
+                                        IOTHUBMESSAGE_DISPOSITION_RESULT messageResult = IoTHubClient_LL_MessageCallback(iotHubClientHandle, receivedMessage);
+                                        if (messageResult == IOTHUBMESSAGE_ACCEPTED)
+                                        {
+                                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_094: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ACCEPTED then _DoWork shall "accept" the message.]*/
+                                            completeMessage(httpApiExHandle, deviceData, etagValue, ACCEPT, pendingCompletions);
+                                        }
+                                        else if (messageResult == IOTHUBMESSAGE_REJECTED)
+                                        {
+                                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_095: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message.]*/
+                                            completeMessage(httpApiExHandle, deviceData, etagValue, REJECT, pendingCompletions);
+                                        }
+                                        else
+                                        {
+                                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message.] */
+                                            completeMessage(httpApiExHandle, deviceData, etagValue, ABANDON, pendingCompletions);
+                                        }
+                                    }
+                                }
+                                IoTHubMessage_Destroy(receivedMessage);
                             }
                         }
+
                     }
-                    BUFFER_delete(responseContent);
                 }
-                HTTPHeaders_Free(responseHTTPHeaders);
+            }
+            BUFFER_delete(responseContent);
+        }
+        HTTPHeaders_Free(responseHTTPHeaders);
+    }
+
+    return result;
+}
+
+static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
+    if (deviceData->DoWork_PullMessage)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+        time_t timeNow = get_time(NULL);
+        bool isPollingAllowed;
+        if (handleData->pollScheduler != NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_020: [ When "AdaptivePollingTime" is set, the GET request shall be issued only if iothubtransporthttp_poll_is_due returns true. ]*/
+            isPollingAllowed = iothubtransporthttp_poll_is_due(handleData->pollScheduler, &deviceData->pollState, timeNow);
+        }
+        else
+        {
+            isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+        }
+        if (isPollingAllowed)
+        {
+            VECTOR_HANDLE pendingCompletions = NULL;
+            POLL_MESSAGE_RESULT pollResult;
+            bool hasReceivedMessage = false;
+            unsigned int polls = 0;
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_032: [ When "MaxMessagesPerPoll" is bigger than 1, the messages shall not be accepted, rejected or abandoned as they are received but after the last GET request of the cycle, in the order they were received. ]*/
+            if ((handleData->maxMessagesPerPoll > 1) &&
+                ((pendingCompletions = VECTOR_create(sizeof(PENDING_COMPLETION))) == NULL))
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_033: [ If a completion cannot be deferred, the message shall be accepted, rejected or abandoned right away. ]*/
+                LogError("unable to VECTOR_create, the messages are completed as they are received");
+            }
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_031: [ While the service answers a GET request with status code 200, IoTHubTransportHttp_DoWork shall issue another one, up to "MaxMessagesPerPoll" GET requests per device. ]*/
+            do
+            {
+                pollResult = pollMessage(httpApiExHandle, deviceData, iotHubClientHandle, timeNow, pendingCompletions);
+                hasReceivedMessage = hasReceivedMessage || (pollResult == POLL_MESSAGE_RECEIVED);
+                polls++;
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_040: [ When "DoWorkTimeBudget" is set, a device shall stop draining its messages once the budget of the DoWork is spent. ]*/
+            } while ((pollResult == POLL_MESSAGE_RECEIVED) && (polls < handleData->maxMessagesPerPoll) && !isDoWorkBudgetSpent(handleData));
+
+            if (pendingCompletions != NULL)
+            {
+                completePendingMessages(httpApiExHandle, deviceData, pendingCompletions);
+                VECTOR_destroy(pendingCompletions);
+            }
+
+            if ((handleData->pollScheduler != NULL) && ((pollResult != POLL_MESSAGE_NOT_SENT) || hasReceivedMessage))
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_021: [ When "AdaptivePollingTime" is set, after the GET requests IoTHubTransportHttp_DoWork shall schedule the next one by calling iothubtransporthttp_poll_on_polled, telling it a message was received when any status code was 200. A failed request counts as an empty poll. ]*/
+                iothubtransporthttp_poll_on_polled(handleData->pollScheduler, &deviceData->pollState, timeNow, hasReceivedMessage);
             }
         }
         else
@@ -2061,6 +2398,79 @@ static IOTHUB_PROCESS_ITEM_RESULT IoTHubTransportHttp_ProcessItem(TRANSPORT_LL_H
     return IOTHUB_PROCESS_ERROR;
 }
 
+/*serves the devices of one lane of the connection pool with the connection of that lane*/
+static void DoWorkLane(void* context, size_t lane)
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)context;
+    HTTPAPIEX_HANDLE httpApiExHandle = (lane == 0) ? handleData->httpApiExHandle : handleData->poolHttpApiExHandles[lane - 1];
+    IOTHUB_DEVICE_HANDLE* listItem;
+    size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
+    /*Codes_SRS_TRANSPORTMULTITHTTP_07_003: [ The device at position i in the transport device list shall be served by the lane i modulo the pool size, with the connection of that lane. ]*/
+    size_t laneDeviceCount = (deviceListSize > lane) ? ((deviceListSize - lane - 1) / handleData->connectionPoolSize + 1) : 0;
+    if (laneDeviceCount > 0)
+    {
+        bool hasBudget = (handleData->doWorkTickCounter != NULL);
+        bool isBudgetSpent = false;
+        size_t served = 0;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_035: [ Every DoWork, each lane shall start its round-robin one device further than in the previous DoWork, wrapping around its devices. ]*/
+        size_t firstDevice = handleData->doWorkRound % laneDeviceCount;
+        /*pass 0 serves the devices the budget of an earlier DoWork deferred, pass 1 the others*/
+        for (int pass = hasBudget ? 0 : 1; pass < 2; pass++)
+        {
+            for (size_t j = 0; j < laneDeviceCount; j++)
+            {
+                size_t i = lane + ((firstDevice + j) % laneDeviceCount) * handleData->connectionPoolSize;
+                listItem = (IOTHUB_DEVICE_HANDLE *) VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                bool isTurn;
+                if (!hasBudget)
+                {
+                    perDeviceItem->deferral = DEVICE_NOT_DEFERRED;
+                    isTurn = true;
+                }
+                else if (pass == 0)
+                {
+                    isTurn = (perDeviceItem->deferral == DEVICE_DEFERRED);
+                }
+                else if (perDeviceItem->deferral == DEVICE_CAUGHT_UP)
+                {
+                    /*it has had its turn in pass 0*/
+                    perDeviceItem->deferral = DEVICE_NOT_DEFERRED;
+                    isTurn = false;
+                }
+                else
+                {
+                    isTurn = (perDeviceItem->deferral == DEVICE_NOT_DEFERRED);
+                }
+
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_037: [ When "DoWorkTimeBudget" is set, once the budget is spent a lane shall defer its devices not yet served, but every lane shall serve at least 1 device. ]*/
+                if (!isTurn)
+                {
+                    /*the device is served in the other pass*/
+                }
+                else if (hasBudget && (served > 0) && (isBudgetSpent || (isBudgetSpent = isDoWorkBudgetSpent(handleData))))
+                {
+                    perDeviceItem->deferral = DEVICE_DEFERRED;
+                }
+                else
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_07_038: [ The devices deferred by the budget shall be served first by the next DoWork. ]*/
+                    if (perDeviceItem->deferral == DEVICE_DEFERRED)
+                    {
+                        perDeviceItem->deferral = DEVICE_CAUGHT_UP;
+                    }
+                    DoEvent(handleData, httpApiExHandle, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                    DoMessages(handleData, httpApiExHandle, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                    served++;
+                }
+            }
+        }
+    }
+}
+
 static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
@@ -2070,19 +2480,24 @@ static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
     if (handle != NULL)
     {
         HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
-        IOTHUB_DEVICE_HANDLE* listItem;
-        size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_036: [ When "DoWorkTimeBudget" is set, IoTHubTransportHttp_DoWork shall read its start time by calling tickcounter_get_current_ms. If that fails, the budget shall not apply to this DoWork. ]*/
+        handleData->hasDoWorkStartTime = (handleData->doWorkTickCounter != NULL) &&
+            (tickcounter_get_current_ms(handleData->doWorkTickCounter, &handleData->doWorkStartTime) == 0);
+        if (handleData->pool == NULL)
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *) VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-            DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-            DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-
+            DoWorkLane(handleData, 0);
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_004: [ If the connection pool has more than 1 connection, IoTHubTransportHttp_DoWork shall serve all the lanes at the same time by calling iothubtransporthttp_pool_run and return once every lane is done. ]*/
+        else if (iothubtransporthttp_pool_run(handleData->pool, DoWorkLane, handleData) != 0)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_005: [ If iothubtransporthttp_pool_run fails, IoTHubTransportHttp_DoWork shall serve the lanes one after the other. ]*/
+            LogError("unable to iothubtransporthttp_pool_run, the lanes are served one after the other");
+            for (size_t lane = 0; lane < handleData->connectionPoolSize; lane++)
+            {
+                DoWorkLane(handleData, lane);
+            }
+        }
+        handleData->doWorkRound++;
     }
     else
     {
@@ -2135,6 +2550,151 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HAND
     return result;
 }
 
+static IOTHUB_CLIENT_RESULT set_connectionPoolSize(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t connectionPoolSize)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if ((connectionPoolSize == 0) || (connectionPoolSize - 1 > SIZE_MAX / sizeof(HTTPAPIEX_HANDLE)))
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_006: [ If the value of OPTION_HTTP_CONNECTION_POOL_SIZE is 0, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid connection pool size %lu", (unsigned long)connectionPoolSize);
+    }
+    else if (connectionPoolSize == handleData->connectionPoolSize)
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if (handleData->wereOptionsPassedDown)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_007: [ If an option has already been passed down to HTTPAPIEX, changing the pool size shall fail and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("the connection pool size has to be set before the options that are passed down to HTTPAPIEX");
+    }
+    else
+    {
+        HTTPAPIEX_HANDLE* poolHttpApiExHandles = NULL;
+        IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = NULL;
+        size_t created = 0;
+
+        if (connectionPoolSize > 1)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_008: [ For a pool of more than 1 connection, IoTHubTransportHttp_SetOption shall create a HTTPAPIEX_HANDLE for every lane but lane 0 by calling HTTPAPIEX_Create and the threads of the lanes by calling iothubtransporthttp_pool_create. ]*/
+            if ((poolHttpApiExHandles = (HTTPAPIEX_HANDLE*)malloc((connectionPoolSize - 1) * sizeof(HTTPAPIEX_HANDLE))) == NULL)
+            {
+                LogError("unable to malloc");
+            }
+            else
+            {
+                while ((created < connectionPoolSize - 1) &&
+                    ((poolHttpApiExHandles[created] = HTTPAPIEX_Create(STRING_c_str(handleData->hostName))) != NULL))
+                {
+                    created++;
+                }
+
+                if (created < connectionPoolSize - 1)
+                {
+                    LogError("unable to HTTPAPIEX_Create");
+                }
+                else if ((pool = iothubtransporthttp_pool_create(connectionPoolSize)) == NULL)
+                {
+                    LogError("unable to iothubtransporthttp_pool_create");
+                }
+            }
+        }
+
+        if ((connectionPoolSize > 1) && (pool == NULL))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_009: [ If creating the pool fails, IoTHubTransportHttp_SetOption shall free what it created, keep the current pool and return IOTHUB_CLIENT_ERROR. ]*/
+            destroy_poolHttpApiExHandles(poolHttpApiExHandles, created);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_010: [ Otherwise IoTHubTransportHttp_SetOption shall destroy the current pool, keep the connection of lane 0 and return IOTHUB_CLIENT_OK. ]*/
+            destroy_connectionPool(handleData);
+            handleData->connectionPoolSize = connectionPoolSize;
+            handleData->poolHttpApiExHandles = poolHttpApiExHandles;
+            handleData->pool = pool;
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT set_doWorkTimeBudget(HTTPTRANSPORT_HANDLE_DATA* handleData, unsigned int doWorkTimeBudget)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (doWorkTimeBudget == 0)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_041: [ If the value is 0, IoTHubTransportHttp_SetOption shall destroy the tick counter, if any, and every DoWork shall serve every device. ]*/
+        destroy_doWorkTickCounter(handleData);
+        result = IOTHUB_CLIENT_OK;
+    }
+    /*Codes_SRS_TRANSPORTMULTITHTTP_07_042: [ Otherwise, if there is no tick counter yet, IoTHubTransportHttp_SetOption shall create one by calling tickcounter_create. ]*/
+    else if ((handleData->doWorkTickCounter == NULL) &&
+        ((handleData->doWorkTickCounter = tickcounter_create()) == NULL))
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_043: [ If tickcounter_create fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("unable to tickcounter_create");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        handleData->doWorkTimeBudget = doWorkTimeBudget;
+        result = IOTHUB_CLIENT_OK;
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT set_adaptivePollingTime(HTTPTRANSPORT_HANDLE_DATA* handleData, unsigned int adaptivePollingTime)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (adaptivePollingTime == 0)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_023: [ If the value is 0, IoTHubTransportHttp_SetOption shall destroy the poll scheduler, if any, and the devices shall be polled by "MinimumPollingTime" again. ]*/
+        destroy_pollScheduler(handleData);
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if (handleData->pollScheduler != NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_024: [ If there is a poll scheduler, IoTHubTransportHttp_SetOption shall change its times by calling iothubtransporthttp_poll_set_times. ]*/
+        if (iothubtransporthttp_poll_set_times(handleData->pollScheduler, adaptivePollingTime, handleData->getMinimumPollingTime) != 0)
+        {
+            LogError("unable to iothubtransporthttp_poll_set_times");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            handleData->adaptivePollingTime = adaptivePollingTime;
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_025: [ Otherwise IoTHubTransportHttp_SetOption shall create the poll scheduler by calling iothubtransporthttp_poll_create with the value as minimum time and "MinimumPollingTime" as maximum time, then pass it "MaxPollsPerSecond" by calling iothubtransporthttp_poll_set_rate_limit. ]*/
+        IOTHUBTRANSPORTHTTP_POLL_HANDLE pollScheduler = iothubtransporthttp_poll_create(adaptivePollingTime, handleData->getMinimumPollingTime);
+        if (pollScheduler == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_026: [ If creating the poll scheduler fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to iothubtransporthttp_poll_create");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else if (iothubtransporthttp_poll_set_rate_limit(pollScheduler, handleData->maxPollsPerSecond) != 0)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_026: [ If creating the poll scheduler fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to iothubtransporthttp_poll_set_rate_limit");
+            iothubtransporthttp_poll_destroy(pollScheduler);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            handleData->pollScheduler = pollScheduler;
+            handleData->adaptivePollingTime = adaptivePollingTime;
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    return result;
+}
+
 static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -2160,12 +2720,95 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             handleData->doBatchedTransfers = *(bool*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_012: ["CompressBatches"] */
+        else if (strcmp(OPTION_COMPRESS_BATCHES, option) == 0)
+        {
+            if (*(bool*)value && !iothubtransporthttp_compress_is_supported())
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_013: [ If the SDK is built without compression, setting "CompressBatches" to true shall fail and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("the SDK is built without use_http_compression");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                handleData->doCompressedBatches = *(bool*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_121: ["MinimumPollingTime"] */
         else if (strcmp(OPTION_MIN_POLLING_TIME, option) == 0)
         {
             handleData->getMinimumPollingTime = *(unsigned int*)value;
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_029: [ If there is a poll scheduler, "MinimumPollingTime" shall become its maximum time by calling iothubtransporthttp_poll_set_times. ]*/
+            if ((handleData->pollScheduler != NULL) &&
+                (iothubtransporthttp_poll_set_times(handleData->pollScheduler, handleData->adaptivePollingTime, handleData->getMinimumPollingTime) != 0))
+            {
+                LogError("unable to iothubtransporthttp_poll_set_times");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_022: ["AdaptivePollingTime"] */
+        else if (strcmp(OPTION_ADAPTIVE_POLLING_TIME, option) == 0)
+        {
+            result = set_adaptivePollingTime(handleData, *(unsigned int*)value);
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_027: ["MaxPollsPerSecond"] */
+        else if (strcmp(OPTION_MAX_POLLS_PER_SECOND, option) == 0)
+        {
+            handleData->maxPollsPerSecond = *(unsigned int*)value;
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_028: [ If there is a poll scheduler, IoTHubTransportHttp_SetOption shall pass the value to it by calling iothubtransporthttp_poll_set_rate_limit. ]*/
+            if ((handleData->pollScheduler != NULL) &&
+                (iothubtransporthttp_poll_set_rate_limit(handleData->pollScheduler, handleData->maxPollsPerSecond) != 0))
+            {
+                LogError("unable to iothubtransporthttp_poll_set_rate_limit");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_030: ["MaxMessagesPerPoll"] */
+        else if (strcmp(OPTION_MAX_MESSAGES_PER_POLL, option) == 0)
+        {
+            if (*(unsigned int*)value == 0)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_07_034: [ If "MaxMessagesPerPoll" is 0, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("invalid value 0 for MaxMessagesPerPoll");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->maxMessagesPerPoll = *(unsigned int*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_039: ["DoWorkTimeBudget"] */
+        else if (strcmp(OPTION_DOWORK_TIME_BUDGET, option) == 0)
+        {
+            result = set_doWorkTimeBudget(handleData, *(unsigned int*)value);
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_051: ["sas_token_lifetime"] */
+        else if (strcmp(OPTION_SAS_TOKEN_LIFETIME, option) == 0)
+        {
+            handleData->sasTokenLifetime = *(size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_052: ["sas_token_refresh_time"] */
+        else if (strcmp(OPTION_SAS_TOKEN_REFRESH_TIME, option) == 0)
+        {
+            handleData->sasTokenRefreshTime = *(size_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_07_002: ["HttpConnectionPoolSize"] */
+        else if (strcmp(OPTION_HTTP_CONNECTION_POOL_SIZE, option) == 0)
+        {
+            result = set_connectionPoolSize(handleData, *(size_t*)value);
+        }
         else
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2173,9 +2816,15 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_129: [ This option shall passed down to the lower layer by calling HTTPAPIEX_SetOption. ]*/
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_118: [Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code.] */
             HTTPAPIEX_RESULT HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->httpApiExHandle, option, value);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_07_011: [ The option shall be passed down to the connection of every lane of the pool, stopping at the first failure. ]*/
+            for (size_t i = 0; (HTTPAPIEX_result == HTTPAPIEX_OK) && (i < handleData->connectionPoolSize - 1); i++)
+            {
+                HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->poolHttpApiExHandles[i], option, value);
+            }
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
             if (HTTPAPIEX_result == HTTPAPIEX_OK)
             {
+                handleData->wereOptionsPassedDown = true;
                 result = IOTHUB_CLIENT_OK;
             }
             else if (HTTPAPIEX_result == HTTPAPIEX_INVALID_ARG)
@@ -0,0 +1,327 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <string.h>
+#include "iothubtransporthttp_batch.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#define IOTHUB_APP_PREFIX "iothub-app-"
+
+#define ITEM_BYTEARRAY_BEGIN "{\"body\":\""
+#define ITEM_BYTEARRAY_END "\""
+#define ITEM_STRING_BEGIN "{\"body\":"
+#define ITEM_STRING_END ",\"base64Encoded\":false"
+#define ITEM_PROPERTIES_BEGIN ",\"properties\":{"
+#define ITEM_PROPERTY_NAME_BEGIN "\"" IOTHUB_APP_PREFIX
+#define ITEM_PROPERTY_SEPARATOR "\":\""
+#define ITEM_PROPERTY_VALUE_END "\""
+#define ITEM_PROPERTIES_END "}"
+#define ITEM_END "}"
+
+#define LITERAL_LENGTH(literal) (sizeof(literal) - 1)
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char hexDigits[] = "0123456789ABCDEF";
+
+typedef struct BATCH_ITEM_DATA_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    const unsigned char* content;
+    size_t contentSize;
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+} BATCH_ITEM_DATA;
+
+/*returns the size of the JSON string that holds source, quotes included, or 0 if source cannot be a JSON string*/
+/*the escaping is the same as STRING_new_JSON's*/
+static size_t get_json_string_size(const unsigned char* source, size_t size)
+{
+    size_t result = 2; /*the quotes*/
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        if (source[i] >= 128)
+        {
+            LogError("character at position %lu cannot be JSON encoded", (unsigned long)i);
+            result = 0;
+            break;
+        }
+        else if (source[i] <= 0x1F)
+        {
+            result += LITERAL_LENGTH("\\u00XX");
+        }
+        else if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
+        {
+            result += 2;
+        }
+        else
+        {
+            result++;
+        }
+    }
+    return result;
+}
+
+static size_t write_json_string(const unsigned char* source, size_t size, unsigned char* destination)
+{
+    size_t result = 0;
+    size_t i;
+    destination[result++] = '"';
+    for (i = 0; i < size; i++)
+    {
+        if (source[i] <= 0x1F)
+        {
+            destination[result++] = '\\';
+            destination[result++] = 'u';
+            destination[result++] = '0';
+            destination[result++] = '0';
+            destination[result++] = (unsigned char)hexDigits[source[i] >> 4];
+            destination[result++] = (unsigned char)hexDigits[source[i] & 0x0F];
+        }
+        else if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
+        {
+            destination[result++] = '\\';
+            destination[result++] = source[i];
+        }
+        else
+        {
+            destination[result++] = source[i];
+        }
+    }
+    destination[result++] = '"';
+    return result;
+}
+
+static size_t write_literal(unsigned char* destination, const char* literal, size_t length)
+{
+    (void)memcpy(destination, literal, length);
+    return length;
+}
+
+static int get_item_data(IOTHUB_MESSAGE_HANDLE messageHandle, BATCH_ITEM_DATA* data, IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE* itemSize)
+{
+    int result;
+    MAP_HANDLE properties;
+
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_002: [ iothubtransporthttp_batch_get_item_size shall get the content of the message by calling IoTHubMessage_GetContentType and then IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+    data->contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (data->contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        if (IoTHubMessage_GetByteArray(messageHandle, &data->content, &data->contentSize) != IOTHUB_MESSAGE_OK)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_004: [ If any operation fails, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+            LogError("unable to get the data for the message.");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_005: [ itemSize shall receive the exact number of bytes that iothubtransporthttp_batch_write_item writes for the message, the size of its content and the count and total length of its property names and values. ]*/
+            itemSize->itemSize = LITERAL_LENGTH(ITEM_BYTEARRAY_BEGIN) + iothubtransporthttp_batch_base64_encoded_size(data->contentSize) + LITERAL_LENGTH(ITEM_BYTEARRAY_END);
+            result = 0;
+        }
+    }
+    else if (data->contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* source = IoTHubMessage_GetString(messageHandle);
+        if (source == NULL)
+        {
+            LogError("unable to IoTHubMessage_GetString");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t jsonSize;
+            data->content = (const unsigned char*)source;
+            data->contentSize = strlen(source);
+            if ((jsonSize = get_json_string_size(data->content, data->contentSize)) == 0)
+            {
+                /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_006: [ If the string of a message cannot be JSON encoded, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+                LogError("unable to JSON encode the message");
+                result = __LINE__;
+            }
+            else
+            {
+                itemSize->itemSize = LITERAL_LENGTH(ITEM_STRING_BEGIN) + jsonSize + LITERAL_LENGTH(ITEM_STRING_END);
+                result = 0;
+            }
+        }
+    }
+    else
+    {
+        LogError("an unknown message type was encountered (%d)", data->contentType);
+        result = __LINE__;
+    }
+
+    if (result == 0)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_003: [ iothubtransporthttp_batch_get_item_size shall get the properties of the message by calling IoTHubMessage_Properties and Map_GetInternals. ]*/
+        if (((properties = IoTHubMessage_Properties(messageHandle)) == NULL) ||
+            (Map_GetInternals(properties, &data->keys, &data->values, &data->count) != MAP_OK))
+        {
+            LogError("error while Map_GetInternals");
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            itemSize->contentSize = data->contentSize;
+            itemSize->propertyCount = data->count;
+            itemSize->propertiesSize = 0;
+            for (i = 0; i < data->count; i++)
+            {
+                itemSize->propertiesSize += strlen(data->keys[i]) + strlen(data->values[i]);
+            }
+
+            if (data->count > 0)
+            {
+                /*every property but the first is preceded by a comma*/
+                itemSize->itemSize += LITERAL_LENGTH(ITEM_PROPERTIES_BEGIN) + LITERAL_LENGTH(ITEM_PROPERTIES_END) + (data->count - 1) +
+                    data->count * (LITERAL_LENGTH(ITEM_PROPERTY_NAME_BEGIN) + LITERAL_LENGTH(ITEM_PROPERTY_SEPARATOR) + LITERAL_LENGTH(ITEM_PROPERTY_VALUE_END)) +
+                    itemSize->propertiesSize;
+            }
+            itemSize->itemSize += LITERAL_LENGTH(ITEM_END);
+        }
+    }
+    return result;
+}
+
+int iothubtransporthttp_batch_get_item_size(IOTHUB_MESSAGE_HANDLE messageHandle, IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE* itemSize)
+{
+    int result;
+    if ((messageHandle == NULL) || (itemSize == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_001: [ If messageHandle or itemSize is NULL, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+        LogError("invalid arg messageHandle=%p, itemSize=%p", messageHandle, itemSize);
+        result = __LINE__;
+    }
+    else
+    {
+        BATCH_ITEM_DATA data;
+        result = get_item_data(messageHandle, &data, itemSize);
+    }
+    return result;
+}
+
+int iothubtransporthttp_batch_write_item(IOTHUB_MESSAGE_HANDLE messageHandle, unsigned char* destination, size_t available, size_t* written)
+{
+    int result;
+    BATCH_ITEM_DATA data;
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+
+    if ((messageHandle == NULL) || (destination == NULL) || (written == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_007: [ If messageHandle, destination or written is NULL, iothubtransporthttp_batch_write_item shall fail and return a non-zero value. ]*/
+        LogError("invalid arg messageHandle=%p, destination=%p, written=%p", messageHandle, destination, written);
+        result = __LINE__;
+    }
+    else if (get_item_data(messageHandle, &data, &itemSize) != 0)
+    {
+        LogError("unable to get the data of the message");
+        result = __LINE__;
+    }
+    else if (itemSize.itemSize > available)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_008: [ If the item does not fit in available bytes, iothubtransporthttp_batch_write_item shall fail without writing to destination and return a non-zero value. ]*/
+        LogError("the item needs %lu bytes, only %lu are available", (unsigned long)itemSize.itemSize, (unsigned long)available);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t position = 0;
+        size_t i;
+
+        if (data.contentType == IOTHUBMESSAGE_BYTEARRAY)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_009: [ A message of type IOTHUBMESSAGE_BYTEARRAY shall be written as {"body":"base64 encoding of the message content" followed by the properties and }. ]*/
+            position += write_literal(destination + position, ITEM_BYTEARRAY_BEGIN, LITERAL_LENGTH(ITEM_BYTEARRAY_BEGIN));
+            position += iothubtransporthttp_batch_base64_encode(data.content, data.contentSize, destination + position);
+            position += write_literal(destination + position, ITEM_BYTEARRAY_END, LITERAL_LENGTH(ITEM_BYTEARRAY_END));
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_010: [ A message of type IOTHUBMESSAGE_STRING shall be written as {"body":JSON encoding of the string,"base64Encoded":false followed by the properties and }. ]*/
+            position += write_literal(destination + position, ITEM_STRING_BEGIN, LITERAL_LENGTH(ITEM_STRING_BEGIN));
+            position += write_json_string(data.content, data.contentSize, destination + position);
+            position += write_literal(destination + position, ITEM_STRING_END, LITERAL_LENGTH(ITEM_STRING_END));
+        }
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_011: [ The properties shall be written as ,"properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} and shall be missing if the message has no properties. ]*/
+        if (data.count > 0)
+        {
+            position += write_literal(destination + position, ITEM_PROPERTIES_BEGIN, LITERAL_LENGTH(ITEM_PROPERTIES_BEGIN));
+            for (i = 0; i < data.count; i++)
+            {
+                if (i > 0)
+                {
+                    destination[position++] = ',';
+                }
+                position += write_literal(destination + position, ITEM_PROPERTY_NAME_BEGIN, LITERAL_LENGTH(ITEM_PROPERTY_NAME_BEGIN));
+                position += write_literal(destination + position, data.keys[i], strlen(data.keys[i]));
+                position += write_literal(destination + position, ITEM_PROPERTY_SEPARATOR, LITERAL_LENGTH(ITEM_PROPERTY_SEPARATOR));
+                position += write_literal(destination + position, data.values[i], strlen(data.values[i]));
+                position += write_literal(destination + position, ITEM_PROPERTY_VALUE_END, LITERAL_LENGTH(ITEM_PROPERTY_VALUE_END));
+            }
+            position += write_literal(destination + position, ITEM_PROPERTIES_END, LITERAL_LENGTH(ITEM_PROPERTIES_END));
+        }
+        position += write_literal(destination + position, ITEM_END, LITERAL_LENGTH(ITEM_END));
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_012: [ On success iothubtransporthttp_batch_write_item shall set written to the number of bytes written and return 0. ]*/
+        *written = position;
+        result = 0;
+    }
+    return result;
+}
+
+size_t iothubtransporthttp_batch_base64_encoded_size(size_t size)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_013: [ iothubtransporthttp_batch_base64_encoded_size shall return 4 bytes for every started group of 3 bytes of size. ]*/
+    return ((size + 2) / 3) * 4;
+}
+
+size_t iothubtransporthttp_batch_base64_encode(const unsigned char* source, size_t size, unsigned char* destination)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_014: [ iothubtransporthttp_batch_base64_encode shall write the padded base64 encoding of source to destination and return the number of bytes written. ]*/
+    /*whole groups of 3 bytes are encoded without any branch, only the last group needs padding*/
+    size_t result = 0;
+    size_t wholeGroupsSize = size - (size % 3);
+    size_t i;
+
+    for (i = 0; i < wholeGroupsSize; i += 3)
+    {
+        unsigned long group = ((unsigned long)source[i] << 16) | ((unsigned long)source[i + 1] << 8) | (unsigned long)source[i + 2];
+        destination[result] = (unsigned char)base64Alphabet[(group >> 18) & 0x3F];
+        destination[result + 1] = (unsigned char)base64Alphabet[(group >> 12) & 0x3F];
+        destination[result + 2] = (unsigned char)base64Alphabet[(group >> 6) & 0x3F];
+        destination[result + 3] = (unsigned char)base64Alphabet[group & 0x3F];
+        result += 4;
+    }
+
+    if (size - wholeGroupsSize == 1)
+    {
+        unsigned long group = (unsigned long)source[i] << 16;
+        destination[result] = (unsigned char)base64Alphabet[(group >> 18) & 0x3F];
+        destination[result + 1] = (unsigned char)base64Alphabet[(group >> 12) & 0x3F];
+        destination[result + 2] = '=';
+        destination[result + 3] = '=';
+        result += 4;
+    }
+    else if (size - wholeGroupsSize == 2)
+    {
+        unsigned long group = ((unsigned long)source[i] << 16) | ((unsigned long)source[i + 1] << 8);
+        destination[result] = (unsigned char)base64Alphabet[(group >> 18) & 0x3F];
+        destination[result + 1] = (unsigned char)base64Alphabet[(group >> 12) & 0x3F];
+        destination[result + 2] = (unsigned char)base64Alphabet[(group >> 6) & 0x3F];
+        destination[result + 3] = '=';
+        result += 4;
+    }
+
+    return result;
+}
@@ -0,0 +1,283 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "iothubtransporthttp_compress.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#ifdef USE_HTTP_COMPRESSION
+
+#include <limits.h>
+#include "zlib.h"
+
+/*a 4KB history window is enough to find the JSON keys that every item of a batch repeats and keeps zlib below 48KB*/
+#define COMPRESS_WINDOW_BITS 12
+#define COMPRESS_MEM_LEVEL 6
+/*the compressed bytes are copied to the destination in chunks of this size*/
+#define COMPRESS_CHUNK_SIZE 256
+
+typedef struct IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE_TAG
+{
+    z_stream stream;
+    BUFFER_HANDLE destination;
+    size_t pendingSize; /*bytes given to zlib since the last flush, part of their output can still be held by zlib*/
+    unsigned char chunk[COMPRESS_CHUNK_SIZE];
+} IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE;
+
+/*zlib allocates through gballoc like the rest of the SDK*/
+static voidpf compress_alloc(voidpf opaque, uInt items, uInt size)
+{
+    (void)opaque;
+    return ((size != 0) && (items > SIZE_MAX / size)) ? NULL : malloc((size_t)items * size);
+}
+
+static void compress_free(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    free(address);
+}
+
+static int deflate_to_destination(IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE* instance, const unsigned char* source, size_t size, int flush)
+{
+    int result = 0;
+
+    instance->stream.next_in = (Bytef*)source;
+    instance->stream.avail_in = (uInt)size;
+    do
+    {
+        size_t produced;
+        instance->stream.next_out = instance->chunk;
+        instance->stream.avail_out = sizeof(instance->chunk);
+        if (deflate(&instance->stream, flush) == Z_STREAM_ERROR)
+        {
+            LogError("deflate failed");
+            result = __LINE__;
+        }
+        else if ((produced = sizeof(instance->chunk) - instance->stream.avail_out) == 0)
+        {
+            /*zlib keeps everything for now*/
+        }
+        else
+        {
+            size_t length = BUFFER_length(instance->destination);
+            if (BUFFER_enlarge(instance->destination, produced) != 0)
+            {
+                LogError("unable to BUFFER_enlarge");
+                result = __LINE__;
+            }
+            else
+            {
+                (void)memcpy(BUFFER_u_char(instance->destination) + length, instance->chunk, produced);
+            }
+        }
+    } while ((result == 0) && (instance->stream.avail_out == 0));
+
+    return result;
+}
+
+bool iothubtransporthttp_compress_is_supported(void)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_001: [ iothubtransporthttp_compress_is_supported shall return true when the SDK is built with USE_HTTP_COMPRESSION and false otherwise. ]*/
+    return true;
+}
+
+IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE iothubtransporthttp_compress_create(BUFFER_HANDLE destination)
+{
+    IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE* result;
+
+    if (destination == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_002: [ If destination is NULL, iothubtransporthttp_compress_create shall fail and return NULL. ]*/
+        LogError("invalid arg destination=NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_003: [ iothubtransporthttp_compress_create shall allocate the compressor and start a zlib stream by calling deflateInit2. ]*/
+    else if ((result = (IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE*)malloc(sizeof(IOTHUBTRANSPORTHTTP_COMPRESS_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_004: [ If any of the operations fails, iothubtransporthttp_compress_create shall free what it allocated and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        result->stream.zalloc = compress_alloc;
+        result->stream.zfree = compress_free;
+        result->stream.opaque = NULL;
+        if (deflateInit2(&result->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, COMPRESS_WINDOW_BITS, COMPRESS_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            LogError("deflateInit2 failed");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->destination = destination;
+            result->pendingSize = 0;
+        }
+    }
+
+    return result;
+}
+
+void iothubtransporthttp_compress_destroy(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_005: [ If compressHandle is NULL, iothubtransporthttp_compress_destroy shall do nothing. ]*/
+    if (compressHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_006: [ iothubtransporthttp_compress_destroy shall end the zlib stream by calling deflateEnd and free the compressor, but not the destination. ]*/
+        (void)deflateEnd(&compressHandle->stream);
+        free(compressHandle);
+    }
+}
+
+int iothubtransporthttp_compress_fits(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, size_t size, size_t limit, bool* fits)
+{
+    int result;
+
+    if ((compressHandle == NULL) || (fits == NULL) || (size > UINT_MAX))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_007: [ If compressHandle or fits is NULL, iothubtransporthttp_compress_fits shall fail and return a non-zero value. ]*/
+        LogError("invalid arg compressHandle=%p, fits=%p, size=%lu", compressHandle, fits, (unsigned long)size);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_008: [ The finished stream shall be bound by the bytes already produced plus deflateBound of the bytes given since the last flush and size. ]*/
+        uLong bound = compressHandle->stream.total_out + deflateBound(&compressHandle->stream, (uLong)(compressHandle->pendingSize + size));
+        result = 0;
+        if ((bound > limit) && (compressHandle->pendingSize > 0))
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_009: [ If the bound exceeds limit and bytes have been given since the last flush, iothubtransporthttp_compress_fits shall flush the stream with Z_SYNC_FLUSH and compute the bound again. ]*/
+            if (deflate_to_destination(compressHandle, NULL, 0, Z_SYNC_FLUSH) != 0)
+            {
+                /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_010: [ If flushing fails, iothubtransporthttp_compress_fits shall fail and return a non-zero value. ]*/
+                LogError("unable to flush the stream");
+                result = __LINE__;
+            }
+            else
+            {
+                compressHandle->pendingSize = 0;
+                bound = compressHandle->stream.total_out + deflateBound(&compressHandle->stream, (uLong)size);
+            }
+        }
+
+        if (result == 0)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_011: [ fits shall receive true when the bound does not exceed limit. ]*/
+            *fits = (bound <= limit);
+        }
+    }
+
+    return result;
+}
+
+int iothubtransporthttp_compress_append(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, const unsigned char* source, size_t size)
+{
+    int result;
+
+    if ((compressHandle == NULL) || (source == NULL) || (size > UINT_MAX))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_012: [ If compressHandle or source is NULL, iothubtransporthttp_compress_append shall fail and return a non-zero value. ]*/
+        LogError("invalid arg compressHandle=%p, source=%p, size=%lu", compressHandle, source, (unsigned long)size);
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_013: [ iothubtransporthttp_compress_append shall compress source with Z_NO_FLUSH and append the bytes zlib produces to the destination by calling BUFFER_enlarge. ]*/
+    else if (deflate_to_destination(compressHandle, source, size, Z_NO_FLUSH) != 0)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_014: [ If compressing fails, iothubtransporthttp_compress_append shall fail and return a non-zero value. ]*/
+        LogError("unable to compress");
+        result = __LINE__;
+    }
+    else
+    {
+        compressHandle->pendingSize += size;
+        result = 0;
+    }
+
+    return result;
+}
+
+int iothubtransporthttp_compress_finish(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, const unsigned char* source, size_t size)
+{
+    int result;
+
+    if ((compressHandle == NULL) || (source == NULL) || (size > UINT_MAX))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_015: [ If compressHandle or source is NULL, iothubtransporthttp_compress_finish shall fail and return a non-zero value. ]*/
+        LogError("invalid arg compressHandle=%p, source=%p, size=%lu", compressHandle, source, (unsigned long)size);
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_016: [ iothubtransporthttp_compress_finish shall compress source with Z_FINISH and append the rest of the stream to the destination. ]*/
+    else if (deflate_to_destination(compressHandle, source, size, Z_FINISH) != 0)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_017: [ If compressing fails, iothubtransporthttp_compress_finish shall fail and return a non-zero value. ]*/
+        LogError("unable to compress");
+        result = __LINE__;
+    }
+    else
+    {
+        compressHandle->pendingSize = 0;
+        result = 0;
+    }
+
+    return result;
+}
+
+#else
+
+/*without zlib the compressor cannot be created, the HTTP transport refuses the CompressBatches option*/
+
+bool iothubtransporthttp_compress_is_supported(void)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_001: [ iothubtransporthttp_compress_is_supported shall return true when the SDK is built with USE_HTTP_COMPRESSION and false otherwise. ]*/
+    return false;
+}
+
+IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE iothubtransporthttp_compress_create(BUFFER_HANDLE destination)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_018: [ Without USE_HTTP_COMPRESSION, iothubtransporthttp_compress_create shall return NULL and the other functions shall fail. ]*/
+    (void)destination;
+    LogError("the SDK is built without use_http_compression");
+    return NULL;
+}
+
+void iothubtransporthttp_compress_destroy(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle)
+{
+    (void)compressHandle;
+}
+
+int iothubtransporthttp_compress_fits(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, size_t size, size_t limit, bool* fits)
+{
+    (void)compressHandle;
+    (void)size;
+    (void)limit;
+    (void)fits;
+    return __LINE__;
+}
+
+int iothubtransporthttp_compress_append(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, const unsigned char* source, size_t size)
+{
+    (void)compressHandle;
+    (void)source;
+    (void)size;
+    return __LINE__;
+}
+
+int iothubtransporthttp_compress_finish(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle, const unsigned char* source, size_t size)
+{
+    (void)compressHandle;
+    (void)source;
+    (void)size;
+    return __LINE__;
+}
+
+#endif
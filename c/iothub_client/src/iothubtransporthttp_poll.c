@@ -0,0 +1,256 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "iothubtransporthttp_poll.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*an empty poll adds up to 1/JITTER_DIVISOR of the idle time to the wait*/
+#define JITTER_DIVISOR 4
+
+typedef struct IOTHUBTRANSPORTHTTP_POLL_INSTANCE_TAG
+{
+    unsigned int minimumTime;
+    unsigned int maximumTime;
+    unsigned int pollsPerSecond; /*0 when there is no cap*/
+    LOCK_HANDLE lockHandle; /*guards the rate window, the lanes of the connection pool poll at the same time*/
+    bool isWindowStarted;
+    time_t windowStart;
+    unsigned int pollsInWindow;
+} IOTHUBTRANSPORTHTTP_POLL_INSTANCE;
+
+/*a linear congruential step, the jitter does not need anything better*/
+static uint32_t next_random(IOTHUBTRANSPORTHTTP_POLL_STATE* pollState)
+{
+    pollState->seed = pollState->seed * 1664525u + 1013904223u;
+    return pollState->seed >> 8;
+}
+
+static unsigned int get_jitter(IOTHUBTRANSPORTHTTP_POLL_STATE* pollState, unsigned int time)
+{
+    return (unsigned int)(next_random(pollState) % (time / JITTER_DIVISOR + 1));
+}
+
+static void set_times(IOTHUBTRANSPORTHTTP_POLL_INSTANCE* poll, unsigned int minimumTime, unsigned int maximumTime)
+{
+    poll->minimumTime = minimumTime;
+    poll->maximumTime = (maximumTime < minimumTime) ? minimumTime : maximumTime;
+}
+
+IOTHUBTRANSPORTHTTP_POLL_HANDLE iothubtransporthttp_poll_create(unsigned int minimumTime, unsigned int maximumTime)
+{
+    IOTHUBTRANSPORTHTTP_POLL_INSTANCE* result;
+
+    if (minimumTime == 0)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_001: [ If minimumTime is 0, iothubtransporthttp_poll_create shall fail and return NULL. ]*/
+        LogError("invalid argument minimumTime=0");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_002: [ iothubtransporthttp_poll_create shall allocate memory for the scheduler and create its lock by calling Lock_Init. ]*/
+    else if ((result = (IOTHUBTRANSPORTHTTP_POLL_INSTANCE*)malloc(sizeof(IOTHUBTRANSPORTHTTP_POLL_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_poll_create shall free everything it created and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_poll_create shall free everything it created and return NULL. ]*/
+        LogError("unable to Lock_Init");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_004: [ A maximumTime smaller than minimumTime shall be raised to minimumTime. ]*/
+        set_times(result, minimumTime, maximumTime);
+        result->pollsPerSecond = 0;
+        result->isWindowStarted = false;
+        result->pollsInWindow = 0;
+    }
+
+    return result;
+}
+
+void iothubtransporthttp_poll_destroy(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_005: [ If pollHandle is NULL, iothubtransporthttp_poll_destroy shall do nothing. ]*/
+    if (pollHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_006: [ iothubtransporthttp_poll_destroy shall free the lock by calling Lock_Deinit and free the scheduler. ]*/
+        (void)Lock_Deinit(pollHandle->lockHandle);
+        free(pollHandle);
+    }
+}
+
+int iothubtransporthttp_poll_set_times(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle, unsigned int minimumTime, unsigned int maximumTime)
+{
+    int result;
+
+    if ((pollHandle == NULL) || (minimumTime == 0))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_007: [ If pollHandle is NULL or minimumTime is 0, iothubtransporthttp_poll_set_times shall fail and return a non-zero value. ]*/
+        LogError("invalid argument pollHandle=%p, minimumTime=%u", pollHandle, minimumTime);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_008: [ Otherwise iothubtransporthttp_poll_set_times shall store the times, raising maximumTime to minimumTime if it is smaller, and return 0. ]*/
+        set_times(pollHandle, minimumTime, maximumTime);
+        result = 0;
+    }
+
+    return result;
+}
+
+int iothubtransporthttp_poll_set_rate_limit(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle, unsigned int pollsPerSecond)
+{
+    int result;
+
+    if (pollHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_009: [ If pollHandle is NULL, iothubtransporthttp_poll_set_rate_limit shall fail and return a non-zero value. ]*/
+        LogError("invalid argument pollHandle=NULL");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_010: [ Otherwise iothubtransporthttp_poll_set_rate_limit shall store pollsPerSecond, 0 meaning no cap, and return 0. ]*/
+        pollHandle->pollsPerSecond = pollsPerSecond;
+        result = 0;
+    }
+
+    return result;
+}
+
+/*takes a poll out of the rate window of the current second, if there is one left*/
+static bool take_rate(IOTHUBTRANSPORTHTTP_POLL_INSTANCE* poll, time_t now)
+{
+    bool result;
+
+    if (Lock(poll->lockHandle) != LOCK_OK)
+    {
+        /*the cap cannot be checked, the device waits for the next DoWork*/
+        LogError("unable to Lock");
+        result = false;
+    }
+    else
+    {
+        double sinceWindowStart = poll->isWindowStarted ? get_difftime(now, poll->windowStart) : 0;
+        if (!poll->isWindowStarted || (sinceWindowStart >= 1) || (sinceWindowStart < 0))
+        {
+            poll->isWindowStarted = true;
+            poll->windowStart = now;
+            poll->pollsInWindow = 0;
+        }
+
+        if (poll->pollsInWindow < poll->pollsPerSecond)
+        {
+            poll->pollsInWindow++;
+            result = true;
+        }
+        else
+        {
+            result = false;
+        }
+        (void)Unlock(poll->lockHandle);
+    }
+
+    return result;
+}
+
+bool iothubtransporthttp_poll_is_due(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE* pollState, time_t now)
+{
+    bool result;
+
+    if ((pollHandle == NULL) || (pollState == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_011: [ If pollHandle or pollState is NULL, iothubtransporthttp_poll_is_due shall return false. ]*/
+        LogError("invalid argument pollHandle=%p, pollState=%p", pollHandle, pollState);
+        result = false;
+    }
+    else if (now == (time_t)(-1))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_012: [ If now is (time_t)-1, iothubtransporthttp_poll_is_due shall return true. ]*/
+        result = true;
+    }
+    else
+    {
+        if (!pollState->isScheduled)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_013: [ The first call for a device shall schedule its first poll after a wait taken from the seed of the device, between 0 and the minimum time. ]*/
+            pollState->seed *= 2654435761u; /*consecutive seeds end up far apart*/
+            pollState->isScheduled = true;
+            pollState->scheduledFrom = now;
+            pollState->waitTime = (unsigned int)(next_random(pollState) % (pollHandle->minimumTime + 1));
+            pollState->idleTime = pollHandle->minimumTime;
+        }
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_014: [ A device shall be due once waitTime seconds have passed since the time it was scheduled from, or when the clock went back. ]*/
+        double elapsed = get_difftime(now, pollState->scheduledFrom);
+        if ((elapsed < 0) || (elapsed >= pollState->waitTime))
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_015: [ If there is a rate limit, a due device shall be reported due only while the polls of the current second are below the limit. ]*/
+            result = (pollHandle->pollsPerSecond == 0) || take_rate(pollHandle, now);
+        }
+        else
+        {
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+void iothubtransporthttp_poll_on_polled(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE* pollState, time_t now, bool hasReceivedMessage)
+{
+    if ((pollHandle == NULL) || (pollState == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_016: [ If pollHandle or pollState is NULL, iothubtransporthttp_poll_on_polled shall do nothing. ]*/
+        LogError("invalid argument pollHandle=%p, pollState=%p", pollHandle, pollState);
+    }
+    else if (now == (time_t)(-1))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_017: [ If now is (time_t)-1, the device shall be scheduled again by its next call to iothubtransporthttp_poll_is_due. ]*/
+        pollState->isScheduled = false;
+    }
+    else
+    {
+        pollState->isScheduled = true;
+        pollState->scheduledFrom = now;
+        if (hasReceivedMessage)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_018: [ After a poll that brought a message, the next poll shall be due after the minimum time and the idle time shall go back to the minimum time. ]*/
+            pollState->waitTime = pollHandle->minimumTime;
+            pollState->idleTime = pollHandle->minimumTime;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POLL_07_019: [ After an empty poll, the next poll shall be due after the idle time plus a jitter of up to a quarter of it, and the idle time shall double, up to the maximum time. ]*/
+            unsigned int idleTime = pollState->idleTime;
+            if (idleTime < pollHandle->minimumTime)
+            {
+                idleTime = pollHandle->minimumTime;
+            }
+            else if (idleTime > pollHandle->maximumTime)
+            {
+                idleTime = pollHandle->maximumTime;
+            }
+
+            unsigned int jitter = get_jitter(pollState, idleTime);
+            pollState->waitTime = (jitter > UINT_MAX - idleTime) ? UINT_MAX : idleTime + jitter;
+            pollState->idleTime = (idleTime > pollHandle->maximumTime / 2) ? pollHandle->maximumTime : idleTime * 2;
+        }
+    }
+}
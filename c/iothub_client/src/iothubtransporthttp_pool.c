@@ -0,0 +1,288 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include "azure_c_shared_utility/gballoc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+#include "iothubtransporthttp_pool.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/*the threads are woken up by every run, the timeout only bounds the wait if a wake up is lost*/
+#define POOL_IDLE_WAIT_TIME 1000
+
+typedef struct POOL_LANE_TAG
+{
+    struct IOTHUBTRANSPORTHTTP_POOL_INSTANCE_TAG* pool;
+    size_t lane;
+    COND_HANDLE runCondition; /*posted when there is a run or the thread has to stop*/
+    THREAD_HANDLE threadHandle;
+    size_t lastRun; /*the last run the lane has taken*/
+} POOL_LANE;
+
+typedef struct IOTHUBTRANSPORTHTTP_POOL_INSTANCE_TAG
+{
+    LOCK_HANDLE lockHandle;
+    COND_HANDLE doneCondition; /*posted by the last lane that finishes a run*/
+    size_t laneCount;
+    POOL_LANE* lanes; /*the lanes that have a thread, lanes[i] is lane i + 1*/
+    size_t run; /*incremented by every iothubtransporthttp_pool_run*/
+    size_t pendingLanes; /*lanes that have not finished the current run*/
+    IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION function;
+    void* context;
+    sig_atomic_t stopThreads;
+} IOTHUBTRANSPORTHTTP_POOL_INSTANCE;
+
+/*used by unittests only*/
+const size_t iothubtransporthttp_pool_ThreadTerminationOffset = offsetof(IOTHUBTRANSPORTHTTP_POOL_INSTANCE, stopThreads);
+
+static void lock_pool(IOTHUBTRANSPORTHTTP_POOL_INSTANCE* pool)
+{
+    /*a run cannot end without the lock, so it is retried rather than given up*/
+    while (Lock(pool->lockHandle) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        ThreadAPI_Sleep(1);
+    }
+}
+
+static int lane_thread(void* threadArgument)
+{
+    POOL_LANE* lane = (POOL_LANE*)threadArgument;
+    IOTHUBTRANSPORTHTTP_POOL_INSTANCE* pool = lane->pool;
+    bool isStopped = false;
+
+    while (!isStopped)
+    {
+        lock_pool(pool);
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_011: [ While there is no new run, the thread of a lane shall wait on its run condition by calling Condition_Wait. ]*/
+        if ((lane->lastRun == pool->run) && !pool->stopThreads)
+        {
+            if (Condition_Wait(lane->runCondition, pool->lockHandle, POOL_IDLE_WAIT_TIME) == COND_ERROR)
+            {
+                LogError("Condition_Wait failed");
+            }
+        }
+
+        if (pool->stopThreads)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_013: [ The thread of a lane shall exit once iothubtransporthttp_pool_destroy has been called. ]*/
+            isStopped = true;
+            (void)Unlock(pool->lockHandle);
+        }
+        else if (lane->lastRun == pool->run)
+        {
+            /*the wait timed out*/
+            (void)Unlock(pool->lockHandle);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_012: [ The thread of a lane shall call the function of a new run with its context and the lane without holding the lock, and the last lane to finish shall wake up iothubtransporthttp_pool_run by calling Condition_Post. ]*/
+            IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION function = pool->function;
+            void* context = pool->context;
+            lane->lastRun = pool->run;
+            (void)Unlock(pool->lockHandle);
+
+            function(context, lane->lane);
+
+            lock_pool(pool);
+            pool->pendingLanes--;
+            if (pool->pendingLanes == 0)
+            {
+                if (Condition_Post(pool->doneCondition) != COND_OK)
+                {
+                    LogError("Condition_Post failed");
+                }
+            }
+            (void)Unlock(pool->lockHandle);
+        }
+    }
+
+    return 0;
+}
+
+/*stops and joins the threads of the first laneCount lanes and frees their conditions*/
+static void stop_lanes(IOTHUBTRANSPORTHTTP_POOL_INSTANCE* pool, size_t laneCount)
+{
+    size_t i;
+
+    lock_pool(pool);
+    pool->stopThreads = 1;
+    for (i = 0; i < laneCount; i++)
+    {
+        if (Condition_Post(pool->lanes[i].runCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed");
+        }
+    }
+    (void)Unlock(pool->lockHandle);
+
+    for (i = 0; i < laneCount; i++)
+    {
+        int res;
+        if (ThreadAPI_Join(pool->lanes[i].threadHandle, &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed");
+        }
+        Condition_Deinit(pool->lanes[i].runCondition);
+    }
+}
+
+IOTHUBTRANSPORTHTTP_POOL_HANDLE iothubtransporthttp_pool_create(size_t laneCount)
+{
+    IOTHUBTRANSPORTHTTP_POOL_INSTANCE* result;
+
+    if ((laneCount < 2) || (laneCount - 1 > SIZE_MAX / sizeof(POOL_LANE)))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_001: [ If laneCount is less than 2, iothubtransporthttp_pool_create shall fail and return NULL. ]*/
+        LogError("invalid arg laneCount=%lu", (unsigned long)laneCount);
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_002: [ iothubtransporthttp_pool_create shall allocate memory for the pool and its lanes, create its lock by calling Lock_Init and its done condition by calling Condition_Init. ]*/
+    else if ((result = (IOTHUBTRANSPORTHTTP_POOL_INSTANCE*)malloc(sizeof(IOTHUBTRANSPORTHTTP_POOL_INSTANCE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_pool_create shall free everything it created and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else if ((result->lanes = (POOL_LANE*)malloc((laneCount - 1) * sizeof(POOL_LANE))) == NULL)
+    {
+        LogError("unable to malloc");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        LogError("Lock_Init failed");
+        free(result->lanes);
+        free(result);
+        result = NULL;
+    }
+    else if ((result->doneCondition = Condition_Init()) == NULL)
+    {
+        LogError("Condition_Init failed");
+        Lock_Deinit(result->lockHandle);
+        free(result->lanes);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t i;
+
+        result->laneCount = laneCount;
+        result->run = 0;
+        result->pendingLanes = 0;
+        result->function = NULL;
+        result->context = NULL;
+        result->stopThreads = 0;
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_004: [ For every lane but lane 0, iothubtransporthttp_pool_create shall create a run condition by calling Condition_Init and start a thread by calling ThreadAPI_Create. ]*/
+        for (i = 0; i < laneCount - 1; i++)
+        {
+            POOL_LANE* lane = &result->lanes[i];
+            lane->pool = result;
+            lane->lane = i + 1;
+            lane->lastRun = 0;
+            if ((lane->runCondition = Condition_Init()) == NULL)
+            {
+                LogError("Condition_Init failed");
+                break;
+            }
+            else if (ThreadAPI_Create(&lane->threadHandle, lane_thread, lane) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Create failed");
+                Condition_Deinit(lane->runCondition);
+                break;
+            }
+        }
+
+        if (i < laneCount - 1)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_005: [ If a lane cannot be started, iothubtransporthttp_pool_create shall stop the threads already started, free all resources and return NULL. ]*/
+            stop_lanes(result, i);
+            Condition_Deinit(result->doneCondition);
+            Lock_Deinit(result->lockHandle);
+            free(result->lanes);
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void iothubtransporthttp_pool_destroy(IOTHUBTRANSPORTHTTP_POOL_HANDLE poolHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_006: [ If poolHandle is NULL, iothubtransporthttp_pool_destroy shall do nothing. ]*/
+    if (poolHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_007: [ iothubtransporthttp_pool_destroy shall signal the threads of the lanes to end, join them and free all resources. ]*/
+        stop_lanes(poolHandle, poolHandle->laneCount - 1);
+        Condition_Deinit(poolHandle->doneCondition);
+        Lock_Deinit(poolHandle->lockHandle);
+        free(poolHandle->lanes);
+        free(poolHandle);
+    }
+}
+
+int iothubtransporthttp_pool_run(IOTHUBTRANSPORTHTTP_POOL_HANDLE poolHandle, IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION function, void* context)
+{
+    int result;
+
+    if ((poolHandle == NULL) || (function == NULL))
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_008: [ If poolHandle or function is NULL, iothubtransporthttp_pool_run shall fail and return a non-zero value. ]*/
+        LogError("invalid arg poolHandle=%p, function=%p", poolHandle, function);
+        result = __LINE__;
+    }
+    else if (Lock(poolHandle->lockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_009: [ If the run cannot be started, iothubtransporthttp_pool_run shall fail without calling function and return a non-zero value. ]*/
+        LogError("unable to Lock");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+
+        /*Codes_SRS_IOTHUBTRANSPORTHTTP_POOL_07_010: [ iothubtransporthttp_pool_run shall start a new run under the lock of the pool, wake up the thread of every lane by calling Condition_Post, call function for lane 0 on the calling thread, then wait on the done condition until every lane has finished and return 0. ]*/
+        poolHandle->function = function;
+        poolHandle->context = context;
+        poolHandle->run++;
+        poolHandle->pendingLanes = poolHandle->laneCount - 1;
+        for (i = 0; i < poolHandle->laneCount - 1; i++)
+        {
+            if (Condition_Post(poolHandle->lanes[i].runCondition) != COND_OK)
+            {
+                /*the lane still takes the run once its wait times out*/
+                LogError("Condition_Post failed");
+            }
+        }
+        (void)Unlock(poolHandle->lockHandle);
+
+        function(context, 0);
+
+        lock_pool(poolHandle);
+        while (poolHandle->pendingLanes > 0)
+        {
+            if (Condition_Wait(poolHandle->doneCondition, poolHandle->lockHandle, POOL_IDLE_WAIT_TIME) == COND_ERROR)
+            {
+                LogError("Condition_Wait failed");
+            }
+        }
+        (void)Unlock(poolHandle->lockHandle);
+        result = 0;
+    }
+
+    return result;
+}
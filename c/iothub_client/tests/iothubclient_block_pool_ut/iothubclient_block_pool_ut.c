@@ -0,0 +1,470 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothub_client_block_pool.h"
+
+#define TEST_BLOCK_SIZE     20
+#define TEST_CAPACITY       3
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubclient_block_pool_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_001: [ If blockSize or capacity is 0, or the pool would not fit in memory, IoTHubClient_BlockPool_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Create_with_0_blockSize_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE result = IoTHubClient_BlockPool_Create(0, TEST_CAPACITY);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_001: [ If blockSize or capacity is 0, or the pool would not fit in memory, IoTHubClient_BlockPool_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Create_with_0_capacity_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE result = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, 0);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_001: [ If blockSize or capacity is 0, or the pool would not fit in memory, IoTHubClient_BlockPool_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Create_with_overflowing_size_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE result = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, SIZE_MAX / 2);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_002: [ IoTHubClient_BlockPool_Create shall allocate memory for the pool and, in one allocation, for capacity blocks of blockSize bytes rounded up to the alignment of pointers, 64 bit integers and doubles. ]*/
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_017: [ IoTHubClient_BlockPool_GetStatistics shall copy the counters of the pool to statistics and return 0. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Create_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(TEST_CAPACITY * 24));
+
+    ///act
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE result = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_BlockPool_GetStatistics(result, &statistics));
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY, statistics.capacity);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.inUse);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.highWatermark);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.allocations);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.fallbacks);
+
+    ///cleanup
+    IoTHubClient_BlockPool_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_003: [ If any allocation fails, IoTHubClient_BlockPool_Create shall free everything it allocated and return NULL. ]*/
+TEST_FUNCTION(when_allocating_fails_IoTHubClient_BlockPool_Create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_BlockPool_Create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_BLOCK_POOL_HANDLE result = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_004: [ All the blocks shall initially be free; they shall be handed out in address order. ]*/
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_009: [ If the pool has a free block, IoTHubClient_BlockPool_Alloc shall remove it from the free blocks, update the inUse, highWatermark and allocations counters and return it. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Alloc_hands_out_the_blocks_without_calling_malloc)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    ///act
+    unsigned char* block1 = (unsigned char*)IoTHubClient_BlockPool_Alloc(pool);
+    unsigned char* block2 = (unsigned char*)IoTHubClient_BlockPool_Alloc(pool);
+    unsigned char* block3 = (unsigned char*)IoTHubClient_BlockPool_Alloc(pool);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(block1);
+    ASSERT_IS_TRUE(block2 == block1 + 24);
+    ASSERT_IS_TRUE(block3 == block2 + 24);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_BlockPool_GetStatistics(pool, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 3, statistics.inUse);
+    ASSERT_ARE_EQUAL(size_t, 3, statistics.highWatermark);
+    ASSERT_ARE_EQUAL(size_t, 3, statistics.allocations);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.fallbacks);
+
+    ///cleanup
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Free(pool, block2);
+    IoTHubClient_BlockPool_Free(pool, block3);
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_008: [ If poolHandle is NULL or the pool has been destroyed, IoTHubClient_BlockPool_Alloc shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Alloc_with_NULL_poolHandle_returns_NULL)
+{
+    ///arrange
+
+    ///act
+    void* result = IoTHubClient_BlockPool_Alloc(NULL);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_010: [ Otherwise IoTHubClient_BlockPool_Alloc shall allocate the block with malloc and increment the fallbacks counter. ]*/
+TEST_FUNCTION(when_the_pool_is_exhausted_IoTHubClient_BlockPool_Alloc_calls_malloc)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, 1);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(24));
+
+    ///act
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(block2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_BlockPool_GetStatistics(pool, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.inUse);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.allocations);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.fallbacks);
+
+    ///cleanup
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Free(pool, block2);
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_011: [ If malloc fails, IoTHubClient_BlockPool_Alloc shall return NULL. ]*/
+TEST_FUNCTION(when_the_pool_is_exhausted_and_malloc_fails_IoTHubClient_BlockPool_Alloc_returns_NULL)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, 1);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(24))
+        .SetReturn(NULL);
+
+    ///act
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+
+    ///assert
+    ASSERT_IS_NULL(block2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_BlockPool_GetStatistics(pool, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.fallbacks);
+
+    ///cleanup
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_012: [ If poolHandle or block is NULL, IoTHubClient_BlockPool_Free shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Free_with_NULL_block_does_nothing)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClient_BlockPool_Free(pool, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_013: [ If block belongs to the pool, IoTHubClient_BlockPool_Free shall add it to the free blocks and decrement the inUse counter. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Free_returns_the_block_to_the_pool)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClient_BlockPool_Free(pool, block1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_BlockPool_GetStatistics(pool, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.inUse);
+    ASSERT_ARE_EQUAL(size_t, 2, statistics.highWatermark);
+    ASSERT_ARE_EQUAL(void_ptr, block1, IoTHubClient_BlockPool_Alloc(pool));
+
+    ///cleanup
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Free(pool, block2);
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_015: [ Otherwise block was allocated with malloc and IoTHubClient_BlockPool_Free shall free it. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Free_frees_a_fallback_block)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, 1);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(block2));
+
+    ///act
+    IoTHubClient_BlockPool_Free(pool, block2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_005: [ If poolHandle is NULL, IoTHubClient_BlockPool_Destroy shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClient_BlockPool_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_006: [ If no block of the pool is in use, including the blocks allocated with malloc once the pool was exhausted, IoTHubClient_BlockPool_Destroy shall free all the memory of the pool. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Destroy_frees_the_pool)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(pool));
+
+    ///act
+    IoTHubClient_BlockPool_Destroy(pool);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_007: [ Otherwise IoTHubClient_BlockPool_Destroy shall only mark the pool as destroyed; the memory shall be freed when the last block in use is freed. ]*/
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_014: [ If the pool has been destroyed and block was the last block in use, IoTHubClient_BlockPool_Free shall free all the memory of the pool. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Destroy_with_blocks_in_use_frees_the_pool_when_the_last_block_is_freed)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClient_BlockPool_Destroy(pool);
+    IoTHubClient_BlockPool_Free(pool, block1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(IoTHubClient_BlockPool_Alloc(pool));
+
+    ///arrange
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(pool));
+
+    ///act
+    IoTHubClient_BlockPool_Free(pool, block2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_014: [ If the pool has been destroyed and block was the last block in use, IoTHubClient_BlockPool_Free shall free all the memory of the pool. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_Destroy_with_a_fallback_block_in_use_frees_the_pool_when_it_is_freed)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, 1);
+    void* block1 = IoTHubClient_BlockPool_Alloc(pool);
+    void* block2 = IoTHubClient_BlockPool_Alloc(pool);
+    IoTHubClient_BlockPool_Free(pool, block1);
+    IoTHubClient_BlockPool_Destroy(pool);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(block2));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(pool));
+
+    ///act
+    IoTHubClient_BlockPool_Free(pool, block2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_016: [ If poolHandle or statistics is NULL, IoTHubClient_BlockPool_GetStatistics shall return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_GetStatistics_with_NULL_poolHandle_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+
+    ///act
+    int result = IoTHubClient_BlockPool_GetStatistics(NULL, &statistics);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_BLOCKPOOL_07_016: [ If poolHandle or statistics is NULL, IoTHubClient_BlockPool_GetStatistics shall return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_BlockPool_GetStatistics_with_NULL_statistics_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_BLOCK_POOL_HANDLE pool = IoTHubClient_BlockPool_Create(TEST_BLOCK_SIZE, TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_BlockPool_GetStatistics(pool, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_BlockPool_Destroy(pool);
+}
+
+END_TEST_SUITE(iothubclient_block_pool_ut)
@@ -0,0 +1,428 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <signal.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+MOCKABLE_FUNCTION(, void, test_dispatch_function, void*, context);
+
+#undef ENABLE_MOCKS
+
+#include "iothub_client_dispatcher.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern const size_t IoTHubClient_Dispatcher_ThreadTerminationOffset;
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4443
+#define TEST_COND_HANDLE        (COND_HANDLE)0x4444
+#define TEST_THREAD_HANDLE      (THREAD_HANDLE)0x4442
+#define TEST_DISPATCH_CONTEXT   (void*)0x4447
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static THREAD_START_FUNC g_thread_func;
+static void* g_thread_func_arg;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    *threadHandle = TEST_THREAD_HANDLE;
+    g_thread_func = func;
+    g_thread_func_arg = arg;
+    return THREADAPI_OK;
+}
+
+static void stop_dispatcher_thread(void)
+{
+    *(sig_atomic_t*)(((char*)g_thread_func_arg) + IoTHubClient_Dispatcher_ThreadTerminationOffset) = 1;
+}
+
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    (void)timeout_milliseconds;
+    /*tell the dispatcher thread to stop after the wait*/
+    stop_dispatcher_thread();
+    return COND_OK;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubclient_dispatcher_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Unlock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Post, COND_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
+
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Join, THREADAPI_OK);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    g_thread_func = NULL;
+    g_thread_func_arg = NULL;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_001: [ IoTHubClient_Dispatcher_Create shall allocate memory for the dispatcher, create its lock by calling Lock_Init and its item condition by calling Condition_Init. ]*/
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_003: [ IoTHubClient_Dispatcher_Create shall start the dispatcher thread by calling ThreadAPI_Create. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Create_succeeds)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    ///act
+    IOTHUB_CLIENT_DISPATCHER_HANDLE result = IoTHubClient_Dispatcher_Create();
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Dispatcher_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_002: [ If any of the resources cannot be created, IoTHubClient_Dispatcher_Create shall free everything it created and return NULL. ]*/
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_004: [ If starting the thread fails, IoTHubClient_Dispatcher_Create shall free all resources and return NULL. ]*/
+TEST_FUNCTION(when_creating_a_resource_fails_IoTHubClient_Dispatcher_Create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_Dispatcher_Create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_DISPATCHER_HANDLE result = IoTHubClient_Dispatcher_Create();
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_005: [ If dispatcherHandle is NULL, IoTHubClient_Dispatcher_Destroy shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClient_Dispatcher_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_006: [ IoTHubClient_Dispatcher_Destroy shall signal the thread to end once it has run the posted items and join it. ]*/
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_007: [ IoTHubClient_Dispatcher_Destroy shall free the items that were not run and all other resources. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Destroy_joins_the_thread_and_frees_resources)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(dispatcher));
+
+    ///act
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_007: [ IoTHubClient_Dispatcher_Destroy shall free the items that were not run and all other resources. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Destroy_frees_the_items_that_were_not_run)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    (void)IoTHubClient_Dispatcher_Post(dispatcher, test_dispatch_function, TEST_DISPATCH_CONTEXT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(dispatcher));
+
+    ///act
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_008: [ If dispatcherHandle or function is NULL, IoTHubClient_Dispatcher_Post shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Post_with_NULL_dispatcherHandle_fails)
+{
+    ///arrange
+
+    ///act
+    int result = IoTHubClient_Dispatcher_Post(NULL, test_dispatch_function, TEST_DISPATCH_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_008: [ If dispatcherHandle or function is NULL, IoTHubClient_Dispatcher_Post shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Post_with_NULL_function_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Dispatcher_Post(dispatcher, NULL, TEST_DISPATCH_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_009: [ IoTHubClient_Dispatcher_Post shall allocate an item holding function and context. ]*/
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_011: [ IoTHubClient_Dispatcher_Post shall add the item after the items already posted and wake the thread up by calling Condition_Post, under the dispatcher lock, and return 0. ]*/
+TEST_FUNCTION(IoTHubClient_Dispatcher_Post_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    int result = IoTHubClient_Dispatcher_Post(dispatcher, test_dispatch_function, TEST_DISPATCH_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_010: [ If any operation fails, IoTHubClient_Dispatcher_Post shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(when_an_operation_fails_IoTHubClient_Dispatcher_Post_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_Dispatcher_Post failure in test %zu/%zu", index, count);
+
+        ///act
+        int result = IoTHubClient_Dispatcher_Post(dispatcher, test_dispatch_function, TEST_DISPATCH_CONTEXT);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(int, 0, result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_013: [ The thread shall take all the posted items under the lock and call their functions, in the order they were posted, without holding the lock. ]*/
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_014: [ The thread shall exit once IoTHubClient_Dispatcher_Destroy has been called and no item is left. ]*/
+TEST_FUNCTION(dispatcher_thread_runs_the_posted_items_in_order_before_exiting)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    (void)IoTHubClient_Dispatcher_Post(dispatcher, test_dispatch_function, (void*)0x1);
+    (void)IoTHubClient_Dispatcher_Post(dispatcher, test_dispatch_function, (void*)0x2);
+    stop_dispatcher_thread();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(test_dispatch_function((void*)0x1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_dispatch_function((void*)0x2));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    int result = g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_DISPATCHER_07_012: [ While no item has been posted, the thread shall wait on the item condition by calling Condition_Wait. ]*/
+TEST_FUNCTION(dispatcher_thread_without_items_waits_on_the_item_condition)
+{
+    ///arrange
+    IOTHUB_CLIENT_DISPATCHER_HANDLE dispatcher = IoTHubClient_Dispatcher_Create();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, IGNORED_NUM_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    (void)g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Dispatcher_Destroy(dispatcher);
+}
+
+END_TEST_SUITE(iothubclient_dispatcher_ut)
@@ -0,0 +1,340 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothub_client_ingress_queue.h"
+
+#define TEST_LOCK_HANDLE    (LOCK_HANDLE)0x4443
+#define TEST_ITEM_1         (void*)0x4451
+#define TEST_ITEM_2         (void*)0x4452
+#define TEST_ITEM_3         (void*)0x4453
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubclient_ingress_queue_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    /*only used by compilers that have no atomic pointer exchange*/
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_001: [ IoTHubClient_IngressQueue_Create shall allocate memory for the queue and for its stub node. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Create_succeeds)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE result = IoTHubClient_IngressQueue_Create();
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_002: [ If any allocation fails, IoTHubClient_IngressQueue_Create shall free everything it allocated and return NULL. ]*/
+TEST_FUNCTION(when_allocating_fails_IoTHubClient_IngressQueue_Create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_IngressQueue_Create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE result = IoTHubClient_IngressQueue_Create();
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_003: [ If queueHandle is NULL, IoTHubClient_IngressQueue_Destroy shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClient_IngressQueue_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_004: [ IoTHubClient_IngressQueue_Destroy shall free all the nodes of the queue and the queue itself, but not the items. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Destroy_frees_the_nodes_left_in_the_queue)
+{
+    ///arrange
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    (void)IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_1);
+    (void)IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(queue));
+
+    ///act
+    IoTHubClient_IngressQueue_Destroy(queue);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_005: [ If queueHandle or item is NULL, IoTHubClient_IngressQueue_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Push_with_NULL_queueHandle_fails)
+{
+    ///arrange
+
+    ///act
+    int result = IoTHubClient_IngressQueue_Push(NULL, TEST_ITEM_1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_005: [ If queueHandle or item is NULL, IoTHubClient_IngressQueue_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Push_with_NULL_item_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_IngressQueue_Push(queue, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(queue);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_006: [ IoTHubClient_IngressQueue_Push shall allocate a node holding item. ]*/
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_008: [ IoTHubClient_IngressQueue_Push shall make the node the new head of the queue by atomically exchanging the head pointer, then link the previous head to it, and return 0. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Push_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    int result = IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM_1, IoTHubClient_IngressQueue_Pop(queue));
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(queue);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_007: [ If any operation fails, IoTHubClient_IngressQueue_Push shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(when_allocating_the_node_fails_IoTHubClient_IngressQueue_Push_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(NULL);
+
+    ///act
+    int result = IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(IoTHubClient_IngressQueue_Pop(queue));
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(queue);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_009: [ If queueHandle is NULL, IoTHubClient_IngressQueue_Pop shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Pop_with_NULL_queueHandle_returns_NULL)
+{
+    ///arrange
+
+    ///act
+    void* result = IoTHubClient_IngressQueue_Pop(NULL);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_010: [ If there is no completely pushed item in the queue, IoTHubClient_IngressQueue_Pop shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Pop_on_empty_queue_returns_NULL)
+{
+    ///arrange
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    umock_c_reset_all_calls();
+
+    ///act
+    void* result = IoTHubClient_IngressQueue_Pop(queue);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(queue);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_INGRESS_QUEUE_07_011: [ Otherwise IoTHubClient_IngressQueue_Pop shall return the oldest item, make its node the new stub node and free the previous stub node. ]*/
+TEST_FUNCTION(IoTHubClient_IngressQueue_Pop_returns_the_items_in_FIFO_order)
+{
+    ///arrange
+    void* result1;
+    void* result2;
+    void* result3;
+    void* result4;
+    IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE queue = IoTHubClient_IngressQueue_Create();
+    (void)IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_1);
+    (void)IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result1 = IoTHubClient_IngressQueue_Pop(queue);
+    (void)IoTHubClient_IngressQueue_Push(queue, TEST_ITEM_3);
+    result2 = IoTHubClient_IngressQueue_Pop(queue);
+    result3 = IoTHubClient_IngressQueue_Pop(queue);
+    result4 = IoTHubClient_IngressQueue_Pop(queue);
+
+    ///assert
+    ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM_1, result1);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM_2, result2);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM_3, result3);
+    ASSERT_IS_NULL(result4);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_IngressQueue_Destroy(queue);
+}
+
+END_TEST_SUITE(iothubclient_ingress_queue_ut)
@@ -42,11 +42,14 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 
 #include "iothub_client_version.h"
 #include "iothub_message.h"
+#include "iothub_client_block_pool.h"
+#include "iothub_client_outbox.h"
 
 #undef ENABLE_MOCKS
 
 #include "iothub_transport_ll.h"
 #include "iothub_client_ll.h"
+#include "iothub_client_options.h"
 #include "iothub_client_private.h"
 
 #define ENABLE_MOCKS
@@ -147,10 +150,19 @@ static const char* TEST_STRING_VALUE = "Test string value";
 #define TEST_TIME_VALUE                     (time_t)123456
 
 #define TEST_BUFFER_HANDLE                  (BUFFER_HANDLE)0x52
+#define TEST_BLOCK_POOL_HANDLE              (IOTHUB_CLIENT_BLOCK_POOL_HANDLE)0x53
+#define TEST_MESSAGE_POOL_SIZE              4
+#define TEST_MESSAGE_SIZE                   10
+#define TEST_OUTBOX_HANDLE                  (IOTHUB_CLIENT_OUTBOX_HANDLE)0x54
+#define TEST_HIGH_PRIORITY_MESSAGE_HANDLE   (IOTHUB_MESSAGE_HANDLE)0x55
+#define TEST_LOW_PRIORITY_MESSAGE_HANDLE    (IOTHUB_MESSAGE_HANDLE)0x56
+#define TEST_OUTBOX_DIRECTORY               "outbox"
+#define TEST_OUTBOX_RECORD_ID               0x0000000100000020ULL
 
 static const char* TEST_METHOD_NAME = "method_name";
 static const char* TEST_CHAR = "TestChar";
 static uint64_t g_current_ms = 0;
+static PDLIST_ENTRY g_waitingToSend; /*the list given to the transport in _Register*/
 
 static size_t g_fail_constbuffer_create;
 
@@ -300,7 +312,7 @@ static IOTHUB_DEVICE_HANDLE my_FAKE_IoTHubTransport_Register(TRANSPORT_LL_HANDLE
     (void)handle;
     (void)device;
     (void)iotHubClientHandle;
-    (void)waitingToSend;
+    g_waitingToSend = waitingToSend;
     return (IOTHUB_DEVICE_HANDLE)my_gballoc_malloc(1);
 }
 
@@ -309,6 +321,73 @@ static void my_FAKE_IoTHubTransport_Unregister(IOTHUB_DEVICE_HANDLE handle)
     my_gballoc_free(handle);
 }
 
+static void* my_IoTHubClient_BlockPool_Alloc(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle)
+{
+    (void)poolHandle;
+    return my_gballoc_malloc(sizeof(IOTHUB_MESSAGE_LIST));
+}
+
+static void my_IoTHubClient_BlockPool_Free(IOTHUB_CLIENT_BLOCK_POOL_HANDLE poolHandle, void* block)
+{
+    (void)poolHandle;
+    my_gballoc_free(block);
+}
+
+static size_t g_outboxPendingRecords; /*how many events IoTHubClient_Outbox_ForEachPending finds*/
+
+static int my_IoTHubClient_Outbox_ForEachPending(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK pendingCallback, void* context)
+{
+    size_t i;
+    (void)outboxHandle;
+    for (i = 0; i < g_outboxPendingRecords; i++)
+    {
+        pendingCallback(TEST_OUTBOX_RECORD_ID + i, context);
+    }
+    return 0;
+}
+
+static int my_IoTHubClient_Outbox_Append(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t* recordId)
+{
+    (void)outboxHandle;
+    (void)messageHandle;
+    *recordId = TEST_OUTBOX_RECORD_ID;
+    return 0;
+}
+
+static IOTHUB_CLIENT_OUTBOX_READ_RESULT my_IoTHubClient_Outbox_Read(IOTHUB_CLIENT_OUTBOX_HANDLE outboxHandle, uint64_t recordId, IOTHUB_MESSAGE_HANDLE* messageHandle)
+{
+    (void)outboxHandle;
+    /*the second pending event was sent with a high priority*/
+    *messageHandle = (recordId == TEST_OUTBOX_RECORD_ID + 1) ? TEST_HIGH_PRIORITY_MESSAGE_HANDLE : TEST_MESSAGE_HANDLE;
+    return IOTHUB_CLIENT_OUTBOX_READ_OK;
+}
+
+static IOTHUB_MESSAGE_PRIORITY my_IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+    if (iotHubMessageHandle == TEST_HIGH_PRIORITY_MESSAGE_HANDLE)
+    {
+        result = IOTHUB_MESSAGE_PRIORITY_HIGH;
+    }
+    else if (iotHubMessageHandle == TEST_LOW_PRIORITY_MESSAGE_HANDLE)
+    {
+        result = IOTHUB_MESSAGE_PRIORITY_LOW;
+    }
+    else
+    {
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    return result;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    (void)iotHubMessageHandle;
+    *buffer = (const unsigned char*)TEST_CHAR;
+    *size = TEST_MESSAGE_SIZE;
+    return IOTHUB_MESSAGE_OK;
+}
+
 static IOTHUB_CLIENT_RESULT my_FAKE_IoTHubTransport_GetSendStatus(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
 {
     (void)handle;
@@ -395,11 +474,18 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_TRANSPORT_PROVIDER, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_DEVICE_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_PRIORITY, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_DEVICE_TWIN_STATE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(CONSTBUFFER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_IDENTITY_TYPE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
 
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_BLOCK_POOL_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_OUTBOX_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_OUTBOX_PENDING_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_OUTBOX_READ_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_PROCESS_ITEM_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_STATUS, int);
@@ -448,6 +534,9 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Clone, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Clone, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentType, IOTHUBMESSAGE_BYTEARRAY);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetPriority, my_IoTHubMessage_GetPriority);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
 
     REGISTER_GLOBAL_MOCK_RETURN(get_time, (time_t)TEST_TIME_VALUE);
 
@@ -495,6 +584,27 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_GLOBAL_MOCK_RETURN(test_message_callback_async, IOTHUBMESSAGE_ACCEPTED);
     REGISTER_GLOBAL_MOCK_RETURN(messageCallback, IOTHUBMESSAGE_ACCEPTED);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_BlockPool_Create, TEST_BLOCK_POOL_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_BlockPool_Create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_BlockPool_Alloc, my_IoTHubClient_BlockPool_Alloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_BlockPool_Alloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_BlockPool_Free, my_IoTHubClient_BlockPool_Free);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_BlockPool_GetStatistics, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_BlockPool_GetStatistics, __LINE__);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_Outbox_Create, TEST_OUTBOX_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_Create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_Outbox_ForEachPending, my_IoTHubClient_Outbox_ForEachPending);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_ForEachPending, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_Outbox_Append, my_IoTHubClient_Outbox_Append);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_Append, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_Outbox_Read, my_IoTHubClient_Outbox_Read);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_Read, IOTHUB_CLIENT_OUTBOX_READ_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_Outbox_Complete, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_Complete, __LINE__);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_Outbox_Flush, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Outbox_Flush, __LINE__);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -1390,6 +1500,8 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_succeeds)
     STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+
     STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1474,9 +1586,15 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails)
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
     STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
     STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1484,7 +1602,7 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails)
     umock_c_negative_tests_snapshot();
 
     // act
-    size_t calls_cannot_fail[] = { 3 };
+    size_t calls_cannot_fail[] = { 2, 4, 5 };
     size_t count = umock_c_negative_tests_call_count();
     for (size_t index = 0; index < count; index++)
     {
@@ -1589,6 +1707,7 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_1_items_with_callback_succeeds)
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
+    one->pool = NULL;
     DList_InsertTailList(&temp, &(one->entry));
     umock_c_reset_all_calls();
 
@@ -1624,18 +1743,21 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback_succeeds)
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
+    one->pool = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
+    two->pool = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
+    three->pool = NULL;
     DList_InsertTailList(&temp, &(three->entry));
 
     umock_c_reset_all_calls();
@@ -1684,18 +1806,21 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback__but_batch
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
+    one->pool = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
+    two->pool = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
+    three->pool = NULL;
     DList_InsertTailList(&temp, &(three->entry));
 
 
@@ -1956,18 +2081,21 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_without_callback_suc
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = test_event_confirmation_callback;
     one->context = (void*)1;
+    one->pool = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = NULL;
     two->context = NULL;
+    two->pool = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
+    three->pool = NULL;
     DList_InsertTailList(&temp, &(three->entry));
 
     umock_c_reset_all_calls();
@@ -2015,18 +2143,21 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_with_callback_but_ba
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = NULL;
     one->context = NULL;
+    one->pool = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = NULL;
     two->context = NULL;
+    two->pool = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
+    three->pool = NULL;
     DList_InsertTailList(&temp, &(three->entry));
 
     umock_c_reset_all_calls();
@@ -2888,6 +3019,119 @@ TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_one_with_timeout_one_without_
     IoTHubClient_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_07_036: [ While every message has been given a timeout no earlier than the timeouts of the messages added before it, the messages in waitingToSend shall be considered sorted by timeout. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_038: [ When the messages in waitingToSend are sorted by timeout, IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has a timeout that has not expired. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_lowered_times_out_a_later_message_first) /*test wants to see that a message queued behind one that did not timeout yet still has its callback called*/
+{
+    //arrange
+
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    uint64_t hundred = 100;
+    (void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &hundred);
+
+    /*first message expires at 110, the second one at 11, both of these messages are send at time=10*/
+    uint64_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    uint64_t one = 1;
+    (void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+    umock_c_reset_all_calls();
+
+    uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout only for the second message*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)(TEST_DEVICEMESSAGE_HANDLE_2))); /*calling the callback*/
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+        .IgnoreArgument(1);
+
+    /*we don't care what happens in the Transport, so let's ignore all those calls*/
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_067: [ Once waitingToSend and the outbox backlog are empty, the timeouts of the messages that left them shall not be taken into account to decide whether the messages added afterwards are sorted by timeout. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_messageTimeout_checks_whether_waitingToSend_has_drained)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    uint64_t one = 1;
+    (void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(g_waitingToSend));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(g_waitingToSend, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_037: [ If no message has ever been given a timeout, IoTHubClient_LL_DoWork shall not look at waitingToSend for timed out messages. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_without_messageTimeout_does_not_timeout_messages)
+{
+    //arrange
+
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    umock_c_reset_all_calls();
+
+    uint64_t timeIsNow = 999999999999999ULL; /*some very big number*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+    /*we don't care what happens in the Transport, so let's ignore all those calls*/
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
 TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
 {
@@ -3572,4 +3816,1310 @@ TEST_FUNCTION(IoTHubClient_LL_SetDeviceTwinCallback_subscribe_fail)
     IoTHubClient_LL_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_07_021: [ If optionName is OPTION_MESSAGE_POOL_SIZE, IoTHubClient_LL_SetOption shall create a pool of that many waitingToSend records by calling IoTHubClient_BlockPool_Create. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_MessagePoolSize_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Create(sizeof(IOTHUB_MESSAGE_LIST), TEST_MESSAGE_POOL_SIZE));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_022: [ If the value of OPTION_MESSAGE_POOL_SIZE is 0, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_MessagePoolSize_zero_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 0;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_023: [ If the message pool has already been created, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_MessagePoolSize_twice_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_024: [ If IoTHubClient_BlockPool_Create fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_MessagePoolSize_BlockPool_Create_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Create(sizeof(IOTHUB_MESSAGE_LIST), TEST_MESSAGE_POOL_SIZE))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_025: [ If the message pool has been created, IoTHubClient_LL_SendEventAsync shall allocate the waitingToSend record by calling IoTHubClient_BlockPool_Alloc. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_message_pool_allocates_from_the_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Alloc(TEST_BLOCK_POOL_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_025: [ If the message pool has been created, IoTHubClient_LL_SendEventAsync shall allocate the waitingToSend record by calling IoTHubClient_BlockPool_Alloc. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_message_pool_fails_when_BlockPool_Alloc_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Alloc(TEST_BLOCK_POOL_HANDLE))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_026: [ A record allocated from the message pool shall be returned to it by calling IoTHubClient_BlockPool_Free. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_returns_pooled_record_to_the_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    DLIST_ENTRY temp;
+    DList_InitializeListHead(&temp);
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->callback = eventConfirmationCallback;
+    one->context = (void*)1;
+    one->pool = TEST_BLOCK_POOL_HANDLE;
+    DList_InsertTailList(&temp, &(one->entry));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Free(TEST_BLOCK_POOL_HANDLE, one));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_029: [ IoTHubClient_LL_Destroy shall destroy the message pool, if any, by calling IoTHubClient_BlockPool_Destroy. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_destroys_the_message_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_Destroy(TEST_BLOCK_POOL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#endif
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClient_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_027: [ If iotHubClientHandle or statistics is NULL, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStatistics_with_NULL_handle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetMessagePoolStatistics(NULL, &statistics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_027: [ If iotHubClientHandle or statistics is NULL, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStatistics_with_NULL_statistics_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetMessagePoolStatistics(handle, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_028: [ If the message pool has not been created, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStatistics_without_message_pool_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetMessagePoolStatistics(handle, &statistics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_030: [ IoTHubClient_LL_GetMessagePoolStatistics shall fill statistics by calling IoTHubClient_BlockPool_GetStatistics and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStatistics_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS expected = { TEST_MESSAGE_POOL_SIZE, 2, 3, 7, 1 };
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_GetStatistics(TEST_BLOCK_POOL_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_statistics(&expected, sizeof(expected));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetMessagePoolStatistics(handle, &statistics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, TEST_MESSAGE_POOL_SIZE, statistics.capacity);
+    ASSERT_ARE_EQUAL(size_t, 2, statistics.inUse);
+    ASSERT_ARE_EQUAL(size_t, 3, statistics.highWatermark);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.fallbacks);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_031: [ If IoTHubClient_BlockPool_GetStatistics fails, IoTHubClient_LL_GetMessagePoolStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStatistics_fails_when_BlockPool_GetStatistics_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t poolSize = TEST_MESSAGE_POOL_SIZE;
+    IOTHUB_CLIENT_BLOCK_POOL_STATISTICS statistics;
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_BlockPool_GetStatistics(TEST_BLOCK_POOL_HANDLE, IGNORED_PTR_ARG))
+        .SetReturn(__LINE__);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetMessagePoolStatistics(handle, &statistics);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_032: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(NULL, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_032: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_messageHandle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, NULL, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_032: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_callback_and_non_NULL_context_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, NULL, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_034: [ IoTHubClient_LL_SendEventAsync_Move shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it, eventConfirmationCallback and userContextCallback. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_succeeds_without_cloning_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_033: [ Upon success eventMessageHandle shall belong to IoTHubClient_LL, which shall destroy it once its eventConfirmationCallback has been called. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_after_SendEventAsync_Move_destroys_the_moved_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#endif
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClient_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_035: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR and eventMessageHandle shall still belong to the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_fails_when_malloc_fails_and_does_not_destroy_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_035: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR and eventMessageHandle shall still belong to the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_fails_when_tickcounter_fails_and_does_not_destroy_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    uint64_t thisIsNotZero = 312984751;
+    (void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &thisIsNotZero);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+static IOTHUB_CLIENT_LL_HANDLE create_with_send_queue_limits(size_t maxQueuedMessages, size_t maxQueuedBytes, IOTHUB_CLIENT_QUEUE_FULL_POLICY policy)
+{
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MAX_QUEUED_MESSAGES, &maxQueuedMessages);
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_MAX_QUEUED_BYTES, &maxQueuedBytes);
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_QUEUE_FULL_POLICY, &policy);
+    return handle;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_039: [ If optionName is OPTION_MAX_QUEUED_MESSAGES, IoTHubClient_LL_SetOption shall limit the number of messages accepted and not yet confirmed to value, a pointer to a size_t; 0 means no limit. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_042: [ While OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES is set, the size of the payload of the message shall be obtained by calling IoTHubMessage_GetContentType and IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_043: [ Otherwise, if the message does not fit, it shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_full_send_queue_returns_QUEUE_FULL)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(1, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_043: [ Otherwise, if the message does not fit, it shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_full_send_queue_returns_QUEUE_FULL_and_does_not_destroy_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(0, TEST_MESSAGE_SIZE - 1, IOTHUB_CLIENT_QUEUE_FULL_BLOCK);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_045: [ If the message does not fit and the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST, the message shall not be queued, eventConfirmationCallback shall be called with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED and IOTHUB_CLIENT_OK shall be returned. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_full_send_queue_and_DROP_NEWEST_drops_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(1, 0, IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)2));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_045: [ If the message does not fit and the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST, the message shall not be queued, eventConfirmationCallback shall be called with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED and IOTHUB_CLIENT_OK shall be returned. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_full_send_queue_and_DROP_NEWEST_destroys_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(0, TEST_MESSAGE_SIZE - 1, IOTHUB_CLIENT_QUEUE_FULL_DROP_NEWEST);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_MESSAGE_HANDLE));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_040: [ If optionName is OPTION_MAX_QUEUED_BYTES, IoTHubClient_LL_SetOption shall limit the payload bytes of the messages accepted and not yet confirmed to value, a pointer to a size_t; 0 means no limit. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_044: [ If the message does not fit and the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST, the oldest messages in waitingToSend shall be removed and have their callbacks called with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED until the message fits. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_full_send_queue_and_DROP_OLDEST_drops_the_oldest_message)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(0, 2 * TEST_MESSAGE_SIZE, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_041: [ If optionName is OPTION_QUEUE_FULL_POLICY, value is a pointer to an IOTHUB_CLIENT_QUEUE_FULL_POLICY; if it is not one of the policies IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_QueueFullPolicy_with_invalid_policy_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = (IOTHUB_CLIENT_QUEUE_FULL_POLICY)42;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_QUEUE_FULL_POLICY, &policy);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_047: [ If iotHubClientHandle, messageCount or byteCount is NULL, IoTHubClient_LL_GetSendQueueDepth shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueDepth_with_NULL_handle_fails)
+{
+    //arrange
+    size_t messageCount;
+    size_t byteCount;
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendQueueDepth(NULL, &messageCount, &byteCount);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_047: [ If iotHubClientHandle, messageCount or byteCount is NULL, IoTHubClient_LL_GetSendQueueDepth shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueDepth_with_NULL_counts_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t count;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_GetSendQueueDepth(handle, NULL, &count);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_GetSendQueueDepth(handle, &count, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_048: [ IoTHubClient_LL_GetSendQueueDepth shall set messageCount to the number of messages accepted and not yet confirmed, byteCount to their measured payload bytes and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueDepth_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(10, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    size_t messageCount;
+    size_t byteCount;
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendQueueDepth(handle, &messageCount, &byteCount);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 2, messageCount);
+    ASSERT_ARE_EQUAL(size_t, 2 * TEST_MESSAGE_SIZE, byteCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_046: [ A message shall stop counting against the limits once its confirmation callback has been called. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_releases_the_message_from_the_send_queue)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(1, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    DLIST_ENTRY temp;
+    size_t messageCount;
+    size_t byteCount;
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    DList_InitializeListHead(&temp);
+    DList_InsertTailList(&temp, DList_RemoveHeadList(g_waitingToSend)); /*this is what the transport does: it takes the message from waitingToSend*/
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClient_LL_GetSendQueueDepth(handle, &messageCount, &byteCount));
+    ASSERT_ARE_EQUAL(size_t, 0, messageCount);
+    ASSERT_ARE_EQUAL(size_t, 0, byteCount);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2));
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+static IOTHUB_CLIENT_LL_HANDLE create_with_outbox(void)
+{
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SetOption(handle, OPTION_OUTBOX_DIRECTORY, TEST_OUTBOX_DIRECTORY);
+    return handle;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_049: [ If optionName is OPTION_OUTBOX_DIRECTORY, IoTHubClient_LL_SetOption shall create an outbox in the directory value, a const char*, by calling IoTHubClient_Outbox_Create and get its pending events by calling IoTHubClient_Outbox_ForEachPending. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_051: [ Every event left pending in the outbox shall be added to the outbox backlog, in the order it was sent, with no confirmation callback and no timeout. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_OutboxDirectory_creates_the_outbox_and_queues_its_pending_events)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t messageCount;
+    size_t byteCount;
+    g_outboxPendingRecords = 1;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_ForEachPending(TEST_OUTBOX_HANDLE, IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_OUTBOX_DIRECTORY, TEST_OUTBOX_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    (void)IoTHubClient_LL_GetSendQueueDepth(handle, &messageCount, &byteCount);
+    ASSERT_ARE_EQUAL(size_t, 1, messageCount);
+
+    //cleanup
+    g_outboxPendingRecords = 0;
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_052: [ If IoTHubClient_Outbox_Create or IoTHubClient_Outbox_ForEachPending fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR and no outbox shall be used. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_OutboxDirectory_fails_when_Outbox_Create_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments()
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_OUTBOX_DIRECTORY, TEST_OUTBOX_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_052: [ If IoTHubClient_Outbox_Create or IoTHubClient_Outbox_ForEachPending fails, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR and no outbox shall be used. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_OutboxDirectory_fails_when_Outbox_ForEachPending_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_ForEachPending(TEST_OUTBOX_HANDLE, IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(2)
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Destroy(TEST_OUTBOX_HANDLE));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_OUTBOX_DIRECTORY, TEST_OUTBOX_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_050: [ If the outbox has already been created, or any event has been sent and not confirmed yet, IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_OutboxDirectory_after_SendEventAsync_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(handle, OPTION_OUTBOX_DIRECTORY, TEST_OUTBOX_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_053: [ While the outbox is used, IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall append eventMessageHandle to it by calling IoTHubClient_Outbox_Append and add the record to the outbox backlog without a message, instead of adding it to waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_outbox_appends_the_message_instead_of_cloning_it)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Append(TEST_OUTBOX_HANDLE, TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(DList_IsListEmpty(g_waitingToSend));
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_054: [ If IoTHubClient_Outbox_Append fails, IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_outbox_fails_when_Outbox_Append_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Append(TEST_OUTBOX_HANDLE, TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_058: [ IoTHubClient_LL_DoWork shall keep up to 16 events of the outbox in waitingToSend by moving the oldest records of the outbox backlog there, with the message read back by calling IoTHubClient_Outbox_Read. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_07_060: [ IoTHubClient_LL_DoWork shall then write the events appended and completed since the previous call to the outbox by calling IoTHubClient_Outbox_Flush once. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_outbox_reads_the_events_back_and_flushes_the_outbox)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Read(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(g_waitingToSend, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Flush(TEST_OUTBOX_HANDLE));
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(DList_IsListEmpty(g_waitingToSend));
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_062: [ If IoTHubClient_Outbox_Read returns IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD, the confirmation callback of the event shall be called with IOTHUB_CLIENT_CONFIRMATION_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_outbox_drops_an_event_whose_record_is_not_valid)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Read(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Complete(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Flush(TEST_OUTBOX_HANDLE));
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(DList_IsListEmpty(g_waitingToSend));
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_068: [ If IoTHubClient_Outbox_Read returns IOTHUB_CLIENT_OUTBOX_READ_ERROR, the record shall be put back at the head of the outbox backlog and read again by the next call to IoTHubClient_LL_DoWork. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_outbox_keeps_an_event_that_cannot_be_read_yet)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Read(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(IOTHUB_CLIENT_OUTBOX_READ_ERROR);
+    STRICT_EXPECTED_CALL(DList_InsertHeadList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Flush(TEST_OUTBOX_HANDLE));
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Read(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(g_waitingToSend, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Flush(TEST_OUTBOX_HANDLE));
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+    IoTHubClient_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(DList_IsListEmpty(g_waitingToSend));
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_071: [ The record shall be added to waitingToSend like the records of IoTHubClient_LL_SendEventAsync, with the priority of the message read back obtained by calling IoTHubMessage_GetPriority. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_outbox_puts_the_events_read_back_in_their_priority_lane)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle;
+    size_t messageCount;
+    size_t byteCount;
+    g_outboxPendingRecords = 2;
+    handle = create_with_outbox();
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(void_ptr, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_MESSAGE_HANDLE, containingRecord(g_waitingToSend->Blink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+    (void)IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, &messageCount, &byteCount);
+    ASSERT_ARE_EQUAL(size_t, 1, messageCount);
+    (void)IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, &messageCount, &byteCount);
+    ASSERT_ARE_EQUAL(size_t, 1, messageCount);
+
+    //cleanup
+    g_outboxPendingRecords = 0;
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_056: [ Once the confirmation callback of an event of the outbox has been called with any result but IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, the event shall be completed by calling IoTHubClient_Outbox_Complete. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_outbox_completes_the_event)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    DLIST_ENTRY temp;
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    IoTHubClient_LL_DoWork(handle);
+    DList_InitializeListHead(&temp);
+    DList_InsertTailList(&temp, DList_RemoveHeadList(g_waitingToSend)); /*this is what the transport does: it takes the message from waitingToSend*/
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Complete(TEST_OUTBOX_HANDLE, TEST_OUTBOX_RECORD_ID));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_059: [ IoTHubClient_LL_Destroy shall complete the callbacks of the outbox backlog with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY and destroy the outbox by calling IoTHubClient_Outbox_Destroy, leaving the events that were not confirmed in it. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_with_outbox_leaves_the_events_in_the_outbox)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_outbox();
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubClient_Outbox_Destroy(TEST_OUTBOX_HANDLE));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+#endif
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClient_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_063: [ The record shall be added to waitingToSend after every record of the same or a higher priority and before every record of a lower priority, the priority being obtained by calling IoTHubMessage_GetPriority. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_high_priority_goes_ahead_of_normal_priority_messages)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_HIGH_PRIORITY_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_HIGH_PRIORITY_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, (void*)2, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->context);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)3, containingRecord(g_waitingToSend->Flink->Flink, IOTHUB_MESSAGE_LIST, entry)->context);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, containingRecord(g_waitingToSend->Blink, IOTHUB_MESSAGE_LIST, entry)->context);
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_063: [ The record shall be added to waitingToSend after every record of the same or a higher priority and before every record of a lower priority, the priority being obtained by calling IoTHubMessage_GetPriority. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_normal_priority_goes_ahead_of_low_priority_messages)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_LOW_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)2, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->context);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, containingRecord(g_waitingToSend->Blink, IOTHUB_MESSAGE_LIST, entry)->context);
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_066: [ IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST shall drop the oldest events of the lowest priority in waitingToSend first. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_DROP_OLDEST_drops_the_oldest_message_of_the_lowest_priority)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(2, 0, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->context);
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_069: [ A record added to waitingToSend shall keep the messages sorted by timeout if its timeout is no earlier than the timeout of the nearest record before it and no later than the timeout of the nearest record after it, records without a timeout being skipped. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_times_out_a_message_behind_a_higher_priority_message_that_did_not_time_out)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    uint64_t timeout = 10;
+    uint64_t sendTime1 = 10;
+    uint64_t sendTime2 = 15;
+    (void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &timeout);
+
+    /*the first message expires at 20, the second one at 25 but goes ahead of the first one*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &sendTime1, sizeof(sendTime1));
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &sendTime2, sizeof(sendTime2));
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    uint64_t timeIsNow = 22;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClient_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_064: [ If iotHubClientHandle, messageCount or byteCount is NULL, or priority is not one of the IOTHUB_MESSAGE_PRIORITY values, IoTHubClient_LL_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueDepthByPriority_with_invalid_arguments_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t count;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_GetSendQueueDepthByPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH, &count, &count);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, NULL, &count);
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, &count, NULL);
+    IOTHUB_CLIENT_RESULT result4 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, (IOTHUB_MESSAGE_PRIORITY)42, &count, &count);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result4);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_07_065: [ IoTHubClient_LL_GetSendQueueDepthByPriority shall set messageCount and byteCount to the part of the counts of IoTHubClient_LL_GetSendQueueDepth made of messages of that priority and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueDepthByPriority_counts_the_messages_of_each_priority)
+{
+    //arrange
+    IOTHUB_CLIENT_LL_HANDLE handle = create_with_send_queue_limits(10, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    size_t highCount;
+    size_t highBytes;
+    size_t normalCount;
+    size_t normalBytes;
+    size_t lowCount;
+    size_t lowBytes;
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_HIGH_PRIORITY_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    (void)IoTHubClient_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, &highCount, &highBytes);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, &normalCount, &normalBytes);
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClient_LL_GetSendQueueDepthByPriority(handle, IOTHUB_MESSAGE_PRIORITY_LOW, &lowCount, &lowBytes);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result3);
+    ASSERT_ARE_EQUAL(size_t, 1, highCount);
+    ASSERT_ARE_EQUAL(size_t, TEST_MESSAGE_SIZE, highBytes);
+    ASSERT_ARE_EQUAL(size_t, 2, normalCount);
+    ASSERT_ARE_EQUAL(size_t, 2 * TEST_MESSAGE_SIZE, normalBytes);
+    ASSERT_ARE_EQUAL(size_t, 0, lowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, lowBytes);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClient_LL_Destroy(handle);
+}
+
 END_TEST_SUITE(iothubclient_ll_ut)
@@ -0,0 +1,902 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/map.h"
+#include "iothub_message.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothub_client_outbox.h"
+
+#define TEST_DIRECTORY          "."
+#define TEST_SEGMENT_SIZE       4096
+#define TEST_MAX_PROPERTIES     4
+#define TEST_MAX_SEGMENTS       10
+
+static const unsigned char TEST_PAYLOAD[] = { 0x01, 0x00, 0x02, 0xFF };
+
+/*a message good enough for the outbox to write and read back*/
+typedef struct TEST_MESSAGE_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    unsigned char* payload;
+    size_t payloadSize;
+    char* messageId;
+    char* correlationId;
+    char* keys[TEST_MAX_PROPERTIES];
+    char* values[TEST_MAX_PROPERTIES];
+    size_t propertyCount;
+    IOTHUB_MESSAGE_PRIORITY priority;
+} TEST_MESSAGE;
+
+static char* copy_string(const char* source)
+{
+    char* result = (char*)malloc(strlen(source) + 1);
+    (void)strcpy(result, source);
+    return result;
+}
+
+static TEST_MESSAGE* create_test_message(IOTHUBMESSAGE_CONTENT_TYPE contentType, const unsigned char* payload, size_t payloadSize)
+{
+    TEST_MESSAGE* result = (TEST_MESSAGE*)malloc(sizeof(TEST_MESSAGE));
+    (void)memset(result, 0, sizeof(TEST_MESSAGE));
+    result->contentType = contentType;
+    result->payload = (unsigned char*)malloc(payloadSize + 1);
+    (void)memcpy(result->payload, payload, payloadSize);
+    result->payload[payloadSize] = '\0';
+    result->payloadSize = payloadSize;
+    result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    return result;
+}
+
+static IOTHUB_MESSAGE_HANDLE my_IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray, size_t size)
+{
+    return (IOTHUB_MESSAGE_HANDLE)create_test_message(IOTHUBMESSAGE_BYTEARRAY, byteArray, size);
+}
+
+static IOTHUB_MESSAGE_HANDLE my_IoTHubMessage_CreateFromString(const char* source)
+{
+    return (IOTHUB_MESSAGE_HANDLE)create_test_message(IOTHUBMESSAGE_STRING, (const unsigned char*)source, strlen(source));
+}
+
+static IOTHUBMESSAGE_CONTENT_TYPE my_IoTHubMessage_GetContentType(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->contentType;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    *buffer = ((TEST_MESSAGE*)iotHubMessageHandle)->payload;
+    *size = ((TEST_MESSAGE*)iotHubMessageHandle)->payloadSize;
+    return IOTHUB_MESSAGE_OK;
+}
+
+static const char* my_IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return (const char*)((TEST_MESSAGE*)iotHubMessageHandle)->payload;
+}
+
+static MAP_HANDLE my_IoTHubMessage_Properties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    /*the message is its own property map*/
+    return (MAP_HANDLE)iotHubMessageHandle;
+}
+
+static const char* my_IoTHubMessage_GetMessageId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->messageId;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_SetMessageId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* messageId)
+{
+    ((TEST_MESSAGE*)iotHubMessageHandle)->messageId = copy_string(messageId);
+    return IOTHUB_MESSAGE_OK;
+}
+
+static const char* my_IoTHubMessage_GetCorrelationId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->correlationId;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_SetCorrelationId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* correlationId)
+{
+    ((TEST_MESSAGE*)iotHubMessageHandle)->correlationId = copy_string(correlationId);
+    return IOTHUB_MESSAGE_OK;
+}
+
+static IOTHUB_MESSAGE_PRIORITY my_IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->priority;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    ((TEST_MESSAGE*)iotHubMessageHandle)->priority = priority;
+    return IOTHUB_MESSAGE_OK;
+}
+
+static void my_IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    TEST_MESSAGE* message = (TEST_MESSAGE*)iotHubMessageHandle;
+    if (message != NULL)
+    {
+        size_t i;
+        for (i = 0; i < message->propertyCount; i++)
+        {
+            free(message->keys[i]);
+            free(message->values[i]);
+        }
+        free(message->messageId);
+        free(message->correlationId);
+        free(message->payload);
+        free(message);
+    }
+}
+
+static MAP_RESULT my_Map_GetInternals(MAP_HANDLE handle, const char*const** keys, const char*const** values, size_t* count)
+{
+    TEST_MESSAGE* message = (TEST_MESSAGE*)handle;
+    *keys = (const char*const*)message->keys;
+    *values = (const char*const*)message->values;
+    *count = message->propertyCount;
+    return MAP_OK;
+}
+
+static MAP_RESULT my_Map_AddOrUpdate(MAP_HANDLE handle, const char* key, const char* value)
+{
+    MAP_RESULT result;
+    TEST_MESSAGE* message = (TEST_MESSAGE*)handle;
+    if (message->propertyCount == TEST_MAX_PROPERTIES)
+    {
+        result = MAP_ERROR;
+    }
+    else
+    {
+        message->keys[message->propertyCount] = copy_string(key);
+        message->values[message->propertyCount] = copy_string(value);
+        message->propertyCount++;
+        result = MAP_OK;
+    }
+    return result;
+}
+
+static TEST_MESSAGE* create_full_test_message(void)
+{
+    TEST_MESSAGE* result = (TEST_MESSAGE*)my_IoTHubMessage_CreateFromByteArray(TEST_PAYLOAD, sizeof(TEST_PAYLOAD));
+    (void)my_IoTHubMessage_SetMessageId((IOTHUB_MESSAGE_HANDLE)result, "message id");
+    (void)my_IoTHubMessage_SetCorrelationId((IOTHUB_MESSAGE_HANDLE)result, "correlation id");
+    (void)my_Map_AddOrUpdate((MAP_HANDLE)result, "key1", "value1");
+    (void)my_Map_AddOrUpdate((MAP_HANDLE)result, "key2", "");
+    result->priority = IOTHUB_MESSAGE_PRIORITY_HIGH;
+    return result;
+}
+
+static uint64_t g_pendingRecords[TEST_MAX_SEGMENTS];
+static size_t g_pendingRecordCount;
+
+static void on_pending_record(uint64_t recordId, void* context)
+{
+    (void)context;
+    if (g_pendingRecordCount < TEST_MAX_SEGMENTS)
+    {
+        g_pendingRecords[g_pendingRecordCount] = recordId;
+    }
+    g_pendingRecordCount++;
+}
+
+static void get_segment_file_name(char* fileName, unsigned long segmentIndex)
+{
+    (void)sprintf(fileName, "%s/iothub_outbox_%010lu.log", TEST_DIRECTORY, segmentIndex);
+}
+
+static int segment_file_exists(unsigned long segmentIndex)
+{
+    char fileName[64];
+    FILE* segmentFile;
+    get_segment_file_name(fileName, segmentIndex);
+    segmentFile = fopen(fileName, "rb");
+    if (segmentFile != NULL)
+    {
+        (void)fclose(segmentFile);
+    }
+    return (segmentFile != NULL);
+}
+
+static void delete_outbox_files(void)
+{
+    char fileName[64];
+    unsigned long i;
+    for (i = 0; i < TEST_MAX_SEGMENTS; i++)
+    {
+        get_segment_file_name(fileName, i);
+        (void)remove(fileName);
+    }
+    (void)remove(TEST_DIRECTORY "/iothub_outbox.head");
+    (void)remove(TEST_DIRECTORY "/iothub_outbox.head.new");
+}
+
+/*flips a byte of the body of the first record of the segment, the body follows the 16 bytes of the header*/
+static void corrupt_first_record(unsigned long segmentIndex)
+{
+    char fileName[64];
+    FILE* segmentFile;
+    int byte;
+    get_segment_file_name(fileName, segmentIndex);
+    segmentFile = fopen(fileName, "r+b");
+    ASSERT_IS_NOT_NULL(segmentFile);
+    ASSERT_ARE_EQUAL(int, 0, fseek(segmentFile, 16, SEEK_SET));
+    byte = fgetc(segmentFile);
+    ASSERT_ARE_EQUAL(int, 0, fseek(segmentFile, 16, SEEK_SET));
+    (void)fputc(byte ^ 0xFF, segmentFile);
+    (void)fclose(segmentFile);
+}
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubclient_outbox_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_PRIORITY, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_CreateFromByteArray, my_IoTHubMessage_CreateFromByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_CreateFromString, my_IoTHubMessage_CreateFromString);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetContentType, my_IoTHubMessage_GetContentType);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetString, my_IoTHubMessage_GetString);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Properties, my_IoTHubMessage_Properties);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetMessageId, my_IoTHubMessage_GetMessageId);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_SetMessageId, my_IoTHubMessage_SetMessageId);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetCorrelationId, my_IoTHubMessage_GetCorrelationId);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_SetCorrelationId, my_IoTHubMessage_SetCorrelationId);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetPriority, my_IoTHubMessage_GetPriority);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_SetPriority, my_IoTHubMessage_SetPriority);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Destroy, my_IoTHubMessage_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_GetInternals, my_Map_GetInternals);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_AddOrUpdate, my_Map_AddOrUpdate);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    delete_outbox_files();
+    g_pendingRecordCount = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    delete_outbox_files();
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_001: [ If directory is NULL, or segmentSize is 0 or greater than 0x7FFFFFFF, IoTHubClient_Outbox_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Create_with_NULL_directory_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_HANDLE result = IoTHubClient_Outbox_Create(NULL, TEST_SEGMENT_SIZE);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_001: [ If directory is NULL, or segmentSize is 0 or greater than 0x7FFFFFFF, IoTHubClient_Outbox_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Create_with_0_segmentSize_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_HANDLE result = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 0);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_004: [ IoTHubClient_Outbox_Create shall create a new segment to append to after the existing ones. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Create_in_an_empty_directory_succeeds)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_HANDLE result = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_IS_TRUE(segment_file_exists(0));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_ForEachPending(result, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 0, g_pendingRecordCount);
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_002: [ If any resource cannot be allocated or the segment to append to cannot be created, IoTHubClient_Outbox_Create shall return NULL. ]*/
+TEST_FUNCTION(when_allocating_fails_IoTHubClient_Outbox_Create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_Outbox_Create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_OUTBOX_HANDLE result = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_005: [ If outboxHandle is NULL, IoTHubClient_Outbox_Destroy shall do nothing, otherwise it shall flush and close the segment files and free the outbox; the pending records stay in the directory. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClient_Outbox_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_007: [ If outboxHandle or pendingCallback is NULL, IoTHubClient_Outbox_ForEachPending shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_ForEachPending_with_NULL_pendingCallback_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_ForEachPending(outbox, NULL, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_009: [ If outboxHandle, messageHandle or recordId is NULL, IoTHubClient_Outbox_Append shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Append_with_NULL_messageHandle_fails)
+{
+    ///arrange
+    uint64_t recordId;
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_Append(outbox, NULL, &recordId);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_010: [ IoTHubClient_Outbox_Append shall write a pending record holding the content type, priority, payload, message id, correlation id and properties of messageHandle at the end of the segment appended to, and set recordId to the segment index in the upper 32 bits and the offset of the record in the lower 32 bits. ]*/
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_014: [ IoTHubClient_Outbox_Read shall set messageHandle to a new message with the content type, priority, payload, message id, correlation id and properties stored in the record and return IOTHUB_CLIENT_OUTBOX_READ_OK. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Read_returns_the_appended_message)
+{
+    ///arrange
+    uint64_t recordId;
+    TEST_MESSAGE* result;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT readResult = IoTHubClient_Outbox_Read(outbox, recordId, (IOTHUB_MESSAGE_HANDLE*)&result);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_OK, (int)readResult);
+    ASSERT_ARE_EQUAL(uint64_t, 0, recordId);
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUBMESSAGE_BYTEARRAY, (int)result->contentType);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_PAYLOAD), result->payloadSize);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_PAYLOAD, result->payload, sizeof(TEST_PAYLOAD)));
+    ASSERT_ARE_EQUAL(char_ptr, "message id", result->messageId);
+    ASSERT_ARE_EQUAL(char_ptr, "correlation id", result->correlationId);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_HIGH, (int)result->priority);
+    ASSERT_ARE_EQUAL(size_t, 2, result->propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, "key1", result->keys[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "value1", result->values[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "key2", result->keys[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "", result->values[1]);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)result);
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_014: [ IoTHubClient_Outbox_Read shall set messageHandle to a new message with the content type, priority, payload, message id, correlation id and properties stored in the record and return IOTHUB_CLIENT_OUTBOX_READ_OK. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Read_returns_an_appended_string_message)
+{
+    ///arrange
+    uint64_t recordId;
+    TEST_MESSAGE* result;
+    TEST_MESSAGE* message = (TEST_MESSAGE*)my_IoTHubMessage_CreateFromString("some text");
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT readResult = IoTHubClient_Outbox_Read(outbox, recordId, (IOTHUB_MESSAGE_HANDLE*)&result);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_OK, (int)readResult);
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUBMESSAGE_STRING, (int)result->contentType);
+    ASSERT_ARE_EQUAL(char_ptr, "some text", (const char*)result->payload);
+    ASSERT_IS_NULL(result->messageId);
+    ASSERT_IS_NULL(result->correlationId);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)result->priority);
+    ASSERT_ARE_EQUAL(size_t, 0, result->propertyCount);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)result);
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_020: [ If outboxHandle or messageHandle is NULL, IoTHubClient_Outbox_Read shall return IOTHUB_CLIENT_OUTBOX_READ_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Read_with_NULL_messageHandle_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result = IoTHubClient_Outbox_Read(outbox, 0, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_ERROR, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_012: [ If recordId is not the id of a record of the outbox, or the record is cut short, its checksum does not match or it does not hold a message, IoTHubClient_Outbox_Read shall set messageHandle to NULL and return IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Read_with_an_unknown_recordId_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result = IoTHubClient_Outbox_Read(outbox, ((uint64_t)5) << 32, &messageHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD, (int)result);
+    ASSERT_IS_NULL(messageHandle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_012: [ If recordId is not the id of a record of the outbox, or the record is cut short, its checksum does not match or it does not hold a message, IoTHubClient_Outbox_Read shall set messageHandle to NULL and return IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Read_of_a_corrupted_record_fails)
+{
+    ///arrange
+    uint64_t recordId;
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Flush(outbox));
+    corrupt_first_record(0);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result = IoTHubClient_Outbox_Read(outbox, recordId, &messageHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_INVALID_RECORD, (int)result);
+    ASSERT_IS_NULL(messageHandle);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_021: [ If the record cannot be read because of an I/O error or any other failure, IoTHubClient_Outbox_Read shall set messageHandle to NULL and return IOTHUB_CLIENT_OUTBOX_READ_ERROR. ]*/
+TEST_FUNCTION(when_the_message_cannot_be_created_IoTHubClient_Outbox_Read_fails_with_IOTHUB_CLIENT_OUTBOX_READ_ERROR)
+{
+    ///arrange
+    uint64_t recordId;
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_PAYLOAD)))
+        .IgnoreArgument(1)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_OUTBOX_READ_RESULT result = IoTHubClient_Outbox_Read(outbox, recordId, &messageHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OUTBOX_READ_ERROR, (int)result);
+    ASSERT_IS_NULL(messageHandle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_015: [ If outboxHandle is NULL, or recordId is not the id of a pending record of the outbox, IoTHubClient_Outbox_Complete shall fail and return a non-zero value. ]*/
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_016: [ IoTHubClient_Outbox_Complete shall overwrite the state of the record in place with completed. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Complete_of_a_completed_record_fails)
+{
+    ///arrange
+    uint64_t recordId;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Complete(outbox, recordId));
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_Complete(outbox, recordId);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 0, g_pendingRecordCount);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_003: [ IoTHubClient_Outbox_Create shall read the index of the first segment from the head file of directory, or use 0 if there is none, and count the pending records of that segment and of every segment that follows it. ]*/
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_005: [ If outboxHandle is NULL, IoTHubClient_Outbox_Destroy shall do nothing, otherwise it shall flush and close the segment files and free the outbox; the pending records stay in the directory. ]*/
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_008: [ IoTHubClient_Outbox_ForEachPending shall call pendingCallback with the record id of every pending record, segment after segment, in the order the records were appended. ]*/
+TEST_FUNCTION(the_pending_records_are_found_by_the_next_outbox)
+{
+    ///arrange
+    uint64_t recordIds[3];
+    size_t i;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    for (i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[i]));
+    }
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Complete(outbox, recordIds[1]));
+    IoTHubClient_Outbox_Destroy(outbox);
+    umock_c_reset_all_calls();
+
+    ///act
+    outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    int result = IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(outbox);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_pendingRecordCount);
+    ASSERT_ARE_EQUAL(uint64_t, recordIds[0], g_pendingRecords[0]);
+    ASSERT_ARE_EQUAL(uint64_t, recordIds[2], g_pendingRecords[1]);
+    ASSERT_IS_TRUE(segment_file_exists(1));
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_006: [ Appends shall go to a new segment once the segment appended to has reached segmentSize bytes. ]*/
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_013: [ Once the first segment has no pending record and is not the segment appended to, its file shall be deleted, after the index of the new first segment has been written to the head file. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Complete_deletes_the_completed_segments)
+{
+    ///arrange
+    uint64_t recordIds[2];
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 1);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[0]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[1]));
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_Complete(outbox, recordIds[0]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(uint64_t, ((uint64_t)1) << 32, recordIds[1]);
+    ASSERT_IS_FALSE(segment_file_exists(0));
+    ASSERT_IS_TRUE(segment_file_exists(1));
+
+    ///cleanup
+    IoTHubClient_Outbox_Destroy(outbox);
+
+    outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 1);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 1, g_pendingRecordCount);
+    ASSERT_ARE_EQUAL(uint64_t, recordIds[1], g_pendingRecords[0]);
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_003: [ IoTHubClient_Outbox_Create shall read the index of the first segment from the head file of directory, or use 0 if there is none, and count the pending records of that segment and of every segment that follows it. ]*/
+TEST_FUNCTION(a_torn_record_is_not_pending)
+{
+    ///arrange
+    uint64_t recordId;
+    char fileName[64];
+    FILE* segmentFile;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    IoTHubClient_Outbox_Destroy(outbox);
+
+    /*the header of a second record, cut short*/
+    get_segment_file_name(fileName, 0);
+    segmentFile = fopen(fileName, "ab");
+    ASSERT_IS_NOT_NULL(segmentFile);
+    (void)fwrite("IHOB", 1, 4, segmentFile);
+    (void)fclose(segmentFile);
+    umock_c_reset_all_calls();
+
+    ///act
+    outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    int result = IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_pendingRecordCount);
+    ASSERT_ARE_EQUAL(uint64_t, recordId, g_pendingRecords[0]);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_003: [ IoTHubClient_Outbox_Create shall read the index of the first segment from the head file of directory, or use 0 if there is none, and count the pending records of that segment and of every segment that follows it. ]*/
+TEST_FUNCTION(a_record_that_does_not_match_its_checksum_is_not_pending)
+{
+    ///arrange
+    uint64_t recordId;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    IoTHubClient_Outbox_Destroy(outbox);
+    corrupt_first_record(0);
+    umock_c_reset_all_calls();
+
+    ///act
+    outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    int result = IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(outbox);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_pendingRecordCount);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_019: [ The head file shall be replaced by renaming a new head file, written and synced beforehand, over it. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Complete_replaces_the_head_file)
+{
+    ///arrange
+    uint64_t recordIds[3];
+    FILE* headFile;
+    unsigned long firstSegmentIndex = 0;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 1);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[0]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[1]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[2]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Complete(outbox, recordIds[0]));
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_Complete(outbox, recordIds[1]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    headFile = fopen(TEST_DIRECTORY "/iothub_outbox.head", "rb");
+    ASSERT_IS_NOT_NULL(headFile);
+    ASSERT_ARE_EQUAL(int, 1, fscanf(headFile, "%lu", &firstSegmentIndex));
+    (void)fclose(headFile);
+    ASSERT_ARE_EQUAL(int, 2, (int)firstSegmentIndex);
+    headFile = fopen(TEST_DIRECTORY "/iothub_outbox.head.new", "rb");
+    ASSERT_IS_NULL(headFile);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_019: [ The head file shall be replaced by renaming a new head file, written and synced beforehand, over it. ]*/
+TEST_FUNCTION(the_new_head_file_is_used_when_the_head_file_is_missing)
+{
+    ///arrange
+    uint64_t recordIds[2];
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 1);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[0]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordIds[1]));
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Complete(outbox, recordIds[0]));
+    IoTHubClient_Outbox_Destroy(outbox);
+
+    /*a crash between removing the head file and renaming the new one*/
+    ASSERT_ARE_EQUAL(int, 0, rename(TEST_DIRECTORY "/iothub_outbox.head", TEST_DIRECTORY "/iothub_outbox.head.new"));
+    umock_c_reset_all_calls();
+
+    ///act
+    outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, 1);
+    int result = IoTHubClient_Outbox_ForEachPending(outbox, on_pending_record, NULL);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(outbox);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_pendingRecordCount);
+    ASSERT_ARE_EQUAL(uint64_t, recordIds[1], g_pendingRecords[0]);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_017: [ If outboxHandle is NULL, IoTHubClient_Outbox_Flush shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Flush_with_NULL_fails)
+{
+    ///arrange
+
+    ///act
+    int result = IoTHubClient_Outbox_Flush(NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_OUTBOX_07_018: [ IoTHubClient_Outbox_Flush shall call fflush on the segment files that have buffered appends or completions, sync them to the storage, and return a non-zero value if any fflush or sync fails. ]*/
+TEST_FUNCTION(IoTHubClient_Outbox_Flush_writes_the_appends)
+{
+    ///arrange
+    uint64_t recordId;
+    char fileName[64];
+    FILE* segmentFile;
+    long fileSize;
+    TEST_MESSAGE* message = create_full_test_message();
+    IOTHUB_CLIENT_OUTBOX_HANDLE outbox = IoTHubClient_Outbox_Create(TEST_DIRECTORY, TEST_SEGMENT_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_Outbox_Append(outbox, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = IoTHubClient_Outbox_Flush(outbox);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    get_segment_file_name(fileName, 0);
+    segmentFile = fopen(fileName, "rb");
+    ASSERT_IS_NOT_NULL(segmentFile);
+    (void)fseek(segmentFile, 0, SEEK_END);
+    fileSize = ftell(segmentFile);
+    (void)fclose(segmentFile);
+    ASSERT_IS_TRUE(fileSize > 0);
+
+    ///cleanup
+    my_IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)message);
+    IoTHubClient_Outbox_Destroy(outbox);
+}
+
+END_TEST_SUITE(iothubclient_outbox_ut)
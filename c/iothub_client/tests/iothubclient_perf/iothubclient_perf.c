@@ -0,0 +1,179 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*measures the latency of IoTHubClient_SendEventAsync seen by several application threads while the worker thread is
+blocked in the transport, with and without OPTION_INGRESS_QUEUE*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/platform.h"
+
+#include "iothub_client.h"
+#include "iothub_client_options.h"
+#include "iothub_message.h"
+#include "perf_transport.h"
+#include "perf_timer.h"
+
+#define PRODUCER_COUNT 8
+#define EVENTS_PER_PRODUCER 2000
+#define DOWORK_TIME_MS 5
+
+typedef struct PRODUCER_TAG
+{
+    IOTHUB_CLIENT_HANDLE clientHandle;
+    IOTHUB_MESSAGE_HANDLE messageHandle;
+    uint64_t latencies[EVENTS_PER_PRODUCER];
+    size_t failures;
+} PRODUCER;
+
+static PRODUCER producers[PRODUCER_COUNT];
+static uint64_t allLatencies[PRODUCER_COUNT * EVENTS_PER_PRODUCER];
+
+static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)result;
+    (void)userContextCallback;
+}
+
+static int ProducerThread(void* arg)
+{
+    PRODUCER* producer = (PRODUCER*)arg;
+    size_t i;
+    for (i = 0; i < EVENTS_PER_PRODUCER; i++)
+    {
+        uint64_t start = perf_timer_get_us();
+        if (IoTHubClient_SendEventAsync(producer->clientHandle, producer->messageHandle, SendConfirmationCallback, NULL) != IOTHUB_CLIENT_OK)
+        {
+            producer->failures++;
+        }
+        producer->latencies[i] = perf_timer_get_us() - start;
+    }
+    return 0;
+}
+
+static int CompareLatencies(const void* left, const void* right)
+{
+    uint64_t a = *(const uint64_t*)left;
+    uint64_t b = *(const uint64_t*)right;
+    return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+static int RunScenario(const char* name, bool useIngressQueue)
+{
+    int result;
+    IOTHUB_CLIENT_CONFIG config;
+    IOTHUB_CLIENT_HANDLE clientHandle;
+
+    config.protocol = PERF_Protocol;
+    config.deviceId = "perfDevice";
+    config.deviceKey = "cGVyZg==";
+    config.deviceSasToken = NULL;
+    config.iotHubName = "perf";
+    config.iotHubSuffix = "azure-devices.net";
+    config.protocolGatewayHostName = NULL;
+
+    if ((clientHandle = IoTHubClient_Create(&config)) == NULL)
+    {
+        (void)printf("IoTHubClient_Create failed\r\n");
+        result = __LINE__;
+    }
+    else if (useIngressQueue && (IoTHubClient_SetOption(clientHandle, OPTION_INGRESS_QUEUE, &useIngressQueue) != IOTHUB_CLIENT_OK))
+    {
+        (void)printf("IoTHubClient_SetOption(OPTION_INGRESS_QUEUE) failed\r\n");
+        IoTHubClient_Destroy(clientHandle);
+        result = __LINE__;
+    }
+    else
+    {
+        THREAD_HANDLE threads[PRODUCER_COUNT];
+        size_t started = 0;
+        size_t failures = 0;
+        size_t i;
+        size_t count = 0;
+        uint64_t elapsed;
+
+        elapsed = perf_timer_get_us();
+        for (i = 0; i < PRODUCER_COUNT; i++)
+        {
+            producers[i].clientHandle = clientHandle;
+            producers[i].failures = 0;
+            if ((producers[i].messageHandle = IoTHubMessage_CreateFromString("{\"temperature\":21.5}")) == NULL)
+            {
+                break;
+            }
+            if (ThreadAPI_Create(&threads[i], ProducerThread, &producers[i]) != THREADAPI_OK)
+            {
+                IoTHubMessage_Destroy(producers[i].messageHandle);
+                break;
+            }
+            started++;
+        }
+
+        for (i = 0; i < started; i++)
+        {
+            int threadResult;
+            (void)ThreadAPI_Join(threads[i], &threadResult);
+            IoTHubMessage_Destroy(producers[i].messageHandle);
+            failures += producers[i].failures;
+            (void)memcpy(&allLatencies[count], producers[i].latencies, sizeof(producers[i].latencies));
+            count += EVENTS_PER_PRODUCER;
+        }
+        elapsed = perf_timer_get_us() - elapsed;
+
+        /*lets the worker thread send everything before the numbers are printed*/
+        IoTHubClient_Destroy(clientHandle);
+
+        if ((started != PRODUCER_COUNT) || (failures != 0))
+        {
+            (void)printf("%s: %u producer(s) started, %u failed call(s)\r\n", name, (unsigned int)started, (unsigned int)failures);
+            result = __LINE__;
+        }
+        else
+        {
+            qsort(allLatencies, count, sizeof(allLatencies[0]), CompareLatencies);
+            (void)printf("%-16s calls=%u p50=%uus p90=%uus p99=%uus max=%uus total=%ums\r\n",
+                name,
+                (unsigned int)count,
+                (unsigned int)allLatencies[count / 2],
+                (unsigned int)allLatencies[(count * 90) / 100],
+                (unsigned int)allLatencies[(count * 99) / 100],
+                (unsigned int)allLatencies[count - 1],
+                (unsigned int)(elapsed / 1000));
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    if (platform_init() != 0)
+    {
+        (void)printf("platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)printf("%d producers x %d events, transport DoWork blocks %d ms\r\n", PRODUCER_COUNT, EVENTS_PER_PRODUCER, DOWORK_TIME_MS);
+        PerfTransport_SetDoWorkTime(DOWORK_TIME_MS);
+
+        if (RunScenario("lock", false) != 0)
+        {
+            result = __LINE__;
+        }
+        else if (RunScenario("ingress queue", true) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        platform_deinit();
+    }
+    return result;
+}
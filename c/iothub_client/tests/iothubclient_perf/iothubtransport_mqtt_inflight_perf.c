@@ -0,0 +1,151 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*measures the time it takes the MQTT transport to match the PUBACKs of n publishes in flight, the way it used to
+(walking the list of the publishes waiting for an acknowledgement) and the way it does now (looking the packet id up
+in iothubtransport_mqtt_inflight). The acknowledgements arrive in a shuffled order, as they may after a reconnect.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "azure_c_shared_utility/doublylinkedlist.h"
+
+#include "iothubtransport_mqtt_inflight.h"
+#include "perf_timer.h"
+
+#define MAX_INFLIGHT 60000
+#define INITIAL_CAPACITY 16
+
+typedef struct INFLIGHT_RECORD_TAG
+{
+    uint16_t packet_id;
+    DLIST_ENTRY entry;
+} INFLIGHT_RECORD;
+
+static const size_t inflightCounts[] = { 10, 100, 1000, 10000, 30000, 60000 };
+
+static INFLIGHT_RECORD records[MAX_INFLIGHT];
+static uint16_t ackOrder[MAX_INFLIGHT];
+
+static void ShuffleAcks(size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        ackOrder[i] = (uint16_t)(i + 1);
+    }
+    for (i = count; i > 1; i--)
+    {
+        size_t j = ((size_t)rand() * ((size_t)RAND_MAX + 1) + (size_t)rand()) % i;
+        uint16_t swap = ackOrder[i - 1];
+        ackOrder[i - 1] = ackOrder[j];
+        ackOrder[j] = swap;
+    }
+}
+
+/*acks every record by walking the waiting list, returns the number of records acked*/
+static size_t AckWithList(size_t count)
+{
+    size_t acked = 0;
+    DLIST_ENTRY waitingForAck;
+    size_t i;
+
+    DList_InitializeListHead(&waitingForAck);
+    for (i = 0; i < count; i++)
+    {
+        records[i].packet_id = (uint16_t)(i + 1);
+        DList_InsertTailList(&waitingForAck, &records[i].entry);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        PDLIST_ENTRY currentListEntry = waitingForAck.Flink;
+        while (currentListEntry != &waitingForAck)
+        {
+            INFLIGHT_RECORD* record = containingRecord(currentListEntry, INFLIGHT_RECORD, entry);
+            if (record->packet_id == ackOrder[i])
+            {
+                (void)DList_RemoveEntryList(currentListEntry);
+                acked++;
+                break;
+            }
+            currentListEntry = currentListEntry->Flink;
+        }
+    }
+    return acked;
+}
+
+/*acks every record by looking its packet id up in the table, returns the number of records acked*/
+static size_t AckWithTable(size_t count)
+{
+    size_t acked = 0;
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflight = iothubtransport_mqtt_inflight_create(INITIAL_CAPACITY);
+    if (inflight != NULL)
+    {
+        DLIST_ENTRY waitingForAck;
+        size_t i;
+
+        DList_InitializeListHead(&waitingForAck);
+        for (i = 0; i < count; i++)
+        {
+            records[i].packet_id = (uint16_t)(i + 1);
+            if (iothubtransport_mqtt_inflight_insert(inflight, records[i].packet_id, &records[i]) != 0)
+            {
+                break;
+            }
+            DList_InsertTailList(&waitingForAck, &records[i].entry);
+        }
+
+        if (i == count)
+        {
+            for (i = 0; i < count; i++)
+            {
+                INFLIGHT_RECORD* record = (INFLIGHT_RECORD*)iothubtransport_mqtt_inflight_remove(inflight, ackOrder[i]);
+                if (record != NULL)
+                {
+                    (void)DList_RemoveEntryList(&record->entry);
+                    acked++;
+                }
+            }
+        }
+        iothubtransport_mqtt_inflight_destroy(inflight);
+    }
+    return acked;
+}
+
+static int RunScenario(const char* name, size_t(*ack)(size_t), size_t count)
+{
+    int result;
+    uint64_t elapsed = perf_timer_get_us();
+    size_t acked = ack(count);
+    elapsed = perf_timer_get_us() - elapsed;
+
+    if (acked != count)
+    {
+        (void)printf("%s: %u of %u publishes acked\r\n", name, (unsigned int)acked, (unsigned int)count);
+        result = __LINE__;
+    }
+    else
+    {
+        (void)printf("%-6s inflight=%-6u total=%uus per ack=%.3fus\r\n", name, (unsigned int)count, (unsigned int)elapsed, (double)elapsed / (double)count);
+        result = 0;
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+    size_t i;
+
+    srand(1);
+    for (i = 0; (result == 0) && (i < sizeof(inflightCounts) / sizeof(inflightCounts[0])); i++)
+    {
+        ShuffleAcks(inflightCounts[i]);
+        if ((RunScenario("list", AckWithList, inflightCounts[i]) != 0) ||
+            (RunScenario("table", AckWithTable, inflightCounts[i]) != 0))
+        {
+            result = __LINE__;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,230 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*measures the time it takes the MQTT transport to parse the topics of the messages it receives, the way it used to
+(a STRING_TOKENIZER over a copy of the topic, a STRING per token and a malloc per property name and value) and the way
+it does now (iothubtransport_mqtt_topic reads the topic once, in place, and decodes the properties on the stack).
+The topics are the ones IoT Hub sends for a device twin response, a desired properties patch, a device method
+invocation and a cloud to device message with its system and application properties.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/string_tokenizer.h"
+
+#include "iothubtransport_mqtt_topic.h"
+#include "perf_timer.h"
+
+#define ITERATIONS 100000
+
+static const char* topics[] =
+{
+    "$iothub/twin/res/204/?$rid=42",
+    "$iothub/twin/PATCH/properties/desired/?$version=17",
+    "$iothub/methods/POST/reboot_device/?$rid=1234",
+    "devices/thermostat-0042/messages/devicebound/%24.mid=6a3b8d1e-3c2f-4b55-9d0e-27a1c3f8e915&%24.to=%2Fdevices%2Fthermostat-0042%2Fmessages%2FdeviceBound&%24.cid&%24.uid&iothub-ack=full&alert=high%20temperature&zone=lab%2F2"
+};
+
+static const char* oldSystemProperties[] = { "%24.exp", "%24.mid", "%24.uid", "%24.to", "%24.cid", "devices/", "iothub-operation", "iothub-ack" };
+static const char* systemProperties[] = { "$.exp", "$.mid", "$.uid", "$.to", "$.cid", "iothub-operation", "iothub-ack" };
+
+static int StartsWithNoCase(const char* topic, const char* prefix)
+{
+    size_t index;
+    for (index = 0; prefix[index] != '\0'; index++)
+    {
+        if (toupper((unsigned char)prefix[index]) != toupper((unsigned char)topic[index]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*parses the topic with the STRING functions the way the MQTT transport used to, returns a checksum of what it found*/
+static size_t ParseWithTokenizer(const char* topic)
+{
+    size_t result = 0;
+
+    if (StartsWithNoCase(topic, "$iothub/twin"))
+    {
+        STRING_TOKENIZER_HANDLE tokenizer = STRING_TOKENIZER_create_from_char(topic);
+        STRING_HANDLE token = STRING_new();
+        if (tokenizer != NULL && token != NULL)
+        {
+            size_t index = 0;
+            while (STRING_TOKENIZER_get_next_token(tokenizer, token, "/") == 0)
+            {
+                if (index == 2 && strcmp(STRING_c_str(token), "PATCH") == 0)
+                {
+                    result = 1;
+                    break;
+                }
+                else if (index == 3)
+                {
+                    result = (size_t)atol(STRING_c_str(token));
+                    if (STRING_TOKENIZER_get_next_token(tokenizer, token, "/?$rid=") == 0)
+                    {
+                        result += (size_t)atol(STRING_c_str(token));
+                    }
+                    break;
+                }
+                index++;
+            }
+        }
+        STRING_delete(token);
+        STRING_TOKENIZER_destroy(tokenizer);
+    }
+    else if (StartsWithNoCase(topic, "$iothub/methods"))
+    {
+        STRING_HANDLE methodName = STRING_new();
+        STRING_TOKENIZER_HANDLE tokenizer = STRING_TOKENIZER_create_from_char(topic);
+        STRING_HANDLE token = STRING_new();
+        if (methodName != NULL && tokenizer != NULL && token != NULL)
+        {
+            size_t index = 0;
+            while (STRING_TOKENIZER_get_next_token(tokenizer, token, "/") == 0)
+            {
+                if (index == 3)
+                {
+                    (void)STRING_concat_with_STRING(methodName, token);
+                }
+                else if (index == 4 && strncmp(STRING_c_str(token), "?$rid=", 6) == 0)
+                {
+                    result = STRING_length(methodName) + (size_t)atol(STRING_c_str(token) + 6);
+                    break;
+                }
+                index++;
+            }
+        }
+        STRING_delete(token);
+        STRING_TOKENIZER_destroy(tokenizer);
+        STRING_delete(methodName);
+    }
+    else
+    {
+        STRING_HANDLE copy = STRING_construct(topic);
+        STRING_TOKENIZER_HANDLE tokenizer = (copy == NULL) ? NULL : STRING_TOKENIZER_create(copy);
+        STRING_HANDLE token = STRING_new();
+        if (tokenizer != NULL && token != NULL)
+        {
+            while (STRING_TOKENIZER_get_next_token(tokenizer, token, "&") == 0)
+            {
+                const char* tokenData = STRING_c_str(token);
+                const char* separator = strchr(tokenData, '=');
+                size_t index;
+                for (index = 0; index < sizeof(oldSystemProperties) / sizeof(oldSystemProperties[0]); index++)
+                {
+                    if (strncmp(tokenData, oldSystemProperties[index], strlen(oldSystemProperties[index])) == 0)
+                    {
+                        break;
+                    }
+                }
+                if (index == sizeof(oldSystemProperties) / sizeof(oldSystemProperties[0]) && separator != NULL)
+                {
+                    size_t nameLength = (size_t)(separator - tokenData);
+                    char* name = (char*)malloc(nameLength + 1);
+                    char* value = (char*)malloc(strlen(separator));
+                    if (name != NULL && value != NULL)
+                    {
+                        (void)memcpy(name, tokenData, nameLength);
+                        name[nameLength] = '\0';
+                        (void)strcpy(value, separator + 1);
+                        result += strlen(name) + 1;
+                    }
+                    free(name);
+                    free(value);
+                }
+            }
+        }
+        STRING_delete(token);
+        STRING_TOKENIZER_destroy(tokenizer);
+        STRING_delete(copy);
+    }
+    return result;
+}
+
+static int CountProperty(void* context, const char* name, const char* value)
+{
+    size_t index;
+    (void)value;
+    for (index = 0; index < sizeof(systemProperties) / sizeof(systemProperties[0]); index++)
+    {
+        if (strcmp(name, systemProperties[index]) == 0)
+        {
+            return 0;
+        }
+    }
+    *(size_t*)context += strlen(name) + 1;
+    return 0;
+}
+
+/*parses the topic with iothubtransport_mqtt_topic, returns a checksum of what it found*/
+static size_t ParseWithScanner(const char* topic)
+{
+    size_t result = 0;
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    if (iothubtransport_mqtt_topic_parse(topic, &topicInfo) == 0)
+    {
+        if (topicInfo.type == IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN)
+        {
+            result = topicInfo.isPatch ? 1 : (size_t)topicInfo.statusCode + topicInfo.requestId;
+        }
+        else if (topicInfo.type == IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD)
+        {
+            result = topicInfo.methodNameLength + topicInfo.requestId;
+        }
+        else
+        {
+            (void)iothubtransport_mqtt_topic_for_each_property(topicInfo.properties, CountProperty, &result);
+        }
+    }
+    return result;
+}
+
+/*parses the topic ITERATIONS times, returns the sum of the checksums*/
+static size_t RunScenario(const char* name, size_t(*parse)(const char*), size_t topicIndex)
+{
+    size_t i;
+    size_t sum = 0;
+    uint64_t elapsed = perf_timer_get_us();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        sum += parse(topics[topicIndex]);
+    }
+    elapsed = perf_timer_get_us() - elapsed;
+
+    (void)printf("%-9s topic=%u total=%uus per topic=%.3fus\r\n", name, (unsigned int)topicIndex, (unsigned int)elapsed, (double)elapsed / (double)ITERATIONS);
+    return sum;
+}
+
+int main(void)
+{
+    int result = 0;
+    size_t i;
+
+    if (platform_init() != 0)
+    {
+        (void)printf("platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        for (i = 0; (result == 0) && (i < sizeof(topics) / sizeof(topics[0])); i++)
+        {
+            size_t tokenizerChecksum = RunScenario("tokenizer", ParseWithTokenizer, i);
+            size_t scannerChecksum = RunScenario("scanner", ParseWithScanner, i);
+            if (tokenizerChecksum != scannerChecksum)
+            {
+                (void)printf("topic %u parsed differently (%u, %u)\r\n", (unsigned int)i, (unsigned int)tokenizerChecksum, (unsigned int)scannerChecksum);
+                result = __LINE__;
+            }
+        }
+        platform_deinit();
+    }
+    return result;
+}
@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*measures the time it takes to build the payload of an HTTP batch, the way it used to be built (one STRING per item,
+concatenated, then copied into a BUFFER) and the way the HTTP transport builds it now (the items are measured, the
+BUFFER is allocated once and every item is written straight into it)*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/strings.h"
+
+#include "iothub_message.h"
+#include "iothubtransporthttp_batch.h"
+#include "perf_timer.h"
+
+#define MESSAGE_COUNT 500
+#define MESSAGE_SIZE 256
+#define ITERATIONS 20
+
+static IOTHUB_MESSAGE_HANDLE messages[MESSAGE_COUNT];
+
+/*builds the payload with the STRING functions the way the HTTP transport used to*/
+static BUFFER_HANDLE BuildWithStrings(void)
+{
+    BUFFER_HANDLE result;
+    STRING_HANDLE payload = STRING_construct("[");
+    size_t i;
+
+    for (i = 0; (payload != NULL) && (i < MESSAGE_COUNT); i++)
+    {
+        const unsigned char* source;
+        size_t size;
+        STRING_HANDLE item = STRING_construct("{\"body\":\"");
+        STRING_HANDLE encoded;
+
+        if ((item == NULL) ||
+            (IoTHubMessage_GetByteArray(messages[i], &source, &size) != IOTHUB_MESSAGE_OK) ||
+            ((encoded = Base64_Encode_Bytes(source, size)) == NULL))
+        {
+            STRING_delete(item);
+            STRING_delete(payload);
+            payload = NULL;
+        }
+        else
+        {
+            if ((STRING_concat_with_STRING(item, encoded) != 0) ||
+                (STRING_concat(item, "\"}") != 0) ||
+                ((i > 0) && (STRING_concat(payload, ",") != 0)) ||
+                (STRING_concat_with_STRING(payload, item) != 0))
+            {
+                STRING_delete(payload);
+                payload = NULL;
+            }
+            STRING_delete(encoded);
+            STRING_delete(item);
+        }
+    }
+
+    if ((payload == NULL) || (STRING_concat(payload, "]") != 0))
+    {
+        STRING_delete(payload);
+        result = NULL;
+    }
+    else
+    {
+        if ((result = BUFFER_new()) != NULL)
+        {
+            if (BUFFER_build(result, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+            {
+                BUFFER_delete(result);
+                result = NULL;
+            }
+        }
+        STRING_delete(payload);
+    }
+    return result;
+}
+
+/*builds the payload the way the HTTP transport does now*/
+static BUFFER_HANDLE BuildInPlace(void)
+{
+    BUFFER_HANDLE result;
+    size_t payloadSize = 1;
+    size_t i;
+
+    for (i = 0; i < MESSAGE_COUNT; i++)
+    {
+        IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+        if (iothubtransporthttp_batch_get_item_size(messages[i], &itemSize) != 0)
+        {
+            break;
+        }
+        payloadSize += itemSize.itemSize + 1;
+    }
+
+    if (i < MESSAGE_COUNT)
+    {
+        result = NULL;
+    }
+    else if ((result = BUFFER_new()) == NULL)
+    {
+        /*nothing to build in*/
+    }
+    else if (BUFFER_pre_build(result, payloadSize) != 0)
+    {
+        BUFFER_delete(result);
+        result = NULL;
+    }
+    else
+    {
+        unsigned char* destination = BUFFER_u_char(result);
+        size_t position = 0;
+
+        destination[position++] = '[';
+        for (i = 0; i < MESSAGE_COUNT; i++)
+        {
+            size_t written;
+            if (iothubtransporthttp_batch_write_item(messages[i], destination + position, payloadSize - position - 1, &written) != 0)
+            {
+                break;
+            }
+            position += written;
+            destination[position++] = (i == MESSAGE_COUNT - 1) ? ']' : ',';
+        }
+
+        if (position != payloadSize)
+        {
+            BUFFER_delete(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
+static int RunScenario(const char* name, BUFFER_HANDLE(*build)(void), BUFFER_HANDLE* payload)
+{
+    int result = 0;
+    uint64_t best = 0;
+    size_t i;
+
+    *payload = NULL;
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        uint64_t elapsed = perf_timer_get_us();
+        BUFFER_HANDLE built = build();
+        elapsed = perf_timer_get_us() - elapsed;
+
+        if (built == NULL)
+        {
+            (void)printf("%s: the payload could not be built\r\n", name);
+            result = __LINE__;
+            break;
+        }
+
+        if ((i == 0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+
+        if (*payload == NULL)
+        {
+            *payload = built;
+        }
+        else
+        {
+            BUFFER_delete(built);
+        }
+    }
+
+    if (result != 0)
+    {
+        BUFFER_delete(*payload);
+        *payload = NULL;
+    }
+    else
+    {
+        (void)printf("%-10s payload=%u bytes best=%uus per batch\r\n", name, (unsigned int)BUFFER_length(*payload), (unsigned int)best);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    if (platform_init() != 0)
+    {
+        (void)printf("platform_init failed\r\n");
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char content[MESSAGE_SIZE];
+        size_t created;
+        size_t i;
+
+        for (i = 0; i < MESSAGE_SIZE; i++)
+        {
+            content[i] = (unsigned char)i;
+        }
+
+        for (created = 0; created < MESSAGE_COUNT; created++)
+        {
+            if ((messages[created] = IoTHubMessage_CreateFromByteArray(content, sizeof(content))) == NULL)
+            {
+                break;
+            }
+        }
+
+        if (created != MESSAGE_COUNT)
+        {
+            (void)printf("IoTHubMessage_CreateFromByteArray failed\r\n");
+            result = __LINE__;
+        }
+        else
+        {
+            BUFFER_HANDLE withStrings;
+            BUFFER_HANDLE inPlace;
+
+            (void)printf("%d messages of %d bytes per batch, best of %d batches\r\n", MESSAGE_COUNT, MESSAGE_SIZE, ITERATIONS);
+            if (RunScenario("strings", BuildWithStrings, &withStrings) != 0)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                if (RunScenario("in place", BuildInPlace, &inPlace) != 0)
+                {
+                    result = __LINE__;
+                }
+                else
+                {
+                    /*both ways shall build the very same payload*/
+                    if ((BUFFER_length(withStrings) != BUFFER_length(inPlace)) ||
+                        (memcmp(BUFFER_u_char(withStrings), BUFFER_u_char(inPlace), BUFFER_length(inPlace)) != 0))
+                    {
+                        (void)printf("the payloads are different\r\n");
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        result = 0;
+                    }
+                    BUFFER_delete(inPlace);
+                }
+                BUFFER_delete(withStrings);
+            }
+        }
+
+        for (i = 0; i < created; i++)
+        {
+            IoTHubMessage_Destroy(messages[i]);
+        }
+        platform_deinit();
+    }
+    return result;
+}
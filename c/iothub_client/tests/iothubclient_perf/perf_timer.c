@@ -0,0 +1,26 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "perf_timer.h"
+
+#ifdef WIN32
+#include <windows.h>
+
+uint64_t perf_timer_get_us(void)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    (void)QueryPerformanceFrequency(&frequency);
+    (void)QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / (frequency.QuadPart / 1000000));
+}
+#else
+#include <time.h>
+
+uint64_t perf_timer_get_us(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+#endif
@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PERF_TIMER_H
+#define PERF_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*monotonic time in microseconds, only meaningful as a difference between two calls*/
+extern uint64_t perf_timer_get_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_TIMER_H */
@@ -0,0 +1,145 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "iothub_client_private.h"
+#include "perf_transport.h"
+
+#define PERF_HOSTNAME "perf.azure-devices.net"
+
+typedef struct PERF_TRANSPORT_TAG
+{
+    STRING_HANDLE hostname;
+    PDLIST_ENTRY waitingToSend;
+} PERF_TRANSPORT;
+
+static unsigned int doWorkTime = 0;
+
+void PerfTransport_SetDoWorkTime(unsigned int milliseconds)
+{
+    doWorkTime = milliseconds;
+}
+
+static TRANSPORT_LL_HANDLE PerfTransport_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    PERF_TRANSPORT* result = (PERF_TRANSPORT*)malloc(sizeof(PERF_TRANSPORT));
+    if (result == NULL)
+    {
+        LogError("unable to malloc");
+    }
+    else if ((result->hostname = STRING_construct(PERF_HOSTNAME)) == NULL)
+    {
+        LogError("unable to STRING_construct");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->waitingToSend = config->waitingToSend;
+    }
+    return result;
+}
+
+static void PerfTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    PERF_TRANSPORT* transport = (PERF_TRANSPORT*)handle;
+    STRING_delete(transport->hostname);
+    free(transport);
+}
+
+static STRING_HANDLE PerfTransport_GetHostname(TRANSPORT_LL_HANDLE handle)
+{
+    return ((PERF_TRANSPORT*)handle)->hostname;
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return IOTHUB_CLIENT_INVALID_ARG;
+}
+
+static IOTHUB_DEVICE_HANDLE PerfTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
+{
+    (void)device;
+    (void)iotHubClientHandle;
+    ((PERF_TRANSPORT*)handle)->waitingToSend = waitingToSend;
+    return handle;
+}
+
+static void PerfTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    (void)deviceHandle;
+}
+
+static int PerfTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return __LINE__;
+}
+
+static void PerfTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static IOTHUB_PROCESS_ITEM_RESULT PerfTransport_ProcessItem(TRANSPORT_LL_HANDLE handle, IOTHUB_IDENTITY_TYPE item_type, IOTHUB_IDENTITY_INFO* iothub_item)
+{
+    (void)handle;
+    (void)item_type;
+    (void)iothub_item;
+    return IOTHUB_PROCESS_ERROR;
+}
+
+static void PerfTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    PERF_TRANSPORT* transport = (PERF_TRANSPORT*)handle;
+    if (!DList_IsListEmpty(transport->waitingToSend))
+    {
+        DLIST_ENTRY completed;
+        DList_InitializeListHead(&completed);
+        DList_AppendTailList(&completed, transport->waitingToSend);
+        DList_RemoveEntryList(transport->waitingToSend);
+        DList_InitializeListHead(transport->waitingToSend);
+
+        /*this is where a real transport would be blocked on the network*/
+        ThreadAPI_Sleep(doWorkTime);
+        IoTHubClient_LL_SendComplete(iotHubClientHandle, &completed, IOTHUB_CLIENT_CONFIRMATION_OK);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    *iotHubClientStatus = DList_IsListEmpty(((PERF_TRANSPORT*)handle)->waitingToSend) ? IOTHUB_CLIENT_SEND_STATUS_IDLE : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    return IOTHUB_CLIENT_OK;
+}
+
+static TRANSPORT_PROVIDER thisTransportProvider =
+{
+    PerfTransport_Subscribe,                /*pfIoTHubTransport_Subscribe_DeviceMethod IoTHubTransport_Subscribe_DeviceMethod;*/
+    PerfTransport_Unsubscribe,              /*pfIoTHubTransport_Unsubscribe_DeviceMethod IoTHubTransport_Unsubscribe_DeviceMethod;*/
+    PerfTransport_Subscribe,                /*pfIoTHubTransport_Subscribe_DeviceTwin IoTHubTransport_Subscribe_DeviceTwin;*/
+    PerfTransport_Unsubscribe,              /*pfIoTHubTransport_Unsubscribe_DeviceTwin IoTHubTransport_Unsubscribe_DeviceTwin;*/
+    PerfTransport_ProcessItem,              /*pfIoTHubTransport_ProcessItem IoTHubTransport_ProcessItem;*/
+    PerfTransport_GetHostname,              /*pfIoTHubTransport_GetHostname IoTHubTransport_GetHostname;*/
+    PerfTransport_SetOption,                /*pfIoTHubTransport_SetOption IoTHubTransport_SetOption;*/
+    PerfTransport_Create,                   /*pfIoTHubTransport_Create IoTHubTransport_Create;*/
+    PerfTransport_Destroy,                  /*pfIoTHubTransport_Destroy IoTHubTransport_Destroy;*/
+    PerfTransport_Register,                 /*pfIotHubTransport_Register IoTHubTransport_Register;*/
+    PerfTransport_Unregister,               /*pfIotHubTransport_Unregister IoTHubTransport_Unegister;*/
+    PerfTransport_Subscribe,                /*pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;*/
+    PerfTransport_Unsubscribe,              /*pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;*/
+    PerfTransport_DoWork,                   /*pfIoTHubTransport_DoWork IoTHubTransport_DoWork;*/
+    PerfTransport_GetSendStatus             /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus;*/
+};
+
+const TRANSPORT_PROVIDER* PERF_Protocol(void)
+{
+    return &thisTransportProvider;
+}
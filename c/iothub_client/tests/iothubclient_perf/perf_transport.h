@@ -0,0 +1,22 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PERF_TRANSPORT_H
+#define PERF_TRANSPORT_H
+
+#include "iothub_transport_ll.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*a transport that never touches the network: every _DoWork sleeps for the configured time (standing in for a blocking
+TLS write or HTTP request) and then completes all the waiting events with IOTHUB_CLIENT_CONFIRMATION_OK*/
+extern const TRANSPORT_PROVIDER* PERF_Protocol(void);
+extern void PerfTransport_SetDoWorkTime(unsigned int milliseconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_TRANSPORT_H */
@@ -0,0 +1,668 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <signal.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/vector.h"
+
+MOCKABLE_FUNCTION(, void, test_work_function, void*, context);
+
+#undef ENABLE_MOCKS
+
+#include "iothub_client_threadpool.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern VECTOR_HANDLE real_VECTOR_create(size_t elementSize);
+    extern void real_VECTOR_destroy(VECTOR_HANDLE handle);
+    extern void* real_VECTOR_find_if(const VECTOR_HANDLE handle, PREDICATE_FUNCTION pred, const void* value);
+    extern int real_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements);
+    extern size_t real_VECTOR_size(const VECTOR_HANDLE handle);
+    extern void* real_VECTOR_element(const VECTOR_HANDLE handle, size_t index);
+    extern void real_VECTOR_erase(VECTOR_HANDLE handle, void* elements, size_t numElements);
+
+    extern const size_t IoTHubClient_ThreadPool_ThreadTerminationOffset;
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_LOCK_HANDLE    (LOCK_HANDLE)0x4443
+#define TEST_THREAD_HANDLE  (THREAD_HANDLE)0x4442
+#define TEST_COND_HANDLE    (COND_HANDLE)0x4444
+#define TEST_WORK_CONTEXT   (void*)0x4447
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static THREAD_START_FUNC g_thread_func;
+static void* g_thread_func_arg;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    *threadHandle = TEST_THREAD_HANDLE;
+    g_thread_func = func;
+    g_thread_func_arg = arg;
+    return THREADAPI_OK;
+}
+
+static void my_ThreadAPI_Sleep(unsigned int milliseconds)
+{
+    (void)milliseconds;
+    /*tell the pool thread to stop after one round*/
+    *(sig_atomic_t*)(((char*)g_thread_func_arg) + IoTHubClient_ThreadPool_ThreadTerminationOffset) = 1;
+}
+
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    /*tell the pool thread to stop after waiting once*/
+    *(sig_atomic_t*)(((char*)g_thread_func_arg) + IoTHubClient_ThreadPool_ThreadTerminationOffset) = 1;
+    return (timeout_milliseconds == 0) ? COND_OK : COND_TIMEOUT;
+}
+
+/*runs the pool thread again from within a work function, so that it finds the only work item busy*/
+static void run_pool_thread_from_work_function(void* context)
+{
+    (void)context;
+    (void)g_thread_func(g_thread_func_arg);
+}
+
+static VECTOR_HANDLE my_VECTOR_create(size_t elementSize)
+{
+    return real_VECTOR_create(elementSize);
+}
+
+static void my_VECTOR_destroy(VECTOR_HANDLE handle)
+{
+    real_VECTOR_destroy(handle);
+}
+
+static void* my_VECTOR_find_if(const VECTOR_HANDLE handle, PREDICATE_FUNCTION pred, const void* value)
+{
+    return real_VECTOR_find_if(handle, pred, value);
+}
+
+static int my_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements)
+{
+    return real_VECTOR_push_back(handle, elements, numElements);
+}
+
+static size_t my_VECTOR_size(const VECTOR_HANDLE handle)
+{
+    return real_VECTOR_size(handle);
+}
+
+static void* my_VECTOR_element(const VECTOR_HANDLE handle, size_t index)
+{
+    return real_VECTOR_element(handle, index);
+}
+
+static void my_VECTOR_erase(VECTOR_HANDLE handle, void* elements, size_t numElements)
+{
+    real_VECTOR_erase(handle, elements, numElements);
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubclient_threadpool_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Unlock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
+
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Join, THREADAPI_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Sleep, my_ThreadAPI_Sleep);
+
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, my_VECTOR_create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, my_VECTOR_destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_find_if, my_VECTOR_find_if);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_push_back, my_VECTOR_push_back);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_push_back, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_size, my_VECTOR_size);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_element, my_VECTOR_element);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_erase, my_VECTOR_erase);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    g_thread_func = NULL;
+    g_thread_func_arg = NULL;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+static void setup_threadpool_create_mocks(size_t threadCount)
+{
+    size_t i;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(threadCount * sizeof(THREAD_HANDLE)));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    for (i = 0; i < threadCount; i++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreAllArguments();
+    }
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_001: [ If threadCount is 0, IoTHubClient_ThreadPool_Create shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_Create_with_0_threads_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_HANDLE result = IoTHubClient_ThreadPool_Create(0);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_002: [ IoTHubClient_ThreadPool_Create shall allocate memory for the pool, create the pool lock by calling Lock_Init and the list of work items by calling VECTOR_create. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_004: [ IoTHubClient_ThreadPool_Create shall start threadCount threads by calling ThreadAPI_Create. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_Create_succeeds)
+{
+    ///arrange
+    setup_threadpool_create_mocks(2);
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_HANDLE result = IoTHubClient_ThreadPool_Create(2);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_Destroy(result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_003: [ If any of the resources cannot be created, IoTHubClient_ThreadPool_Create shall free everything it created and return NULL. ]*/
+TEST_FUNCTION(when_allocating_resources_fails_IoTHubClient_ThreadPool_Create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(THREAD_HANDLE)));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_ThreadPool_Create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_THREADPOOL_HANDLE result = IoTHubClient_ThreadPool_Create(1);
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_005: [ If starting any of the threads fails, IoTHubClient_ThreadPool_Create shall stop and join the threads already started, free all resources and return NULL. ]*/
+TEST_FUNCTION(when_ThreadAPI_Create_fails_IoTHubClient_ThreadPool_Create_joins_the_started_threads)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(2 * sizeof(THREAD_HANDLE)));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_HANDLE result = IoTHubClient_ThreadPool_Create(2);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_006: [ If threadPoolHandle is NULL, IoTHubClient_ThreadPool_Destroy shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_Destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClient_ThreadPool_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_007: [ IoTHubClient_ThreadPool_Destroy shall signal the pool threads to end, wake them up by calling Condition_Post once per thread and join them. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_008: [ IoTHubClient_ThreadPool_Destroy shall free all the work items that were not removed and all other resources. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_Destroy_joins_the_threads_and_frees_resources)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(threadPool));
+
+    ///act
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_014: [ If threadPoolHandle or workFunction is NULL, IoTHubClient_ThreadPool_AddWork shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_AddWork_with_NULL_threadPoolHandle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE result = IoTHubClient_ThreadPool_AddWork(NULL, test_work_function, TEST_WORK_CONTEXT);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_014: [ If threadPoolHandle or workFunction is NULL, IoTHubClient_ThreadPool_AddWork shall return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_AddWork_with_NULL_workFunction_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE result = IoTHubClient_ThreadPool_AddWork(threadPool, NULL, TEST_WORK_CONTEXT);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_015: [ IoTHubClient_ThreadPool_AddWork shall allocate a work item holding workFunction and context, and create the work item condition by calling Condition_Init. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_017: [ IoTHubClient_ThreadPool_AddWork shall add the work item to the pool's list under the pool lock and return it. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_022: [ IoTHubClient_ThreadPool_AddWork shall wake up a pool thread by calling Condition_Post on the pool condition. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_AddWork_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE result = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, TEST_WORK_CONTEXT);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, result);
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_016: [ If any operation fails, IoTHubClient_ThreadPool_AddWork shall return NULL. ]*/
+TEST_FUNCTION(when_an_operation_fails_IoTHubClient_ThreadPool_AddWork_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "IoTHubClient_ThreadPool_AddWork failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE result = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, TEST_WORK_CONTEXT);
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_010: [ Each pool thread shall pick the registered work items in a round robin fashion, skipping the work items that are being run by another pool thread. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_011: [ The pool thread shall call the work function of the work item it picked, passing the context given to IoTHubClient_ThreadPool_AddWork. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_012: [ The pool threads shall exit when IoTHubClient_ThreadPool_Destroy is called. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_013: [ Every time the round robin wraps around the list of work items, the next round shall start only after a pool thread has waited 1 ms, so that each work item is called every 1 ms as with a dedicated thread. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_024: [ Once a round has ended, the pool threads shall not pick any work item until the next round starts. ]*/
+TEST_FUNCTION(threadpool_thread_calls_each_work_function_once_per_round)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItem1 = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, (void*)0x1);
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItem2 = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, (void*)0x2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(test_work_function((void*)0x1));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(test_work_function((void*)0x2));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    /*the round has ended, the thread waits 1 ms before starting the next one*/
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 1));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    int result = g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, workItem1);
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, workItem2);
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_021: [ If there is no work item the pool thread can pick, it shall call Condition_Wait on the pool condition with the pool lock, for at most 1 ms if work items are registered and until it is signaled otherwise. ]*/
+TEST_FUNCTION(threadpool_thread_without_work_waits_on_the_condition_until_signaled)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    (void)g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_021: [ If there is no work item the pool thread can pick, it shall call Condition_Wait on the pool condition with the pool lock, for at most 1 ms if work items are registered and until it is signaled otherwise. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_024: [ Once a round has ended, the pool threads shall not pick any work item until the next round starts. ]*/
+TEST_FUNCTION(threadpool_thread_waits_1_ms_while_another_thread_ended_the_round)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(2);
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItem = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, TEST_WORK_CONTEXT);
+    umock_c_reset_all_calls();
+    REGISTER_GLOBAL_MOCK_HOOK(test_work_function, run_pool_thread_from_work_function);
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(test_work_function(TEST_WORK_CONTEXT));
+
+    /*the pool thread run from the work function finds the round ended*/
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 1));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    (void)g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(test_work_function, NULL);
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, workItem);
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_018: [ If threadPoolHandle or workItemHandle is NULL, IoTHubClient_ThreadPool_RemoveWork shall do nothing. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_RemoveWork_with_NULL_workItemHandle_does_nothing)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_019: [ If the work function is being run by a pool thread, IoTHubClient_ThreadPool_RemoveWork shall wait for it to return by calling Condition_Wait on the work item condition with the pool lock. ]*/
+/*Tests_SRS_IOTHUBCLIENT_THREADPOOL_07_020: [ IoTHubClient_ThreadPool_RemoveWork shall remove the work item from the pool's list and free it. ]*/
+TEST_FUNCTION(IoTHubClient_ThreadPool_RemoveWork_removes_and_frees_the_work_item)
+{
+    ///arrange
+    IOTHUB_CLIENT_THREADPOOL_HANDLE threadPool = IoTHubClient_ThreadPool_Create(1);
+    IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE workItem = IoTHubClient_ThreadPool_AddWork(threadPool, test_work_function, TEST_WORK_CONTEXT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, workItem))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(workItem));
+
+    ///act
+    IoTHubClient_ThreadPool_RemoveWork(threadPool, workItem);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_ThreadPool_Destroy(threadPool);
+}
+
+END_TEST_SUITE(iothubclient_threadpool_ut)
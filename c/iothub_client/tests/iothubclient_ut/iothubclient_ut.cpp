@@ -17,8 +17,12 @@
 #include "iothub_client_ll.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "iothubtransport.h"
+#include "iothub_client_options.h"
+#include "iothub_client_ingress_queue.h"
+#include "iothub_client_dispatcher.h"
 
 extern "C" int gballoc_init(void);
 extern "C" void gballoc_deinit(void);
@@ -55,14 +59,33 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 #define TEST_DEVICEMESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x52
 #define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4442
 #define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4443
+#define TEST_COND_HANDLE (COND_HANDLE)0x4444
+#define TEST_THREADPOOL_HANDLE (IOTHUB_CLIENT_THREADPOOL_HANDLE)0x4445
+#define TEST_WORK_ITEM_HANDLE (IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE)0x4446
+#define TEST_INGRESS_QUEUE_HANDLE (IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE)0x4447
+#define TEST_DISPATCHER_HANDLE (IOTHUB_CLIENT_DISPATCHER_HANDLE)0x4448
+#define TEST_CLONED_MESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x53
 static const char* TEST_CHAR = "TestChar";
 
 static size_t howManyDoWorkCalls = 0;
+static IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+static IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
 static size_t doWorkCallCount = 0;
 static THREAD_START_FUNC threadFunc;
 static void* threadFuncArg;
+static IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION poolWorkFunction;
+static void* poolWorkContext;
+static void* ingressQueueItem;
+static IOTHUB_CLIENT_DISPATCHER_FUNCTION dispatchedFunction;
+static void* dispatchedContext;
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK llEventConfirmationCallback;
+static void* llEventUserContext;
+static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC llMessageCallback;
+static void* llMessageUserContext;
 static const TRANSPORT_PROVIDER* provideFAKE(void);
 extern "C" const size_t IoTHubClient_ThreadTerminationOffset;
+extern "C" const size_t IoTHubClient_IsDestroyingOffset;
+static IOTHUB_CLIENT_HANDLE destroyingClientOnConditionWait; /*Condition_Wait marks it as being destroyed, as IoTHubClient_Destroy would from another thread*/
 
 static const IOTHUB_CLIENT_CONFIG TEST_CONFIG =
 {
@@ -103,14 +126,25 @@ public:
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_Destroy, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+        llEventConfirmationCallback = eventConfirmationCallback;
+        llEventUserContext = userContextCallback;
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+
+    MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_Move, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
+        llMessageCallback = messageCallback;
+        llMessageUserContext = userContextCallback;
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
         doWorkCallCount++;
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepth, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, size_t*, messageCount, size_t*, byteCount)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepthByPriority, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, size_t*, messageCount, size_t*, byteCount)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
 
@@ -164,6 +198,61 @@ public:
     MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
     MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
 
+    /* Condition mocks */
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init);
+    MOCK_METHOD_END(COND_HANDLE, TEST_COND_HANDLE);
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle);
+    MOCK_METHOD_END(COND_RESULT, COND_OK);
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        if ((howManyDoWorkCalls > 0) && (howManyDoWorkCalls == doWorkCallCount))
+        {
+            *(sig_atomic_t*)(((char*)threadFuncArg) + IoTHubClient_ThreadTerminationOffset) = 1; /*tell the thread to stop*/
+        }
+        if (destroyingClientOnConditionWait != NULL)
+        {
+            *(bool*)(((char*)destroyingClientOnConditionWait) + IoTHubClient_IsDestroyingOffset) = true;
+        }
+    MOCK_METHOD_END(COND_RESULT, COND_OK);
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle);
+    MOCK_VOID_METHOD_END();
+
+    /* Thread pool mocks */
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, IoTHubClient_ThreadPool_AddWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION, workFunction, void*, context)
+        poolWorkFunction = workFunction;
+        poolWorkContext = context;
+    MOCK_METHOD_END(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, TEST_WORK_ITEM_HANDLE);
+    MOCK_STATIC_METHOD_2(, void, IoTHubClient_ThreadPool_RemoveWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, workItemHandle);
+    MOCK_VOID_METHOD_END();
+
+    /* Ingress queue mocks */
+    MOCK_STATIC_METHOD_0(, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, IoTHubClient_IngressQueue_Create);
+    MOCK_METHOD_END(IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, TEST_INGRESS_QUEUE_HANDLE);
+    MOCK_STATIC_METHOD_1(, void, IoTHubClient_IngressQueue_Destroy, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle);
+    MOCK_VOID_METHOD_END();
+    MOCK_STATIC_METHOD_2(, int, IoTHubClient_IngressQueue_Push, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle, void*, item)
+        ingressQueueItem = item;
+    MOCK_METHOD_END(int, 0);
+    MOCK_STATIC_METHOD_1(, void*, IoTHubClient_IngressQueue_Pop, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle)
+        void* poppedItem = ingressQueueItem;
+        ingressQueueItem = NULL;
+    MOCK_METHOD_END(void*, poppedItem);
+
+    /* Dispatcher mocks */
+    MOCK_STATIC_METHOD_0(, IOTHUB_CLIENT_DISPATCHER_HANDLE, IoTHubClient_Dispatcher_Create);
+    MOCK_METHOD_END(IOTHUB_CLIENT_DISPATCHER_HANDLE, TEST_DISPATCHER_HANDLE);
+    MOCK_STATIC_METHOD_1(, void, IoTHubClient_Dispatcher_Destroy, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle);
+    MOCK_VOID_METHOD_END();
+    MOCK_STATIC_METHOD_3(, int, IoTHubClient_Dispatcher_Post, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle, IOTHUB_CLIENT_DISPATCHER_FUNCTION, function, void*, context)
+        dispatchedFunction = function;
+        dispatchedContext = context;
+    MOCK_METHOD_END(int, 0);
+
+    /* IoTHubMessage mocks */
+    MOCK_STATIC_METHOD_1(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+    MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, TEST_CLONED_MESSAGE_HANDLE);
+    MOCK_STATIC_METHOD_1(, void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+    MOCK_VOID_METHOD_END();
+
     /* gballoc mocks */
     MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
         void* result2;
@@ -215,6 +304,15 @@ public:
     MOCK_STATIC_METHOD_2(, void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubTransport_SetWorkerIdleWaitTime, TRANSPORT_HANDLE, transportHlHandle, unsigned int, idleWaitTime)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
+    MOCK_STATIC_METHOD_1(, void, IoTHubTransport_SignalWorkerThread, TRANSPORT_HANDLE, transportHlHandle)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubTransport_SetThreadPool, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
     MOCK_STATIC_METHOD_2(, int, mallocAndStrcpy_s, char**, destination, const char*, source)
         int result2;
         if ((destination == NULL) || (source == NULL))
@@ -328,9 +426,12 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , IOTHUB_CLIENT_LL_HANDLE, IoTH
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_Destroy, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_Move, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepth, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, size_t*, messageCount, size_t*, byteCount)
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueDepthByPriority, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, size_t*, messageCount, size_t*, byteCount)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetOption, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value)
 
@@ -344,6 +445,26 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , LOCK_RESULT, Lock, LOCK_HANDL
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubClientMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, IoTHubClient_ThreadPool_AddWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION, workFunction, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, IoTHubClient_ThreadPool_RemoveWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, workItemHandle);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubClientMocks, , IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, IoTHubClient_IngressQueue_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_IngressQueue_Destroy, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , int, IoTHubClient_IngressQueue_Push, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle, void*, item);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void*, IoTHubClient_IngressQueue_Pop, IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE, queueHandle);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubClientMocks, , IOTHUB_CLIENT_DISPATCHER_HANDLE, IoTHubClient_Dispatcher_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_Dispatcher_Destroy, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , int, IoTHubClient_Dispatcher_Post, IOTHUB_CLIENT_DISPATCHER_HANDLE, dispatcherHandle, IOTHUB_CLIENT_DISPATCHER_FUNCTION, function, void*, context);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void*, gballoc_malloc, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, gballoc_free, void*, ptr)
@@ -356,6 +477,9 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , TRANSPORT_LL_HANDLE, IoTHubTr
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_StartWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , bool, IoTHubTransport_SignalEndWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_SetWorkerIdleWaitTime, TRANSPORT_HANDLE, transportHlHandle, unsigned int, idleWaitTime);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubTransport_SignalWorkerThread, TRANSPORT_HANDLE, transportHlHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_SetThreadPool, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
@@ -415,8 +539,16 @@ BEGIN_TEST_SUITE(iothubclient_ut)
         whenShallmalloc_fail = 0;
         howManyDoWorkCalls = 0;
         doWorkCallCount = 0;
+        destroyingClientOnConditionWait = NULL;
         threadFunc = NULL;
         threadFuncArg = NULL;
+        ingressQueueItem = NULL;
+        dispatchedFunction = NULL;
+        dispatchedContext = NULL;
+        llEventConfirmationCallback = NULL;
+        llEventUserContext = NULL;
+        llMessageCallback = NULL;
+        llMessageUserContext = NULL;
     }
 
     TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -937,6 +1069,7 @@ BEGIN_TEST_SUITE(iothubclient_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SignalWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE));
 
         // act
         auto result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
@@ -965,6 +1098,7 @@ BEGIN_TEST_SUITE(iothubclient_ut)
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SignalWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE));
 
         // act
         auto result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
@@ -1338,6 +1472,146 @@ BEGIN_TEST_SUITE(iothubclient_ut)
         IoTHubClient_Destroy(iotHubClient);
     }
 
+    /*Tests_SRS_IOTHUBCLIENT_07_033: [ If IoTHubClient_LL_SendEventAsync returns IOTHUB_CLIENT_QUEUE_FULL and OPTION_QUEUE_FULL_POLICY is IOTHUB_CLIENT_QUEUE_FULL_BLOCK, IoTHubClient_SendEventAsync shall wait for room by calling Condition_Wait on the queue space condition with the lock and no timeout, and then call IoTHubClient_LL_SendEventAsync again. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_035: [ If optionName is OPTION_QUEUE_FULL_POLICY and IoTHubClient_LL_SetOption succeeds, IoTHubClient_SetOption shall remember the policy for IoTHubClient_SendEventAsync. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_BLOCK_policy_waits_while_the_queue_is_full)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_QUEUE_FULL);
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_034: [ If Condition_Wait fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_BLOCK_policy_fails_when_Condition_Wait_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_QUEUE_FULL);
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0))
+            .SetReturn(COND_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_059: [ If IoTHubClient_Destroy has been called while IoTHubClient_SendEventAsync was waiting, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR without calling IoTHubClient_LL_SendEventAsync again. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_BLOCK_policy_fails_when_the_client_is_destroyed_while_waiting)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+        mocks.ResetAllCalls();
+
+        destroyingClientOnConditionWait = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_QUEUE_FULL);
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0));
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE)); /*lets IoTHubClient_Destroy go on*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        destroyingClientOnConditionWait = NULL;
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_063: [ If optionName is OPTION_QUEUE_FULL_POLICY and value points to IOTHUB_CLIENT_QUEUE_FULL_BLOCK, IoTHubClient_SetOption shall create the queue space condition (if needed) by calling Condition_Init before calling IoTHubClient_LL_SetOption. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_QueueFullPolicy_BLOCK_creates_the_queue_space_condition)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, OPTION_QUEUE_FULL_POLICY, &policy));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_064: [ If Condition_Init fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_QueueFullPolicy_BLOCK_fails_when_Condition_Init_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .SetReturn((COND_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
     /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
     TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SendEventAsync_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
     {
@@ -1837,227 +2111,1582 @@ BEGIN_TEST_SUITE(iothubclient_ut)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Work scheduling */
+    /* IoTHubClient_IsSendBusy */
 
-    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-    /*Tests_SRS_IOTHUBCLIENT_02_072: [ All threads marked as disposable (upon completion of a file upload) shall be joined and the data structures build for them shall be freed. ]*/
-    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms)
+    /*Tests_SRS_IOTHUBCLIENT_07_054: [ If iotHubClientHandle is NULL, IoTHubClient_IsSendBusy shall return false. ]*/
+    TEST_FUNCTION(IoTHubClient_IsSendBusy_With_NULL_handle_returns_false)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        // act
+        bool result = IoTHubClient_IsSendBusy(NULL);
+
+        // assert
+        ASSERT_IS_FALSE(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_055: [ IoTHubClient_IsSendBusy shall not take the lock and shall return false only when IoTHubClient_LL_GetSendStatus succeeds and reports IOTHUB_CLIENT_SEND_STATUS_IDLE. ]*/
+    TEST_FUNCTION(IoTHubClient_IsSendBusy_returns_false_when_idle_without_locking)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 1;
-        current_iothub_client = iotHubClient;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-        
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
 
         // act
-        threadFunc(threadFuncArg);
+        bool result = IoTHubClient_IsSendBusy(iotHubClient);
 
         // assert
+        ASSERT_IS_FALSE(result);
         mocks.AssertActualAndExpectedCalls();
-        
-        ///cleanup
+
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms_2_times)
+    /*Tests_SRS_IOTHUBCLIENT_07_055: [ IoTHubClient_IsSendBusy shall not take the lock and shall return false only when IoTHubClient_LL_GetSendStatus succeeds and reports IOTHUB_CLIENT_SEND_STATUS_IDLE. ]*/
+    TEST_FUNCTION(IoTHubClient_IsSendBusy_returns_true_when_busy)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 2;
-        current_iothub_client = iotHubClient;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
 
         // act
-        threadFunc(threadFuncArg);
+        bool result = IoTHubClient_IsSendBusy(iotHubClient);
 
         // assert
+        ASSERT_IS_TRUE(result);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.] */
-    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_DoWork_Is_Not_called)
+    /*Tests_SRS_IOTHUBCLIENT_07_055: [ IoTHubClient_IsSendBusy shall not take the lock and shall return false only when IoTHubClient_LL_GetSendStatus succeeds and reports IOTHUB_CLIENT_SEND_STATUS_IDLE. ]*/
+    TEST_FUNCTION(IoTHubClient_IsSendBusy_returns_true_when_getting_the_status_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 1;
-        current_iothub_client = iotHubClient;
-
-        /* first round, when lock fails */
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-
-        /* second round, when lock does not fail and DoWork gets called */
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .SetReturn(IOTHUB_CLIENT_ERROR);
 
         // act
-        threadFunc(threadFuncArg);
+        bool result = IoTHubClient_IsSendBusy(iotHubClient);
 
         // assert
+        ASSERT_IS_TRUE(result);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_SetOption */
+    /* IoTHubClient_SignalQueueSpace */
 
-    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
+    /*Tests_SRS_IOTHUBCLIENT_07_061: [ If iotHubClientHandle is NULL, IoTHubClient_SignalQueueSpace shall do nothing. ]*/
+    TEST_FUNCTION(IoTHubClient_SignalQueueSpace_With_NULL_handle_does_nothing)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
 
-        ///act
-        auto result = IoTHubClient_SetOption(NULL, "a", "b");
-
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        // act
+        IoTHubClient_SignalQueueSpace(NULL);
 
-        ///cleanup
-        
+        // assert
+        mocks.AssertActualAndExpectedCalls();
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
+    /*Tests_SRS_IOTHUBCLIENT_07_062: [ IoTHubClient_SignalQueueSpace shall not take the lock and shall wake up the IoTHubClient_SendEventAsync calls waiting for room in the send queue by calling Condition_Post once for each of them. ]*/
+    TEST_FUNCTION(IoTHubClient_SignalQueueSpace_without_waiting_senders_does_not_lock_nor_post)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
-
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_QUEUE_FULL_POLICY, &policy);
+        mocks.ResetAllCalls();
+
+        // act
+        IoTHubClient_SignalQueueSpace(iotHubClient);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetSendQueueDepth */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_036: [ If iotHubClientHandle is NULL, IoTHubClient_GetSendQueueDepth shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueDepth_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t messageCount;
+        size_t byteCount;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepth(NULL, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_037: [ IoTHubClient_GetSendQueueDepth shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_039: [ IoTHubClient_GetSendQueueDepth shall pass the events in the ingress queue to IoTHubClient_LL, call IoTHubClient_LL_GetSendQueueDepth with messageCount and byteCount and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueDepth_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        size_t messageCount;
+        size_t byteCount;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendQueueDepth(TEST_IOTHUB_CLIENT_LL_HANDLE, &messageCount, &byteCount))
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepth(iotHubClient, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_SIZE, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_038: [ If acquiring the lock fails, IoTHubClient_GetSendQueueDepth shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendQueueDepth_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        size_t messageCount;
+        size_t byteCount;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepth(iotHubClient, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetSendQueueDepthByPriority */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_040: [ If iotHubClientHandle is NULL, IoTHubClient_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueDepthByPriority_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t messageCount;
+        size_t byteCount;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepthByPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_041: [ IoTHubClient_GetSendQueueDepthByPriority shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_043: [ IoTHubClient_GetSendQueueDepthByPriority shall pass the events in the ingress queue to IoTHubClient_LL, call IoTHubClient_LL_GetSendQueueDepthByPriority with priority, messageCount and byteCount and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueDepthByPriority_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        size_t messageCount;
+        size_t byteCount;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendQueueDepthByPriority(TEST_IOTHUB_CLIENT_LL_HANDLE, IOTHUB_MESSAGE_PRIORITY_HIGH, &messageCount, &byteCount))
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepthByPriority(iotHubClient, IOTHUB_MESSAGE_PRIORITY_HIGH, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_SIZE, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_042: [ If acquiring the lock fails, IoTHubClient_GetSendQueueDepthByPriority shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendQueueDepthByPriority_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        size_t messageCount;
+        size_t byteCount;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueDepthByPriority(iotHubClient, IOTHUB_MESSAGE_PRIORITY_HIGH, &messageCount, &byteCount);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Work scheduling */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+    /*Tests_SRS_IOTHUBCLIENT_02_072: [ All threads marked as disposable (upon completion of a file upload) shall be joined and the data structures build for them shall be freed. ]*/
+    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+        
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms_2_times)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 2;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.] */
+    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_DoWork_Is_Not_called)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+
+        /* first round, when lock fails */
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+
+        /* second round, when lock does not fail and DoWork gets called */
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_SetOption */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_001: [ When OPTION_WORKER_IDLE_WAIT_TIME is non-zero, instead of sleeping the thread shall wait on the work condition by calling Condition_Wait while holding the lock, so that it can be woken up by the APIs queueing work. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_002: [ Otherwise the thread shall wait at most WorkerIdleWaitTime milliseconds. ]*/
+    TEST_FUNCTION(Worker_Thread_waits_on_condition_when_idle_wait_time_is_set)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 100));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_003: [ If there are events being sent, the thread shall wait at most 1 ms so that confirmations are processed as fast as before. ]*/
+    TEST_FUNCTION(Worker_Thread_waits_1_ms_when_events_are_being_sent)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 1));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_004: [ APIs that queue work for the worker thread shall wake it up when OPTION_WORKER_IDLE_WAIT_TIME is non-zero. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_signals_the_worker_thread_when_idle_wait_time_is_set)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_005: [ If the transport connection is shared, the worker thread shall be woken up by calling IoTHubTransport_SignalWorkerThread whatever the OPTION_WORKER_IDLE_WAIT_TIME of this client, since the transport keeps the wait time set by any of its clients. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_transport_signals_the_transport_worker_thread)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SignalWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_005: [ If the transport connection is shared, the worker thread shall be woken up by calling IoTHubTransport_SignalWorkerThread whatever the OPTION_WORKER_IDLE_WAIT_TIME of this client, since the transport keeps the wait time set by any of its clients. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_transport_signals_the_transport_worker_thread_when_another_client_set_the_idle_wait_time)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient1 = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient2 = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient1, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient2));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SignalWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient2, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient2);
+        IoTHubClient_Destroy(iotHubClient1);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        ///act
+        auto result = IoTHubClient_SetOption(NULL, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+        ///cleanup
+        
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, NULL, "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_006: [ If optionName is OPTION_WORKER_IDLE_WAIT_TIME then IoTHubClient_SetOption shall create the work condition (if needed) by calling Condition_Init and shall store the value, an unsigned int in milliseconds. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_WorkerIdleWaitTime_creates_the_condition)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Init());
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_009: [ The worker thread shall be woken up so that the new wait time is used immediately. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_WorkerIdleWaitTime_twice_reuses_the_condition)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(handle, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        idleWaitTime = 0;
+        auto result = IoTHubClient_SetOption(handle, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_007: [ If Condition_Init fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_WorkerIdleWaitTime_fails_when_Condition_Init_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Init())
+            .SetReturn((COND_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_008: [ If the transport connection is shared, IoTHubClient_SetOption shall call IoTHubTransport_SetWorkerIdleWaitTime and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_WorkerIdleWaitTime_with_transport_calls_IoTHubTransport_SetWorkerIdleWaitTime)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int idleWaitTime = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SetWorkerIdleWaitTime(TEST_IOTHUBTRANSPORT_HANDLE, 100));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /* IoTHubClient_SetThreadPool */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_015: [ If iotHubClientHandle is NULL, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SetThreadPool_with_NULL_handle_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetThreadPool(NULL, TEST_THREADPOOL_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_016: [ IoTHubClient_SetThreadPool shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_020: [ Otherwise IoTHubClient_SetThreadPool shall store threadPoolHandle, which may be NULL to go back to a dedicated thread, and return IOTHUB_CLIENT_OK. ]*/
+    TEST_FUNCTION(IoTHubClient_SetThreadPool_succeeds)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_017: [ If acquiring the lock fails, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetThreadPool_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_018: [ If the transport connection is shared, IoTHubClient_SetThreadPool shall call IoTHubTransport_SetThreadPool and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_SetThreadPool_with_transport_calls_IoTHubTransport_SetThreadPool)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SetThreadPool(TEST_IOTHUBTRANSPORT_HANDLE, TEST_THREADPOOL_HANDLE))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_019: [ If the work has already been scheduled, IoTHubClient_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetThreadPool_after_the_worker_thread_started_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_012: [ If a thread pool has been set, the work shall be scheduled by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_thread_pool_adds_work_to_the_pool)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_AddWork(TEST_THREADPOOL_HANDLE, IGNORED_PTR_ARG, iotHubClient))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_012: [ If a thread pool has been set, the work shall be scheduled by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]*/
+    TEST_FUNCTION(when_IoTHubClient_ThreadPool_AddWork_fails_IoTHubClient_SendEventAsync_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_AddWork(TEST_THREADPOOL_HANDLE, IGNORED_PTR_ARG, iotHubClient))
+            .IgnoreArgument(2)
+            .SetReturn((IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_013: [ The work item registered with the thread pool shall call IoTHubClient_LL_DoWork under the lock created in IoTHubClient_Create, unless IoTHubClient_Destroy has been called. ]*/
+    TEST_FUNCTION(thread_pool_work_item_calls_IoTHubClient_LL_DoWork_under_the_lock)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        poolWorkFunction(poolWorkContext);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_014: [ If the work was scheduled on a thread pool, IoTHubClient_Destroy shall call IoTHubClient_ThreadPool_RemoveWork after unlocking the serializing lock. ]*/
+    TEST_FUNCTION(IoTHubClient_Destroy_with_thread_pool_removes_the_work_item)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetThreadPool(iotHubClient, TEST_THREADPOOL_HANDLE);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(TEST_LIST_HANDLE));
+#endif
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_RemoveWork(TEST_THREADPOOL_HANDLE, TEST_WORK_ITEM_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        IoTHubClient_Destroy(iotHubClient);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* OPTION_INGRESS_QUEUE */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_021: [ If optionName is OPTION_INGRESS_QUEUE and value points to true, IoTHubClient_SetOption shall create the ingress queue by calling IoTHubClient_IngressQueue_Create and start the worker thread if it was not previously started. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_IngressQueue_creates_the_queue_and_starts_the_worker_thread)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Create());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_027: [ If creating the ingress queue or starting the worker thread fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_IoTHubClient_IngressQueue_Create_fails_IoTHubClient_SetOption_IngressQueue_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Create())
+            .SetReturn((IOTHUB_CLIENT_INGRESS_QUEUE_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_027: [ If creating the ingress queue or starting the worker thread fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_starting_the_worker_thread_fails_IoTHubClient_SetOption_IngressQueue_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Create());
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Destroy(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_028: [ If the transport connection is shared, IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG for OPTION_INGRESS_QUEUE. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_IngressQueue_with_transport_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_029: [ Once the ingress queue has been created it cannot be removed; setting OPTION_INGRESS_QUEUE to false shall then return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_IngressQueue_false_after_true_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        useIngressQueue = false;
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_056: [ If IoTHubClient_SendEventAsync has already been called, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR for OPTION_INGRESS_QUEUE set to true and shall not create the ingress queue. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_IngressQueue_after_SendEventAsync_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_023: [ IoTHubClient_SendEventAsync shall clone eventMessageHandle by calling IoTHubMessage_Clone and add it, with eventConfirmationCallback and userContextCallback, to the ingress queue by calling IoTHubClient_IngressQueue_Push. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_07_031: [ If the ingress queue has been created, IoTHubClient_SendEventAsync shall queue the event without acquiring the lock created in IoTHubClient_Create, instead of calling IoTHubClient_LL_SendEventAsync. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingress_queue_queues_the_event_without_locking)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Push(TEST_INGRESS_QUEUE_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_065: [ When OPTION_WORKER_IDLE_WAIT_TIME is non-zero, IoTHubClient_SendEventAsync shall acquire the lock after queueing the event and wake up the worker thread while holding it, so that the wake-up cannot fall between the worker draining the ingress queue and waiting on the work condition. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingress_queue_and_idle_wait_time_signals_the_worker_thread_under_the_lock)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Push(TEST_INGRESS_QUEUE_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_066: [ If acquiring that lock fails, IoTHubClient_SendEventAsync shall still wake up the worker thread and return IOTHUB_CLIENT_OK. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SendEventAsync_with_ingress_queue_and_idle_wait_time_still_signals_the_worker_thread)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        unsigned int idleWaitTime = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_WORKER_IDLE_WAIT_TIME, &idleWaitTime);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Push(TEST_INGRESS_QUEUE_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_022: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingress_queue_and_NULL_message_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, NULL, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_022: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingress_queue_and_context_without_callback_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_024: [ If any of these operations fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_IoTHubMessage_Clone_fails_IoTHubClient_SendEventAsync_with_ingress_queue_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE))
+            .SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_024: [ If any of these operations fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_IoTHubClient_IngressQueue_Push_fails_IoTHubClient_SendEventAsync_with_ingress_queue_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Push(TEST_INGRESS_QUEUE_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .SetReturn(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        ingressQueueItem = NULL;
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_025: [ The queued events shall be passed to IoTHubClient_LL_SendEventAsync_Move, in the order they were queued, before IoTHubClient_LL_DoWork is called. ]*/
+    TEST_FUNCTION(Worker_Thread_passes_the_queued_events_to_the_LL_before_DoWork)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_Move(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_026: [ If IoTHubClient_LL_SendEventAsync_Move fails for a queued event, its eventConfirmationCallback (if any) shall be called with IOTHUB_CLIENT_CONFIRMATION_ERROR and its message shall be destroyed. ]*/
+    TEST_FUNCTION(when_IoTHubClient_LL_SendEventAsync_fails_for_a_queued_event_its_callback_is_called_with_error)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_STATUS status;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_Move(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, &status));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        (void)IoTHubClient_GetSendStatus(iotHubClient, &status);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_032: [ IoTHubClient_GetSendStatus shall first pass the events in the ingress queue to IoTHubClient_LL, so that they are accounted for in the status. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_with_ingress_queue_passes_the_queued_events_to_the_LL_first)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_STATUS status;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_Move(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, &status))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &status);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, status);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_030: [ IoTHubClient_Destroy shall pass the events left in the ingress queue to IoTHubClient_LL before destroying it, so that their callbacks are called with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+    TEST_FUNCTION(IoTHubClient_Destroy_with_ingress_queue_passes_the_queued_events_to_the_LL_and_destroys_the_queue)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useIngressQueue = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_INGRESS_QUEUE, &useIngressQueue);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_Move(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Pop(TEST_INGRESS_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(TEST_LIST_HANDLE));
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_IngressQueue_Destroy(TEST_INGRESS_QUEUE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        IoTHubClient_Destroy(iotHubClient);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* OPTION_CALLBACK_DISPATCH_THREAD */
+
+    /*Tests_SRS_IOTHUBCLIENT_07_044: [ If optionName is OPTION_CALLBACK_DISPATCH_THREAD and value points to true, IoTHubClient_SetOption shall create the callback dispatcher by calling IoTHubClient_Dispatcher_Create. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_CallbackDispatchThread_creates_the_dispatcher)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
         IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Dispatcher_Create());
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
         ///act
-        auto result = IoTHubClient_SetOption(handle, NULL, "b");
+        auto result = IoTHubClient_SetOption(handle, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         IoTHubClient_Destroy(handle);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+    /*Tests_SRS_IOTHUBCLIENT_07_045: [ If IoTHubClient_Dispatcher_Create fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_IoTHubClient_Dispatcher_Create_fails_IoTHubClient_SetOption_CallbackDispatchThread_fails)
     {
         /// arrange
         CIoTHubClientMocks mocks;
-
+        bool useDispatcher = true;
         IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Dispatcher_Create())
+            .SetReturn((IOTHUB_CLIENT_DISPATCHER_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+        auto result = IoTHubClient_SetOption(handle, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         IoTHubClient_Destroy(handle);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+    /*Tests_SRS_IOTHUBCLIENT_07_046: [ Once the callback dispatcher has been created it cannot be removed; setting OPTION_CALLBACK_DISPATCH_THREAD to false shall then return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_CallbackDispatchThread_false_after_true_fails)
     {
         /// arrange
         CIoTHubClientMocks mocks;
-
+        bool useDispatcher = true;
         IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(handle, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        useDispatcher = false;
+        auto result = IoTHubClient_SetOption(handle, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
         IoTHubClient_Destroy(handle);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+    /*Tests_SRS_IOTHUBCLIENT_07_057: [ If the ingress queue has been created, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR for OPTION_CALLBACK_DISPATCH_THREAD set to true and shall not create the callback dispatcher. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_CallbackDispatchThread_after_IngressQueue_fails)
     {
         /// arrange
         CIoTHubClientMocks mocks;
-
+        bool useIngressQueue = true;
+        bool useDispatcher = true;
         IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(handle, OPTION_INGRESS_QUEUE, &useIngressQueue);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
-            .SetReturn(IOTHUB_CLIENT_ERROR);
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        auto result = IoTHubClient_SetOption(handle, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
@@ -2067,27 +3696,158 @@ BEGIN_TEST_SUITE(iothubclient_ut)
         IoTHubClient_Destroy(handle);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+    /*Tests_SRS_IOTHUBCLIENT_07_047: [ While the callback dispatcher exists, IoTHubClient_SendEventAsync shall pass to IoTHubClient_LL, instead of eventConfirmationCallback (if not NULL), a callback that posts eventConfirmationCallback to the dispatcher by calling IoTHubClient_Dispatcher_Post. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_with_dispatcher_posts_the_confirmation_to_the_dispatcher)
     {
         /// arrange
         CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(3)
+            .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_IS_TRUE(llEventConfirmationCallback != eventConfirmationCallback);
+        mocks.AssertActualAndExpectedCalls();
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Dispatcher_Post(TEST_DISPATCHER_HANDLE, IGNORED_PTR_ARG, llEventUserContext))
+            .IgnoreArgument(2);
+        llEventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, llEventUserContext);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        mocks.ResetAllCalls();
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)0x42));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        dispatchedFunction(dispatchedContext);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_048: [ If allocating the context of that callback fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_allocating_the_dispatched_confirmation_fails_IoTHubClient_SendEventAsync_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .SetReturn((void*)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        IoTHubClient_Destroy(handle);
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_052: [ If a callback cannot be posted to the dispatcher, it shall be called on the thread that runs IoTHubClient_LL_DoWork, as without the dispatcher. ]*/
+    TEST_FUNCTION(when_IoTHubClient_Dispatcher_Post_fails_the_confirmation_is_called_directly)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Dispatcher_Post(TEST_DISPATCHER_HANDLE, IGNORED_PTR_ARG, llEventUserContext))
+            .IgnoreArgument(2)
+            .SetReturn(__LINE__);
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)0x42));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        llEventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, llEventUserContext);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_049: [ While the callback dispatcher exists, IoTHubClient_SetMessageCallback shall still pass messageCallback itself to IoTHubClient_LL, so that the disposition it returns is the one sent for the message. ]*/
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_dispatcher_passes_the_message_callback_itself)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_IS_TRUE(llMessageCallback == messageCallback);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_07_053: [ IoTHubClient_Destroy shall destroy the callback dispatcher by calling IoTHubClient_Dispatcher_Destroy once IoTHubClient_LL has been destroyed and the worker thread joined, so that the callbacks posted to it, including the ones completed by IoTHubClient_LL_Destroy, are called. ]*/
+    TEST_FUNCTION(IoTHubClient_Destroy_with_dispatcher_destroys_the_dispatcher_after_the_LL)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        bool useDispatcher = true;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, OPTION_CALLBACK_DISPATCH_THREAD, &useDispatcher);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+#endif
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, singlylinkedlist_destroy(TEST_LIST_HANDLE));
+#endif
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_Dispatcher_Destroy(TEST_DISPATCHER_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        ///act
+        IoTHubClient_Destroy(iotHubClient);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
     }
 
     /*Tests_SRS_IOTHUBCLIENT_LL_10_007: [** `IoTHubClient_SetDeviceTwinCallback` shall fail and return `IOTHUB_CLIENT_INVALID_ARG` if parameter `iotHubClientHandle` is `NULL`. ]*/
@@ -351,6 +351,9 @@ public:
 
         MOCK_STATIC_METHOD_1(, size_t, STRING_length, STRING_HANDLE, handle)
         MOCK_METHOD_END(size_t, BASEIMPLEMENTATION::STRING_length(handle))
+
+    MOCK_STATIC_METHOD_3(, void, test_release_buffer, const unsigned char*, byteArray, size_t, size, void*, context)
+    MOCK_VOID_METHOD_END()
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubMessageMocks, , void*, gballoc_malloc, size_t, size);
@@ -383,6 +386,7 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubMessageMocks, , int, STRING_concat_with_STRI
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubMessageMocks, , int, STRING_empty, STRING_HANDLE, s1);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubMessageMocks, , const char*, STRING_c_str, STRING_HANDLE, s);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubMessageMocks, , size_t, STRING_length, STRING_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubMessageMocks, , void, test_release_buffer, const unsigned char*, byteArray, size_t, size, void*, context);
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_RESULT_VALUES);
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
@@ -1527,4 +1531,272 @@ BEGIN_TEST_SUITE(iothubmessage_ut)
         IoTHubMessage_Destroy(h);
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_07_023: [ IoTHubMessage_CreateFromByteArrayNoCopy shall keep byteArray, size, releaseCallback and context without copying the content of byteArray. ]*/
+    /*Tests_SRS_IOTHUBMESSAGE_07_024: [ IoTHubMessage_CreateFromByteArrayNoCopy shall call Map_Create to create the message properties. ]*/
+    /*Tests_SRS_IOTHUBMESSAGE_07_026: [ Otherwise, IoTHubMessage_CreateFromByteArrayNoCopy shall return a non-NULL handle of type IOTHUBMESSAGE_BYTEARRAY. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArrayNoCopy_happy_path)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, test_release_buffer, (void*)0x42);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY, IoTHubMessage_GetContentType(h));
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_022: [ If size is not zero and byteArray is NULL, IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArrayNoCopy_fails_when_size_non_zero_buffer_NULL)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(NULL, 1, test_release_buffer, (void*)0x42);
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_025: [ If there are any errors then IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL and shall not call releaseCallback. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArrayNoCopy_fails_when_Map_Create_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        whenShallMap_Create_fail = currentMap_Create_call + 1;
+        STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, test_release_buffer, (void*)0x42);
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_025: [ If there are any errors then IoTHubMessage_CreateFromByteArrayNoCopy shall return NULL and shall not call releaseCallback. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArrayNoCopy_fails_when_gballoc_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, test_release_buffer, (void*)0x42);
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_028: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_GetByteArray shall return the byteArray and size it was created with. ]*/
+    TEST_FUNCTION(IoTHubMessage_GetByteArray_with_NoCopy_message_returns_the_wrapped_byte_array)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, NULL, NULL);
+        const unsigned char* byteArray;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        ///act
+        auto r = IoTHubMessage_GetByteArray(h, &byteArray, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)c, (void*)byteArray);
+        ASSERT_ARE_EQUAL(size_t, 1, size);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_027: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_Clone shall copy its byte array by calling BUFFER_create. ]*/
+    TEST_FUNCTION(IoTHubMessage_Clone_with_NoCopy_message_copies_the_byte_array)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, test_release_buffer, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, BUFFER_create(c, 1));
+        STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_029: [ If iotHubMessageHandle was created by IoTHubMessage_CreateFromByteArrayNoCopy, IoTHubMessage_Destroy shall call releaseCallback (if not NULL) with the byteArray, size and context the message was created with. ]*/
+    TEST_FUNCTION(IoTHubMessage_Destroy_with_NoCopy_message_calls_the_release_callback)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArrayNoCopy(c, 1, test_release_buffer, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, test_release_buffer(c, 1, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(h));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///act
+        IoTHubMessage_Destroy(h);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_030: [ If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL. ]*/
+    TEST_FUNCTION(IoTHubMessage_GetPriority_with_NULL_handle_returns_normal)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_031: [ Otherwise IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL if IoTHubMessage_SetPriority was never called. ]*/
+    TEST_FUNCTION(IoTHubMessage_GetPriority_of_a_new_message_returns_normal)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(h);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_032: [ If iotHubMessageHandle is NULL or priority is not one of the IOTHUB_MESSAGE_PRIORITY values, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubMessage_SetPriority_with_NULL_handle_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_032: [ If iotHubMessageHandle is NULL or priority is not one of the IOTHUB_MESSAGE_PRIORITY values, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubMessage_SetPriority_with_unknown_priority_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, (IOTHUB_MESSAGE_PRIORITY)42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)IoTHubMessage_GetPriority(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_033: [ Otherwise IoTHubMessage_SetPriority shall store priority in the message and return IOTHUB_MESSAGE_OK. ]*/
+    TEST_FUNCTION(IoTHubMessage_SetPriority_succeeds)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromString("a");
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_HIGH, (int)IoTHubMessage_GetPriority(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_07_034: [ IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle. ]*/
+    TEST_FUNCTION(IoTHubMessage_Clone_copies_the_priority)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        (void)IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_LOW);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, BUFFER_clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_LOW, (int)IoTHubMessage_GetPriority(r));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
 END_TEST_SUITE(iothubmessage_ut)
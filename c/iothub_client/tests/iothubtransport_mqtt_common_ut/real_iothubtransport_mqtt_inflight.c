@@ -0,0 +1,7 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*the transport under test uses the real table, its allocations are not mocked*/
+#define GBALLOC_H
+
+#include "../../src/iothubtransport_mqtt_inflight.c"
@@ -0,0 +1,512 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransport_mqtt_inflight.h"
+
+#define TEST_CAPACITY           3
+#define TEST_RECORD_COUNT       64
+#define TEST_PACKET_ID          (uint16_t)42
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static int g_records[TEST_RECORD_COUNT];
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+/*inserts the records under the packet ids firstPacketId, firstPacketId + step, ...*/
+static void insert_records(IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle, size_t count, uint16_t firstPacketId, uint16_t step)
+{
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        int result = iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)(firstPacketId + i * step), &g_records[i]);
+        ASSERT_ARE_EQUAL(int, 0, result);
+    }
+}
+
+BEGIN_TEST_SUITE(iothubtransport_mqtt_inflight_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_001: [ If initialCapacity is 0, iothubtransport_mqtt_inflight_create shall fail and return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_create_with_0_initialCapacity_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE result = iothubtransport_mqtt_inflight_create(0);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_002: [ iothubtransport_mqtt_inflight_create shall allocate memory for the table and for its slots, all of them free. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_create_succeeds)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    ///act
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE result = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, iothubtransport_mqtt_inflight_get_count(result));
+    ASSERT_IS_NULL(iothubtransport_mqtt_inflight_find(result, TEST_PACKET_ID));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_003: [ If any allocation fails, iothubtransport_mqtt_inflight_create shall free everything it allocated and return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_create_when_malloc_fails_it_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    ///act
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE result = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_003: [ If any allocation fails, iothubtransport_mqtt_inflight_create shall free everything it allocated and return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_create_when_malloc_of_the_slots_fails_it_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE result = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_004: [ The number of slots shall be the smallest power of 2, at least 4 and at most 65536, whose 3/4 is not smaller than initialCapacity. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_create_holds_initialCapacity_records_without_growing)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    ///act
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_005: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_destroy shall do nothing. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_destroy_with_NULL_handle_does_nothing)
+{
+    ///arrange
+
+    ///act
+    iothubtransport_mqtt_inflight_destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_006: [ iothubtransport_mqtt_inflight_destroy shall free the slots and the table, and shall not touch the records. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_destroy_frees_the_table)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(inflightHandle));
+
+    ///act
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_007: [ If inflightHandle or record is NULL, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_with_invalid_arguments_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result1 = iothubtransport_mqtt_inflight_insert(NULL, TEST_PACKET_ID, &g_records[0]);
+    int result2 = iothubtransport_mqtt_inflight_insert(inflightHandle, TEST_PACKET_ID, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(size_t, 0, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_008: [ If packetId is already in the table, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_of_a_packet_id_in_flight_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, 1, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = iothubtransport_mqtt_inflight_insert(inflightHandle, TEST_PACKET_ID, &g_records[1]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[0], iothubtransport_mqtt_inflight_find(inflightHandle, TEST_PACKET_ID));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_009: [ When the table is 3/4 full, iothubtransport_mqtt_inflight_insert shall rebuild it with twice as many slots, up to 65536. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_when_3_quarters_full_grows_the_table)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    int result = iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY), &g_records[TEST_CAPACITY]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY + 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[0], iothubtransport_mqtt_inflight_find(inflightHandle, TEST_PACKET_ID));
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[TEST_CAPACITY], iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY)));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_010: [ If the table cannot be rebuilt, iothubtransport_mqtt_inflight_insert shall keep using its current slots. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_when_the_table_cannot_grow_uses_its_slots)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    ///act
+    int result = iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY), &g_records[TEST_CAPACITY]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[TEST_CAPACITY], iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY)));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_011: [ If every slot is taken, iothubtransport_mqtt_inflight_insert shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_when_every_slot_is_taken_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    (void)iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY), &g_records[TEST_CAPACITY]);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    ///act
+    int result = iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY + 1), &g_records[TEST_CAPACITY + 1]);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY + 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_IS_NULL(iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY + 1)));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_012: [ Otherwise iothubtransport_mqtt_inflight_insert shall store record in the first free slot from the slot of packetId on and return 0. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_of_colliding_packet_ids_keeps_them_apart)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_RECORD_COUNT);
+    size_t i;
+    umock_c_reset_all_calls();
+
+    ///act
+    /*every packet id lands on the same slot of the 128 slots of the table*/
+    insert_records(inflightHandle, TEST_RECORD_COUNT, TEST_PACKET_ID, 128);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORD_COUNT, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    for (i = 0; i < TEST_RECORD_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_records[i], iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + i * 128)));
+    }
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_012: [ Otherwise iothubtransport_mqtt_inflight_insert shall store record in the first free slot from the slot of packetId on and return 0. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_insert_holds_every_packet_id)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(1);
+    uint32_t packetId;
+    int result = 0;
+    umock_c_reset_all_calls();
+
+    ///act
+    for (packetId = 0; (packetId <= UINT16_MAX) && (result == 0); packetId++)
+    {
+        result = iothubtransport_mqtt_inflight_insert(inflightHandle, (uint16_t)packetId, &g_records[packetId % TEST_RECORD_COUNT]);
+    }
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, (size_t)UINT16_MAX + 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[UINT16_MAX % TEST_RECORD_COUNT], iothubtransport_mqtt_inflight_find(inflightHandle, UINT16_MAX));
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_013: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_find shall return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_find_with_NULL_handle_returns_NULL)
+{
+    ///arrange
+
+    ///act
+    void* result = iothubtransport_mqtt_inflight_find(NULL, TEST_PACKET_ID);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_014: [ iothubtransport_mqtt_inflight_find shall return the record stored under packetId, or NULL if there is none. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_find_returns_the_record_of_the_packet_id)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    ///act
+    void* result1 = iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + 1));
+    void* result2 = iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + TEST_CAPACITY));
+
+    ///assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[1], result1);
+    ASSERT_IS_NULL(result2);
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_015: [ If inflightHandle is NULL, iothubtransport_mqtt_inflight_remove shall return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_remove_with_NULL_handle_returns_NULL)
+{
+    ///arrange
+
+    ///act
+    void* result = iothubtransport_mqtt_inflight_remove(NULL, TEST_PACKET_ID);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_016: [ If packetId is not in the table, iothubtransport_mqtt_inflight_remove shall return NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_remove_of_an_unknown_packet_id_returns_NULL)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, 1, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    ///act
+    void* result = iothubtransport_mqtt_inflight_remove(inflightHandle, (uint16_t)(TEST_PACKET_ID + 1));
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_017: [ Otherwise iothubtransport_mqtt_inflight_remove shall free the slot, move back the records that probed past it so no tombstone is left, and return the record. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_remove_returns_the_record_and_frees_its_slot)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_CAPACITY);
+    insert_records(inflightHandle, TEST_CAPACITY, TEST_PACKET_ID, 1);
+    umock_c_reset_all_calls();
+
+    ///act
+    void* result = iothubtransport_mqtt_inflight_remove(inflightHandle, TEST_PACKET_ID);
+
+    ///assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[0], result);
+    ASSERT_ARE_EQUAL(size_t, TEST_CAPACITY - 1, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    ASSERT_IS_NULL(iothubtransport_mqtt_inflight_find(inflightHandle, TEST_PACKET_ID));
+    ASSERT_ARE_EQUAL(void_ptr, &g_records[1], iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + 1)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_017: [ Otherwise iothubtransport_mqtt_inflight_remove shall free the slot, move back the records that probed past it so no tombstone is left, and return the record. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_remove_keeps_the_colliding_packet_ids_reachable)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_INFLIGHT_HANDLE inflightHandle = iothubtransport_mqtt_inflight_create(TEST_RECORD_COUNT);
+    size_t i;
+    insert_records(inflightHandle, TEST_RECORD_COUNT, TEST_PACKET_ID, 128);
+    umock_c_reset_all_calls();
+
+    ///act
+    for (i = 0; i < TEST_RECORD_COUNT; i += 2)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_records[i], iothubtransport_mqtt_inflight_remove(inflightHandle, (uint16_t)(TEST_PACKET_ID + i * 128)));
+    }
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORD_COUNT / 2, iothubtransport_mqtt_inflight_get_count(inflightHandle));
+    for (i = 0; i < TEST_RECORD_COUNT; i++)
+    {
+        void* expected = ((i % 2) == 0) ? NULL : &g_records[i];
+        ASSERT_ARE_EQUAL(void_ptr, expected, iothubtransport_mqtt_inflight_find(inflightHandle, (uint16_t)(TEST_PACKET_ID + i * 128)));
+    }
+
+    ///cleanup
+    iothubtransport_mqtt_inflight_destroy(inflightHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_INFLIGHT_07_018: [ iothubtransport_mqtt_inflight_get_count shall return the number of records in the table, or 0 if inflightHandle is NULL. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_inflight_get_count_with_NULL_handle_returns_0)
+{
+    ///arrange
+
+    ///act
+    size_t result = iothubtransport_mqtt_inflight_get_count(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothubtransport_mqtt_inflight_ut)
@@ -0,0 +1,430 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransport_mqtt_topic.h"
+
+#define TEST_MAX_PROPERTIES     8
+#define TEST_MAX_PROPERTY_SIZE  1024
+
+static const char* TEST_DEVICE_TWIN_RESPONSE_TOPIC = "$iothub/twin/res/204/?$rid=42";
+static const char* TEST_DEVICE_TWIN_PATCH_TOPIC = "$iothub/twin/PATCH/properties/desired/?$version=3";
+static const char* TEST_DEVICE_METHOD_TOPIC = "$iothub/methods/POST/reboot_device/?$rid=7";
+static const char* TEST_C2D_TOPIC = "devices/thisIsDeviceID/messages/devicebound/iothub-ack=Full&propName=PropValue&%24.to=%2Fdevices%2FthisIsDeviceID%2Fmessages%2FdeviceBound&%24.cid&%24.uid";
+static const char* TEST_C2D_PROPERTIES = "iothub-ack=Full&propName=PropValue&%24.to=%2Fdevices%2FthisIsDeviceID%2Fmessages%2FdeviceBound&%24.cid&%24.uid";
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static size_t g_propertyCount;
+static char g_propertyNames[TEST_MAX_PROPERTIES][TEST_MAX_PROPERTY_SIZE];
+static char g_propertyValues[TEST_MAX_PROPERTIES][TEST_MAX_PROPERTY_SIZE];
+static size_t g_stopAtProperty;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+/*copies the properties it is called with, and stops at the property g_stopAtProperty*/
+static int on_property(void* context, const char* name, const char* value)
+{
+    int result;
+    ASSERT_ARE_EQUAL(void_ptr, &g_propertyCount, context);
+    if (g_propertyCount == g_stopAtProperty || g_propertyCount == TEST_MAX_PROPERTIES)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        (void)strncpy(g_propertyNames[g_propertyCount], name, TEST_MAX_PROPERTY_SIZE - 1);
+        (void)strncpy(g_propertyValues[g_propertyCount], value, TEST_MAX_PROPERTY_SIZE - 1);
+        g_propertyCount++;
+        result = 0;
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(iothubtransport_mqtt_topic_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    umock_c_reset_all_calls();
+
+    g_propertyCount = 0;
+    g_stopAtProperty = TEST_MAX_PROPERTIES;
+    memset(g_propertyNames, 0, sizeof(g_propertyNames));
+    memset(g_propertyValues, 0, sizeof(g_propertyValues));
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_001: [ If topic or topicInfo is NULL, iothubtransport_mqtt_topic_parse shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_with_invalid_arguments_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse(NULL, &topicInfo);
+    int result2 = iothubtransport_mqtt_topic_parse(TEST_C2D_TOPIC, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_002: [ iothubtransport_mqtt_topic_parse shall read the topic once, without allocating memory, and shall reset every field of topicInfo before filling it. ]*/
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_005: [ Otherwise iothubtransport_mqtt_topic_parse shall read the status code from the next segment, and shall fail if it is not a number. ]*/
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_006: [ iothubtransport_mqtt_topic_parse shall read the request id from the $rid of the query string after the status code, and leave it 0 if there is none. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_device_twin_response_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+    memset(&topicInfo, 0xFF, sizeof(topicInfo));
+
+    ///act
+    int result = iothubtransport_mqtt_topic_parse(TEST_DEVICE_TWIN_RESPONSE_TOPIC, &topicInfo);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN, topicInfo.type);
+    ASSERT_IS_FALSE(topicInfo.isPatch);
+    ASSERT_ARE_EQUAL(int, 204, topicInfo.statusCode);
+    ASSERT_ARE_EQUAL(size_t, 42, topicInfo.requestId);
+    ASSERT_IS_NULL(topicInfo.methodName);
+    ASSERT_IS_NULL(topicInfo.properties);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_006: [ iothubtransport_mqtt_topic_parse shall read the request id from the $rid of the query string after the status code, and leave it 0 if there is none. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_device_twin_response_finds_rid_among_other_parameters)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse("$iothub/twin/res/200/?$version=5&$rid=9", &topicInfo);
+    size_t requestId1 = topicInfo.requestId;
+    int result2 = iothubtransport_mqtt_topic_parse("$iothub/twin/res/200/", &topicInfo);
+    size_t requestId2 = topicInfo.requestId;
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(size_t, 9, requestId1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(size_t, 0, requestId2);
+    ASSERT_ARE_EQUAL(int, 200, topicInfo.statusCode);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_005: [ Otherwise iothubtransport_mqtt_topic_parse shall read the status code from the next segment, and shall fail if it is not a number. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_device_twin_response_with_invalid_status_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse("$iothub/twin/res/2x0/?$rid=2", &topicInfo);
+    int result2 = iothubtransport_mqtt_topic_parse("$iothub/twin/res//?$rid=2", &topicInfo);
+    int result3 = iothubtransport_mqtt_topic_parse("$iothub/twin/res", &topicInfo);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_004: [ If the segment after $iothub/twin is PATCH, iothubtransport_mqtt_topic_parse shall set isPatch to true. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_device_twin_patch_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result = iothubtransport_mqtt_topic_parse(TEST_DEVICE_TWIN_PATCH_TOPIC, &topicInfo);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN, topicInfo.type);
+    ASSERT_IS_TRUE(topicInfo.isPatch);
+    ASSERT_ARE_EQUAL(int, 0, topicInfo.statusCode);
+    ASSERT_ARE_EQUAL(size_t, 0, topicInfo.requestId);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_003: [ A topic starting with $iothub/twin/ shall be a device twin topic, a topic starting with $iothub/methods/ a device method topic, regardless of case, and any other topic a cloud to device message. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_ignores_the_case_of_the_prefix)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO twinInfo;
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO methodInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse("$IOTHUB/Twin/res/200/?$rid=2", &twinInfo);
+    int result2 = iothubtransport_mqtt_topic_parse("$IoTHub/METHODS/POST/method/?$rid=2", &methodInfo);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_TWIN, twinInfo.type);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD, methodInfo.type);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_007: [ iothubtransport_mqtt_topic_parse shall point methodName at the segment after the verb of a device method topic and read the request id from the $rid of the query string that follows it. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_device_method_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result = iothubtransport_mqtt_topic_parse(TEST_DEVICE_METHOD_TOPIC, &topicInfo);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_DEVICE_METHOD, topicInfo.type);
+    ASSERT_ARE_EQUAL(size_t, strlen("reboot_device"), topicInfo.methodNameLength);
+    ASSERT_ARE_EQUAL(int, 0, memcmp("reboot_device", topicInfo.methodName, topicInfo.methodNameLength));
+    ASSERT_ARE_EQUAL(void_ptr, TEST_DEVICE_METHOD_TOPIC + strlen("$iothub/methods/POST/"), topicInfo.methodName);
+    ASSERT_ARE_EQUAL(size_t, 7, topicInfo.requestId);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_008: [ If the method name is empty or is not followed by a query string with a $rid, iothubtransport_mqtt_topic_parse shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_malformed_device_method_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse("$iothub/methods/POST//?$rid=2", &topicInfo);
+    int result2 = iothubtransport_mqtt_topic_parse("$iothub/methods/POST/method_name", &topicInfo);
+    int result3 = iothubtransport_mqtt_topic_parse("$iothub/methods/POST/method_name/?$version=2", &topicInfo);
+    int result4 = iothubtransport_mqtt_topic_parse("$iothub/methods/POST/method_name/?$rid=", &topicInfo);
+    int result5 = iothubtransport_mqtt_topic_parse("$iothub/methods/POST", &topicInfo);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result4);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result5);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_009: [ iothubtransport_mqtt_topic_parse shall point properties at what follows devices/{device id}/messages/devicebound/ in a cloud to device message topic, or at the end of the topic if there is nothing there. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_c2d_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result = iothubtransport_mqtt_topic_parse(TEST_C2D_TOPIC, &topicInfo);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, IOTHUBTRANSPORT_MQTT_TOPIC_C2D, topicInfo.type);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_C2D_PROPERTIES, topicInfo.properties);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_009: [ iothubtransport_mqtt_topic_parse shall point properties at what follows devices/{device id}/messages/devicebound/ in a cloud to device message topic, or at the end of the topic if there is nothing there. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_parse_c2d_without_properties_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORT_MQTT_TOPIC_INFO topicInfo;
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_parse("devices/thisIsDeviceID/messages/devicebound/", &topicInfo);
+    const char* properties1 = topicInfo.properties;
+    int result2 = iothubtransport_mqtt_topic_parse("devices/thisIsDeviceID", &topicInfo);
+    const char* properties2 = topicInfo.properties;
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(char_ptr, "", properties1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, "", properties2);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_010: [ If properties or propertyCallback is NULL, iothubtransport_mqtt_topic_for_each_property shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_with_invalid_arguments_fails)
+{
+    ///arrange
+
+    ///act
+    int result1 = iothubtransport_mqtt_topic_for_each_property(NULL, on_property, &g_propertyCount);
+    int result2 = iothubtransport_mqtt_topic_for_each_property(TEST_C2D_PROPERTIES, NULL, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(size_t, 0, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_011: [ iothubtransport_mqtt_topic_for_each_property shall call propertyCallback with the URL decoded name and value of each &-separated name=value pair, skipping the pairs with no = or with an empty name. ]*/
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_012: [ iothubtransport_mqtt_topic_for_each_property shall decode the property in a buffer on the stack, or allocate one if it does not fit. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_decodes_every_property)
+{
+    ///arrange
+
+    ///act
+    int result = iothubtransport_mqtt_topic_for_each_property(TEST_C2D_PROPERTIES, on_property, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 3, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, "iothub-ack", g_propertyNames[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "Full", g_propertyValues[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "propName", g_propertyNames[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "PropValue", g_propertyValues[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "$.to", g_propertyNames[2]);
+    ASSERT_ARE_EQUAL(char_ptr, "/devices/thisIsDeviceID/messages/deviceBound", g_propertyValues[2]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_011: [ iothubtransport_mqtt_topic_for_each_property shall call propertyCallback with the URL decoded name and value of each &-separated name=value pair, skipping the pairs with no = or with an empty name. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_keeps_what_is_not_URL_encoded)
+{
+    ///arrange
+
+    ///act
+    int result = iothubtransport_mqtt_topic_for_each_property("=skipped&&a%3Db=c=d&empty=&bad=%zz%4&upper=%7E%7e", on_property, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 4, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, "a=b", g_propertyNames[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "c=d", g_propertyValues[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "empty", g_propertyNames[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "", g_propertyValues[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "bad", g_propertyNames[2]);
+    ASSERT_ARE_EQUAL(char_ptr, "%zz%4", g_propertyValues[2]);
+    ASSERT_ARE_EQUAL(char_ptr, "upper", g_propertyNames[3]);
+    ASSERT_ARE_EQUAL(char_ptr, "~~", g_propertyValues[3]);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_012: [ iothubtransport_mqtt_topic_for_each_property shall decode the property in a buffer on the stack, or allocate one if it does not fit. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_allocates_for_a_large_property)
+{
+    ///arrange
+    char properties[TEST_MAX_PROPERTY_SIZE];
+    (void)strcpy(properties, "large=");
+    (void)memset(properties + 6, 'v', 500);
+    properties[506] = '\0';
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(507));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    int result = iothubtransport_mqtt_topic_for_each_property(properties, on_property, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, "large", g_propertyNames[0]);
+    ASSERT_ARE_EQUAL(char_ptr, properties + 6, g_propertyValues[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_013: [ If the buffer cannot be allocated, iothubtransport_mqtt_topic_for_each_property shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_when_malloc_fails_it_fails)
+{
+    ///arrange
+    char properties[TEST_MAX_PROPERTY_SIZE];
+    (void)strcpy(properties, "large=");
+    (void)memset(properties + 6, 'v', 500);
+    properties[506] = '\0';
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    ///act
+    int result = iothubtransport_mqtt_topic_for_each_property(properties, on_property, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORT_MQTT_TOPIC_07_014: [ If propertyCallback returns a non-zero value, iothubtransport_mqtt_topic_for_each_property shall stop and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransport_mqtt_topic_for_each_property_stops_when_the_callback_fails)
+{
+    ///arrange
+    g_stopAtProperty = 1;
+
+    ///act
+    int result = iothubtransport_mqtt_topic_for_each_property(TEST_C2D_PROPERTIES, on_property, &g_propertyCount);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_propertyCount);
+    ASSERT_ARE_EQUAL(char_ptr, "iothub-ack", g_propertyNames[0]);
+}
+
+END_TEST_SUITE(iothubtransport_mqtt_topic_ut)
@@ -14,6 +14,7 @@
 #include "iothubtransport.h"
 
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 
@@ -62,6 +63,8 @@ static size_t doWorkCallCount = 0;
 extern "C" const size_t IoTHubTransport_ThreadTerminationOffset;
 static THREAD_START_FUNC threadFunc;
 static void* threadFuncArg;
+static IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION poolWorkFunction;
+static void* poolWorkContext;
 
 #define TEST_DEVICE_ID "theidofTheDevice"
 #define TEST_DEVICE_KEY "theKeyoftheDevice"
@@ -71,7 +74,10 @@ static void* threadFuncArg;
 #define TEST_IOTHUB_CLIENT_HANDLE1 (IOTHUB_CLIENT_HANDLE)0xDEAD
 #define TEST_IOTHUB_CLIENT_HANDLE2 (IOTHUB_CLIENT_HANDLE)0xDEAF
 #define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4443
+#define TEST_COND_HANDLE (COND_HANDLE)0x4444
 #define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4442
+#define TEST_THREADPOOL_HANDLE (IOTHUB_CLIENT_THREADPOOL_HANDLE)0x4445
+#define TEST_WORK_ITEM_HANDLE (IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE)0x4446
 
 
 
@@ -368,6 +374,34 @@ public:
     MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
     MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
 
+    /* Condition mocks */
+    MOCK_STATIC_METHOD_0(, COND_HANDLE, Condition_Init);
+    MOCK_METHOD_END(COND_HANDLE, TEST_COND_HANDLE);
+    MOCK_STATIC_METHOD_1(, COND_RESULT, Condition_Post, COND_HANDLE, handle);
+    MOCK_METHOD_END(COND_RESULT, COND_OK);
+    MOCK_STATIC_METHOD_3(, COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds)
+        if ((howManyDoWorkCalls > 0) && (howManyDoWorkCalls == doWorkCallCount))
+        {
+            *(sig_atomic_t*)(((char*)threadFuncArg) + IoTHubTransport_ThreadTerminationOffset) = 1; /*tell the thread to stop*/
+        }
+    MOCK_METHOD_END(COND_RESULT, COND_OK);
+    MOCK_STATIC_METHOD_1(, void, Condition_Deinit, COND_HANDLE, handle);
+    MOCK_VOID_METHOD_END();
+
+    /* Thread pool mocks */
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, IoTHubClient_ThreadPool_AddWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION, workFunction, void*, context)
+        poolWorkFunction = workFunction;
+        poolWorkContext = context;
+    MOCK_METHOD_END(IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, TEST_WORK_ITEM_HANDLE);
+    MOCK_STATIC_METHOD_2(, void, IoTHubClient_ThreadPool_RemoveWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, workItemHandle);
+    MOCK_VOID_METHOD_END();
+
+    /* iothub_client mocks */
+    MOCK_STATIC_METHOD_1(, bool, IoTHubClient_IsSendBusy, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+    MOCK_METHOD_END(bool, false);
+    MOCK_STATIC_METHOD_1(, void, IoTHubClient_SignalQueueSpace, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+    MOCK_VOID_METHOD_END();
+
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, DList_InitializeListHead, PDLIST_ENTRY, listHead);
@@ -437,6 +471,17 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , LOCK_RESULT, Lock, LOCK_HA
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, , COND_HANDLE, Condition_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , COND_RESULT, Condition_Post, COND_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , COND_RESULT, Condition_Wait, COND_HANDLE, handle, LOCK_HANDLE, lock, int, timeout_milliseconds);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, Condition_Deinit, COND_HANDLE, handle);
+
+DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, IoTHubClient_ThreadPool_AddWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_FUNCTION, workFunction, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , void, IoTHubClient_ThreadPool_RemoveWork, IOTHUB_CLIENT_THREADPOOL_HANDLE, threadPoolHandle, IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE, workItemHandle);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , bool, IoTHubClient_IsSendBusy, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, IoTHubClient_SignalQueueSpace, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+
 static TRANSPORT_PROVIDER FAKE_transport_provider =
 {
     FAKE_IoTHubTransport_Subscribe_DeviceMethod,    /*pfIoTHubTransport_Subscribe_DeviceMethod IoTHubTransport_Subscribe_DeviceMethod;*/
@@ -1279,11 +1324,21 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
     STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
     STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
     STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
     STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
     STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
     STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
     STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
     STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
@@ -1304,6 +1359,7 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
 
 //Tests_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. 
+//Tests_SRS_IOTHUBTRANSPORT_07_015: [ After each call to lower layer transport DoWork, IoTHubClient_SignalQueueSpace shall be called for each client using the transport, so that the events waiting for room in the send queue are retried. ]
 TEST_FUNCTION(IoTHubTransport_worker_thread_runs_two_devices_once)
 {
     CIotHubTransportMocks mocks;
@@ -1319,6 +1375,14 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_two_devices_once)
     STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
     STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE2));
 
     STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
@@ -1356,6 +1420,14 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_lock_fails)
     STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
     STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
     STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE2));
     STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
     STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
@@ -1374,5 +1446,348 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_lock_fails)
     IoTHubTransport_Destroy(transportHandle);
 }
 
+//Tests_SRS_IOTHUBTRANSPORT_07_001: [ If an idle wait time has been set, the thread shall call Condition_Wait with the transport lock and the idle wait time instead of sleeping. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_waits_on_condition_when_idle_wait_time_is_set)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetWorkerIdleWaitTime(transportHandle, 100);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    mocks.ResetAllCalls();
+
+    howManyDoWorkCalls = 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_IsSendBusy(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 100));
+    STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    threadFunc(threadFuncArg);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_014: [ If any client using the transport reports that it is busy sending, the thread shall wait at most 1 ms so that confirmations are processed as fast as before. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_waits_1_ms_when_a_client_is_busy)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetWorkerIdleWaitTime(transportHandle, 100);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2);
+    mocks.ResetAllCalls();
+
+    howManyDoWorkCalls = 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE2));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_IsSendBusy(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_IsSendBusy(TEST_IOTHUB_CLIENT_HANDLE2))
+        .SetReturn(true);
+    STRICT_EXPECTED_CALL(mocks, Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 1));
+    STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+    STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    threadFunc(threadFuncArg);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2);
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_002: [ If transportHandle is NULL, IoTHubTransport_SetWorkerIdleWaitTime shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleWaitTime_NULL_handle_fails)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+
+    ///act
+    auto result = IoTHubTransport_SetWorkerIdleWaitTime(NULL, 100);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_INVALID_ARG, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_003: [ IoTHubTransport_SetWorkerIdleWaitTime shall create the work condition by calling Condition_Init if it does not exist yet and idleWaitTime is not 0. ]
+//Tests_SRS_IOTHUBTRANSPORT_07_005: [ IoTHubTransport_SetWorkerIdleWaitTime shall store idleWaitTime, wake up the worker thread and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleWaitTime_creates_condition)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Condition_Init());
+
+    ///act
+    auto result = IoTHubTransport_SetWorkerIdleWaitTime(transportHandle, 100);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_004: [ If Condition_Init fails, IoTHubTransport_SetWorkerIdleWaitTime shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleWaitTime_Condition_Init_fails)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Condition_Init())
+        .SetReturn((COND_HANDLE)NULL);
+
+    ///act
+    auto result = IoTHubTransport_SetWorkerIdleWaitTime(transportHandle, 100);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_ERROR, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_006: [ If transportHandle is NULL, IoTHubTransport_SignalWorkerThread shall do nothing. ]
+TEST_FUNCTION(IoTHubTransport_SignalWorkerThread_NULL_handle_does_nothing)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+
+    ///act
+    IoTHubTransport_SignalWorkerThread(NULL);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_007: [ If an idle wait time has been set, IoTHubTransport_SignalWorkerThread shall wake up the worker thread by calling Condition_Post. ]
+TEST_FUNCTION(IoTHubTransport_SignalWorkerThread_posts_condition)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetWorkerIdleWaitTime(transportHandle, 100);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Condition_Post(TEST_COND_HANDLE));
+
+    ///act
+    IoTHubTransport_SignalWorkerThread(transportHandle);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_007: [ If an idle wait time has been set, IoTHubTransport_SignalWorkerThread shall wake up the worker thread by calling Condition_Post. ]
+TEST_FUNCTION(IoTHubTransport_SignalWorkerThread_without_idle_wait_time_does_nothing)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    mocks.ResetAllCalls();
+
+    ///act
+    IoTHubTransport_SignalWorkerThread(transportHandle);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_011: [ If transportHandle is NULL, IoTHubTransport_SetThreadPool shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetThreadPool_NULL_handle_fails)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetThreadPool(NULL, TEST_THREADPOOL_HANDLE);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_INVALID_ARG, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_012: [ If the worker has already been started, IoTHubTransport_SetThreadPool shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransport_SetThreadPool_after_worker_started_fails)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetThreadPool(transportHandle, TEST_THREADPOOL_HANDLE);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_ERROR, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_013: [ Otherwise IoTHubTransport_SetThreadPool shall store threadPoolHandle and return IOTHUB_CLIENT_OK. ]
+//Tests_SRS_IOTHUBTRANSPORT_07_008: [ If a thread pool has been set, IoTHubTransport_StartWorkerThread shall schedule the work by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]
+TEST_FUNCTION(IoTHubTransport_StartWorkerThread_with_thread_pool_adds_work)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    IOTHUB_CLIENT_RESULT setResult = IoTHubTransport_SetThreadPool(transportHandle, TEST_THREADPOOL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_AddWork(TEST_THREADPOOL_HANDLE, IGNORED_PTR_ARG, transportHandle))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)setResult);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_008: [ If a thread pool has been set, IoTHubTransport_StartWorkerThread shall schedule the work by calling IoTHubClient_ThreadPool_AddWork instead of starting a thread. ]
+TEST_FUNCTION(IoTHubTransport_StartWorkerThread_thread_pool_add_work_fails_returns_error)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetThreadPool(transportHandle, TEST_THREADPOOL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_AddWork(TEST_THREADPOOL_HANDLE, IGNORED_PTR_ARG, transportHandle))
+        .IgnoreArgument(2)
+        .SetReturn((IOTHUB_CLIENT_THREADPOOL_WORK_ITEM_HANDLE)NULL);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_ERROR, (int)result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_009: [ The work item registered with the thread pool shall call lower layer transport DoWork under the transport lock, unless the worker has been signaled to end. ]
+//Tests_SRS_IOTHUBTRANSPORT_07_015: [ After each call to lower layer transport DoWork, IoTHubClient_SignalQueueSpace shall be called for each client using the transport, so that the events waiting for room in the send queue are retried. ]
+TEST_FUNCTION(IoTHubTransport_thread_pool_work_item_calls_DoWork_under_lock)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetThreadPool(transportHandle, TEST_THREADPOOL_HANDLE);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_SignalQueueSpace(TEST_IOTHUB_CLIENT_HANDLE1));
+    STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    poolWorkFunction(poolWorkContext);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_07_010: [ If the work was scheduled on a thread pool, it shall be removed by calling IoTHubClient_ThreadPool_RemoveWork instead of joining a thread. ]
+TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_with_thread_pool_removes_work)
+{
+    CIotHubTransportMocks mocks;
+    ///arrange
+    auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetThreadPool(transportHandle, TEST_THREADPOOL_HANDLE);
+    (void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    bool okToJoin = IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_ThreadPool_RemoveWork(TEST_THREADPOOL_HANDLE, TEST_WORK_ITEM_HANDLE));
+
+    ///act
+    IoTHubTransport_JoinWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+    ///assert
+    ASSERT_IS_TRUE(okToJoin);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransport_Destroy(transportHandle);
+}
+
 END_TEST_SUITE(iothubtransport_ut)
 
@@ -155,6 +155,7 @@ extern "C"
 
 	extern int real_DList_RemoveEntryList(PDLIST_ENTRY Entry);
 	extern void real_DList_InsertTailList(PDLIST_ENTRY ListHead, PDLIST_ENTRY Entry);
+	extern void real_DList_InsertHeadList(PDLIST_ENTRY ListHead, PDLIST_ENTRY Entry);
 	extern int real_DList_IsListEmpty(const PDLIST_ENTRY ListHead);
 	extern void real_DList_InitializeListHead(PDLIST_ENTRY ListHead);
 
@@ -168,6 +169,11 @@ extern "C"
 		real_DList_InsertTailList(ListHead, Entry);
 	}
 
+	void my_DList_InsertHeadList(PDLIST_ENTRY ListHead, PDLIST_ENTRY Entry)
+	{
+		real_DList_InsertHeadList(ListHead, Entry);
+	}
+
 	int my_DList_IsListEmpty(const PDLIST_ENTRY ListHead)
 	{
 		return real_DList_IsListEmpty(ListHead);
@@ -375,6 +381,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 
 	REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveEntryList, my_DList_RemoveEntryList);
 	REGISTER_GLOBAL_MOCK_HOOK(DList_InsertTailList, my_DList_InsertTailList);
+	REGISTER_GLOBAL_MOCK_HOOK(DList_InsertHeadList, my_DList_InsertHeadList);
 	REGISTER_GLOBAL_MOCK_HOOK(DList_IsListEmpty, my_DList_IsListEmpty);
 	REGISTER_GLOBAL_MOCK_HOOK(DList_InitializeListHead, my_DList_InitializeListHead);
 }
@@ -0,0 +1,549 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/map.h"
+#include "iothub_message.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransporthttp_batch.h"
+
+#define TEST_MAX_PROPERTIES     2
+#define TEST_DESTINATION_SIZE   256
+#define TEST_UNTOUCHED          0xA5
+
+static const unsigned char TEST_BYTES[] = { 'a', 'b', 'c', 'd' };
+
+/*the message is its own property map*/
+typedef struct TEST_MESSAGE_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    const unsigned char* bytes;
+    size_t bytesSize;
+    const char* string;
+    const char* keys[TEST_MAX_PROPERTIES];
+    const char* values[TEST_MAX_PROPERTIES];
+    size_t propertyCount;
+} TEST_MESSAGE;
+
+static TEST_MESSAGE g_message;
+static unsigned char g_destination[TEST_DESTINATION_SIZE];
+
+static IOTHUBMESSAGE_CONTENT_TYPE my_IoTHubMessage_GetContentType(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->contentType;
+}
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    *buffer = ((TEST_MESSAGE*)iotHubMessageHandle)->bytes;
+    *size = ((TEST_MESSAGE*)iotHubMessageHandle)->bytesSize;
+    return IOTHUB_MESSAGE_OK;
+}
+
+static const char* my_IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return ((TEST_MESSAGE*)iotHubMessageHandle)->string;
+}
+
+static MAP_HANDLE my_IoTHubMessage_Properties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return (MAP_HANDLE)iotHubMessageHandle;
+}
+
+static MAP_RESULT my_Map_GetInternals(MAP_HANDLE handle, const char*const** keys, const char*const** values, size_t* count)
+{
+    TEST_MESSAGE* message = (TEST_MESSAGE*)handle;
+    *keys = (const char*const*)message->keys;
+    *values = (const char*const*)message->values;
+    *count = message->propertyCount;
+    return MAP_OK;
+}
+
+static IOTHUB_MESSAGE_HANDLE set_bytearray_message(const unsigned char* bytes, size_t bytesSize)
+{
+    (void)memset(&g_message, 0, sizeof(g_message));
+    g_message.contentType = IOTHUBMESSAGE_BYTEARRAY;
+    g_message.bytes = bytes;
+    g_message.bytesSize = bytesSize;
+    return (IOTHUB_MESSAGE_HANDLE)&g_message;
+}
+
+static IOTHUB_MESSAGE_HANDLE set_string_message(const char* string)
+{
+    (void)memset(&g_message, 0, sizeof(g_message));
+    g_message.contentType = IOTHUBMESSAGE_STRING;
+    g_message.string = string;
+    return (IOTHUB_MESSAGE_HANDLE)&g_message;
+}
+
+static void add_property(const char* key, const char* value)
+{
+    g_message.keys[g_message.propertyCount] = key;
+    g_message.values[g_message.propertyCount] = value;
+    g_message.propertyCount++;
+}
+
+static void setup_bytearray_item_expectations(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(messageHandle));
+    STRICT_EXPECTED_CALL(Map_GetInternals((MAP_HANDLE)messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+}
+
+static void setup_string_item_expectations(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(messageHandle));
+    STRICT_EXPECTED_CALL(Map_GetInternals((MAP_HANDLE)messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+}
+
+static void assert_item_is_written(IOTHUB_MESSAGE_HANDLE messageHandle, const char* expectedItem)
+{
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    size_t written;
+    int result;
+
+    result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    result = iothubtransporthttp_batch_write_item(messageHandle, g_destination, itemSize.itemSize, &written);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, strlen(expectedItem), itemSize.itemSize);
+    ASSERT_ARE_EQUAL(size_t, itemSize.itemSize, written);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expectedItem, g_destination, written));
+    ASSERT_ARE_EQUAL(int, TEST_UNTOUCHED, g_destination[written]);
+}
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubtransporthttp_batch_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetContentType, my_IoTHubMessage_GetContentType);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetString, my_IoTHubMessage_GetString);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Properties, my_IoTHubMessage_Properties);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_GetInternals, my_Map_GetInternals);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    (void)memset(g_destination, TEST_UNTOUCHED, sizeof(g_destination));
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_001: [ If messageHandle or itemSize is NULL, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_with_NULL_messageHandle_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(NULL, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_001: [ If messageHandle or itemSize is NULL, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_with_NULL_itemSize_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_002: [ iothubtransporthttp_batch_get_item_size shall get the content of the message by calling IoTHubMessage_GetContentType and then IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_003: [ iothubtransporthttp_batch_get_item_size shall get the properties of the message by calling IoTHubMessage_Properties and Map_GetInternals. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_005: [ itemSize shall receive the exact number of bytes that iothubtransporthttp_batch_write_item writes for the message, the size of its content and the count and total length of its property names and values. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_for_a_bytearray_message_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    add_property("a", "xy");
+    setup_bytearray_item_expectations(messageHandle);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, strlen("{\"body\":\"YWJjZA==\",\"properties\":{\"iothub-app-a\":\"xy\"}}"), itemSize.itemSize);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_BYTES), itemSize.contentSize);
+    ASSERT_ARE_EQUAL(size_t, 1, itemSize.propertyCount);
+    ASSERT_ARE_EQUAL(size_t, 3, itemSize.propertiesSize);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_002: [ iothubtransporthttp_batch_get_item_size shall get the content of the message by calling IoTHubMessage_GetContentType and then IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_005: [ itemSize shall receive the exact number of bytes that iothubtransporthttp_batch_write_item writes for the message, the size of its content and the count and total length of its property names and values. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_for_a_string_message_succeeds)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_string_message("a\"b");
+    setup_string_item_expectations(messageHandle);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, strlen("{\"body\":\"a\\\"b\",\"base64Encoded\":false}"), itemSize.itemSize);
+    ASSERT_ARE_EQUAL(size_t, 3, itemSize.contentSize);
+    ASSERT_ARE_EQUAL(size_t, 0, itemSize.propertyCount);
+    ASSERT_ARE_EQUAL(size_t, 0, itemSize.propertiesSize);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_004: [ If any operation fails, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_when_IoTHubMessage_GetByteArray_fails_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_004: [ If any operation fails, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_when_IoTHubMessage_GetString_fails_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_string_message("a");
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(messageHandle))
+        .SetReturn(NULL);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_004: [ If any operation fails, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_for_an_unknown_content_type_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle))
+        .SetReturn(IOTHUBMESSAGE_UNKNOWN);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_004: [ If any operation fails, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_when_Map_GetInternals_fails_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(messageHandle));
+    STRICT_EXPECTED_CALL(Map_GetInternals((MAP_HANDLE)messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(MAP_ERROR);
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_006: [ If the string of a message cannot be JSON encoded, iothubtransporthttp_batch_get_item_size shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_get_item_size_for_a_non_ascii_string_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_BATCH_ITEM_SIZE itemSize;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_string_message("a\xC3\xA9");
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(messageHandle));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(messageHandle));
+
+    ///act
+    int result = iothubtransporthttp_batch_get_item_size(messageHandle, &itemSize);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_007: [ If messageHandle, destination or written is NULL, iothubtransporthttp_batch_write_item shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_with_NULL_messageHandle_fails)
+{
+    ///arrange
+    size_t written;
+
+    ///act
+    int result = iothubtransporthttp_batch_write_item(NULL, g_destination, sizeof(g_destination), &written);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_007: [ If messageHandle, destination or written is NULL, iothubtransporthttp_batch_write_item shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_with_NULL_destination_fails)
+{
+    ///arrange
+    size_t written;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+
+    ///act
+    int result = iothubtransporthttp_batch_write_item(messageHandle, NULL, sizeof(g_destination), &written);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_007: [ If messageHandle, destination or written is NULL, iothubtransporthttp_batch_write_item shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_with_NULL_written_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+
+    ///act
+    int result = iothubtransporthttp_batch_write_item(messageHandle, g_destination, sizeof(g_destination), NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_008: [ If the item does not fit in available bytes, iothubtransporthttp_batch_write_item shall fail without writing to destination and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_when_the_item_does_not_fit_fails)
+{
+    ///arrange
+    size_t written;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    setup_bytearray_item_expectations(messageHandle);
+
+    ///act
+    int result = iothubtransporthttp_batch_write_item(messageHandle, g_destination, strlen("{\"body\":\"YWJjZA==\"}") - 1, &written);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, TEST_UNTOUCHED, g_destination[0]);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_009: [ A message of type IOTHUBMESSAGE_BYTEARRAY shall be written as {"body":"base64 encoding of the message content" followed by the properties and }. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_012: [ On success iothubtransporthttp_batch_write_item shall set written to the number of bytes written and return 0. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_writes_a_bytearray_message)
+{
+    ///arrange
+    size_t written;
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    setup_bytearray_item_expectations(messageHandle);
+
+    ///act
+    int result = iothubtransporthttp_batch_write_item(messageHandle, g_destination, sizeof(g_destination), &written);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, strlen("{\"body\":\"YWJjZA==\"}"), written);
+    ASSERT_ARE_EQUAL(int, 0, memcmp("{\"body\":\"YWJjZA==\"}", g_destination, written));
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_009: [ A message of type IOTHUBMESSAGE_BYTEARRAY shall be written as {"body":"base64 encoding of the message content" followed by the properties and }. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_writes_an_empty_bytearray_message)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(NULL, 0);
+
+    ///act & assert
+    assert_item_is_written(messageHandle, "{\"body\":\"\"}");
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_011: [ The properties shall be written as ,"properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} and shall be missing if the message has no properties. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_writes_the_properties)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_bytearray_message(TEST_BYTES, sizeof(TEST_BYTES));
+    add_property("a", "x");
+    add_property("bb", "");
+
+    ///act & assert
+    assert_item_is_written(messageHandle, "{\"body\":\"YWJjZA==\",\"properties\":{\"iothub-app-a\":\"x\",\"iothub-app-bb\":\"\"}}");
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_010: [ A message of type IOTHUBMESSAGE_STRING shall be written as {"body":JSON encoding of the string,"base64Encoded":false followed by the properties and }. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_writes_a_string_message)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_string_message("some text");
+    add_property("a", "x");
+
+    ///act & assert
+    assert_item_is_written(messageHandle, "{\"body\":\"some text\",\"base64Encoded\":false,\"properties\":{\"iothub-app-a\":\"x\"}}");
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_010: [ A message of type IOTHUBMESSAGE_STRING shall be written as {"body":JSON encoding of the string,"base64Encoded":false followed by the properties and }. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_write_item_escapes_a_string_message)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE messageHandle = set_string_message("\"/\\\n\x1F");
+
+    ///act & assert
+    assert_item_is_written(messageHandle, "{\"body\":\"\\\"\\/\\\\\\u000A\\u001F\",\"base64Encoded\":false}");
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_013: [ iothubtransporthttp_batch_base64_encoded_size shall return 4 bytes for every started group of 3 bytes of size. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_base64_encoded_size_succeeds)
+{
+    ///arrange
+
+    ///act & assert
+    ASSERT_ARE_EQUAL(size_t, 0, iothubtransporthttp_batch_base64_encoded_size(0));
+    ASSERT_ARE_EQUAL(size_t, 4, iothubtransporthttp_batch_base64_encoded_size(1));
+    ASSERT_ARE_EQUAL(size_t, 4, iothubtransporthttp_batch_base64_encoded_size(3));
+    ASSERT_ARE_EQUAL(size_t, 8, iothubtransporthttp_batch_base64_encoded_size(4));
+    ASSERT_ARE_EQUAL(size_t, 8, iothubtransporthttp_batch_base64_encoded_size(6));
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_014: [ iothubtransporthttp_batch_base64_encode shall write the padded base64 encoding of source to destination and return the number of bytes written. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_base64_encode_encodes_the_RFC4648_vectors)
+{
+    ///arrange
+    static const char* const vectors[][2] =
+    {
+        { "", "" },
+        { "f", "Zg==" },
+        { "fo", "Zm8=" },
+        { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" },
+        { "fooba", "Zm9vYmE=" },
+        { "foobar", "Zm9vYmFy" }
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        ///act
+        size_t written = iothubtransporthttp_batch_base64_encode((const unsigned char*)vectors[i][0], strlen(vectors[i][0]), g_destination);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, strlen(vectors[i][1]), written);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(vectors[i][1], g_destination, written));
+    }
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_BATCH_07_014: [ iothubtransporthttp_batch_base64_encode shall write the padded base64 encoding of source to destination and return the number of bytes written. ]*/
+TEST_FUNCTION(iothubtransporthttp_batch_base64_encode_uses_the_whole_alphabet)
+{
+    ///arrange
+    static const unsigned char source[] = { 0x00, 0x10, 0x83, 0x10, 0x51, 0x87, 0x20, 0x92, 0x8B, 0x30, 0xD3, 0x8F, 0x41, 0x14, 0x93, 0x51, 0x55, 0x97, 0x61, 0x96, 0x9B, 0x71, 0xD7, 0x9F, 0x82, 0x18, 0xA3, 0x92, 0x59, 0xA7, 0xA2, 0x9A, 0xAB, 0xB2, 0xDB, 0xAF, 0xC3, 0x1C, 0xB3, 0xD3, 0x5D, 0xB7, 0xE3, 0x9E, 0xBB, 0xF3, 0xDF, 0xBF };
+
+    ///act
+    size_t written = iothubtransporthttp_batch_base64_encode(source, sizeof(source), g_destination);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 64, written);
+    ASSERT_ARE_EQUAL(int, 0, memcmp("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", g_destination, written));
+}
+
+END_TEST_SUITE(iothubtransporthttp_batch_ut)
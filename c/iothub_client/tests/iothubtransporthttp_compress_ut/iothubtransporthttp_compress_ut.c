@@ -0,0 +1,418 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "zlib.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/buffer_.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransporthttp_compress.h"
+
+#define TEST_BUFFER_HANDLE      (BUFFER_HANDLE)0x4450
+#define TEST_DESTINATION_SIZE   4096
+
+static const unsigned char TEST_ITEM_1[] = "[{\"body\":\"eyJ0ZW1wZXJhdHVyZSI6MjB9\",\"properties\":{\"iothub-app-a\":\"b\"}}";
+static const unsigned char TEST_ITEM_2[] = ",{\"body\":\"eyJ0ZW1wZXJhdHVyZSI6MjF9\",\"properties\":{\"iothub-app-a\":\"b\"}}";
+static const unsigned char TEST_CLOSING[] = "]";
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+/*the destination is a plain array, BUFFER_enlarge fails when it is full*/
+static unsigned char g_destination[TEST_DESTINATION_SIZE];
+static size_t g_destinationLength;
+
+static int my_BUFFER_enlarge(BUFFER_HANDLE handle, size_t enlargeSize)
+{
+    int result;
+    (void)handle;
+    if (enlargeSize > TEST_DESTINATION_SIZE - g_destinationLength)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        g_destinationLength += enlargeSize;
+        result = 0;
+    }
+    return result;
+}
+
+static unsigned char* my_BUFFER_u_char(BUFFER_HANDLE handle)
+{
+    (void)handle;
+    return g_destination;
+}
+
+static size_t my_BUFFER_length(BUFFER_HANDLE handle)
+{
+    (void)handle;
+    return g_destinationLength;
+}
+
+/*inflates the destination, returns the number of bytes or 0 when the stream is not complete*/
+static size_t inflate_destination(unsigned char* inflated, size_t size)
+{
+    uLongf inflatedSize = (uLongf)size;
+    return (uncompress(inflated, &inflatedSize, g_destination, (uLong)g_destinationLength) == Z_OK) ? (size_t)inflatedSize : 0;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubtransporthttp_compress_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_enlarge, my_BUFFER_enlarge);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_u_char, my_BUFFER_u_char);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, my_BUFFER_length);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    g_destinationLength = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_001: [ iothubtransporthttp_compress_is_supported shall return true when the SDK is built with USE_HTTP_COMPRESSION and false otherwise. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_is_supported_returns_true)
+{
+    ///arrange
+
+    ///act
+    bool result = iothubtransporthttp_compress_is_supported();
+
+    ///assert
+    ASSERT_IS_TRUE(result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_002: [ If destination is NULL, iothubtransporthttp_compress_create shall fail and return NULL. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_create_with_NULL_destination_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE result = iothubtransporthttp_compress_create(NULL);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_003: [ iothubtransporthttp_compress_create shall allocate the compressor and start a zlib stream by calling deflateInit2. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_create_succeeds)
+{
+    ///arrange
+
+    ///act
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE result = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_destinationLength);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_004: [ If any of the operations fails, iothubtransporthttp_compress_create shall free what it allocated and return NULL. ]*/
+TEST_FUNCTION(when_allocating_the_compressor_fails_iothubtransporthttp_compress_create_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(NULL);
+
+    ///act
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE result = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_005: [ If compressHandle is NULL, iothubtransporthttp_compress_destroy shall do nothing. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    iothubtransporthttp_compress_destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_006: [ iothubtransporthttp_compress_destroy shall end the zlib stream by calling deflateEnd and free the compressor, but not the destination. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_destroy_does_not_touch_the_destination)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    umock_c_reset_all_calls();
+
+    ///act
+    iothubtransporthttp_compress_destroy(compressHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 0, g_destinationLength);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_007: [ If compressHandle or fits is NULL, iothubtransporthttp_compress_fits shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_fits_with_NULL_compressHandle_fails)
+{
+    ///arrange
+    bool fits;
+
+    ///act
+    int result = iothubtransporthttp_compress_fits(NULL, 1, TEST_DESTINATION_SIZE, &fits);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_007: [ If compressHandle or fits is NULL, iothubtransporthttp_compress_fits shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_fits_with_NULL_fits_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+
+    ///act
+    int result = iothubtransporthttp_compress_fits(compressHandle, 1, TEST_DESTINATION_SIZE, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_008: [ The finished stream shall be bound by the bytes already produced plus deflateBound of the bytes given since the last flush and size. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_011: [ fits shall receive true when the bound does not exceed limit. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_fits_tells_whether_the_bound_is_within_the_limit)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    bool fitsInDestination;
+    bool fitsInLess;
+
+    ///act
+    int result1 = iothubtransporthttp_compress_fits(compressHandle, sizeof(TEST_ITEM_1) - 1, TEST_DESTINATION_SIZE, &fitsInDestination);
+    int result2 = iothubtransporthttp_compress_fits(compressHandle, sizeof(TEST_ITEM_1) - 1, sizeof(TEST_ITEM_1) - 1, &fitsInLess);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_IS_TRUE(fitsInDestination);
+    ASSERT_IS_FALSE(fitsInLess);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_009: [ If the bound exceeds limit and bytes have been given since the last flush, iothubtransporthttp_compress_fits shall flush the stream with Z_SYNC_FLUSH and compute the bound again. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_fits_flushes_when_the_estimate_is_not_enough)
+{
+    ///arrange
+    unsigned char repeated[1024];
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    size_t lengthBeforeFlush;
+    bool fits;
+    (void)memset(repeated, 'a', sizeof(repeated));
+    (void)iothubtransporthttp_compress_append(compressHandle, repeated, sizeof(repeated));
+    lengthBeforeFlush = g_destinationLength;
+
+    ///act
+    int result = iothubtransporthttp_compress_fits(compressHandle, 1, 64, &fits);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(fits);
+    ASSERT_IS_TRUE(g_destinationLength > lengthBeforeFlush);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_012: [ If compressHandle or source is NULL, iothubtransporthttp_compress_append shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_append_with_NULL_source_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+
+    ///act
+    int result = iothubtransporthttp_compress_append(compressHandle, NULL, 1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_015: [ If compressHandle or source is NULL, iothubtransporthttp_compress_finish shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_compress_finish_with_NULL_compressHandle_fails)
+{
+    ///arrange
+
+    ///act
+    int result = iothubtransporthttp_compress_finish(NULL, TEST_CLOSING, 1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_013: [ iothubtransporthttp_compress_append shall compress source with Z_NO_FLUSH and append the bytes zlib produces to the destination by calling BUFFER_enlarge. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_016: [ iothubtransporthttp_compress_finish shall compress source with Z_FINISH and append the rest of the stream to the destination. ]*/
+TEST_FUNCTION(the_destination_inflates_to_the_appended_items)
+{
+    ///arrange
+    unsigned char expected[sizeof(TEST_ITEM_1) + sizeof(TEST_ITEM_2)];
+    unsigned char inflated[sizeof(expected)];
+    size_t expectedSize = 0;
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    (void)memcpy(expected + expectedSize, TEST_ITEM_1, sizeof(TEST_ITEM_1) - 1);
+    expectedSize += sizeof(TEST_ITEM_1) - 1;
+    (void)memcpy(expected + expectedSize, TEST_ITEM_2, sizeof(TEST_ITEM_2) - 1);
+    expectedSize += sizeof(TEST_ITEM_2) - 1;
+    (void)memcpy(expected + expectedSize, TEST_CLOSING, 1);
+    expectedSize += 1;
+
+    ///act
+    int result1 = iothubtransporthttp_compress_append(compressHandle, TEST_ITEM_1, sizeof(TEST_ITEM_1) - 1);
+    int result2 = iothubtransporthttp_compress_append(compressHandle, TEST_ITEM_2, sizeof(TEST_ITEM_2) - 1);
+    int result3 = iothubtransporthttp_compress_finish(compressHandle, TEST_CLOSING, 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(int, 0, result3);
+    ASSERT_IS_TRUE(g_destinationLength < expectedSize);
+    ASSERT_ARE_EQUAL(size_t, expectedSize, inflate_destination(inflated, sizeof(inflated)));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expected, inflated, expectedSize));
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_011: [ fits shall receive true when the bound does not exceed limit. ]*/
+TEST_FUNCTION(the_finished_stream_is_within_the_limit_fits_agreed_to)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    size_t limit = 512;
+    bool fits = true;
+    size_t appended = 0;
+
+    ///act
+    while (fits)
+    {
+        ASSERT_ARE_EQUAL(int, 0, iothubtransporthttp_compress_fits(compressHandle, sizeof(TEST_ITEM_2), limit, &fits));
+        if (fits)
+        {
+            ASSERT_ARE_EQUAL(int, 0, iothubtransporthttp_compress_append(compressHandle, TEST_ITEM_2, sizeof(TEST_ITEM_2) - 1));
+            appended += sizeof(TEST_ITEM_2) - 1;
+        }
+    }
+    ASSERT_ARE_EQUAL(int, 0, iothubtransporthttp_compress_finish(compressHandle, TEST_CLOSING, 1));
+
+    ///assert
+    ASSERT_IS_TRUE(appended > limit);
+    ASSERT_IS_TRUE(g_destinationLength <= limit);
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_COMPRESS_07_017: [ If compressing fails, iothubtransporthttp_compress_finish shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(when_BUFFER_enlarge_fails_iothubtransporthttp_compress_finish_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE compressHandle = iothubtransporthttp_compress_create(TEST_BUFFER_HANDLE);
+    (void)iothubtransporthttp_compress_append(compressHandle, TEST_ITEM_1, sizeof(TEST_ITEM_1) - 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_enlarge(TEST_BUFFER_HANDLE, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(1);
+
+    ///act
+    int result = iothubtransporthttp_compress_finish(compressHandle, TEST_CLOSING, 1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_compress_destroy(compressHandle);
+}
+
+END_TEST_SUITE(iothubtransporthttp_compress_ut)
@@ -0,0 +1,598 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+static double my_get_difftime(time_t stopTime, time_t startTime)
+{
+    return (double)(stopTime - startTime);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/agenttime.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransporthttp_poll.h"
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4443
+#define TEST_NOW                (time_t)1000
+#define TEST_MINIMUM_TIME       60
+#define TEST_MAXIMUM_TIME       1500
+#define TEST_DEVICE_COUNT       8
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static IOTHUBTRANSPORTHTTP_POLL_STATE g_states[TEST_DEVICE_COUNT];
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+/*schedules the device and moves it to the time it is due*/
+static time_t schedule_device(IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE* pollState)
+{
+    (void)iothubtransporthttp_poll_is_due(pollHandle, pollState, TEST_NOW);
+    return TEST_NOW + (time_t)pollState->waitTime;
+}
+
+BEGIN_TEST_SUITE(iothubtransporthttp_poll_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(time_t, long long);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, my_get_difftime);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    size_t i;
+
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    (void)memset(g_states, 0, sizeof(g_states));
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        g_states[i].seed = (uint32_t)i;
+    }
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_001: [ If minimumTime is 0, iothubtransporthttp_poll_create shall fail and return NULL. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_create_with_0_minimumTime_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE result = iothubtransporthttp_poll_create(0, TEST_MAXIMUM_TIME);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_002: [ iothubtransporthttp_poll_create shall allocate memory for the scheduler and create its lock by calling Lock_Init. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_create_succeeds)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE result = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_poll_create shall free everything it created and return NULL. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_create_when_malloc_fails_it_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE result = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_poll_create shall free everything it created and return NULL. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_create_when_Lock_Init_fails_it_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE result = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_004: [ A maximumTime smaller than minimumTime shall be raised to minimumTime. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_create_raises_maximumTime_to_minimumTime)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, 1);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    umock_c_reset_all_calls();
+
+    ///act
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, TEST_MINIMUM_TIME, (int)g_states[0].idleTime);
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_005: [ If pollHandle is NULL, iothubtransporthttp_poll_destroy shall do nothing. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_destroy_with_NULL_handle_does_nothing)
+{
+    ///arrange
+
+    ///act
+    iothubtransporthttp_poll_destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_006: [ iothubtransporthttp_poll_destroy shall free the lock by calling Lock_Deinit and free the scheduler. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_destroy_frees_the_scheduler)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(pollHandle));
+
+    ///act
+    iothubtransporthttp_poll_destroy(pollHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_007: [ If pollHandle is NULL or minimumTime is 0, iothubtransporthttp_poll_set_times shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_set_times_with_invalid_arguments_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result1 = iothubtransporthttp_poll_set_times(NULL, TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    int result2 = iothubtransporthttp_poll_set_times(pollHandle, 0, TEST_MAXIMUM_TIME);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_008: [ Otherwise iothubtransporthttp_poll_set_times shall store the times, raising maximumTime to minimumTime if it is smaller, and return 0. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_set_times_applies_from_the_next_poll)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = iothubtransporthttp_poll_set_times(pollHandle, 5, 1);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, true);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 5, (int)g_states[0].waitTime);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+    ASSERT_ARE_EQUAL(int, 5, (int)g_states[0].idleTime);
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_009: [ If pollHandle is NULL, iothubtransporthttp_poll_set_rate_limit shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_set_rate_limit_with_NULL_handle_fails)
+{
+    ///arrange
+
+    ///act
+    int result = iothubtransporthttp_poll_set_rate_limit(NULL, 1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_011: [ If pollHandle or pollState is NULL, iothubtransporthttp_poll_is_due shall return false. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_with_NULL_arguments_returns_false)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    umock_c_reset_all_calls();
+
+    ///act
+    bool result1 = iothubtransporthttp_poll_is_due(NULL, &g_states[0], TEST_NOW);
+    bool result2 = iothubtransporthttp_poll_is_due(pollHandle, NULL, TEST_NOW);
+
+    ///assert
+    ASSERT_IS_FALSE(result1);
+    ASSERT_IS_FALSE(result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_012: [ If now is (time_t)-1, iothubtransporthttp_poll_is_due shall return true. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_without_time_returns_true)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    umock_c_reset_all_calls();
+
+    ///act
+    bool result = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], (time_t)(-1));
+
+    ///assert
+    ASSERT_IS_TRUE(result);
+    ASSERT_IS_FALSE(g_states[0].isScheduled);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_013: [ The first call for a device shall schedule its first poll after a wait taken from the seed of the device, between 0 and the minimum time. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_spreads_the_first_polls_within_the_minimum_time)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    bool areAllEqual = true;
+    size_t i;
+    umock_c_reset_all_calls();
+
+    ///act
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        (void)iothubtransporthttp_poll_is_due(pollHandle, &g_states[i], TEST_NOW);
+    }
+
+    ///assert
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        ASSERT_IS_TRUE(g_states[i].isScheduled);
+        ASSERT_IS_TRUE(g_states[i].waitTime <= TEST_MINIMUM_TIME);
+        ASSERT_ARE_EQUAL(int, TEST_MINIMUM_TIME, (int)g_states[i].idleTime);
+        areAllEqual = areAllEqual && (g_states[i].waitTime == g_states[0].waitTime);
+    }
+    ASSERT_IS_FALSE(areAllEqual);
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_014: [ A device shall be due once waitTime seconds have passed since the time it was scheduled from, or when the clock went back. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_returns_false_before_the_wait_and_true_after_it)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, true);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_difftime(now + TEST_MINIMUM_TIME - 1, now));
+    STRICT_EXPECTED_CALL(get_difftime(now + TEST_MINIMUM_TIME, now));
+
+    ///act
+    bool result1 = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], now + TEST_MINIMUM_TIME - 1);
+    bool result2 = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], now + TEST_MINIMUM_TIME);
+
+    ///assert
+    ASSERT_IS_FALSE(result1);
+    ASSERT_IS_TRUE(result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_014: [ A device shall be due once waitTime seconds have passed since the time it was scheduled from, or when the clock went back. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_when_the_clock_went_back_returns_true)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, true);
+    umock_c_reset_all_calls();
+
+    ///act
+    bool result = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], now - 1);
+
+    ///assert
+    ASSERT_IS_TRUE(result);
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_010: [ Otherwise iothubtransporthttp_poll_set_rate_limit shall store pollsPerSecond, 0 meaning no cap, and return 0. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_015: [ If there is a rate limit, a due device shall be reported due only while the polls of the current second are below the limit. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_caps_the_polls_of_a_second)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = TEST_NOW + TEST_MINIMUM_TIME;
+    size_t i;
+    for (i = 0; i < 3; i++)
+    {
+        (void)schedule_device(pollHandle, &g_states[i]);
+    }
+    int result = iothubtransporthttp_poll_set_rate_limit(pollHandle, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_difftime(now, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(get_difftime(now, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(get_difftime(now, now));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(get_difftime(now, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(get_difftime(now, now));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    bool result1 = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], now);
+    bool result2 = iothubtransporthttp_poll_is_due(pollHandle, &g_states[1], now);
+    bool result3 = iothubtransporthttp_poll_is_due(pollHandle, &g_states[2], now);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(result1);
+    ASSERT_IS_TRUE(result2);
+    ASSERT_IS_FALSE(result3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(iothubtransporthttp_poll_is_due(pollHandle, &g_states[2], now + 1));
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_015: [ If there is a rate limit, a due device shall be reported due only while the polls of the current second are below the limit. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_is_due_when_Lock_fails_returns_false)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = TEST_NOW + TEST_MINIMUM_TIME;
+    (void)schedule_device(pollHandle, &g_states[0]);
+    (void)iothubtransporthttp_poll_set_rate_limit(pollHandle, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_difftime(now, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE))
+        .SetReturn(LOCK_ERROR);
+
+    ///act
+    bool result = iothubtransporthttp_poll_is_due(pollHandle, &g_states[0], now);
+
+    ///assert
+    ASSERT_IS_FALSE(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_016: [ If pollHandle or pollState is NULL, iothubtransporthttp_poll_on_polled shall do nothing. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_on_polled_with_NULL_arguments_does_nothing)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    umock_c_reset_all_calls();
+
+    ///act
+    iothubtransporthttp_poll_on_polled(NULL, &g_states[0], TEST_NOW, true);
+    iothubtransporthttp_poll_on_polled(pollHandle, NULL, TEST_NOW, true);
+
+    ///assert
+    ASSERT_IS_FALSE(g_states[0].isScheduled);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_017: [ If now is (time_t)-1, the device shall be scheduled again by its next call to iothubtransporthttp_poll_is_due. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_on_polled_without_time_unschedules_the_device)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    (void)schedule_device(pollHandle, &g_states[0]);
+    umock_c_reset_all_calls();
+
+    ///act
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], (time_t)(-1), true);
+
+    ///assert
+    ASSERT_IS_FALSE(g_states[0].isScheduled);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_018: [ After a poll that brought a message, the next poll shall be due after the minimum time and the idle time shall go back to the minimum time. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_on_polled_after_a_message_polls_again_after_the_minimum_time)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+    umock_c_reset_all_calls();
+
+    ///act
+    iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now + 1, true);
+
+    ///assert
+    ASSERT_IS_TRUE(g_states[0].isScheduled);
+    ASSERT_IS_TRUE(g_states[0].scheduledFrom == now + 1);
+    ASSERT_ARE_EQUAL(int, TEST_MINIMUM_TIME, (int)g_states[0].waitTime);
+    ASSERT_ARE_EQUAL(int, TEST_MINIMUM_TIME, (int)g_states[0].idleTime);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_019: [ After an empty poll, the next poll shall be due after the idle time plus a jitter of up to a quarter of it, and the idle time shall double, up to the maximum time. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_on_polled_after_empty_polls_backs_off_up_to_the_maximum_time)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MINIMUM_TIME, TEST_MAXIMUM_TIME);
+    time_t now = schedule_device(pollHandle, &g_states[0]);
+    unsigned int expectedIdleTime = TEST_MINIMUM_TIME;
+    size_t i;
+    umock_c_reset_all_calls();
+
+    ///act
+    for (i = 0; i < 8; i++)
+    {
+        iothubtransporthttp_poll_on_polled(pollHandle, &g_states[0], now, false);
+
+        ///assert
+        ASSERT_IS_TRUE(g_states[0].waitTime >= expectedIdleTime);
+        ASSERT_IS_TRUE(g_states[0].waitTime <= expectedIdleTime + expectedIdleTime / 4);
+        expectedIdleTime = (expectedIdleTime * 2 > TEST_MAXIMUM_TIME) ? TEST_MAXIMUM_TIME : expectedIdleTime * 2;
+        ASSERT_ARE_EQUAL(int, (int)expectedIdleTime, (int)g_states[0].idleTime);
+    }
+    ASSERT_ARE_EQUAL(int, TEST_MAXIMUM_TIME, (int)g_states[0].idleTime);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POLL_07_019: [ After an empty poll, the next poll shall be due after the idle time plus a jitter of up to a quarter of it, and the idle time shall double, up to the maximum time. ]*/
+TEST_FUNCTION(iothubtransporthttp_poll_on_polled_after_empty_polls_spreads_the_devices)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POLL_HANDLE pollHandle = iothubtransporthttp_poll_create(TEST_MAXIMUM_TIME, TEST_MAXIMUM_TIME);
+    bool areAllEqual = true;
+    size_t i;
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        (void)schedule_device(pollHandle, &g_states[i]);
+    }
+    umock_c_reset_all_calls();
+
+    ///act
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        iothubtransporthttp_poll_on_polled(pollHandle, &g_states[i], TEST_NOW, false);
+    }
+
+    ///assert
+    for (i = 0; i < TEST_DEVICE_COUNT; i++)
+    {
+        areAllEqual = areAllEqual && (g_states[i].waitTime == g_states[0].waitTime);
+    }
+    ASSERT_IS_FALSE(areAllEqual);
+
+    ///cleanup
+    iothubtransporthttp_poll_destroy(pollHandle);
+}
+
+END_TEST_SUITE(iothubtransporthttp_poll_ut)
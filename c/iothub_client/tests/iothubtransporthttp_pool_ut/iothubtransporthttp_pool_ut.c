@@ -0,0 +1,416 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#undef ENABLE_MOCKS
+
+#include "iothubtransporthttp_pool.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern const size_t iothubtransporthttp_pool_ThreadTerminationOffset;
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST_LOCK_HANDLE        (LOCK_HANDLE)0x4443
+#define TEST_COND_HANDLE        (COND_HANDLE)0x4444
+#define TEST_THREAD_HANDLE      (THREAD_HANDLE)0x4442
+#define TEST_LANE_CONTEXT       (void*)0x4447
+
+#define TEST_MAX_LANE_CALLS 4
+
+static TEST_MUTEX_HANDLE test_serialize_mutex;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static THREAD_START_FUNC g_thread_func;
+static void* g_thread_func_arg;
+static IOTHUBTRANSPORTHTTP_POOL_HANDLE g_pool;
+static bool g_is_lane_thread_running;
+
+static size_t g_lane_calls;
+static size_t g_lanes[TEST_MAX_LANE_CALLS];
+static void* g_lane_contexts[TEST_MAX_LANE_CALLS];
+
+static void test_lane_function(void* context, size_t lane)
+{
+    if (g_lane_calls < TEST_MAX_LANE_CALLS)
+    {
+        g_lanes[g_lane_calls] = lane;
+        g_lane_contexts[g_lane_calls] = context;
+    }
+    g_lane_calls++;
+}
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    *threadHandle = TEST_THREAD_HANDLE;
+    g_thread_func = func;
+    g_thread_func_arg = arg;
+    return THREADAPI_OK;
+}
+
+static void stop_lane_threads(void)
+{
+    *(sig_atomic_t*)(((char*)g_pool) + iothubtransporthttp_pool_ThreadTerminationOffset) = 1;
+}
+
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    (void)timeout_milliseconds;
+    if (!g_is_lane_thread_running && (g_pool != NULL) && (g_thread_func != NULL) && (g_lane_calls > 0))
+    {
+        /*iothubtransporthttp_pool_run waits for the lanes, the thread of the last lane created runs now*/
+        g_is_lane_thread_running = true;
+        (void)g_thread_func(g_thread_func_arg);
+        g_is_lane_thread_running = false;
+    }
+    else if (g_pool != NULL)
+    {
+        /*a lane thread waits for a run, tell it to stop after the wait*/
+        stop_lane_threads();
+    }
+    return COND_OK;
+}
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(iothubtransporthttp_pool_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    result = umock_c_init(on_umock_c_error);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Unlock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Post, COND_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
+
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Join, THREADAPI_OK);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    TEST_MUTEX_ACQUIRE(test_serialize_mutex);
+    g_thread_func = NULL;
+    g_thread_func_arg = NULL;
+    g_pool = NULL;
+    g_is_lane_thread_running = false;
+    g_lane_calls = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_001: [ If laneCount is less than 2, iothubtransporthttp_pool_create shall fail and return NULL. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_create_with_1_lane_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE result = iothubtransporthttp_pool_create(1);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_002: [ iothubtransporthttp_pool_create shall allocate memory for the pool and its lanes, create its lock by calling Lock_Init and its done condition by calling Condition_Init. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_004: [ For every lane but lane 0, iothubtransporthttp_pool_create shall create a run condition by calling Condition_Init and start a thread by calling ThreadAPI_Create. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_create_starts_a_thread_for_every_lane_but_lane_0)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    ///act
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE result = iothubtransporthttp_pool_create(3);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_pool_destroy(result);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_003: [ If any of the resources cannot be created, iothubtransporthttp_pool_create shall free everything it created and return NULL. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_005: [ If a lane cannot be started, iothubtransporthttp_pool_create shall stop the threads already started, free all resources and return NULL. ]*/
+TEST_FUNCTION(when_creating_a_resource_fails_iothubtransporthttp_pool_create_fails)
+{
+    ///arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    umock_c_negative_tests_snapshot();
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        char tmp_msg[128];
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+        sprintf(tmp_msg, "iothubtransporthttp_pool_create failure in test %zu/%zu", index, count);
+
+        ///act
+        IOTHUBTRANSPORTHTTP_POOL_HANDLE result = iothubtransporthttp_pool_create(3);
+
+        ///assert
+        ASSERT_IS_NULL_WITH_MSG(result, tmp_msg);
+    }
+
+    ///cleanup
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_006: [ If poolHandle is NULL, iothubtransporthttp_pool_destroy shall do nothing. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_destroy_with_NULL_does_nothing)
+{
+    ///arrange
+
+    ///act
+    iothubtransporthttp_pool_destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_007: [ iothubtransporthttp_pool_destroy shall signal the threads of the lanes to end, join them and free all resources. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_destroy_joins_the_threads_and_frees_resources)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = iothubtransporthttp_pool_create(2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(pool));
+
+    ///act
+    iothubtransporthttp_pool_destroy(pool);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_008: [ If poolHandle or function is NULL, iothubtransporthttp_pool_run shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_run_with_NULL_poolHandle_fails)
+{
+    ///arrange
+
+    ///act
+    int result = iothubtransporthttp_pool_run(NULL, test_lane_function, TEST_LANE_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_lane_calls);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_008: [ If poolHandle or function is NULL, iothubtransporthttp_pool_run shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_run_with_NULL_function_fails)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = iothubtransporthttp_pool_create(2);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = iothubtransporthttp_pool_run(pool, NULL, TEST_LANE_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_pool_destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_009: [ If the run cannot be started, iothubtransporthttp_pool_run shall fail without calling function and return a non-zero value. ]*/
+TEST_FUNCTION(when_Lock_fails_iothubtransporthttp_pool_run_fails_without_calling_function)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = iothubtransporthttp_pool_create(2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE))
+        .SetReturn(LOCK_ERROR);
+
+    ///act
+    int result = iothubtransporthttp_pool_run(pool, test_lane_function, TEST_LANE_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_lane_calls);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_pool_destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_010: [ iothubtransporthttp_pool_run shall start a new run under the lock of the pool, wake up the thread of every lane by calling Condition_Post, call function for lane 0 on the calling thread, then wait on the done condition until every lane has finished and return 0. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_012: [ The thread of a lane shall call the function of a new run with its context and the lane without holding the lock, and the last lane to finish shall wake up iothubtransporthttp_pool_run by calling Condition_Post. ]*/
+TEST_FUNCTION(iothubtransporthttp_pool_run_calls_function_for_every_lane)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = iothubtransporthttp_pool_create(2);
+    g_pool = pool;
+    umock_c_reset_all_calls();
+
+    ///act
+    int result = iothubtransporthttp_pool_run(pool, test_lane_function, TEST_LANE_CONTEXT);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_lane_calls);
+    ASSERT_ARE_EQUAL(size_t, 0, g_lanes[0]);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_LANE_CONTEXT, g_lane_contexts[0]);
+    ASSERT_ARE_EQUAL(size_t, 1, g_lanes[1]);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_LANE_CONTEXT, g_lane_contexts[1]);
+
+    ///cleanup
+    iothubtransporthttp_pool_destroy(pool);
+}
+
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_011: [ While there is no new run, the thread of a lane shall wait on its run condition by calling Condition_Wait. ]*/
+/*Tests_SRS_IOTHUBTRANSPORTHTTP_POOL_07_013: [ The thread of a lane shall exit once iothubtransporthttp_pool_destroy has been called. ]*/
+TEST_FUNCTION(lane_thread_without_run_waits_on_the_run_condition)
+{
+    ///arrange
+    IOTHUBTRANSPORTHTTP_POOL_HANDLE pool = iothubtransporthttp_pool_create(2);
+    g_pool = pool;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, IGNORED_NUM_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    ///act
+    int result = g_thread_func(g_thread_func_arg);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_lane_calls);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    iothubtransporthttp_pool_destroy(pool);
+}
+
+END_TEST_SUITE(iothubtransporthttp_pool_ut)
@@ -21,6 +21,9 @@
 #include "iothub_client_options.h"
 #include "iothub_client_version.h"
 #include "iothub_client_private.h"
+#include "iothubtransporthttp_pool.h"
+#include "iothubtransporthttp_poll.h"
+#include "iothubtransporthttp_compress.h"
 
 #include "azure_c_shared_utility/urlencode.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
@@ -32,6 +35,8 @@
 #include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/sastoken.h"
 
 #define IOTHUB_ACK "iothub-ack"
 #define IOTHUB_ACK_NONE "none"
@@ -114,6 +119,43 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_HTTPAPIEX_HANDLE_2 (HTTPAPIEX_HANDLE)0x344
+#define TEST_HTTPAPIEX_HANDLE_3 (HTTPAPIEX_HANDLE)0x345
+#define TEST_POOL_HANDLE (IOTHUBTRANSPORTHTTP_POOL_HANDLE)0x4449
+
+static const size_t TEST_CONNECTION_POOL_SIZE_0 = 0;
+static const size_t TEST_CONNECTION_POOL_SIZE_2 = 2;
+static const size_t TEST_CONNECTION_POOL_SIZE_3 = 3;
+
+/*the lane function and context of the last iothubtransporthttp_pool_run, the mock does not run the lanes*/
+static IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION poolLaneFunction;
+static void* poolLaneContext;
+
+#define TEST_COMPRESS_HANDLE (IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE)0x4451
+
+/*what the mock of iothubtransporthttp_compress_fits answers*/
+static bool compressFits;
+
+#define TEST_POLL_HANDLE (IOTHUBTRANSPORTHTTP_POLL_HANDLE)0x4453
+
+static const unsigned int TEST_ADAPTIVE_POLLING_TIME_0 = 0;
+static const unsigned int TEST_ADAPTIVE_POLLING_TIME = 5;
+static const unsigned int TEST_MAX_POLLS_PER_SECOND = 10;
+static const unsigned int TEST_MAX_MESSAGES_PER_POLL_0 = 0;
+static const unsigned int TEST_MAX_MESSAGES_PER_POLL = 3;
+
+#define TEST_TICK_COUNTER_HANDLE (TICK_COUNTER_HANDLE)0x4455
+
+/*what the mock of tickcounter_get_current_ms answers, it moves on by tickCounterStep every call*/
+static uint64_t currentTickCount;
+static uint64_t tickCounterStep;
+
+static const unsigned int TEST_DOWORK_TIME_BUDGET_0 = 0;
+static const unsigned int TEST_DOWORK_TIME_BUDGET = 100;
+
+#define TEST_SAS_TOKEN "SharedAccessSignature sr=test&sig=test&se=test&skn="
+static const size_t TEST_SAS_TOKEN_LIFETIME = 60;
+static const size_t TEST_SAS_TOKEN_REFRESH_TIME = 20;
 
 static const bool thisIsTrue = true;
 static const bool thisIsFalse = false;
@@ -267,6 +309,8 @@ static IOTHUBTRANSPORT_CONFIG TEST_CONFIG_NULL_IOTHUB_SUFFIX =
 #define TEST_IOTHUB_MESSAGE_HANDLE_10 ((IOTHUB_MESSAGE_HANDLE)0x01da)
 #define TEST_IOTHUB_MESSAGE_HANDLE_11 ((IOTHUB_MESSAGE_HANDLE)0x01db)
 #define TEST_IOTHUB_MESSAGE_HANDLE_12 ((IOTHUB_MESSAGE_HANDLE)0x01dc)
+#define TEST_IOTHUB_MESSAGE_HANDLE_13 ((IOTHUB_MESSAGE_HANDLE)0x01dd)
+#define TEST_IOTHUB_MESSAGE_HANDLE_14 ((IOTHUB_MESSAGE_HANDLE)0x01de)
 
 static IOTHUB_MESSAGE_LIST message1 =  /*this is the oldest message, always the first to be processed, send etc*/
 {
@@ -292,7 +336,7 @@ static IOTHUB_MESSAGE_LIST message3 = /*this is the newest message, always last
     { NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
 };
 
-static IOTHUB_MESSAGE_LIST message4 = /*this is outof bounds message (>256K)*/
+static IOTHUB_MESSAGE_LIST message4 = /*this is outof bounds message (its batch is 1 byte over 255K - 1)*/
 {
     TEST_IOTHUB_MESSAGE_HANDLE_4,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
     NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
@@ -300,7 +344,7 @@ static IOTHUB_MESSAGE_LIST message4 = /*this is outof bounds message (>256K)*/
     { NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
 };
 
-static IOTHUB_MESSAGE_LIST message5 = /*this is almost out of bounds message (<256K)*/
+static IOTHUB_MESSAGE_LIST message5 = /*this is almost out of bounds message (its batch is at most 255K - 1)*/
 {
     TEST_IOTHUB_MESSAGE_HANDLE_5,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
     NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
@@ -356,6 +400,22 @@ static IOTHUB_MESSAGE_LIST message12 = /*this is message of 255*1024 bytes - 384
     { NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
 };
 
+static IOTHUB_MESSAGE_LIST message13 = /*this is a message that has a property "a":"b" and makes a batch of exactly 255*1024 - 1 bytes*/
+{
+    TEST_IOTHUB_MESSAGE_HANDLE_13,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
+    NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
+    NULL,                                           /*void* context;                                              */
+    { NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
+};
+
+static IOTHUB_MESSAGE_LIST message14 = /*this is the content of message13 with a property "aa":"b", its batch is 1 byte over 255*1024 - 1 bytes*/
+{
+    TEST_IOTHUB_MESSAGE_HANDLE_14,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
+    NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
+    NULL,                                           /*void* context;                                              */
+    { NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
+};
+
 #define TEST_MAP_EMPTY (MAP_HANDLE) 0xe0
 #define TEST_MAP_1_PROPERTY (MAP_HANDLE) 0xe1
 #define TEST_MAP_2_PROPERTY (MAP_HANDLE) 0xe2
@@ -465,9 +525,13 @@ static size_t whenShallVECTOR_find_if_fail;
 #define TEST_MINIMAL_PAYLOAD [{"body":""}]
 #define TEST_MINIMAL_PAYLOAD_STRING TOSTRING(TEST_MINIMAL_PAYLOAD)
 
-#define TEST_BIG_BUFFER_1_SIZE          (MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD)
-#define TEST_BIG_BUFFER_1_OVERFLOW_SIZE (TEST_BIG_BUFFER_1_SIZE +1 )
-#define TEST_BIG_BUFFER_1_FIT_SIZE      (TEST_BIG_BUFFER_1_SIZE)
+/*a batch of 1 message is [{"body":"base64 encoding of the content"}], that is 13 bytes + the base64 encoding*/
+#define TEST_BATCH_ITEM_OVERHEAD        13
+#define TEST_BIG_BUFFER_1_FIT_SIZE      (((MAXIMUM_MESSAGE_SIZE - TEST_BATCH_ITEM_OVERHEAD) / 4) * 3)
+#define TEST_BIG_BUFFER_1_OVERFLOW_SIZE (TEST_BIG_BUFFER_1_FIT_SIZE + 1)
+
+/*a batch of 1 message with the property "a":"b" is [{"body":"base64 encoding of the content","properties":{"iothub-app-a":"b"}}], that is 47 bytes + the base64 encoding*/
+#define TEST_BATCH_ITEM_A_B_OVERHEAD    47
 
 #define TEST_BIG_BUFFER_9_OVERFLOW_SIZE (256*1024)
 
@@ -492,6 +556,9 @@ static const size_t buffer9_size = TEST_BIG_BUFFER_9_OVERFLOW_SIZE;
 static const unsigned char* buffer11;
 static const size_t buffer11_size = MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - 2 - PROPERTY_OVERHEAD;
 
+static const unsigned char* buffer13;
+static const size_t buffer13_size = ((MAXIMUM_MESSAGE_SIZE - TEST_BATCH_ITEM_A_B_OVERHEAD) / 4) * 3;
+
 static unsigned char* bigBufferOverflow; /*this is a buffer that contains just enough characters to go over the limit of 256K as a single message*/
 static unsigned char* bigBufferFit; /*this is a buffer that contains just enough characters to NOT go over the limit of 256K as a single message*/
 
@@ -760,6 +827,73 @@ public:
         MOCK_STATIC_METHOD_1(, void, HTTPAPIEX_Destroy, HTTPAPIEX_HANDLE, handle)
         MOCK_VOID_METHOD_END()
 
+        /* iothubtransporthttp_pool mocks */
+        MOCK_STATIC_METHOD_1(, IOTHUBTRANSPORTHTTP_POOL_HANDLE, iothubtransporthttp_pool_create, size_t, laneCount)
+        MOCK_METHOD_END(IOTHUBTRANSPORTHTTP_POOL_HANDLE, TEST_POOL_HANDLE)
+
+        MOCK_STATIC_METHOD_1(, void, iothubtransporthttp_pool_destroy, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle)
+        MOCK_VOID_METHOD_END()
+
+        MOCK_STATIC_METHOD_3(, int, iothubtransporthttp_pool_run, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle, IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION, function, void*, context)
+            poolLaneFunction = function;
+            poolLaneContext = context;
+        MOCK_METHOD_END(int, 0)
+
+        /* iothubtransporthttp_compress mocks */
+        MOCK_STATIC_METHOD_0(, bool, iothubtransporthttp_compress_is_supported)
+        MOCK_METHOD_END(bool, true)
+
+        MOCK_STATIC_METHOD_1(, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, iothubtransporthttp_compress_create, BUFFER_HANDLE, destination)
+        MOCK_METHOD_END(IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, TEST_COMPRESS_HANDLE)
+
+        MOCK_STATIC_METHOD_1(, void, iothubtransporthttp_compress_destroy, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle)
+        MOCK_VOID_METHOD_END()
+
+        MOCK_STATIC_METHOD_4(, int, iothubtransporthttp_compress_fits, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, size_t, size, size_t, limit, bool*, fits)
+            *fits = compressFits;
+        MOCK_METHOD_END(int, 0)
+
+        MOCK_STATIC_METHOD_3(, int, iothubtransporthttp_compress_append, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size)
+        MOCK_METHOD_END(int, 0)
+
+        MOCK_STATIC_METHOD_3(, int, iothubtransporthttp_compress_finish, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size)
+        MOCK_METHOD_END(int, 0)
+
+        /* iothubtransporthttp_poll mocks */
+        MOCK_STATIC_METHOD_2(, IOTHUBTRANSPORTHTTP_POLL_HANDLE, iothubtransporthttp_poll_create, unsigned int, minimumTime, unsigned int, maximumTime)
+        MOCK_METHOD_END(IOTHUBTRANSPORTHTTP_POLL_HANDLE, TEST_POLL_HANDLE)
+
+        MOCK_STATIC_METHOD_1(, void, iothubtransporthttp_poll_destroy, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle)
+        MOCK_VOID_METHOD_END()
+
+        MOCK_STATIC_METHOD_3(, int, iothubtransporthttp_poll_set_times, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, minimumTime, unsigned int, maximumTime)
+        MOCK_METHOD_END(int, 0)
+
+        MOCK_STATIC_METHOD_2(, int, iothubtransporthttp_poll_set_rate_limit, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, pollsPerSecond)
+        MOCK_METHOD_END(int, 0)
+
+        MOCK_STATIC_METHOD_3(, bool, iothubtransporthttp_poll_is_due, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now)
+        MOCK_METHOD_END(bool, true)
+
+        MOCK_STATIC_METHOD_4(, void, iothubtransporthttp_poll_on_polled, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now, bool, hasReceivedMessage)
+        MOCK_VOID_METHOD_END()
+
+        /* tickcounter mocks */
+        MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+        MOCK_METHOD_END(TICK_COUNTER_HANDLE, TEST_TICK_COUNTER_HANDLE)
+
+        MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        MOCK_VOID_METHOD_END()
+
+        MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms)
+            *current_ms = currentTickCount;
+            currentTickCount += tickCounterStep;
+        MOCK_METHOD_END(int, 0)
+
+        /* sastoken mocks */
+        MOCK_STATIC_METHOD_4(, STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry)
+        MOCK_METHOD_END(STRING_HANDLE, BASEIMPLEMENTATION::STRING_construct(TEST_SAS_TOKEN))
+
         /* IoTHubMessage mocks */
         MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, buffer, size_t, size)
         MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, (IOTHUB_MESSAGE_HANDLE)0x42)
@@ -828,6 +962,13 @@ public:
             *size = buffer11_size;
             break;
         }
+        case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) : /*this is a message that has a property and together with that property makes a batch at maximum*/
+        case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) : /*this is a message that has a property and together with that property makes a batch over the maximum*/
+        {
+            *buffer = buffer13;
+            *size = buffer13_size;
+            break;
+        }
         default:
         {
             /*not expected really*/
@@ -854,6 +995,8 @@ public:
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_9) :
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_12) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
     {
         result2 = NULL;
         break;
@@ -926,11 +1069,13 @@ public:
         break;
     }
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
     {
         result2 = TEST_MAP_1_PROPERTY_A_B;
         break;
     }
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_12) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
     {
         result2 = TEST_MAP_1_PROPERTY_AA_B;
         break;
@@ -971,6 +1116,8 @@ public:
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_9) :
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
     case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_12) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
+    case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
     {
         result2 = IOTHUBMESSAGE_BYTEARRAY;
         break;
@@ -1287,6 +1434,30 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , HTTPAPIEX_HANDLE, HTTP
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_SetOption, HTTPAPIEX_HANDLE, handle, const char*, optionName, const void*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, HTTPAPIEX_Destroy, HTTPAPIEX_HANDLE, handle);
 
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , IOTHUBTRANSPORTHTTP_POOL_HANDLE, iothubtransporthttp_pool_create, size_t, laneCount);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, iothubtransporthttp_pool_destroy, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_pool_run, IOTHUBTRANSPORTHTTP_POOL_HANDLE, poolHandle, IOTHUBTRANSPORTHTTP_POOL_LANE_FUNCTION, function, void*, context);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , bool, iothubtransporthttp_compress_is_supported);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, iothubtransporthttp_compress_create, BUFFER_HANDLE, destination);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, iothubtransporthttp_compress_destroy, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_compress_fits, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, size_t, size, size_t, limit, bool*, fits);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_compress_append, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_compress_finish, IOTHUBTRANSPORTHTTP_COMPRESS_HANDLE, compressHandle, const unsigned char*, source, size_t, size);
+
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , IOTHUBTRANSPORTHTTP_POLL_HANDLE, iothubtransporthttp_poll_create, unsigned int, minimumTime, unsigned int, maximumTime);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, iothubtransporthttp_poll_destroy, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_poll_set_times, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, minimumTime, unsigned int, maximumTime);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, iothubtransporthttp_poll_set_rate_limit, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, unsigned int, pollsPerSecond);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , bool, iothubtransporthttp_poll_is_due, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , void, iothubtransporthttp_poll_on_polled, IOTHUBTRANSPORTHTTP_POLL_HANDLE, pollHandle, IOTHUBTRANSPORTHTTP_POLL_STATE*, pollState, time_t, now, bool, hasReceivedMessage);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
+
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry);
+
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, buffer, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, handle);
@@ -1728,6 +1899,164 @@ static void setupDoWorkLoopForNextDevice(CIoTHubTransportHttpMocks &mocks, size_
         .IgnoreArgument(1);
 }
 
+/*a GET request of DoMessages answered with statusCode*/
+static void setupPollMessage(CIoTHubTransportHttpMocks &mocks, const unsigned int &statusCode)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode, sizeof(statusCode));
+}
+
+/*a message received by a GET request answered with 200 and accepted by the callback, the accept itself is not part of it*/
+static void setupReceivedMessage(CIoTHubTransportHttpMocks &mocks)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+}
+
+/*the DELETE request that accepts the message of TEST_ETAG_VALUE*/
+static void setupAcceptMessage(CIoTHubTransportHttpMocks &mocks, const unsigned int &statusCode)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode, sizeof(statusCode));
+}
+
+/*every batched message is read twice: once to measure its JSON item and once to write it into the payload*/
+static void setupBatchedItem(CIoTHubTransportHttpMocks &mocks, IOTHUB_MESSAGE_HANDLE messageHandle, MAP_HANDLE properties)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+    if (messageHandle == TEST_IOTHUB_MESSAGE_HANDLE_10)
+    {
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(messageHandle));
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+    }
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(messageHandle));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(properties, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+}
+
+static void setupBatchedPayload(CIoTHubTransportHttpMocks &mocks)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+}
+
+static void setupBatchedItemConfirmation(CIoTHubTransportHttpMocks &mocks, PDLIST_ENTRY entry)
+{
+    (void)mocks;
+
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, entry))
+        .IgnoreArgument(1);
+}
+
 //
 //static void setupInitHappyPathUpThroughHostName(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 //{
@@ -1807,11 +2136,11 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
     g_testByTest = MicroMockCreateMutex();
     ASSERT_IS_NOT_NULL(g_testByTest);
-    /*the size of bigBuffer needs to be such that it doesn't fit alone 1 payload of 256KB.*/ /*assume a limit of "less than 1 than 256"*/
-                                                                                             /*the payload already must have the following string: [{"body":""}], which is 13 characters. From (256*1024-1) - 13 =  262130 characters that can go in the base64 encoding.*/
-                                                                                             /*that means 2621301/4*3 = 196597.5 original characters. that means:
-                                                                                             1. 196597 original characters shall fit
-                                                                                             2. 196598 original characters shall not fit*/
+    /*the size of bigBuffer needs to be such that it doesn't fit alone 1 payload of 255KB.*/ /*assume a limit of "less than 1 than 255K"*/
+                                                                                             /*the payload already must have the following string: [{"body":""}], which is 13 characters. From (255*1024-1) - 13 =  261106 characters that can go in the base64 encoding.*/
+                                                                                             /*base64 takes 4 characters for every started group of 3 original characters, that means:
+                                                                                             1. 261104/4*3 = 195828 original characters shall fit
+                                                                                             2. 195829 original characters shall not fit*/
     bigBufferOverflow = (unsigned char*)malloc(TEST_BIG_BUFFER_1_OVERFLOW_SIZE);
     memset(bigBufferOverflow, '3', TEST_BIG_BUFFER_1_OVERFLOW_SIZE);
     bigBufferFit = (unsigned char*)malloc(TEST_BIG_BUFFER_1_FIT_SIZE);
@@ -1825,6 +2154,10 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     memset(temp, '3', buffer11_size);
     buffer11 = temp;
 
+    temp = (unsigned char*)malloc(buffer13_size);
+    memset(temp, '3', buffer13_size);
+    buffer13 = temp;
+
     IoTHubTransportHttp_Unsubscribe_DeviceTwin = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_Unsubscribe_DeviceTwin;
     IoTHubTransportHttp_Subscribe_DeviceTwin = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_Subscribe_DeviceTwin;
     IoTHubTransportHttp_GetHostname = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_GetHostname;
@@ -1844,6 +2177,7 @@ TEST_SUITE_CLEANUP(TestClassCleanup)
 {
     free((void*)buffer9);
     free((void*)buffer11);
+    free((void*)buffer13);
     free(bigBufferFit);
     free(bigBufferOverflow);
 
@@ -1888,6 +2222,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentHTTPHeaders_Clone_call = 0;
     whenShallHTTPHeaders_Clone_fail = 0;
 
+    compressFits = true;
+    currentTickCount = 0;
+    tickCounterStep = 0;
 
     BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
     BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend2);
@@ -4774,73 +5111,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
-
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
-
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
-        .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message10.entry));
 
     /*executing HTTP goodies*/
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
@@ -5669,122 +5948,29 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-/*purpose of this test is to see that gremlins don't emerge when the http return code is 404 from the service*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_accept_code_404_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_020: [ When "AdaptivePollingTime" is set, the GET request shall be issued only if iothubtransporthttp_poll_is_due returns true. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_AdaptivePollingTime_when_the_device_is_not_due_does_not_poll)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
-    unsigned int statusCode404 = 404;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
+
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
     STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_is_due(TEST_POLL_HANDLE, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE))
+        .IgnoreArgument(2)
+        .SetReturn(false);
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .IgnoreArgument(8)
-        .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404));
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
     mocks.AssertActualAndExpectedCalls();
@@ -5793,22 +5979,28 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_httpapi_execute_request_failed_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_020: [ When "AdaptivePollingTime" is set, the GET request shall be issued only if iothubtransporthttp_poll_is_due returns true. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_021: [ When "AdaptivePollingTime" is set, after the GET requests IoTHubTransportHttp_DoWork shall schedule the next one by calling iothubtransporthttp_poll_on_polled, telling it a message was received when any status code was 200. A failed request counts as an empty poll. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_AdaptivePollingTime_when_the_device_is_due_polls_and_schedules_an_empty_poll)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
+
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
     STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_is_due(TEST_POLL_HANDLE, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE))
+        .IgnoreArgument(2);
+
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -5836,75 +6028,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(7)
         .IgnoreArgument(8)
         .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_on_polled(TEST_POLL_HANDLE, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE, false))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .SetReturn(HTTPAPIEX_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -5916,22 +6043,26 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_021: [ When "AdaptivePollingTime" is set, after the GET requests IoTHubTransportHttp_DoWork shall schedule the next one by calling iothubtransporthttp_poll_on_polled, telling it a message was received when any status code was 200. A failed request counts as an empty poll. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_AdaptivePollingTime_when_the_poll_fails_schedules_an_empty_poll)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
+
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
     STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_is_due(TEST_POLL_HANDLE, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE))
+        .IgnoreArgument(2);
+
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -5959,56 +6090,78 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(7)
         .IgnoreArgument(8)
         .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+        .SetReturn(HTTPAPIEX_ERROR);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_on_polled(TEST_POLL_HANDLE, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE, false))
+        .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        ;
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_031: [ While the service answers a GET request with status code 200, IoTHubTransportHttp_DoWork shall issue another one, up to "MaxMessagesPerPoll" GET requests per device. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_032: [ When "MaxMessagesPerPoll" is bigger than 1, the messages shall not be accepted, rejected or abandoned as they are received but after the last GET request of the cycle, in the order they were received. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaxMessagesPerPoll_drains_the_messages_and_accepts_them_after_the_last_GET)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MAX_MESSAGES_PER_POLL, &TEST_MAX_MESSAGES_PER_POLL);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    /*the first 2 GET requests bring a message, their accepts are deferred*/
+    setupPollMessage(mocks, statusCode200);
+    setupReceivedMessage(mocks);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_ETAG_VALUE));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    setupPollMessage(mocks, statusCode200);
+    setupReceivedMessage(mocks);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_ETAG_VALUE));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-        .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+    /*the third one finds the queue empty*/
+    setupPollMessage(mocks, statusCode204);
+
+    /*then both messages are accepted*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+    for (size_t i = 0; i < 2; i++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, i))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+            .IgnoreArgument(1); /*because the deferred ETag is a STRING_HANDLE*/
+        setupAcceptMessage(mocks, statusCode204);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6020,96 +6173,184 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_031: [ While the service answers a GET request with status code 200, IoTHubTransportHttp_DoWork shall issue another one, up to "MaxMessagesPerPoll" GET requests per device. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaxMessagesPerPoll_stops_after_MaxMessagesPerPoll_GET_requests)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MAX_MESSAGES_PER_POLL, &TEST_MAX_MESSAGES_PER_POLL);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
+
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
     STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+    for (size_t i = 0; i < TEST_MAX_MESSAGES_PER_POLL; i++)
+    {
+        setupPollMessage(mocks, statusCode200);
+        setupReceivedMessage(mocks);
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_ETAG_VALUE));
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+    }
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    for (size_t i = 0; i < TEST_MAX_MESSAGES_PER_POLL; i++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, i))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+            .IgnoreArgument(1); /*because the deferred ETag is a STRING_HANDLE*/
+        setupAcceptMessage(mocks, statusCode204);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .IgnoreArgument(8)
-        .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_033: [ If a completion cannot be deferred, the message shall be accepted, rejected or abandoned right away. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaxMessagesPerPoll_when_deferring_fails_accepts_the_message_right_away)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MAX_MESSAGES_PER_POLL, &TEST_MAX_MESSAGES_PER_POLL);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+
+    setupPollMessage(mocks, statusCode200);
+    setupReceivedMessage(mocks);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_ETAG_VALUE))
+        .SetReturn((STRING_HANDLE)NULL);
+    setupAcceptMessage(mocks, statusCode204);
+
+    setupPollMessage(mocks, statusCode204);
+
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_036: [ When "DoWorkTimeBudget" is set, IoTHubTransportHttp_DoWork shall read its start time by calling tickcounter_get_current_ms. If that fails, the budget shall not apply to this DoWork. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_037: [ When "DoWorkTimeBudget" is set, once the budget is spent a lane shall defer its devices not yet served, but every lane shall serve at least 1 device. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_DoWorkTimeBudget_spent_defers_the_second_device)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
+    tickCounterStep = TEST_DOWORK_TIME_BUDGET; /*the budget is spent by the time the first device is served*/
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2); /*the start of the DoWork*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+
+    /*pass 0 looks for deferred devices*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+
+    /*pass 1 serves the first device and defers the second one*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_035: [ Every DoWork, each lane shall start its round-robin one device further than in the previous DoWork, wrapping around its devices. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_038: [ The devices deferred by the budget shall be served first by the next DoWork. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_DoWorkTimeBudget_serves_the_deferred_device_first)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
+    tickCounterStep = TEST_DOWORK_TIME_BUDGET;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*serves the first device and defers the second one*/
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2); /*the start of the DoWork*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+    /*pass 0 serves the deferred device*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
+
+    /*pass 1 has no budget left for the other device*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6121,22 +6362,56 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_Alloc_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_037: [ When "DoWorkTimeBudget" is set, once the budget is spent a lane shall defer its devices not yet served, but every lane shall serve at least 1 device. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_DoWorkTimeBudget_not_spent_serves_every_device)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
     mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2)); /*because DoWork for event*/
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+/*the expectations of a DoWork of TEST_DEVICE_1 with "AdaptivePollingTime" and "sas_token_lifetime" set, up to the token of its GET request*/
+static void setupCachedTokenPollBegin(CIoTHubTransportHttpMocks &mocks, time_t now)
+{
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL))
+        .SetReturn(now);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_is_due(TEST_POLL_HANDLE, IGNORED_PTR_ARG, now))
+        .IgnoreArgument(2);
+
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -6147,8 +6422,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL))
+        .SetReturn(now); /*because the age of the cached token*/
+}
+
+/*the expectations of the GET request of TEST_DEVICE_1 once it has its token, the service has no message*/
+static void setupCachedTokenPollEnd(CIoTHubTransportHttpMocks &mocks, time_t now)
+{
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because the token is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(
         IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
         HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
         "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
@@ -6159,53 +6442,57 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
         ))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
+        .IgnoreArgument(4)
+        .IgnoreArgument(6)
         .IgnoreArgument(7)
-        .IgnoreArgument(8)
-        .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
+        .IgnoreArgument(8);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_on_polled(TEST_POLL_HANDLE, IGNORED_PTR_ARG, now, false))
         .IgnoreArgument(2);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_044: [ When "sas_token_lifetime" is set, the requests of a device with a device key shall be made by HTTPAPIEX_ExecuteRequest with the token cached by the device instead of HTTPAPIEX_SAS_ExecuteRequest. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_045: [ The first token of a device shall be scoped to hostName + "/devices/" + URL_ENCODED(deviceId). ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_046: [ A device shall sign a new token by calling SASToken_Create with its device key, the scope, an empty key name and an expiry "sas_token_lifetime" seconds from now when it has no token, when the refresh time has passed since it signed it, when "sas_token_lifetime" changed or when the clock went back. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_signs_the_first_GET_with_a_new_token)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_LIFETIME, &TEST_SAS_TOKEN_LIFETIME);
 
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+
+    setupCachedTokenPollBegin(mocks, TEST_GET_TIME_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because the deviceId is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/devices/"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*the URL encoded deviceId*/
 
-    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, STRING_new()); /*the empty key name*/
+    STRICT_EXPECTED_CALL(mocks, get_difftime(TEST_GET_TIME_VALUE, 0));
+    STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, (size_t)TEST_GET_TIME_VALUE + TEST_SAS_TOKEN_LIFETIME))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*the empty key name*/
 
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_SAS_TOKEN))
+        .IgnoreArgument(1);
+    setupCachedTokenPollEnd(mocks, TEST_GET_TIME_VALUE);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6217,25 +6504,100 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_succeeds_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_048: [ The event and message HTTP request headers of the device shall get the "Authorization" header by calling HTTPHeaders_ReplaceHeaderNameValuePair only when they do not carry the current token, any other request headers shall get it for every request. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_reuses_the_token_and_the_headers_within_the_refresh_time)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_LIFETIME, &TEST_SAS_TOKEN_LIFETIME);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
-    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    setupCachedTokenPollBegin(mocks, TEST_GET_TIME_VALUE);
+    STRICT_EXPECTED_CALL(mocks, get_difftime(TEST_GET_TIME_VALUE, TEST_GET_TIME_VALUE));
+    setupCachedTokenPollEnd(mocks, TEST_GET_TIME_VALUE);
 
-    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_046: [ A device shall sign a new token by calling SASToken_Create with its device key, the scope, an empty key name and an expiry "sas_token_lifetime" seconds from now when it has no token, when the refresh time has passed since it signed it, when "sas_token_lifetime" changed or when the clock went back. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_048: [ The event and message HTTP request headers of the device shall get the "Authorization" header by calling HTTPHeaders_ReplaceHeaderNameValuePair only when they do not carry the current token, any other request headers shall get it for every request. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_renews_the_token_and_the_headers_after_the_refresh_time)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    time_t later = TEST_GET_TIME_VALUE + TEST_SAS_TOKEN_REFRESH_TIME;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_LIFETIME, &TEST_SAS_TOKEN_LIFETIME);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_REFRESH_TIME, &TEST_SAS_TOKEN_REFRESH_TIME);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    setupCachedTokenPollBegin(mocks, later);
+    STRICT_EXPECTED_CALL(mocks, get_difftime(later, TEST_GET_TIME_VALUE));
+
+    STRICT_EXPECTED_CALL(mocks, STRING_new()); /*the empty key name*/
+    STRICT_EXPECTED_CALL(mocks, get_difftime(later, 0));
+    STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, (size_t)later + TEST_SAS_TOKEN_LIFETIME))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*the empty key name*/
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*the previous token*/
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_SAS_TOKEN))
+        .IgnoreArgument(1);
+    setupCachedTokenPollEnd(mocks, later);
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+/*undefined behavior*/
+/*purpose of this test is to see that gremlins don't emerge when the http return code is 404 from the service*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_accept_code_404_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
+    unsigned int statusCode404 = 404;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
     STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
@@ -6296,10 +6658,39 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
         .IgnoreArgument(1);
 
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404));
+
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -6310,8 +6701,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_with_STRING_succeeds_1)
+/*undefined behavior*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_httpapi_execute_request_failed_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -6362,6 +6753,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
@@ -6386,10 +6778,41 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .SetReturn(HTTPAPIEX_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6402,7 +6825,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 /*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_construct_n_succeeds_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -6452,7 +6875,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);
+        .IgnoreArgument(2)
+        ;
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
@@ -6473,9 +6897,26 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6488,7 +6929,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 /*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_clone_succeeds_1)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -6555,9 +6996,28 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     /*this returns "0" so the message needs to be "accepted"*/
     /*this is "accepting"*/
-    whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6569,38 +7029,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_097: [ _DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
-//
-//requestType: POST
-//	relativePath : abandon relative path begin(as created by _Create) + value of ETag + "/abandon" + APIVERSION
-//	requestHttpHeadersHandle : an HTTP headers instance containing the following
-//	Authorization : " "
-//	If - Match : value of ETag
-//	requestContent : NULL
-//	statusCode : a pointer to unsigned int which might be examined for logging
-//	responseHeadearsHandle : NULL
-//	responseContent : NULL ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_098: [ Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_101: [ _DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
-//
-//requestType: DELETE
-//	relativePath : abandon relative path begin + value of ETag + APIVERSION
-//	requestHttpHeadersHandle : an HTTP headers instance containing the following
-//	Authorization : " "
-//	If - Match : value of ETag
-//	requestContent : NULL
-//	statusCode : a pointer to unsigned int which might be used by logging
-//	responseHeadearsHandle : NULL
-//	responseContent : NULL ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_102: [ Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204. ]
-
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_reject_succeeds_1)
+/*undefined behavior*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_Alloc_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
-    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -6659,10 +7093,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED);
+        .IgnoreArgument(2);
 
-    /*this is "reject"*/
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -6674,38 +7108,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
         .IgnoreArgument(1);
 
+    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
 
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6717,13 +7125,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_statusCode404_succeeds_1)
+/*undefined behavior*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
-    unsigned int statusCode404 = 404;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -6782,10 +7189,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED);
+        .IgnoreArgument(2);
 
-    /*this is "reject"*/
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -6797,39 +7204,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+    whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5)
-        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404));
-
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -6840,13 +7218,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPAPIEX_SAS_ExecuteRequest2_fails_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_with_STRING_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
-    unsigned int statusCode404 = 404;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -6905,10 +7282,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED);
+        .IgnoreArgument(2);
 
-    /*this is "reject"*/
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -6917,42 +7294,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404))
-        .SetReturn(HTTPAPIEX_ERROR);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -6964,8 +7309,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_1)
+/*undefined behavior*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_construct_n_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7028,35 +7373,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED);
+        .IgnoreArgument(2);
 
-    /*this is "reject"*/
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
-
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7068,8 +7395,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_2)
+/*undefined behavior*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_clone_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7131,34 +7458,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(2);
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED); /*1 means "do not acept it"*/
-
-                                            /*this is "reject"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
-        .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
+    whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
-
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7170,12 +7477,38 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_097: [ _DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
+//
+//requestType: POST
+//	relativePath : abandon relative path begin(as created by _Create) + value of ETag + "/abandon" + APIVERSION
+//	requestHttpHeadersHandle : an HTTP headers instance containing the following
+//	Authorization : " "
+//	If - Match : value of ETag
+//	requestContent : NULL
+//	statusCode : a pointer to unsigned int which might be examined for logging
+//	responseHeadearsHandle : NULL
+//	responseContent : NULL ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_098: [ Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_Alloc_fails_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_101: [ _DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
+//
+//requestType: DELETE
+//	relativePath : abandon relative path begin + value of ETag + APIVERSION
+//	requestHttpHeadersHandle : an HTTP headers instance containing the following
+//	Authorization : " "
+//	If - Match : value of ETag
+//	requestContent : NULL
+//	statusCode : a pointer to unsigned int which might be used by logging
+//	responseHeadearsHandle : NULL
+//	responseContent : NULL ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_102: [ Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204. ]
+
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_reject_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -7252,8 +7585,35 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
         .IgnoreArgument(1);
 
-    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7266,11 +7626,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_fails_succeeds_1)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_statusCode404_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
+    unsigned int statusCode404 = 404;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -7344,10 +7705,39 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
         .IgnoreArgument(1);
 
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(4)
+        .IgnoreArgument(5)
+        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404));
+
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -7359,11 +7749,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_with_STRING_fails_succeeds_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPAPIEX_SAS_ExecuteRequest2_fails_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
+    unsigned int statusCode404 = 404;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -7434,26 +7825,58 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+        .IgnoreArgument(1);
 
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
 
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_construct_n_fails_succeeds_2)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_DELETE,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION REJECT_QUERY_PARAMETER,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode404, sizeof(statusCode404))
+        .SetReturn(HTTPAPIEX_ERROR);
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_1)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
@@ -7521,9 +7944,27 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
         .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
+
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7536,7 +7977,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_clone_fails_succeeds)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7600,12 +8041,31 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_REJECTED);
+        .SetReturn(IOTHUBMESSAGE_REJECTED); /*1 means "do not acept it"*/
 
-    /*this is "reject"*/
-    whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
+                                            /*this is "reject"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
 
     ///act
@@ -7618,13 +8078,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_abandons_when_IoTHubMessage_Create_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_Alloc_fails_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
-    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -7668,16 +8127,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(1)
         .SetReturn(TEST_ETAG_VALUE);
 
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+        .SetReturn(IOTHUBMESSAGE_REJECTED);
 
-    /*this is "abandon"*/
+    /*this is "reject"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -7689,38 +8157,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
         .IgnoreArgument(1);
 
+    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-        .IgnoreArgument(1);
-
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7732,8 +8173,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_no_ETag_header_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_fails_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7779,7 +8220,41 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn((const char*)NULL);
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(IOTHUBMESSAGE_REJECTED);
+
+    /*this is "reject"*/
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
+        .IgnoreArgument(1);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7791,8 +8266,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_zero_characters_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_with_STRING_fails_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7838,7 +8313,39 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn("");
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(IOTHUBMESSAGE_REJECTED);
+
+    /*this is "reject"*/
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7850,8 +8357,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_1_characters_not_quote_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_construct_n_fails_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7897,7 +8404,34 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn("a");
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(IOTHUBMESSAGE_REJECTED);
+
+    /*this is "reject"*/
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7909,8 +8443,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_2_characters_last_not_quote_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_clone_fails_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -7956,24 +8490,49 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn("\"a");
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(IOTHUBMESSAGE_REJECTED);
+
+    /*this is "reject"*/
+    whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_1_characters_quote_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_abandons_when_IoTHubMessage_Create_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8015,7 +8574,61 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn("\"");
+        .SetReturn(TEST_ETAG_VALUE);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+
+    /*this is "abandon"*/
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+        .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8028,7 +8641,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_many_last_not_quote_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_no_ETag_header_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -8074,7 +8687,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
         .IgnoreArgument(1)
-        .SetReturn("\"abcd");
+        .SetReturn((const char*)NULL);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8086,12 +8699,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_086: [ If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_top_next_action_when_httpstatus_is_500_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_zero_characters_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode500 = 500;
+    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8129,7 +8742,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(7)
         .IgnoreArgument(8)
         .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode500, sizeof(statusCode500));
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn("");
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8141,8 +8758,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_HTTPAPIEX_SAS_ExecuteRequest2_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_1_characters_not_quote_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -8184,8 +8801,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         .IgnoreArgument(7)
         .IgnoreArgument(8)
         .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200))
-        .SetReturn(HTTPAPIEX_ERROR);
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn("a");
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8197,11 +8817,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_BUFFER_new_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_2_characters_last_not_quote_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8216,8 +8837,34 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn("\"a");
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8229,11 +8876,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_HTTPHeaders_Alloc_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_1_characters_quote_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8243,166 +8891,241 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 1;
     STRICT_EXPECTED_CALL(mocks, get_time(NULL));
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
-                                                      ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_125: [ This function shall return a pointer to a structure of type IOTHUB_TRANSPORT_PROVIDER having the following values for its fields: ]
-TEST_FUNCTION(HTTP_Protocol_succeeds)
-{
-    ///arrange
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn("\"");
 
     ///act
-    auto result = HTTP_Protocol();
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_IS_NOT_NULL(result);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Create, (void*)IoTHubTransportHttp_Create);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Destroy, (void*)IoTHubTransportHttp_Destroy);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Register, (void*)IoTHubTransportHttp_Register);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unregister, (void*)IoTHubTransportHttp_Unregister);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Subscribe, (void*)IoTHubTransportHttp_Subscribe);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unsubscribe, (void*)IoTHubTransportHttp_Unsubscribe);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_DoWork, (void*)IoTHubTransportHttp_DoWork);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_GetSendStatus, (void*)IoTHubTransportHttp_GetSendStatus);
-    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_SetOption, (void*)IoTHubTransportHttp_SetOption);
+    mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_068: [ Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_070: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_OK. The batched items shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_054: [ Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_053: [ If option SetBatching is true then _DoWork shall send batched event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_fails_when_ETag_many_last_not_quote_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    unsigned int statusCode200 = 200;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
     setupDoWorkLoopOnceForOneDevice(mocks);
 
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
-
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn("\"abcd");
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_086: [ If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_top_next_action_when_httpstatus_is_500_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode500 = 500;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode500, sizeof(statusCode500));
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_HTTPAPIEX_SAS_ExecuteRequest2_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int statusCode200 = 200;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
         ))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200))
+        .SetReturn(HTTPAPIEX_ERROR);
 
-    /*once the event has been succesfull...*/
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    ENABLE_BATCHING();
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_BUFFER_new_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    mocks.ResetAllCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8414,95 +9137,91 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_http_status_is_404)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_085: [ If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_goes_to_next_action_when_HTTPHeaders_Alloc_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 1;
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+                                                      ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_125: [ This function shall return a pointer to a structure of type IOTHUB_TRANSPORT_PROVIDER having the following values for its fields: ]
+TEST_FUNCTION(HTTP_Protocol_succeeds)
+{
+    ///arrange
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///act
+    auto result = HTTP_Protocol();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Create, (void*)IoTHubTransportHttp_Create);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Destroy, (void*)IoTHubTransportHttp_Destroy);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Register, (void*)IoTHubTransportHttp_Register);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unregister, (void*)IoTHubTransportHttp_Unregister);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Subscribe, (void*)IoTHubTransportHttp_Subscribe);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unsubscribe, (void*)IoTHubTransportHttp_Unsubscribe);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_DoWork, (void*)IoTHubTransportHttp_DoWork);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_GetSendStatus, (void*)IoTHubTransportHttp_GetSendStatus);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_SetOption, (void*)IoTHubTransportHttp_SetOption);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///cleanup
+}
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_068: [ Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_070: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_OK. The batched items shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_054: [ Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_053: [ If option SetBatching is true then _DoWork shall send batched event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+    mocks.ResetAllCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
     /*executing HTTP goodies*/
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
@@ -8522,11 +9241,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
         .IgnoreArgument(2)
         .IgnoreArgument(5)
         .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-    STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    /*once the event has been succesfull...*/
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -8540,122 +9260,89 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HTTPAPIEX_SAS_ExecuteRequest2_fails)
+static void setupCompressedBatchHead(CIoTHubTransportHttpMocks &mocks)
 {
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
+    (void)mocks;
 
     setupDoWorkLoopOnceForOneDevice(mocks);
-
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_create(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+}
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_012: ["CompressBatches"]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_014: [ When "CompressBatches" is true, IoTHubTransportHttp_DoWork shall deflate the batch into the payload by calling iothubtransporthttp_compress_create. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_015: [ When "CompressBatches" is true, the message size shall be the size of the compressed payload and an item shall be added only if iothubtransporthttp_compress_fits guarantees it within the message size limit. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_017: [ When "CompressBatches" is true, the batch shall be sent with a clone of the event HTTP request headers that has the header "Content-Encoding" set to "deflate". ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_compressed_happy_path_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    ENABLE_BATCHING();
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsTrue);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    setupCompressedBatchHead(mocks);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*measuring the item and checking its compressed size*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_fits(TEST_COMPRESS_HANDLE, IGNORED_NUM_ARG, 255 * 1024 - 1, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*writing the item and compressing it*/
+    STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_append(TEST_COMPRESS_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_finish(TEST_COMPRESS_HANDLE, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_destroy(TEST_COMPRESS_HANDLE));
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+    /*the compressed batch has its own headers*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Encoding", "deflate"))
         .IgnoreArgument(1);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
-
     /*executing HTTP goodies*/
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
         IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,
+        IGNORED_PTR_ARG,
+        IGNORED_PTR_ARG,
+        IGNORED_PTR_ARG,
+        NULL,
+        NULL
         ))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
-        .SetReturn(HTTPAPIEX_ERROR);
-
-    STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -8667,116 +9354,100 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_build_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_015: [ When "CompressBatches" is true, the message size shall be the size of the compressed payload and an item shall be added only if iothubtransporthttp_compress_fits guarantees it within the message size limit. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_compressed_when_the_first_item_does_not_fit_it_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     DList_InsertTailList(&(waitingToSend), &(message1.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+    ENABLE_BATCHING();
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsTrue);
     mocks.ResetAllCalls();
+    compressFits = false;
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    setupCompressedBatchHead(mocks);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_fits(TEST_COMPRESS_HANDLE, IGNORED_NUM_ARG, 255 * 1024 - 1, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_destroy(TEST_COMPRESS_HANDLE));
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
+        .IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+//Tests_SRS_TRANSPORTMULTITHTTP_07_016: [ If compressing fails, IoTHubTransportHttp_DoWork shall put the items back in waitingToSend and advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_compressed_when_finishing_the_stream_fails_puts_the_items_back)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    ENABLE_BATCHING();
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsTrue);
+    mocks.ResetAllCalls();
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-        .IgnoreArgument(1);
+    setupCompressedBatchHead(mocks);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_fits(TEST_COMPRESS_HANDLE, IGNORED_NUM_ARG, 255 * 1024 - 1, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_append(TEST_COMPRESS_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        whenShallBUFFER_build_fail = 1;
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .SetReturn(__LINE__);
-    }
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_finish(TEST_COMPRESS_HANDLE, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(2)
+        .SetReturn(1);
 
+    /*the item goes back to waitingToSend*/
     STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
 
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_destroy(TEST_COMPRESS_HANDLE));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_FALSE(DList_IsListEmpty(&waitingToSend));
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_new_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_http_status_is_404)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -8793,67 +9464,35 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
         .IgnoreArgument(1);
-
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        whenShallBUFFER_new_fail = 1;
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    }
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
 
     STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
@@ -8871,8 +9510,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HTTPAPIEX_SAS_ExecuteRequest2_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -8889,50 +9528,40 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
+        .SetReturn(HTTPAPIEX_ERROR);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        whenShallSTRING_concat_with_STRING_fail = 7;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
 
     ENABLE_BATCHING();
 
@@ -8947,7 +9576,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_keeps_it_when_BUFFER_pre_build_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -8964,45 +9593,18 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    /*the payload cannot be allocated, nothing has been taken out of waitingToSend yet*/
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
-
     ENABLE_BATCHING();
 
     ///act
@@ -9016,7 +9618,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_keeps_it_when_BUFFER_new_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -9033,37 +9635,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-        whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*the payload cannot be allocated, nothing has been taken out of waitingToSend yet*/
+    whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 
     ENABLE_BATCHING();
 
@@ -9078,7 +9655,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_it_fails_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -9092,36 +9669,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+        .IgnoreArgument(1);
 
-        whenShallSTRING_concat_with_STRING_fail = 6;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        /*end of the first batched payload*/
-    }
+    /*measuring the items*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
 
     ENABLE_BATCHING();
 
@@ -9135,8 +9691,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_Bytes_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -9151,27 +9707,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        whenShallBase64_Encode_Bytes_fail = 1;
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        /*end of the first batched payload*/
-    }
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
     ENABLE_BATCHING();
 
@@ -9185,12 +9722,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_ERROR. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_001: [ When batching, the message size shall be the exact number of bytes of the payload, that is the JSON items of all the messages in the batch, their separators and the enclosing [ and ]. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message4.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9203,24 +9742,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message4.messageHandle, TEST_MAP_EMPTY);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .SetReturn(IOTHUB_MESSAGE_ERROR);
+    /*building the list of messages to be notified because this is 100% fail (>256K)*/
+    setupBatchedItemConfirmation(mocks, &(message4.entry));
 
-        /*end of the first batched payload*/
-    }
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -9234,12 +9763,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_fails_it_fails)
+/*this is a test that wants to see that "almost" 255KB message still fits*/
+//Tests_SRS_TRANSPORTMULTITHTTP_07_001: [ When batching, the message size shall be the exact number of bytes of the payload, that is the JSON items of all the messages in the batch, their separators and the enclosing [ and ]. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message5.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9252,18 +9782,40 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    /*measuring the items*/
+    setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
+
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message5.entry));
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        /*end of the first batched payload*/
-    }
+    /*once the event has been succesfull...*/
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -9272,17 +9824,19 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 
     ///assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, TEST_BATCH_ITEM_OVERHEAD + TEST_BIG_BUFFER_1_FIT_SIZE / 3 * 4, BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message2.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9295,9 +9849,43 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
+    setupBatchedItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message2.entry));
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -9311,24 +9899,63 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message2.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+        .IgnoreArgument(1);
+
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
         .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -9342,19 +9969,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fai
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_ERROR. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message4.entry));
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message2.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9362,53 +9987,41 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle))
+        .SetReturn(IOTHUBMESSAGE_UNKNOWN);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message4.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message4.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferOverflow, TEST_BIG_BUFFER_1_OVERFLOW_SIZE));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message4.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-    {
-        /*adding the first payload to the "big" payload*/
-        /*building the list of messages to be notified because this is 100% fail (>256K)*/
-        STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)))
-            .IgnoreArgument(1);
-    }
+    /*once the event has been succesfull...*/
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
         .IgnoreArgument(2);
 
     ENABLE_BATCHING();
@@ -9423,18 +10036,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path
     IoTHubTransportHttp_Destroy(handle);
 }
 
-/*this is a test that wants to see that "almost" 255KB message still fits*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
     DList_InsertTailList(&(waitingToSend), &(message5.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9442,78 +10054,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
-
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
-
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message5.entry)))
-        .IgnoreArgument(1);
-
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY); /*this one does not fit anymore*/
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message1.entry));
 
     /*executing HTTP goodies*/
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
@@ -9552,305 +10102,180 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
+
+/*** IoTHubTransportHttp_GetSendStatus ***/
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
 {
-    ///arrange
+    // arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    DList_InsertTailList(&(waitingToSend), &(message2.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-        .ExpectedAtLeastTimes(2);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    IOTHUB_CLIENT_STATUS status;
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    mocks.AssertActualAndExpectedCalls();
 
-    /*this is second batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    // cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
+{
+    // arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
 
-    {
-        /*adding the second payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-    {
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    mocks.AssertActualAndExpectedCalls();
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)))
-        .IgnoreArgument(1);
+    // cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
+{
+    // arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    mocks.ResetAllCalls();
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+        .IgnoreArgument(2);
 
-    /*once the event has been succesfull...*/
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
+    IOTHUB_CLIENT_STATUS status;
 
-    ENABLE_BATCHING();
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
 
-    ///assert
     mocks.AssertActualAndExpectedCalls();
 
-    ///cleanup
+    // cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
 {
-    ///arrange
+    // arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    DList_InsertTailList(&(waitingToSend), &(message2.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+    IOTHUB_MESSAGE_LIST newEntry;
+    newEntry.messageHandle = eventMessageHandle;
+    DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
 
     mocks.ResetAllCalls();
-    setupDoWorkLoopOnceForOneDevice(mocks);
 
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    IOTHUB_CLIENT_STATUS status;
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-        .ExpectedAtLeastTimes(2);
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    // cleanup
+    IoTHubTransportHttp_Destroy(handle);
+    IoTHubMessage_Destroy(eventMessageHandle);
+}
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
+{
+    // arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+    IOTHUB_MESSAGE_LIST newEntry;
+    newEntry.messageHandle = eventMessageHandle;
+    DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
 
-    /*this is second batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn((void_ptr)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    IOTHUB_CLIENT_STATUS status;
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        whenShallSTRING_concat_fail = currentSTRING_concat_call + 4;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the second batched payload*/
-    }
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-    {
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    IoTHubTransportHttp_Destroy(handle);
+    IoTHubMessage_Destroy(eventMessageHandle);
+}
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_LIST* message, MAP_HANDLE properties) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+{
+    (void)(*mocks);
+    STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+
+    STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(*mocks, message->messageHandle, properties);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    /*the payload is allocated once*/
+    setupBatchedPayload(*mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(*mocks, message->messageHandle, properties);
+    setupBatchedItemConfirmation(*mocks, &(message->entry));
 
     /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+    STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+    STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
         IGNORED_PTR_ARG,
         HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -9869,8 +10294,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
 
     /*once the event has been succesfull...*/
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+    STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
         .IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    mocks.ResetAllCalls();
+
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    setupIrrelevantMocksForProperties(&mocks, &message6, TEST_MAP_1_PROPERTY);
 
     ENABLE_BATCHING();
 
@@ -9884,163 +10326,59 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_001: [ When batching, the message size shall be the exact number of bytes of the payload, that is the JSON items of all the messages in the batch, their separators and the enclosing [ and ]. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
 {
+    /*this test shall use a message whose base64 encoding is MAXIMUM_MESSAGE_SIZE - TEST_BATCH_ITEM_A_B_OVERHEAD bytes*/
+    /*it will also have a property of "a":"b", therefore the payload is exactly MAXIMUM_MESSAGE_SIZE bytes*/
+    /*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    DList_InsertTailList(&(waitingToSend), &(message2.entry));
+    DList_InsertTailList(&(waitingToSend), &(message13.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-        .ExpectedAtLeastTimes(2);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);;
-        /*end of the first batched payload*/
-    }
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    /*this is second batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    setupIrrelevantMocksForProperties(&mocks, &message13, TEST_MAP_1_PROPERTY_A_B);
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ENABLE_BATCHING();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the second batched payload*/
-    }
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    {
-        /*adding the second payload to the "big" payload*/
-        whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 4;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, MAXIMUM_MESSAGE_SIZE, BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
 
-    {
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-        .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_001: [ When batching, the message size shall be the exact number of bytes of the payload, that is the JSON items of all the messages in the batch, their separators and the enclosing [ and ]. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
+{
+    /*this test shall use the same content as the previous test*/
+    /*it will also have a property of "aa":"b", therefore the payload is 1 byte past the MAXIMUM_MESSAGE_SIZE*/
+    /*this is done in a very e2e manner*/
+    ///arrange
+    CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
+    DList_InsertTailList(&(waitingToSend), &(message14.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ENABLE_BATCHING();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+    mocks.ResetAllCalls();
 
-    /*once the event has been succesfull...*/
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
         .IgnoreArgument(2);
 
-    ENABLE_BATCHING();
-
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -10051,136 +10389,64 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
 {
     ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    DList_InsertTailList(&(waitingToSend), &(message5.entry));
+    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-        .ExpectedAtLeastTimes(2);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
 
-    /*this is second batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    ENABLE_BATCHING();
 
-        STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///assert
+    ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+    mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
 
-    {
-        /*adding the second payload to the "big" payload*/
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    {
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_LIST* m1, MAP_HANDLE p1, IOTHUB_MESSAGE_LIST* m2, MAP_HANDLE p2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+{
+    (void)(*mocks);
+    STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+    STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    /*measuring the items*/
+    setupBatchedItem(*mocks, m1->messageHandle, p1);
+    setupBatchedItem(*mocks, m2->messageHandle, p2);
+
+    /*the payload is allocated once*/
+    setupBatchedPayload(*mocks);
+
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(*mocks, m1->messageHandle, p1);
+    setupBatchedItemConfirmation(*mocks, &(m1->entry));
+    setupBatchedItem(*mocks, m2->messageHandle, p2);
+    setupBatchedItemConfirmation(*mocks, &(m2->entry));
 
     /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+    STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+    STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
         IGNORED_PTR_ARG,
         HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -10199,8 +10465,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_
 
     /*once the event has been succesfull...*/
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+    STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
         .IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message7.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    mocks.ResetAllCalls();
+
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    setupIrrelevantMocksForProperties2(&mocks, &message6, TEST_MAP_1_PROPERTY, &message7, TEST_MAP_2_PROPERTY);
 
     ENABLE_BATCHING();
 
@@ -10215,903 +10498,824 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_
 }
 
 
-/*** IoTHubTransportHttp_GetSendStatus ***/
+#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
+#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
 {
-    // arrange
-    CIoTHubTransportHttpMocks mocks;
+    ///arrange
+    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message7.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
 
-    IOTHUB_CLIENT_STATUS status;
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
+    ENABLE_BATCHING();
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
     mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
+    ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
 {
-    // arrange
-    CIoTHubTransportHttpMocks mocks;
+    ///arrange
+    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message7.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_2_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
+
+    ENABLE_BATCHING();
+
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_1_ITEM_STRING) - 1, BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
     mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
+    ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing_when_properties_for_first_fail)
 {
-    // arrange
-    CIoTHubTransportHttpMocks mocks;
+    ///arrange
+    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message7.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    IOTHUB_CLIENT_STATUS status;
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+    ENABLE_BATCHING();
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+    ///assert
+    ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+    ASSERT_ARE_EQUAL(int, 0, BASEIMPLEMENTATION::DList_IsListEmpty(&waitingToSend));
     mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
+    ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_puts_it_back_when_writing_the_item_fails)
 {
-    // arrange
+    ///arrange
     CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-    IOTHUB_MESSAGE_LIST newEntry;
-    newEntry.messageHandle = eventMessageHandle;
-    DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    IOTHUB_CLIENT_STATUS status;
-
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
-
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
-
-    mocks.AssertActualAndExpectedCalls();
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    // cleanup
-    IoTHubTransportHttp_Destroy(handle);
-    IoTHubMessage_Destroy(eventMessageHandle);
-}
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
-{
-    // arrange
-    CIoTHubTransportHttpMocks mocks;
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+        .IgnoreArgument(1);
 
-    IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-    IOTHUB_MESSAGE_LIST newEntry;
-    newEntry.messageHandle = eventMessageHandle;
-    DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
+    /*measuring the items*/
+    setupBatchedItem(mocks, message6.messageHandle, TEST_MAP_1_PROPERTY);
 
-    mocks.ResetAllCalls();
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-        .IgnoreArgument(1)
+    /*writing the item fails the second time the properties are read*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message6.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message6.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
-        .SetFailReturn((void_ptr)NULL);
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
 
-    IOTHUB_CLIENT_STATUS status;
+    /*the messages already moved to eventConfirmations go back to waitingToSend*/
+    STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+    ENABLE_BATCHING();
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+    ///assert
+    ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
     mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
+    ///cleanup
     IoTHubTransportHttp_Destroy(handle);
-    IoTHubMessage_Destroy(eventMessageHandle);
 }
 
-void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE messageHandle) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
 {
-    (void)(*mocks);
-    STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-    STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(messageHandle));
-        STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-
+    ///arrange
 
-        switch ((uintptr_t)messageHandle)
-        {
-        case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-        {
-            STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer11, buffer11_size));
-            break;
-        }
-        default:
-        {
-            STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-            break;
-        }
-        }
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///cleanup
+}
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    switch ((uintptr_t)messageHandle)
-    {
-    case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-    {
-        STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
-            .IgnoreArgument(1);
-        break;
-    }
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
 
-    default:
-    {
-        STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-            .IgnoreArgument(1);
-        break;
-    }
-    }
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
 
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-    /*once the event has been succesfull...*/
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+        .SetReturn(HTTPAPIEX_INVALID_ARG);
 
-    setupIrrelevantMocksForProperties(&mocks, message6.messageHandle);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
-        .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+        .SetReturn(HTTPAPIEX_ERROR);
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
     ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
 {
-    /*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-    /*it will also have a property of "a":"b", therefore reaching the MAXIMUM_MESSAGE_SIZE*/
-    /*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message11.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+        .SetReturn(HTTPAPIEX_RECOVERYFAILED);
 
-    setupIrrelevantMocksForProperties(&mocks, message11.messageHandle);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message11.messageHandle));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1_A_B[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
-        .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_012: ["CompressBatches"]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_CompressBatches_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_is_supported());
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsTrue);
 
     ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_013: [ If the SDK is built without compression, setting "CompressBatches" to true shall fail and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_CompressBatches_fails_when_compression_is_not_supported)
 {
-    /*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-    /*it will also have a property of "aa":"b", therefore reaching 1 byte past the MAXIMUM_MESSAGE_SIZE*/
-    /*this is done in a very e2e manner*/
     ///arrange
-    CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
-    DList_InsertTailList(&(waitingToSend), &(message12.entry));
+    CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    mocks.ResetAllCalls();
 
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_compress_is_supported())
+        .SetReturn(false);
 
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsTrue);
 
-    mocks.ResetAllCalls();
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
-        .IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_013: [ If the SDK is built without compression, setting "CompressBatches" to true shall fail and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_CompressBatches_false_always_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_COMPRESS_BATCHES, &thisIsFalse);
 
     ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_022: ["AdaptivePollingTime"]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_025: [ Otherwise IoTHubTransportHttp_SetOption shall create the poll scheduler by calling iothubtransporthttp_poll_create with the value as minimum time and "MinimumPollingTime" as maximum time, then pass it "MaxPollsPerSecond" by calling iothubtransporthttp_poll_set_rate_limit. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AdaptivePollingTime_creates_the_poll_scheduler)
 {
     ///arrange
-    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MAX_POLLS_PER_SECOND, &TEST_MAX_POLLS_PER_SECOND);
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4)
-        .SetReturn(MAP_ERROR);
-
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_create(TEST_ADAPTIVE_POLLING_TIME, TEST_DEFAULT_GETMINIMUMPOLLINGTIME));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_set_rate_limit(TEST_POLL_HANDLE, TEST_MAX_POLLS_PER_SECOND));
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
     ///assert
-    ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     mocks.AssertActualAndExpectedCalls();
 
-
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE h1, IOTHUB_MESSAGE_HANDLE h2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+//Tests_SRS_TRANSPORTMULTITHTTP_07_026: [ If creating the poll scheduler fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AdaptivePollingTime_fails_when_iothubtransporthttp_poll_create_fails)
 {
-    (void)(*mocks);
-    STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_create(TEST_ADAPTIVE_POLLING_TIME, TEST_DEFAULT_GETMINIMUMPOLLINGTIME))
+        .SetReturn((IOTHUBTRANSPORTHTTP_POLL_HANDLE)NULL);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-    STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h1));
-        STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message6.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_026: [ If creating the poll scheduler fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AdaptivePollingTime_fails_when_iothubtransporthttp_poll_set_rate_limit_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_create(TEST_ADAPTIVE_POLLING_TIME, TEST_DEFAULT_GETMINIMUMPOLLINGTIME));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_set_rate_limit(TEST_POLL_HANDLE, 0))
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_destroy(TEST_POLL_HANDLE));
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
 
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-    }
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_07_024: [ If there is a poll scheduler, IoTHubTransportHttp_SetOption shall change its times by calling iothubtransporthttp_poll_set_times. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_029: [ If there is a poll scheduler, "MinimumPollingTime" shall become its maximum time by calling iothubtransporthttp_poll_set_times. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AdaptivePollingTime_and_MinimumPollingTime_change_the_times_of_the_poll_scheduler)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    unsigned int minimumPollingTime = 100;
+    unsigned int adaptivePollingTime = 2;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    mocks.ResetAllCalls();
 
-    /*this is second batched payload*/
-    {
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h2));
-        STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message7.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_set_times(TEST_POLL_HANDLE, TEST_ADAPTIVE_POLLING_TIME, minimumPollingTime));
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_set_times(TEST_POLL_HANDLE, adaptivePollingTime, minimumPollingTime));
 
-        STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer7, buffer7_size));
-        STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ///act
+    auto result1 = IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &minimumPollingTime);
+    auto result2 = IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &adaptivePollingTime);
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+    mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-            .IgnoreArgument(1);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+//Tests_SRS_TRANSPORTMULTITHTTP_07_023: [ If the value is 0, IoTHubTransportHttp_SetOption shall destroy the poll scheduler, if any, and the devices shall be polled by "MinimumPollingTime" again. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AdaptivePollingTime_0_destroys_the_poll_scheduler)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    mocks.ResetAllCalls();
 
-    {
-        /*adding the second payload to the "big" payload*/
-        STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_destroy(TEST_POLL_HANDLE));
 
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME_0);
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message7.entry)))
-        .IgnoreArgument(1);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_027: ["MaxPollsPerSecond"]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_028: [ If there is a poll scheduler, IoTHubTransportHttp_SetOption shall pass the value to it by calling iothubtransporthttp_poll_set_rate_limit. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_MaxPollsPerSecond_is_passed_to_the_poll_scheduler)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING_TIME, &TEST_ADAPTIVE_POLLING_TIME);
+    mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_poll_set_rate_limit(TEST_POLL_HANDLE, TEST_MAX_POLLS_PER_SECOND));
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_MAX_POLLS_PER_SECOND, &TEST_MAX_POLLS_PER_SECOND);
 
-    /*once the event has been succesfull...*/
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_030: ["MaxMessagesPerPoll"]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_MaxMessagesPerPoll_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
-    DList_InsertTailList(&(waitingToSend), &(message7.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_MAX_MESSAGES_PER_POLL, &TEST_MAX_MESSAGES_PER_POLL);
 
-    setupIrrelevantMocksForProperties2(&mocks, message6.messageHandle, message7.messageHandle);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-        .ExpectedAtLeastTimes(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_034: [ If "MaxMessagesPerPoll" is 0, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_MaxMessagesPerPoll_0_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
-        .IgnoreArgument(1);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_MAX_MESSAGES_PER_POLL, &TEST_MAX_MESSAGES_PER_POLL_0);
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-        .IgnoreArgument(1);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
-        .IgnoreArgument(1);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message7.messageHandle));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_2_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_039: ["DoWorkTimeBudget"]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_042: [ Otherwise, if there is no tick counter yet, IoTHubTransportHttp_SetOption shall create one by calling tickcounter_create. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_DoWorkTimeBudget_creates_a_tick_counter)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_create());
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[0]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-        .IgnoreArgument(1);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"iothub-app-"))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[1]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[1]))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-        .IgnoreArgument(1);
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
-        .IgnoreArgument(1);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_07_042: [ Otherwise, if there is no tick counter yet, IoTHubTransportHttp_SetOption shall create one by calling tickcounter_create. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_DoWorkTimeBudget_twice_keeps_the_tick_counter)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
+    mocks.ResetAllCalls();
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
 
     ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-
-#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
-#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_043: [ If tickcounter_create fails, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_DoWorkTimeBudget_fails_when_tickcounter_create_fails)
 {
     ///arrange
-    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
-    DList_InsertTailList(&(waitingToSend), &(message7.entry));
+    CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
     mocks.ResetAllCalls();
 
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, tickcounter_create())
+        .SetReturn((TICK_COUNTER_HANDLE)NULL);
 
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-#define THRESHOLD1 32 /*between THRESHOLD1 and THRESHOLD2 of STRING_concat fails there still is produced a payload, consisting of only REDKEY, REDVALUE*/
-#define THRESHOLD2 17
-#define THRESHOLD3 7 /*below 7, STRING_concat would fail not in producing properties*/
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_THRESHOLD1_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_041: [ If the value is 0, IoTHubTransportHttp_SetOption shall destroy the tick counter, if any, and every DoWork shall serve every device. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_DoWorkTimeBudget_0_destroys_the_tick_counter)
 {
-    for (size_t i = THRESHOLD1 + 1; i > THRESHOLD1; i--)
-    {
-        ///arrange
-        currentSTRING_concat_call = 0;
-        whenShallSTRING_concat_fail = 0;
-        BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-        CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-        DList_InsertTailList(&(waitingToSend), &(message6.entry));
-        DList_InsertTailList(&(waitingToSend), &(message7.entry));
-        auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-        (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-        mocks.ResetAllCalls();
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET);
+    mocks.ResetAllCalls();
 
-        setupDoWorkLoopOnceForOneDevice(mocks);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
+
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_DOWORK_TIME_BUDGET, &TEST_DOWORK_TIME_BUDGET_0);
 
-        whenShallSTRING_concat_fail = i;
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        ENABLE_BATCHING();
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        ///act
-        IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+//Tests_SRS_TRANSPORTMULTITHTTP_07_051: [ "sas_token_lifetime" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_lifetime_is_not_passed_down)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        ///assert
-        ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
-        mocks.AssertActualAndExpectedCalls();
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_LIFETIME, &TEST_SAS_TOKEN_LIFETIME);
 
-        ///cleanup
-        IoTHubTransportHttp_Destroy(handle);
-        if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-        {
-            BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-            last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-        }
-    }
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_052: [ "sas_token_refresh_time" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_refresh_time_is_not_passed_down)
 {
-    for (size_t i = THRESHOLD1; i > THRESHOLD2; i--)
-    {
-        ///arrange
-        currentSTRING_concat_call = 0;
-        whenShallSTRING_concat_fail = 0;
-        BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-        CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-        DList_InsertTailList(&(waitingToSend), &(message6.entry));
-        DList_InsertTailList(&(waitingToSend), &(message7.entry));
-        auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-        (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-        mocks.ResetAllCalls();
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        setupDoWorkLoopOnceForOneDevice(mocks);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_SAS_TOKEN_REFRESH_TIME, &TEST_SAS_TOKEN_REFRESH_TIME);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        whenShallSTRING_concat_fail = i;
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-        ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_07_006: [ If the value of OPTION_HTTP_CONNECTION_POOL_SIZE is 0, IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_0_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        ///act
-        IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_0);
 
-        ///assert
-        ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
-        mocks.AssertActualAndExpectedCalls();
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        IoTHubTransportHttp_Destroy(handle);
-        if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-        {
-            BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-            last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-        }
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_002: ["HttpConnectionPoolSize"]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_008: [ For a pool of more than 1 connection, IoTHubTransportHttp_SetOption shall create a HTTPAPIEX_HANDLE for every lane but lane 0 by calling HTTPAPIEX_Create and the threads of the lanes by calling iothubtransporthttp_pool_create. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_07_010: [ Otherwise IoTHubTransportHttp_SetOption shall destroy the current pool, keep the connection of lane 0 and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_3_creates_2_connections_and_the_pool)
 {
-    for (size_t i = THRESHOLD2; i > THRESHOLD3; i--)
-    {
-        ///arrange
-        currentSTRING_concat_call = 0;
-        whenShallSTRING_concat_fail = 0;
-        BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-        CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-        DList_InsertTailList(&(waitingToSend), &(message6.entry));
-        DList_InsertTailList(&(waitingToSend), &(message7.entry));
-        auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-        mocks.ResetAllCalls();
-
-        whenShallSTRING_concat_fail = i;
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-        ENABLE_BATCHING();
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2 * sizeof(HTTPAPIEX_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_3);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_pool_create(3));
 
-        ///act
-        IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    ///act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_3);
 
-        ///assert
-        ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-        mocks.AssertActualAndExpectedCalls();
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        IoTHubTransportHttp_Destroy(handle);
-        if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-        {
-            BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-            last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-        }
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_009: [ If creating the pool fails, IoTHubTransportHttp_SetOption shall free what it created, keep the current pool and return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_fails_when_HTTPAPIEX_Create_fails)
 {
     ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2 * sizeof(HTTPAPIEX_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((HTTPAPIEX_HANDLE)NULL);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE_2));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     ///act
-    auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_3);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_009: [ If creating the pool fails, IoTHubTransportHttp_SetOption shall free what it created, keep the current pool and return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_fails_when_iothubtransporthttp_pool_create_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     mocks.ResetAllCalls();
 
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(HTTPAPIEX_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_pool_create(2))
+        .SetReturn((IOTHUBTRANSPORTHTTP_POOL_HANDLE)NULL);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE_2));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
     ///act
-    auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_007: [ If an option has already been passed down to HTTPAPIEX, changing the pool size shall fail and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_fails_after_an_option_was_passed_down)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
     mocks.ResetAllCalls();
 
     ///act
-    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_011: [ The option shall be passed down to the connection of every lane of the pool, stopping at the first failure. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_passes_the_option_down_to_every_connection_of_the_pool)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_3);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_3);
     mocks.ResetAllCalls();
 
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE_2, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE_3, "someOption", (void*)42));
 
     ///act
     auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
@@ -11124,199 +11328,151 @@ TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_011: [ The option shall be passed down to the connection of every lane of the pool, stopping at the first failure. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_stops_at_the_first_connection_of_the_pool_that_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_3);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_3);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-        .SetReturn(HTTPAPIEX_INVALID_ARG);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE_2, "someOption", (void*)42))
+        .SetReturn(HTTPAPIEX_ERROR);
 
     ///act
     auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_004: [ If the connection pool has more than 1 connection, IoTHubTransportHttp_DoWork shall serve all the lanes at the same time by calling iothubtransporthttp_pool_run and return once every lane is done. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_a_connection_pool_calls_iothubtransporthttp_pool_run)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-        .SetReturn(HTTPAPIEX_ERROR);
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_pool_run(TEST_POOL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
     ///act
-    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_003: [ The device at position i in the transport device list shall be served by the lane i modulo the pool size, with the connection of that lane. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_lane_1_of_2_serves_the_second_device)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-        .SetReturn(HTTPAPIEX_RECOVERYFAILED);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    setupDoWorkLoopForNextDevice(mocks, 1);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2));
 
     ///act
-    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+    poolLaneFunction(poolLaneContext, 1);
 
     ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_096: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_07_005: [ If iothubtransporthttp_pool_run fails, IoTHubTransportHttp_DoWork shall serve the lanes one after the other. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_serves_the_lanes_one_after_the_other_when_iothubtransporthttp_pool_run_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    unsigned int statusCode200 = 200;
-    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
     mocks.ResetAllCalls();
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_pool_run(TEST_POOL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .IgnoreArgument(8)
-        .IgnoreArgument(9)
-        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+        .IgnoreArgument(3)
+        .SetReturn(1);
+    setupDoWorkLoopOnceForOneDevice(mocks);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    setupDoWorkLoopForNextDevice(mocks, 1);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-        .IgnoreArgument(1)
-        .SetReturn(TEST_ETAG_VALUE);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(IOTHUBMESSAGE_ABANDONED);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    /*this is "abandon"*/
-    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+//Tests_SRS_TRANSPORTMULTITHTTP_07_010: [ Otherwise IoTHubTransportHttp_SetOption shall destroy the current pool, keep the connection of lane 0 and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_1_destroys_the_pool)
+{
+    ///arrange
+    static const size_t connectionPoolSize1 = 1;
+    CIoTHubTransportHttpMocks mocks;
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
-        .IgnoreArgument(1);
+        .SetReturn(TEST_HTTPAPIEX_HANDLE_2);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &TEST_CONNECTION_POOL_SIZE_2);
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+    STRICT_EXPECTED_CALL(mocks, iothubtransporthttp_pool_destroy(TEST_POOL_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE_2));
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,
-        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
-
     ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &connectionPoolSize1);
 
     ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_1_property_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_096: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -11326,9 +11482,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
-    size_t nHeaders = 1;
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
@@ -11345,7 +11499,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
         IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
         HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
         "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
@@ -11369,39 +11523,23 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    {
-        /*this scope is for is properties code*/
-
-        HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
-
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
-
-        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(3);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-    }
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
 
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(IOTHUBMESSAGE_ABANDONED);
 
-    /*this returns "0" so the message needs to be "accepted"*/
-    /*this is "accepting"*/
+    /*this is "abandon"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -11413,7 +11551,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
         .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
@@ -11426,14 +11564,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
         .IgnoreArgument(1);
 
-
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,
         IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
         IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
         NULL,                                               /*BUFFER_HANDLE requestContent,                                */
         IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
@@ -11457,7 +11594,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_succeeds)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_1_property_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -11467,7 +11604,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     (void)IoTHubTransportHttp_Subscribe(devHandle);
-    size_t nHeaders = 3;
+    size_t nHeaders = 1;
     mocks.ResetAllCalls();
 
     setupDoWorkLoopOnceForOneDevice(mocks);
@@ -11534,19 +11671,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-
-        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(3);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(3);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
     }
 
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -11611,8 +11735,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_1)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -11701,11 +11824,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
             .IgnoreArgument(3);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"))
-            .SetReturn(MAP_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
     }
 
-    /*this is "abandon"*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+
+    /*this returns "0" so the message needs to be "accepted"*/
+    /*this is "accepting"*/
     STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -11717,7 +11845,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
         .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
@@ -11736,8 +11864,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,
         IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+        HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
         IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
         NULL,                                               /*BUFFER_HANDLE requestContent,                                */
         IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
@@ -11760,10 +11888,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
-
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -11847,10 +11974,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 3;
         STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"))
+            .SetReturn(MAP_ERROR);
     }
 
     /*this is "abandon"*/
@@ -11908,9 +12038,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     IoTHubTransportHttp_Destroy(handle);
 }
 
+
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_3)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -11988,10 +12119,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-        whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 2;
         STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
             .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 3;
+        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3);
     }
 
     /*this is "abandon"*/
@@ -12051,7 +12188,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_4)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_3)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -12127,8 +12264,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
             .IgnoreArgument(3);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"))
-            .SetReturn(MAP_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+
+        whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 2;
+        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3);
     }
 
     /*this is "abandon"*/
@@ -12188,7 +12329,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_5)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_4)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -12255,8 +12396,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
         HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
         STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders))
-            .SetReturn(HTTP_HEADERS_ERROR);
+            .CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+
+        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"))
+            .SetReturn(MAP_ERROR);
     }
 
     /*this is "abandon"*/
@@ -12288,343 +12438,149 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
         IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
         HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
         "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
         IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
         NULL,                                               /*BUFFER_HANDLE requestContent,                                */
         IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-        NULL                                                /*BUFFER_HANDLE responseContent))                              */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(7)
-        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatched_happy_path_succeeds)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message1.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-        .IgnoreArgument(1);
-
-    /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
-
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-    /*once the event has been succesfull...*/
-
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
-
-    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-    DISABLE_BATCHING();
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer1, buffer1_size));
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_succeeds)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-        .IgnoreArgument(1);
-
-    /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_10));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
-
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
         ))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-    /*once the event has been succesfull...*/
-
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
-
-    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-    DISABLE_BATCHING();
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), string10, strlen(string10)));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_the_message_limit_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_5)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message11.entry));
+    unsigned int statusCode200 = 200;
+    unsigned int statusCode204 = 204;
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    size_t nHeaders = 3;
     mocks.ResetAllCalls();
 
     setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_11));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_11, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*1 property*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_11));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+        ))
+        .IgnoreArgument(1)
         .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+        .IgnoreArgument(5)
+        .IgnoreArgument(7)
+        .IgnoreArgument(8)
+        .IgnoreArgument(9)
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .IgnoreArgument(1)
+        .SetReturn(TEST_ETAG_VALUE);
 
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-a", TEST_VALUES1_A_B[0]))
+    STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    {
+        /*this scope is for is properties code*/
 
+        HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+        STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders))
+            .SetReturn(HTTP_HEADERS_ERROR);
+    }
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+    /*this is "abandon"*/
+    STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+        .ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+        .IgnoreArgument(1);
 
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
         .IgnoreArgument(1);
+
+
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
         IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+        HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+        "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+        IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+        NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+        IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+        NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+        NULL                                                /*BUFFER_HANDLE responseContent))                              */
         ))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-    /*once the event has been succesfull...*/
-
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
-
-    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-    DISABLE_BATCHING();
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer11, buffer11_size));
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_073: [ The message size is computed from the length of the payload + 384. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_074: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_at_the_message_limit_succeeds)
-{
-    ///arrange
-    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
-    DList_InsertTailList(&(waitingToSend), &(message12.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
-        .IgnoreArgument(2);
-
-    DISABLE_BATCHING();
+        .IgnoreArgument(7)
+        .CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -12644,47 +12600,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_
 //Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_fails_when_getString_fails)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10))
-        .SetReturn((const char*)NULL);
-
-    DISABLE_BATCHING();
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_happy_path_succeeds)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatched_happy_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -12692,11 +12612,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 
     setupDoWorkLoopOnceForOneDevice(mocks);
 
-
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
@@ -12709,22 +12628,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(1);
 
     /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
-
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-        .IgnoreArgument(1);
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
 
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
     STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
@@ -12759,7 +12667,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     /*building the list of messages to be notified if HTTP is fine*/
     STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
         .IgnoreArgument(2);
@@ -12773,20 +12681,26 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer1, buffer1_size));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_069: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_httpStatusCode_is_not_succeess)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message10.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -12796,10 +12710,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10));
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -12810,23 +12722,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(1);
 
     /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_10));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
         .IgnoreArgument(4);
 
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-        .IgnoreArgument(1);
-
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
     STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -12853,7 +12754,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(2)
         .IgnoreArgument(5)
         .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    /*building the list of messages to be notified if HTTP is fine*/
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -12864,19 +12775,19 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), string10, strlen(string10)));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_HTTPAPIEXSAS_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_the_message_limit_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    DList_InsertTailList(&(waitingToSend), &(message11.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -12886,8 +12797,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_11));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_11, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
@@ -12899,24 +12810,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
         .IgnoreArgument(1);
 
-    /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    /*1 property*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_11));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
         .IgnoreArgument(4);
 
-    /*this is making http headers*/
     STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-a", TEST_VALUES1_A_B[0]))
         .IgnoreArgument(1);
 
+
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
     STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -12943,8 +12855,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(2)
         .IgnoreArgument(5)
         .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
-        .SetReturn(HTTPAPIEX_ERROR);
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    /*building the list of messages to be notified if HTTP is fine*/
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -12955,70 +12876,69 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
-    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer11, buffer11_size));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_073: [ The message size is computed from the length of the payload + 384. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_074: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_at_the_message_limit_succeeds)
 {
     ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+    DList_InsertTailList(&(waitingToSend), &(message12.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
+
     setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
+        .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+    DISABLE_BATCHING();
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-        .IgnoreArgument(1);
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-    /*no properties, so no more headers*/
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .IgnoreArgument(4);
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-        .IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_fails_when_getString_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn(1);
+    setupDoWorkLoopOnceForOneDevice(mocks);
 
-    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10))
+        .SetReturn((const char*)NULL);
 
     DISABLE_BATCHING();
 
@@ -13032,8 +12952,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_happy_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13045,6 +12970,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 
     setupDoWorkLoopOnceForOneDevice(mocks);
 
+
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
@@ -13078,8 +13004,43 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
         .IgnoreArgument(1);
 
-    whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
     STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    /*building the list of messages to be notified if HTTP is fine*/
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -13090,14 +13051,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_1)
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_069: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_httpStatusCode_is_not_succeess)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13140,8 +13103,35 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(1)
-        .SetReturn(HTTP_HEADERS_ERROR);
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -13152,14 +13142,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_HTTPAPIEXSAS_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13198,8 +13189,40 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(1)
-        .SetReturn(1111); /*unpredictable value which is an error*/
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
+        .SetReturn(HTTPAPIEX_ERROR);
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -13210,6 +13233,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     ///assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
     mocks.AssertActualAndExpectedCalls();
 
     ///cleanup
@@ -13217,7 +13241,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_3)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13226,7 +13250,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
     mocks.ResetAllCalls();
-
     setupDoWorkLoopOnceForOneDevice(mocks);
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -13252,8 +13275,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(4);
 
     /*this is making http headers*/
-    whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
     STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+    STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(1);
 
     EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
@@ -13271,7 +13311,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_map_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13303,8 +13343,24 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
-        .IgnoreArgument(4)
-        .SetReturn(MAP_ERROR);
+        .IgnoreArgument(4);
+
+    /*this is making http headers*/
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+        .IgnoreArgument(1);
+
+    whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
+    STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+
+    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
     DISABLE_BATCHING();
 
@@ -13319,7 +13375,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_4)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_1)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13344,9 +13400,30 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+        .IgnoreArgument(1);
+
+    /*no properties, so no more headers*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+
+    /*this is making http headers*/
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
         .IgnoreArgument(1)
         .SetReturn(HTTP_HEADERS_ERROR);
 
+    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
     DISABLE_BATCHING();
 
     ///act
@@ -13360,7 +13437,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_5)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_2)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13379,85 +13456,31 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
-    whenShallHTTPHeaders_Clone_fail = currentHTTPHeaders_Clone_call + 1;
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
-    DISABLE_BATCHING();
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_IoTHubMessage_GetByteArray_fails)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message6.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+        .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    /*no properties, so no more headers*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
-        .SetReturn(IOTHUB_MESSAGE_ERROR);
-
-    DISABLE_BATCHING();
-
-    ///act
-    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    ///assert
-    mocks.AssertActualAndExpectedCalls();
-
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_075: [ If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_ERROR. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_overlimit_calls_SendComplete_with_BATCHSTATE_FAILED)
-{
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message9.entry));
-    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-    mocks.ResetAllCalls();
-
-    setupDoWorkLoopOnceForOneDevice(mocks);
-
-
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_9));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_9, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-
-    /*ooops - over 256K*/
+        .IgnoreArgument(4);
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message9.entry)))
+    /*this is making http headers*/
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+        .IgnoreArgument(1)
+        .SetReturn(1111); /*unpredictable value which is an error*/
+
+    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
     DISABLE_BATCHING();
 
@@ -13471,12 +13494,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_3)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13486,103 +13509,34 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
-
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
-
-    {
-        /*adding the first payload to the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        /*closing the "big" payload*/
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-    }
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
-    /*building the list of messages to be notified if HTTP is fine*/
-    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    {
-        /*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-        STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .IgnoreArgument(3);
-    }
-
-    /*executing HTTP goodies*/
-    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-        IGNORED_PTR_ARG,
-        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-        ))
-        .IgnoreArgument(1)
+
+    /*no properties, so no more headers*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
-        .IgnoreArgument(5)
-        .IgnoreArgument(6)
-        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
 
-    /*once the event has been succesfull...*/
+    /*this is making http headers*/
+    whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
-        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-    ENABLE_BATCHING();
+    DISABLE_BATCHING();
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13594,12 +13548,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string_concat_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_map_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13609,44 +13563,28 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+        .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4);
-        whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    /*no properties, so no more headers*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
 
-    ENABLE_BATCHING();
+    DISABLE_BATCHING();
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13658,12 +13596,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_4)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13673,42 +13611,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_Ge
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .IgnoreArgument(3)
-            .IgnoreArgument(4)
-            .SetReturn(MAP_ERROR);
-        /*end of the first batched payload*/
-    }
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+        .IgnoreArgument(1)
+        .SetReturn(HTTP_HEADERS_ERROR);
 
-    ENABLE_BATCHING();
+    DISABLE_BATCHING();
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13720,12 +13637,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_Ge
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_fails_it_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_5)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13735,37 +13652,49 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 
     STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+    whenShallHTTPHeaders_Clone_fail = currentHTTPHeaders_Clone_call + 1;
+    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+    DISABLE_BATCHING();
 
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    ///act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+    ///assert
+    mocks.AssertActualAndExpectedCalls();
 
-        whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-            .IgnoreArgument(1);
-        /*end of the first batched payload*/
-    }
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-    ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_IoTHubMessage_GetByteArray_fails)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+    mocks.ResetAllCalls();
+
+    setupDoWorkLoopOnceForOneDevice(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+    DISABLE_BATCHING();
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13777,12 +13706,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
     IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_with_STRING_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_075: [ If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_CLIENT_CONFIRMATION_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_overlimit_calls_SendComplete_with_BATCHSTATE_FAILED)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
-    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    DList_InsertTailList(&(waitingToSend), &(message9.entry));
     auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
     (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13790,36 +13719,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 
     setupDoWorkLoopOnceForOneDevice(mocks);
 
-    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-    STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-        .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_9));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_9, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+    /*ooops - over 256K*/
 
-        whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        /*end of the first batched payload*/
-    }
+    /*building the list of messages to be notified if HTTP is fine*/
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message9.entry)))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR))
+        .IgnoreArgument(2);
 
-    ENABLE_BATCHING();
+    DISABLE_BATCHING();
 
     ///act
     IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13832,7 +13750,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_new_JSON_fails_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_succeeds)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13849,24 +13767,40 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    /*measuring the items*/
+    setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+    /*the payload is allocated once*/
+    setupBatchedPayload(mocks);
 
-        whenShallSTRING_new_JSON_fail = currentSTRING_new_JSON_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
+    /*writing the items straight into the payload and building the list of messages to be notified if HTTP is fine*/
+    setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
+    setupBatchedItemConfirmation(mocks, &(message10.entry));
 
-        /*end of the first batched payload*/
-    }
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+        IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+        IGNORED_PTR_ARG,
+        HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+        "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+        IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+        IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+        IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+        NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+        NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+        ))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .IgnoreArgument(5)
+        .IgnoreArgument(6)
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+    /*once the event has been succesfull...*/
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK))
+        .IgnoreArgument(2);
 
     ENABLE_BATCHING();
 
@@ -13881,7 +13815,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13898,22 +13832,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHub
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
-            .SetReturn((const char*)NULL);
-
-        /*end of the first batched payload*/
-    }
+    /*measuring the items*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(MAP_ERROR);
 
     ENABLE_BATCHING();
 
@@ -13928,7 +13855,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHub
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_construct_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
 {
     ///arrange
     CIoTHubTransportHttpMocks mocks;
@@ -13945,19 +13872,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
     STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
         .IgnoreArgument(1);
 
-    /*starting to prepare the "big" payload*/
-    STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    /*this is first batched payload*/
-    {
-        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-        whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-
-        /*end of the first batched payload*/
-    }
+    /*measuring the items*/
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+        .SetReturn((const char*)NULL);
 
     ENABLE_BATCHING();
 
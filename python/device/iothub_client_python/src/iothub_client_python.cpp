@@ -728,6 +728,7 @@ public:
         case IOTHUB_CLIENT_ERROR: s << "ERROR"; break;
         case IOTHUB_CLIENT_INVALID_SIZE: s << "INVALID_SIZE"; break;
         case IOTHUB_CLIENT_INDEFINITE_TIME: s << "INDEFINITE_TIME"; break;
+        case IOTHUB_CLIENT_QUEUE_FULL: s << "QUEUE_FULL"; break;
         }
         return s.str();
     }
@@ -1249,6 +1250,7 @@ BOOST_PYTHON_MODULE(IMPORT_NAME)
         .value("ERROR", IOTHUB_CLIENT_ERROR)
         .value("INVALID_SIZE", IOTHUB_CLIENT_INVALID_SIZE)
         .value("INDEFINITE_TIME", IOTHUB_CLIENT_INDEFINITE_TIME)
+        .value("QUEUE_FULL", IOTHUB_CLIENT_QUEUE_FULL)
         ;
 
     enum_<IOTHUB_CLIENT_STATUS>("IoTHubClientStatus")
@@ -1261,6 +1263,7 @@ BOOST_PYTHON_MODULE(IMPORT_NAME)
         .value("BECAUSE_DESTROY", IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY)
         .value("MESSAGE_TIMEOUT", IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT)
         .value("ERROR", IOTHUB_CLIENT_CONFIRMATION_ERROR)
+        .value("MESSAGE_DROPPED", IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED)
         ;
 
     enum_<IOTHUBMESSAGE_DISPOSITION_RESULT>("IoTHubMessageDispositionResult")